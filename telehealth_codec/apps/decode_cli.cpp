@@ -1,6 +1,9 @@
 #include <codec/Bitstream.h>
+#include <codec/Decoder.h>
+#include <codec/EntropyMode.h>
 #include <codec/Frame.h>
-#include <io/FileBitstreamSink.h>
+#include <codec/Scaler.h>
+#include <io/VideoSink.h>
 #include <util/Logger.h>
 #include <fstream>
 #include <cstring>
@@ -46,28 +49,61 @@ int main(int argc, char** argv) {
     TELECODEC_LOG_ERROR("Invalid magic");
     return 1;
   }
+  telehealth::codec::EntropyMode entropy_mode;
+  if (!telehealth::codec::entropy_mode_for_version(fh.version, &entropy_mode)) {
+    TELECODEC_LOG_ERROR("Unsupported bitstream version " << fh.version);
+    return 1;
+  }
+
+  TELECODEC_LOG_INFO("Bitstream v" << fh.version << " " << fh.width << "x" << fh.height << " fps=" << (int)fh.fps
+                     << " entropy=" << telehealth::codec::entropy_mode_name(entropy_mode));
 
-  TELECODEC_LOG_INFO("Bitstream " << fh.width << "x" << fh.height << " fps=" << (int)fh.fps);
+  size_t offset = sizeof(fh);
+  telehealth::codec::QuantMatrices matrices;
+  if (fh.quant_matrix == static_cast<uint8_t>(telehealth::codec::QuantMatrixPreset::Custom)) {
+    if (offset + sizeof(matrices.weights) > data.size()) {
+      TELECODEC_LOG_ERROR("File too small for quant matrices");
+      return 1;
+    }
+    std::memcpy(matrices.weights, data.data() + offset, sizeof(matrices.weights));
+    offset += sizeof(matrices.weights);
+  }
+  telehealth::codec::Decoder decoder(fh, matrices);
 
-  FILE* out_file = std::fopen(output_path.c_str(), "wb");
-  if (!out_file) {
+  telehealth::io::FileYuvSink sink;
+  if (!sink.open(output_path, fh.width, fh.height, fh.fps)) {
     TELECODEC_LOG_ERROR("Cannot open " << output_path);
     return 1;
   }
 
-  size_t offset = sizeof(fh);
+  // Frames coded at a reduced size (dynamic resolution) are scaled back up to the stream's size.
+  telehealth::codec::FrameScaler scaler;
+  telehealth::codec::FrameYUV upscaled(fh.width, fh.height);
   int frame_count = 0;
-  while (offset + sizeof(telehealth::codec::BitstreamFrameHeader) <= data.size()) {
-    telehealth::codec::BitstreamFrameHeader h;
-    std::memcpy(&h, data.data() + offset, sizeof(h));
-    offset += sizeof(h);
-    size_t payload = h.mv_payload_bytes + h.coeff_payload_bytes;
-    if (offset + payload > data.size()) break;
-    offset += payload;
+  telehealth::codec::EncodedFrame ef;
+  while (offset < data.size()) {
+    const size_t record = telehealth::codec::parse_frame(data.data() + offset, data.size() - offset, fh.height, &ef);
+    if (record == 0) break;
+    offset += record;
+
+    if (!decoder.decode(ef)) {
+      TELECODEC_LOG_ERROR("Frame " << ef.frame_id << " failed to decode");
+      return 1;
+    }
+    telehealth::codec::FrameMeta meta;
+    meta.frame_id = static_cast<int64_t>(ef.frame_id);
+    meta.timestamp_us = static_cast<int64_t>(ef.timestamp_us);
+    const telehealth::codec::FrameYUV& picture = decoder.frame();
+    if (picture.width != fh.width || picture.height != fh.height) {
+      scaler.scale(picture, upscaled);
+      sink.write(upscaled, meta);
+    } else {
+      sink.write(picture, meta);
+    }
     frame_count++;
   }
 
-  std::fclose(out_file);
-  TELECODEC_LOG_INFO("Decode CLI: detected " << frame_count << " frames (decode path minimal; output is metadata only)");
+  sink.close();
+  TELECODEC_LOG_INFO("Decode CLI: decoded " << frame_count << " frames to " << output_path);
   return 0;
 }
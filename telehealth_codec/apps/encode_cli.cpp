@@ -1,11 +1,15 @@
 #include <codec/Encoder.h>
 #include <codec/EncoderConfig.h>
+#include <codec/SceneChange.h>
 #include <codec/YuvConverter.h>
 #include <io/VideoSource.h>
 #include <io/FileBitstreamSink.h>
 #include <util/Logger.h>
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cstdlib>
 
 int main(int argc, char** argv) {
@@ -13,6 +17,23 @@ int main(int argc, char** argv) {
   std::string output_path = "output.bin";
   int width = 640, height = 480, fps = 30, qp = 28, gop = 30;
   int max_frames = 100;
+  int slices = 1;
+  bool deblock = true;
+  bool wavefront = false;
+  int refresh = 0;
+  int layers = 1;
+  int kbps = 500;
+  int downscale = 1;
+  int budget_ms = 0;
+  int scenecut = 40;
+  int vbv_ms = 250;
+  int lookahead = 0;
+  int cap_bytes = 0;
+  bool hard_cap = false;
+  bool constant_qp = false;
+  std::string preset = "slow";
+  std::string quant_matrix = "flat";
+  std::string entropy = "eg";
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
@@ -24,8 +45,25 @@ int main(int argc, char** argv) {
     if (arg == "-qp" && i + 1 < argc) { qp = std::atoi(argv[++i]); continue; }
     if (arg == "-gop" && i + 1 < argc) { gop = std::atoi(argv[++i]); continue; }
     if (arg == "-n" && i + 1 < argc) { max_frames = std::atoi(argv[++i]); continue; }
+    if (arg == "-qm" && i + 1 < argc) { quant_matrix = argv[++i]; continue; }
+    if (arg == "-entropy" && i + 1 < argc) { entropy = argv[++i]; continue; }
+    if (arg == "-slices" && i + 1 < argc) { slices = std::atoi(argv[++i]); continue; }
+    if (arg == "-deblock" && i + 1 < argc) { deblock = std::atoi(argv[++i]) != 0; continue; }
+    if (arg == "-wpp" && i + 1 < argc) { wavefront = std::atoi(argv[++i]) != 0; continue; }
+    if (arg == "-refresh" && i + 1 < argc) { refresh = std::atoi(argv[++i]); continue; }
+    if (arg == "-layers" && i + 1 < argc) { layers = std::atoi(argv[++i]); continue; }
+    if (arg == "-kbps" && i + 1 < argc) { kbps = std::atoi(argv[++i]); continue; }
+    if (arg == "-downscale" && i + 1 < argc) { downscale = std::atoi(argv[++i]); continue; }
+    if (arg == "-preset" && i + 1 < argc) { preset = argv[++i]; continue; }
+    if (arg == "-budget" && i + 1 < argc) { budget_ms = std::atoi(argv[++i]); continue; }
+    if (arg == "-scenecut" && i + 1 < argc) { scenecut = std::atoi(argv[++i]); continue; }
+    if (arg == "-vbv" && i + 1 < argc) { vbv_ms = std::atoi(argv[++i]); continue; }
+    if (arg == "-lookahead" && i + 1 < argc) { lookahead = std::atoi(argv[++i]); continue; }
+    if (arg == "-cap" && i + 1 < argc) { cap_bytes = std::atoi(argv[++i]); continue; }
+    if (arg == "-hardcap") { hard_cap = true; continue; }
+    if (arg == "-cqp") { constant_qp = true; continue; }
     if (arg == "--help") {
-      std::cerr << "Usage: " << argv[0] << " [-i input|synthetic] [-o output.bin] [-w width] [-h height] [-fps fps] [-qp qp] [-gop gop] [-n max_frames]\n";
+      std::cerr << "Usage: " << argv[0] << " [-i input|synthetic] [-o output.bin] [-w width] [-h height] [-fps fps] [-qp qp] [-gop gop] [-n max_frames] [-qm flat|perceptual] [-entropy fixed|eg|arith|huff|rans] [-slices n] [-deblock 0|1] [-wpp 0|1] [-refresh frames] [-layers 1-3] [-kbps kbps] [-downscale 1|2|4] [-preset ultrafast|veryfast|fast|medium|slow] [-budget ms_per_frame] [-scenecut 0-100] [-vbv ms] [-lookahead 0-3] [-cap bytes_per_frame] [-hardcap] [-cqp]\n";
       return 0;
     }
   }
@@ -48,6 +86,47 @@ int main(int argc, char** argv) {
   enc_cfg.fps = source->fps();
   enc_cfg.qp_default = qp;
   enc_cfg.gop_size = gop;
+  enc_cfg.num_slices = slices;
+  enc_cfg.deblock = deblock;
+  enc_cfg.wavefront = wavefront;
+  enc_cfg.intra_refresh_frames = refresh;
+  enc_cfg.temporal_layers = layers;
+  enc_cfg.target_bitrate_kbps = static_cast<uint32_t>(kbps);
+  enc_cfg.max_downscale = downscale;
+  enc_cfg.scene_change_threshold = scenecut;
+  enc_cfg.vbv_buffer_ms = vbv_ms;
+  enc_cfg.lookahead_frames = std::clamp(lookahead, 0, 3);
+  enc_cfg.frame_byte_cap = static_cast<uint32_t>(std::max(cap_bytes, 0));
+  enc_cfg.guaranteed_byte_cap = hard_cap;
+  enc_cfg.constant_qp = constant_qp;
+  telehealth::codec::SpeedPreset speed_preset;
+  if (!telehealth::codec::speed_preset_for_name(preset, &speed_preset)) {
+    TELECODEC_LOG_ERROR("Unknown speed preset: " << preset);
+    return 1;
+  }
+  telehealth::codec::apply_speed_preset(speed_preset, &enc_cfg);
+  if (budget_ms > 0) {
+    enc_cfg.adaptive_speed = true;
+    enc_cfg.frame_budget_ms = budget_ms;
+  }
+  if (quant_matrix == "perceptual") {
+    enc_cfg.quant_matrix = telehealth::codec::QuantMatrixPreset::Perceptual;
+  } else if (quant_matrix != "flat") {
+    TELECODEC_LOG_ERROR("Unknown quant matrix preset: " << quant_matrix);
+    return 1;
+  }
+  if (entropy == "fixed") {
+    enc_cfg.entropy_mode = telehealth::codec::EntropyMode::Fixed;
+  } else if (entropy == "arith") {
+    enc_cfg.entropy_mode = telehealth::codec::EntropyMode::Arithmetic;
+  } else if (entropy == "huff") {
+    enc_cfg.entropy_mode = telehealth::codec::EntropyMode::Huffman;
+  } else if (entropy == "rans") {
+    enc_cfg.entropy_mode = telehealth::codec::EntropyMode::Rans;
+  } else if (entropy != "eg") {
+    TELECODEC_LOG_ERROR("Unknown entropy mode: " << entropy);
+    return 1;
+  }
 
   telehealth::codec::Encoder encoder(enc_cfg);
   telehealth::io::FileBitstreamSink sink;
@@ -56,29 +135,64 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  telehealth::codec::BitstreamFileHeader file_header;
-  file_header.width = static_cast<uint16_t>(enc_cfg.width);
-  file_header.height = static_cast<uint16_t>(enc_cfg.height);
-  file_header.fps = static_cast<uint8_t>(enc_cfg.fps);
-  if (!sink.write_file_header(file_header)) {
+  if (!sink.write_file_header(encoder.file_header(), encoder.quant_matrices())) {
     TELECODEC_LOG_ERROR("Failed to write file header");
     return 1;
   }
 
+  // Lookahead: frames are analyzed as they are read and coded lookahead_frames later (the
+  // file has no latency budget, so the analysis runs inline rather than on its own thread).
+  struct PendingFrame {
+    telehealth::codec::FrameYUV yuv;
+    telehealth::codec::FrameMeta meta;
+    telehealth::codec::FrameComplexity complexity;
+  };
+  std::deque<PendingFrame> pending;
+  telehealth::codec::SceneChangeDetector analyzer(enc_cfg.scene_change_threshold);
   telehealth::codec::FrameRGB rgb;
   telehealth::codec::FrameMeta meta;
   telehealth::codec::YuvConverter converter;
   int count = 0;
-  while (count < max_frames && source->read(rgb, meta)) {
-    telehealth::codec::FrameYUV yuv;
-    converter.rgb_to_yuv420(rgb, yuv);
-    auto encoded = encoder.encode(yuv, meta);
+  int read = 0;
+  while (read < max_frames || !pending.empty()) {
+    if (read < max_frames && source->read(rgb, meta)) {
+      PendingFrame frame;
+      converter.rgb_to_yuv420(rgb, frame.yuv);
+      frame.meta = meta;
+      if (enc_cfg.lookahead_frames > 0) {
+        analyzer.analyze(frame.yuv.y_plane.data(), frame.yuv.stride_y, frame.yuv.width, frame.yuv.height);
+        frame.complexity = analyzer.complexity();
+      }
+      pending.push_back(std::move(frame));
+      read++;
+      if (static_cast<int>(pending.size()) <= enc_cfg.lookahead_frames) continue;
+    } else {
+      read = max_frames;  // source exhausted: drain the frames held back
+      if (pending.empty()) break;
+    }
+    std::vector<telehealth::codec::FrameComplexity> upcoming;
+    if (enc_cfg.lookahead_frames > 0)
+      for (const PendingFrame& p : pending) upcoming.push_back(p.complexity);
+    auto encoded = encoder.encode(pending.front().yuv, pending.front().meta,
+                                  upcoming.empty() ? nullptr : upcoming.data(), static_cast<int>(upcoming.size()));
+    pending.pop_front();
     if (!sink.write_frame(encoded)) {
       TELECODEC_LOG_ERROR("Failed to write frame " << count);
       break;
     }
     if (count % 30 == 0)
-      TELECODEC_LOG_INFO("Encoded frame " << count << " (" << encoded.total_bytes() << " bytes)");
+      TELECODEC_LOG_INFO("Encoded frame " << count << " (" << encoded.total_bytes() << " bytes, QP "
+                                          << encoder.last_frame_stats().qp << ", buffer "
+                                          << static_cast<int>(encoder.last_frame_stats().vbv_fullness * 100) << "%)");
+    if (encoder.last_frame_stats().dropped_mbs > 0)
+      TELECODEC_LOG_INFO("Frame " << count << " coded " << encoder.last_frame_stats().dropped_mbs
+                                  << " MBs without residual to fit " << cap_bytes << " bytes");
+    if (encoded.type == telehealth::codec::FrameType::I && (encoded.flags & telehealth::codec::kFrameFlagResolution))
+      TELECODEC_LOG_INFO("Frame " << count << " coded at " << encoded.width << "x" << encoded.height);
+    if (encoder.last_frame_stats().scene_change) TELECODEC_LOG_INFO("Scene change at frame " << count);
+    if (encoder.config().speed_preset != encoder.last_frame_stats().preset)
+      TELECODEC_LOG_INFO("Frame " << count << " took " << encoder.last_frame_stats().encode_ms << " ms, switching to "
+                                  << telehealth::codec::speed_preset_name(encoder.config().speed_preset));
     count++;
   }
 
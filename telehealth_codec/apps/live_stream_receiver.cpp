@@ -1,23 +1,28 @@
 #include <io/UdpReceiver.h>
 #include <io/FileBitstreamSink.h>
 #include <codec/Bitstream.h>
+#include <codec/Decoder.h>
+#include <codec/EncoderConfig.h>
 #include <util/Logger.h>
 #include <iostream>
 #include <string>
 #include <cstdlib>
 #include <chrono>
-#include <thread>
 
 int main(int argc, char** argv) {
   uint16_t port = 5000;
   std::string output_path = "received.bin";
+  int width = 640, height = 480, fps = 30;
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
     if (arg == "-p" && i + 1 < argc) { port = static_cast<uint16_t>(std::atoi(argv[++i])); continue; }
     if (arg == "-o" && i + 1 < argc) { output_path = argv[++i]; continue; }
+    if (arg == "-w" && i + 1 < argc) { width = std::atoi(argv[++i]); continue; }
+    if (arg == "--height" && i + 1 < argc) { height = std::atoi(argv[++i]); continue; }
+    if (arg == "-fps" && i + 1 < argc) { fps = std::atoi(argv[++i]); continue; }
     if (arg == "--help") {
-      std::cerr << "Usage: " << argv[0] << " [-p port] [-o output.bin]\n";
+      std::cerr << "Usage: " << argv[0] << " [-p port] [-o output.bin] [-w width] [--height H] [-fps fps]\n";
       return 0;
     }
   }
@@ -28,43 +33,66 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  // The sender's pipeline codes with the default EncoderConfig at the size given here.
+  telehealth::codec::BitstreamFileHeader fh;
+  fh.version = telehealth::codec::bitstream_version(telehealth::codec::EncoderConfig().entropy_mode);
+  fh.width = static_cast<uint16_t>(width);
+  fh.height = static_cast<uint16_t>(height);
+  fh.fps = static_cast<uint8_t>(fps);
+  telehealth::codec::Decoder decoder(fh);
+
   telehealth::io::FileBitstreamSink file_sink;
   bool header_written = false;
   int frame_count = 0;
+  bool decoded_any = false;
+  uint32_t last_frame_id = 0;
+  int frames_since_loss_report = -1;  // -1: the decoder is intact
+  const int kLossReportInterval = 15;  // repeat a loss report while recovery has not arrived
 
   receiver.set_frame_callback([&](uint32_t frame_id, uint64_t timestamp_us, const uint8_t* data, size_t size) {
     (void)timestamp_us;
     if (size == 0) return;
+    telehealth::codec::EncodedFrame ef;
+    if (telehealth::codec::parse_frame(data, size, height, &ef) == 0) {
+      TELECODEC_LOG_WARN("Malformed frame " << frame_id);
+      return;
+    }
+    if (decoded_any && ef.frame_id <= last_frame_id) return;  // late: the stream has moved on
     if (!header_written) {
-      telehealth::codec::BitstreamFileHeader h;
-      h.magic = 0x54434F44;
-      h.version = 1;
-      h.width = 640;
-      h.height = 480;
-      h.fps = 30;
       if (!file_sink.is_open() && !file_sink.open(output_path)) return;
-      file_sink.write_file_header(h);
+      file_sink.write_file_header(fh);
       header_written = true;
     }
-    telehealth::codec::EncodedFrame ef;
-    ef.frame_id = frame_id;
-    ef.timestamp_us = timestamp_us;
-    ef.raw_bytes.assign(data, data + size);
-    size_t half = size / 2;
-    ef.mv_bytes.assign(data, data + half);
-    ef.coeff_bytes.assign(data + half, data + size);
     if (file_sink.is_open())
       file_sink.write_frame(ef);
+
+    // Feedback: acknowledge intact frames; report the first that is not (a frame was lost),
+    // and again if the recovery frame does not arrive.
+    decoder.decode(ef);
+    decoded_any = true;
+    last_frame_id = ef.frame_id;
+    telehealth::io::FeedbackPacket fb;
+    fb.frame_id = ef.frame_id;
+    if (decoder.intact()) {
+      fb.type = static_cast<uint8_t>(telehealth::io::FeedbackType::Ack);
+      receiver.send_feedback(fb);
+      frames_since_loss_report = -1;
+    } else if (frames_since_loss_report < 0 || ++frames_since_loss_report >= kLossReportInterval) {
+      fb.type = static_cast<uint8_t>(telehealth::io::FeedbackType::Loss);
+      receiver.send_feedback(fb);
+      frames_since_loss_report = 0;
+      TELECODEC_LOG_WARN("Frame " << ef.frame_id << " not intact, requesting recovery");
+    }
     frame_count++;
     if (frame_count % 30 == 0)
       TELECODEC_LOG_INFO("Received frame " << frame_count);
   });
 
   TELECODEC_LOG_INFO("Listening on port " << port << ", writing to " << output_path);
-  for (int i = 0; i < 600; ++i) {
+  // Listen for a minute; poll() takes one datagram, so keep calling it while packets arrive.
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  while (std::chrono::steady_clock::now() < deadline)
     receiver.poll(100);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-  }
 
   file_sink.close();
   receiver.close();
@@ -4,6 +4,7 @@
 #include <codec/YuvConverter.h>
 #include <io/VideoSource.h>
 #include <io/UdpPacketSink.h>
+#include <io/Packet.h>
 #include <util/Logger.h>
 #include <iostream>
 #include <string>
@@ -17,6 +18,18 @@ int main(int argc, char** argv) {
   uint16_t port = 5000;
   int width = 640, height = 480, fps = 30;
   int max_frames = 300;
+  int long_term = 2;
+  int drop_every = 0;  // simulate loss: skip sending every n-th frame
+  int layers = 1;
+  int max_layer = 255;
+  int kbps = 500;
+  int vbv_ms = 250;
+  int lookahead = 0;  // frames held back for rate control (live calls: 0, no added latency)
+  int downscale = 1;
+  int collapse_frame = -1, collapse_kbps = 0;  // simulate a bandwidth drop at a frame
+  int budget_ms = -1;  // encode time per frame for adaptive speed (-1: the frame interval, 0: off)
+  int cap_packets = 0;  // >0: every frame fits this many packets (guaranteed byte cap)
+  std::string preset = "slow";
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
@@ -27,8 +40,24 @@ int main(int argc, char** argv) {
     if (arg == "--height" && i + 1 < argc) { height = std::atoi(argv[++i]); continue; }
     if (arg == "-fps" && i + 1 < argc) { fps = std::atoi(argv[++i]); continue; }
     if (arg == "-n" && i + 1 < argc) { max_frames = std::atoi(argv[++i]); continue; }
+    if (arg == "-ltr" && i + 1 < argc) { long_term = std::atoi(argv[++i]); continue; }
+    if (arg == "-drop" && i + 1 < argc) { drop_every = std::atoi(argv[++i]); continue; }
+    if (arg == "-layers" && i + 1 < argc) { layers = std::atoi(argv[++i]); continue; }
+    if (arg == "-max-layer" && i + 1 < argc) { max_layer = std::atoi(argv[++i]); continue; }
+    if (arg == "-kbps" && i + 1 < argc) { kbps = std::atoi(argv[++i]); continue; }
+    if (arg == "-vbv" && i + 1 < argc) { vbv_ms = std::atoi(argv[++i]); continue; }
+    if (arg == "-lookahead" && i + 1 < argc) { lookahead = std::atoi(argv[++i]); continue; }
+    if (arg == "-downscale" && i + 1 < argc) { downscale = std::atoi(argv[++i]); continue; }
+    if (arg == "-preset" && i + 1 < argc) { preset = argv[++i]; continue; }
+    if (arg == "-budget" && i + 1 < argc) { budget_ms = std::atoi(argv[++i]); continue; }
+    if (arg == "-cap-packets" && i + 1 < argc) { cap_packets = std::atoi(argv[++i]); continue; }
+    if (arg == "-collapse" && i + 2 < argc) {
+      collapse_frame = std::atoi(argv[++i]);
+      collapse_kbps = std::atoi(argv[++i]);
+      continue;
+    }
     if (arg == "--help") {
-      std::cerr << "Usage: " << argv[0] << " [-i input] [-h host] [-p port] [-w width] [--height H] [-fps fps] [-n max_frames]\n";
+      std::cerr << "Usage: " << argv[0] << " [-i input] [-h host] [-p port] [-w width] [--height H] [-fps fps] [-n max_frames] [-ltr long_term_refs] [-drop n] [-layers 1-3] [-max-layer n] [-kbps kbps] [-vbv ms] [-lookahead 0-3] [-downscale 1|2|4] [-collapse frame kbps] [-preset ultrafast|veryfast|fast|medium|slow] [-budget ms_per_frame|0] [-cap-packets n]\n";
       return 0;
     }
   }
@@ -49,11 +78,33 @@ int main(int argc, char** argv) {
     TELECODEC_LOG_ERROR("Failed to open UDP socket to " << host << ":" << port);
     return 1;
   }
+  udp.set_max_temporal_layer(max_layer);
+
+  telehealth::codec::SpeedPreset speed_preset;
+  if (!telehealth::codec::speed_preset_for_name(preset, &speed_preset)) {
+    TELECODEC_LOG_ERROR("Unknown speed preset: " << preset);
+    return 1;
+  }
 
   telehealth::pipeline::Pipeline::Config pipe_cfg;
   pipe_cfg.width = source->width();
   pipe_cfg.height = source->height();
   pipe_cfg.fps = source->fps();
+  pipe_cfg.long_term_refs = long_term;
+  pipe_cfg.temporal_layers = layers;
+  pipe_cfg.target_bitrate_kbps = static_cast<uint32_t>(kbps);
+  pipe_cfg.vbv_buffer_ms = vbv_ms;
+  pipe_cfg.lookahead_frames = lookahead;
+  pipe_cfg.max_downscale = downscale;
+  pipe_cfg.speed_preset = speed_preset;
+  pipe_cfg.frame_budget_ms = budget_ms >= 0 ? budget_ms : 1000 / (pipe_cfg.fps > 0 ? pipe_cfg.fps : 30);
+  pipe_cfg.adaptive_speed = pipe_cfg.frame_budget_ms > 0;
+  // Each packet carries DEFAULT_MTU less its header of the frame record send_frame() splits.
+  if (cap_packets > 0) {
+    pipe_cfg.frame_byte_cap = static_cast<uint32_t>(
+        cap_packets * (telehealth::io::DEFAULT_MTU - telehealth::io::PACKET_HEADER_SIZE));
+    pipe_cfg.guaranteed_byte_cap = true;
+  }
   telehealth::pipeline::Pipeline pipeline(pipe_cfg);
   pipeline.start();
 
@@ -62,23 +113,56 @@ int main(int argc, char** argv) {
   int count = 0;
   int frame_interval_ms = 1000 / (fps > 0 ? fps : 30);
 
+  int coded_width = 0;
+  telehealth::codec::SpeedPreset coded_preset = speed_preset;
   while (count < max_frames && source->read(rgb, meta)) {
+    if (count == collapse_frame) {
+      TELECODEC_LOG_INFO("Bandwidth drops to " << collapse_kbps << " kbps");
+      pipeline.set_target_bitrate_kbps(static_cast<uint32_t>(collapse_kbps));
+    }
     telehealth::pipeline::CaptureItem item;
     item.frame = telehealth::codec::Frame::from_rgb(rgb, meta.frame_id, meta.timestamp_us, meta.pts_sec);
     pipeline.push_capture(std::move(item));
 
     telehealth::pipeline::EncodedItem enc;
     if (pipeline.pop_encoded(enc, 500)) {
-      std::vector<uint8_t> raw = enc.frame.raw_bytes;
-      if (raw.empty()) {
-        raw.insert(raw.end(), enc.frame.mv_bytes.begin(), enc.frame.mv_bytes.end());
-        raw.insert(raw.end(), enc.frame.coeff_bytes.begin(), enc.frame.coeff_bytes.end());
-      }
-      if (!raw.empty() && !udp.send_frame(raw, enc.frame.frame_id, enc.frame.timestamp_us, 0))
+      const std::vector<uint8_t>& raw = enc.frame.raw_bytes;  // frame header + payloads
+      const bool dropped = drop_every > 0 && (count + 1) % drop_every == 0;
+      if (!raw.empty() && !dropped && !udp.send_frame(raw, enc.frame.frame_id, enc.frame.timestamp_us, 0,
+                                                   enc.frame.temporal_layer()))
         TELECODEC_LOG_WARN("UDP send failed for frame " << enc.frame.frame_id);
+      const int w = enc.frame.width ? enc.frame.width : pipe_cfg.width;
+      if (w != coded_width) {
+        coded_width = w;
+        TELECODEC_LOG_INFO("Frame " << enc.frame.frame_id << " coded at " << w << "x"
+                                    << (enc.frame.height ? enc.frame.height : pipe_cfg.height));
+      }
+      if (enc.stats.scene_change) TELECODEC_LOG_INFO("Scene change at frame " << enc.frame.frame_id);
+      if (enc.stats.preset != coded_preset) {
+        coded_preset = enc.stats.preset;
+        TELECODEC_LOG_INFO("Frame " << enc.frame.frame_id << " coded with preset "
+                                    << telehealth::codec::speed_preset_name(coded_preset) << " ("
+                                    << enc.stats.encode_ms << " ms)");
+      }
       count++;
       if (count % 30 == 0)
-        TELECODEC_LOG_INFO("Sent frame " << count);
+        TELECODEC_LOG_INFO("Sent frame " << count << " (QP " << enc.stats.qp << ", rows up to "
+                                          << enc.stats.max_row_qp << ", buffer "
+                                          << static_cast<int>(enc.stats.vbv_fullness * 100) << "%)");
+      if (enc.stats.dropped_mbs > 0)
+        TELECODEC_LOG_INFO("Frame " << enc.frame.frame_id << " coded " << enc.stats.dropped_mbs
+                                    << " MBs without residual to fit " << cap_packets << " packets");
+    }
+    // Receiver feedback: acknowledged frames become recovery points; a loss makes the next
+    // frame predict from the newest acknowledged long-term reference instead of an I-frame.
+    telehealth::io::FeedbackPacket fb;
+    while (udp.poll_feedback(&fb, 0)) {
+      if (fb.type == static_cast<uint8_t>(telehealth::io::FeedbackType::Loss)) {
+        TELECODEC_LOG_INFO("Receiver lost frame " << fb.frame_id << ", recovering");
+        pipeline.report_loss();
+      } else {
+        pipeline.acknowledge(fb.frame_id);
+      }
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(frame_interval_ms));
   }
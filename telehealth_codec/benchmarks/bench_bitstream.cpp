@@ -0,0 +1,60 @@
+#include <codec/Bitstream.h>
+#include <util/Timer.h>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+int main() {
+  const int symbols = 1 << 20;
+  std::vector<uint32_t> values(symbols);
+  std::vector<int> widths(symbols);
+  size_t total_bits = 0;
+  for (int i = 0; i < symbols; ++i) {
+    widths[i] = 1 + rand() % 20;  // mostly short codes, like coefficient and MV syntax
+    values[i] = static_cast<uint32_t>(rand()) & ((1u << widths[i]) - 1);
+    total_bits += static_cast<size_t>(widths[i]);
+  }
+
+  telehealth::codec::BitstreamWriter writer;
+  telehealth::util::Timer t;
+  int iterations = 10;
+  t.start();
+  for (int it = 0; it < iterations; ++it) {
+    writer.reset();
+    for (int i = 0; i < symbols; ++i)
+      writer.write_bits(values[i], widths[i]);
+    writer.flush_byte_align();
+  }
+  t.stop();
+  double write_ms = t.elapsed_ms();
+
+  telehealth::codec::BitstreamReader reader;
+  uint32_t checksum = 0;
+  t.start();
+  for (int it = 0; it < iterations; ++it) {
+    reader.set_data(writer.buffer());
+    for (int i = 0; i < symbols; ++i)
+      checksum += reader.read_bits(widths[i]);
+  }
+  t.stop();
+  double read_ms = t.elapsed_ms();
+
+  // Table-decoder access pattern: look ahead a fixed width, then consume the actual length.
+  t.start();
+  for (int it = 0; it < iterations; ++it) {
+    reader.set_data(writer.buffer());
+    for (int i = 0; i < symbols; ++i) {
+      checksum += reader.peek_bits(20) & ((1u << widths[i]) - 1);
+      reader.skip_bits(widths[i]);
+    }
+  }
+  t.stop();
+  double peek_ms = t.elapsed_ms();
+
+  double bits = static_cast<double>(total_bits) * iterations;
+  std::cout << "BitstreamWriter: " << (bits / (write_ms / 1000.0) / 1e6) << " Mbit/s\n";
+  std::cout << "BitstreamReader: " << (bits / (read_ms / 1000.0) / 1e6) << " Mbit/s\n";
+  std::cout << "BitstreamReader peek/skip: " << (bits / (peek_ms / 1000.0) / 1e6)
+            << " Mbit/s (checksum " << checksum << ")\n";
+  return 0;
+}
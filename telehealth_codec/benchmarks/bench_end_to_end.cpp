@@ -3,9 +3,50 @@
 #include <codec/YuvConverter.h>
 #include <io/VideoSource.h>
 #include <util/Timer.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <vector>
 
-int main() {
+using telehealth::codec::EncoderConfig;
+using telehealth::codec::FrameYUV;
+
+// Synthetic frames converted up front, so the wavefront runs time the encoder alone.
+static std::vector<FrameYUV> synthetic_clip(int width, int height, int frames) {
+  telehealth::io::VideoSourceConfig src_cfg;
+  src_cfg.path = "synthetic";
+  src_cfg.width = width;
+  src_cfg.height = height;
+  src_cfg.fps = 30;
+  std::vector<FrameYUV> clip;
+  auto source = telehealth::io::create_video_source(src_cfg);
+  if (!source || !source->opened()) return clip;
+  telehealth::codec::YuvConverter conv;
+  telehealth::codec::FrameRGB rgb;
+  telehealth::codec::FrameMeta meta;
+  while (static_cast<int>(clip.size()) < frames && source->read(rgb, meta)) {
+    clip.emplace_back();
+    conv.rgb_to_yuv420(rgb, clip.back());
+  }
+  return clip;
+}
+
+static double encode_clip(const std::vector<FrameYUV>& clip, const EncoderConfig& cfg, size_t* bytes) {
+  telehealth::codec::Encoder encoder(cfg);
+  telehealth::util::Timer t;
+  t.start();
+  *bytes = 0;
+  for (size_t i = 0; i < clip.size(); ++i) {
+    telehealth::codec::FrameMeta meta;
+    meta.frame_id = static_cast<int64_t>(i);
+    *bytes += encoder.encode(clip[i], meta).total_bytes();
+  }
+  t.stop();
+  return t.elapsed_ms();
+}
+
+int main(int argc, char** argv) {
   telehealth::io::VideoSourceConfig src_cfg;
   src_cfg.path = "synthetic";
   src_cfg.width = 320;
@@ -43,5 +84,31 @@ int main() {
   std::cout << "End-to-end: " << frames << " frames in " << ms << " ms ("
             << (frames / (ms / 1000.0)) << " fps, "
             << (total_bytes * 8 / (ms / 1000.0) / 1000.0) << " kbps)\n";
+
+  // Wavefront rows against the single-threaded encoder at conferencing resolutions.
+  const int clip_frames = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+  const int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  const int sizes[][2] = {{1280, 720}, {1920, 1080}};
+  for (const auto& size : sizes) {
+    std::vector<FrameYUV> clip = synthetic_clip(size[0], size[1], clip_frames);
+    if (clip.empty()) {
+      std::cerr << "Failed to create " << size[0] << "x" << size[1] << " source\n";
+      return 1;
+    }
+    EncoderConfig cfg;
+    cfg.width = size[0];
+    cfg.height = size[1];
+    cfg.use_diamond_search = true;
+    cfg.slice_threads = 1;
+    size_t single_bytes = 0, wpp_bytes = 0;
+    const double single_ms = encode_clip(clip, cfg, &single_bytes);
+    cfg.wavefront = true;
+    cfg.slice_threads = threads;
+    const double wpp_ms = encode_clip(clip, cfg, &wpp_bytes);
+    const double n = static_cast<double>(clip.size());
+    std::cout << size[0] << "x" << size[1] << ": single thread " << (n / (single_ms / 1000.0)) << " fps ("
+              << single_bytes << " bytes), wavefront on " << threads << " threads " << (n / (wpp_ms / 1000.0))
+              << " fps (" << wpp_bytes << " bytes), speedup " << (single_ms / wpp_ms) << "x\n";
+  }
   return 0;
 }
@@ -0,0 +1,97 @@
+#include <codec/EntropyCoder.h>
+#include <codec/Bitstream.h>
+#include <util/Timer.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using telehealth::codec::BitstreamReader;
+using telehealth::codec::BitstreamWriter;
+using telehealth::codec::EntropyCoder;
+using telehealth::codec::EntropyMode;
+using telehealth::codec::HuffmanTables;
+using telehealth::codec::kCbpBlocks;
+
+// Coefficient payload of one slice (CBP + coded blocks per MB) in each entropy mode: encode
+// once, then time repeated decodes. Blocks are sparse with mostly +-1 levels, like P-frame residuals.
+int main() {
+  const int mbs = 4000;
+  std::vector<int32_t> coeff(static_cast<size_t>(mbs * kCbpBlocks * 64), 0);
+  std::vector<uint32_t> cbps(static_cast<size_t>(mbs), 0);
+  srand(1);
+  size_t coded_blocks = 0;
+  for (int m = 0; m < mbs; ++m) {
+    for (int b = 0; b < kCbpBlocks; ++b) {
+      int32_t* c = &coeff[static_cast<size_t>((m * kCbpBlocks + b) * 64)];
+      if (rand() % 3 == 0) continue;
+      int nonzero = 1 + rand() % 6;
+      for (int n = 0; n < nonzero; ++n) {
+        int pos = (rand() % 16) * (rand() % 4 + 1) % 64;
+        int level = rand() % 5 == 0 ? 2 + rand() % 12 : 1;
+        c[pos] = rand() % 2 ? level : -level;
+      }
+      cbps[static_cast<size_t>(m)] |= 1u << b;
+      coded_blocks++;
+    }
+  }
+
+  const EntropyMode modes[] = {EntropyMode::Fixed, EntropyMode::ExpGolomb, EntropyMode::Huffman,
+                               EntropyMode::Arithmetic, EntropyMode::Rans};
+  const int iterations = 20;
+  for (EntropyMode mode : modes) {
+    EntropyCoder encoder(mode);
+    BitstreamWriter w;
+    HuffmanTables tables;
+    if (mode == EntropyMode::Huffman) {  // train on the payload itself, as a GOP would on its first P-frames
+      BitstreamWriter training;
+      for (int m = 0; m < mbs; ++m) {
+        encoder.encode_cbp(cbps[static_cast<size_t>(m)], training);
+        for (int b = 0; b < kCbpBlocks; ++b)
+          if (cbps[static_cast<size_t>(m)] & (1u << b))
+            encoder.encode_block_8x8(&coeff[static_cast<size_t>((m * kCbpBlocks + b) * 64)], 28, training);
+      }
+      encoder.huffman_stats().build(&tables);
+      encoder.set_huffman_tables(&tables);
+    }
+    telehealth::util::Timer t;
+    t.start();
+    encoder.begin_slice(w);
+    for (int m = 0; m < mbs; ++m) {
+      encoder.encode_cbp(cbps[static_cast<size_t>(m)], w);
+      for (int b = 0; b < kCbpBlocks; ++b)
+        if (cbps[static_cast<size_t>(m)] & (1u << b))
+          encoder.encode_block_8x8(&coeff[static_cast<size_t>((m * kCbpBlocks + b) * 64)], 28, w);
+    }
+    encoder.end_slice(w);
+    w.flush_byte_align();
+    t.stop();
+    double encode_ms = t.elapsed_ms();
+
+    EntropyCoder decoder(mode);
+    if (mode == EntropyMode::Huffman) decoder.set_huffman_tables(&tables);
+    int32_t block[64];
+    uint32_t checksum = 0;
+    t.start();
+    for (int it = 0; it < iterations; ++it) {
+      BitstreamReader r;
+      r.set_data(w.buffer());
+      decoder.begin_slice(r);
+      for (int m = 0; m < mbs; ++m) {
+        uint32_t cbp = decoder.decode_cbp(r);
+        for (int b = 0; b < kCbpBlocks; ++b) {
+          if (!(cbp & (1u << b))) continue;
+          decoder.decode_block_8x8(r, 28, block);
+          checksum += static_cast<uint32_t>(block[0] + block[63]);
+        }
+      }
+    }
+    t.stop();
+    double decode_ms = t.elapsed_ms() / iterations;
+
+    std::cout << entropy_mode_name(mode) << ": " << w.buffer().size() << " bytes, encode "
+              << (coded_blocks / (encode_ms / 1000.0) / 1e6) << " Mblock/s, decode "
+              << (coded_blocks / (decode_ms / 1000.0) / 1e6) << " Mblock/s (checksum " << checksum << ")\n";
+  }
+  return 0;
+}
@@ -11,6 +11,46 @@ namespace codec {
 
 enum class FrameType { I, P };
 
+/// Rate estimates (EntropyCoder costs, bin costs) are fixed point in 1/16 bit.
+constexpr int kBitCostShift = 4;
+
+/// BitstreamFrameHeader::flags: Huffman tables (HuffmanTables::write) open the coeff payload.
+constexpr uint8_t kFrameFlagHuffmanTables = 0x01;
+/// BitstreamFrameHeader::flags: the reconstruction is deblocked (DeblockFilter) before it
+/// becomes the reference.
+constexpr uint8_t kFrameFlagDeblock = 0x02;
+/// BitstreamFrameHeader::flags: wavefront substreams. Every MB row is its own byte-aligned
+/// substream with an offset table entry; rows below a slice's first row start from the
+/// entropy contexts of the row above after its second MB and may predict from it.
+constexpr uint8_t kFrameFlagWavefront = 0x04;
+/// BitstreamFrameHeader::flags: ref_slots / ref_tag are signalled. Without it a frame
+/// predicts from, and replaces, reference slot 0.
+constexpr uint8_t kFrameFlagReferenceSlots = 0x08;
+/// BitstreamFrameHeader::flags: Huffman mode restarts table training here as at an I-frame.
+/// Set on loss-recovery P-frames, whose receiver may have missed the GOP's tables.
+constexpr uint8_t kFrameFlagHuffmanReset = 0x10;
+/// BitstreamFrameHeader::flags bits 5-6: temporal layer (0 = T0, the base layer). A frame
+/// only predicts from frames of lower layers (or T0 from T0), so a relay or receiver can drop
+/// every frame above a layer and still decode the rest.
+constexpr int kFrameFlagTemporalLayerShift = 5;
+constexpr uint8_t kFrameFlagTemporalLayerMask = 0x60;
+constexpr int kMaxTemporalLayers = 3;
+/// BitstreamFrameHeader::flags: the frame is coded at another size than the file header's
+/// (dynamic resolution); a BitstreamFrameSize follows the frame header. Sizes change only
+/// at I-frames.
+constexpr uint8_t kFrameFlagResolution = 0x80;
+/// BitstreamFrameHeader::qp bit 7 (the flags byte is full; QPs stay below 64): MB-row QPs.
+/// Every row after a substream's first opens its coeff substream with the QP change from the
+/// row above (EntropyCoder::encode_qp_delta); a substream's first row is at the frame QP.
+constexpr uint8_t kFrameQpRowDeltas = 0x80;
+
+/// Reference picture slots kept by encoder and decoder: slot 0 is the short-term reference
+/// (the previous frame, or the previous T0 frame with temporal layers), slots 1..3 hold
+/// long-term references for loss recovery. With three temporal layers slot 3 holds the last
+/// T1 frame instead (kTemporalLayerSlot).
+constexpr int kReferenceSlots = 4;
+constexpr int kTemporalLayerSlot = 3;
+
 /// File header for our custom bitstream
 struct BitstreamFileHeader {
   uint32_t magic = 0x54434F44;  // "TCOD"
@@ -19,18 +59,32 @@ struct BitstreamFileHeader {
   uint16_t height = 0;
   uint8_t fps = 30;
   uint8_t chroma_format = 0;  // 0 = 4:2:0
-  uint8_t reserved[2] = {};
+  uint8_t quant_matrix = 0;   // QuantMatrixPreset; Custom: QuantMatrices follow this header
+  uint8_t reserved[3] = {};   // fills the struct to 16 bytes, so it has no padding
 };
+static_assert(sizeof(BitstreamFileHeader) == 16, "BitstreamFileHeader is written as raw bytes");
 
 /// Per-frame header in bitstream
 struct BitstreamFrameHeader {
   uint8_t frame_type = 0;  // 0=I, 1=P
+  uint8_t pad[3] = {};     // explicit, so the struct has no padding
   uint32_t frame_id = 0;
   uint64_t timestamp_us = 0;
-  uint8_t qp = 28;
+  uint8_t qp = 28;  // bits 0-6; bit 7: kFrameQpRowDeltas
+  uint8_t pad2[3] = {};
   uint32_t mv_payload_bytes = 0;
   uint32_t coeff_payload_bytes = 0;
-  uint8_t reserved[4] = {};
+  uint8_t num_slices = 1;  // 0 in streams without slices, read as 1
+  uint8_t flags = 0;       // kFrameFlag*
+  uint8_t ref_slots = 0;   // kFrameFlagReferenceSlots: bits 0-1 slot predicted from, bits 4-7 slots replaced
+  uint8_t ref_tag = 0;     // kFrameFlagReferenceSlots: low 8 bits of the predicted-from slot's frame ID
+};
+static_assert(sizeof(BitstreamFrameHeader) == 32, "BitstreamFrameHeader is written as raw bytes");
+
+/// Coded size of a kFrameFlagResolution frame, right after its BitstreamFrameHeader.
+struct BitstreamFrameSize {
+  uint16_t width = 0;
+  uint16_t height = 0;
 };
 
 /// Encoded frame output (bytes + metadata)
@@ -39,39 +93,140 @@ struct EncodedFrame {
   uint32_t frame_id = 0;
   uint64_t timestamp_us = 0;
   uint8_t qp = 28;
+  bool row_qp = false;  // kFrameQpRowDeltas: qp is the QP of each substream's first row
   std::vector<uint8_t> mv_bytes;
   std::vector<uint8_t> coeff_bytes;
   std::vector<uint8_t> raw_bytes;  // full serialized for packetizer
+  /// MB-row slices; with more than one substream (slices, or MB rows under
+  /// kFrameFlagWavefront), slice_offsets holds the byte offset of substreams 1..n-1 within
+  /// mv_bytes, then within coeff_bytes (2 * (n - 1) entries).
+  uint8_t num_slices = 1;
+  uint8_t flags = 0;  // kFrameFlag*
+  /// With kFrameFlagReferenceSlots: bits 0-1 are the slot a P-frame predicts from, bits 4-7
+  /// the slots its reconstruction replaces; ref_tag is the low byte of the frame ID expected
+  /// in the predicted-from slot, so a decoder that missed that frame can tell.
+  uint8_t ref_slots = 0;
+  uint8_t ref_tag = 0;
+  /// With kFrameFlagResolution: the coded size (else the file header's).
+  uint16_t width = 0;
+  uint16_t height = 0;
+  std::vector<uint32_t> slice_offsets;
   uint32_t total_bytes() const {
     return static_cast<uint32_t>(mv_bytes.size() + coeff_bytes.size());
   }
+  int temporal_layer() const { return (flags & kFrameFlagTemporalLayerMask) >> kFrameFlagTemporalLayerShift; }
 };
 
-/// Bitstream writer: pack bits into buffer
+/// Frame record as files and UDP packets carry it: BitstreamFrameHeader, BitstreamFrameSize
+/// (kFrameFlagResolution only), the substream offset table, then the MV and coeff payloads.
+BitstreamFrameHeader frame_header(const EncodedFrame& frame);
+std::vector<uint8_t> serialize_frame(const EncodedFrame& frame);
+/// Parse one serialize_frame() record of a stream frame_height pixels tall (wavefront frames
+/// have an offset table entry pair per MB row; a signalled size overrides frame_height). Returns the bytes consumed, 0 if data is short.
+size_t parse_frame(const uint8_t* data, size_t size, int frame_height, EncodedFrame* out);
+
+/// Bitstream writer: pack bits LSB-first into buffer. Bits collect in a 64-bit accumulator
+/// and are stored a 32-bit word at a time; the buffer grows geometrically.
 class BitstreamWriter {
  public:
   BitstreamWriter() = default;
   void reset();
+  /// Reserve capacity (bytes) to avoid regrowth for a known payload size.
+  void reserve(size_t bytes);
   void write_bits(uint32_t value, int num_bits);
+  /// Exp-Golomb: (len-1) zero bits, a 1, then the low (len-1) bits of value+1. value < 2^32-1.
+  void write_ue(uint32_t value);
+  /// Signed Exp-Golomb: v > 0 -> 2v-1, v <= 0 -> -2v.
+  void write_se(int32_t value);
   void write_byte(uint8_t b);
   void write_bytes(const uint8_t* data, size_t len);
   void flush_byte_align();
+  /// Written bytes; pending accumulator bits are included only after flush_byte_align().
   const std::vector<uint8_t>& buffer() const { return buffer_; }
-  size_t bit_position() const { return bit_pos_; }
-  size_t byte_position() const { return (bit_pos_ + 7) / 8; }
+  size_t bit_position() const { return buffer_.size() * 8 + static_cast<size_t>(acc_bits_); }
+  size_t byte_position() const { return (bit_position() + 7) / 8; }
 
  private:
+  void flush_word();
+  uint8_t* grow(size_t extra_bytes);
+
   std::vector<uint8_t> buffer_;
-  size_t bit_pos_ = 0;
+  uint64_t acc_ = 0;
+  int acc_bits_ = 0;
 };
 
-/// Bitstream reader for decoder and roundtrip tests
+inline void BitstreamWriter::write_bits(uint32_t value, int num_bits) {
+  if (num_bits <= 0 || num_bits > 32) return;
+  acc_ |= static_cast<uint64_t>(value & (0xFFFFFFFFu >> (32 - num_bits))) << acc_bits_;
+  acc_bits_ += num_bits;
+  if (acc_bits_ >= 32) flush_word();
+}
+
+/// Number of significant bits in v (0 for v == 0).
+inline int bit_length(uint32_t v) {
+  if (v == 0) return 0;
+#if defined(__GNUC__) || defined(__clang__)
+  return 32 - __builtin_clz(v);
+#else
+  int n = 0;
+  while (v) { v >>= 1; ++n; }
+  return n;
+#endif
+}
+
+inline void BitstreamWriter::write_ue(uint32_t value) {
+  uint32_t code = value + 1;
+  int len = bit_length(code);
+  uint32_t info = code ^ (1u << (len - 1));  // bits below the leading 1
+  if (len <= 16) {
+    write_bits(((info << 1) | 1u) << (len - 1), 2 * len - 1);
+  } else {
+    write_bits(0, len - 1);
+    write_bits(1, 1);
+    write_bits(info, len - 1);
+  }
+}
+
+/// Signed Exp-Golomb index: v > 0 -> 2v-1, v <= 0 -> -2v.
+inline uint32_t se_to_ue(int32_t value) {
+  uint32_t mag = static_cast<uint32_t>(value > 0 ? value : -static_cast<int64_t>(value));
+  return value > 0 ? 2 * mag - 1 : 2 * mag;
+}
+
+inline void BitstreamWriter::write_se(int32_t value) {
+  write_ue(se_to_ue(value));
+}
+
+/// Stand-in for BitstreamWriter that only counts bits, so rate estimates can run the real
+/// VLC syntax without touching a buffer.
+class BitCounter {
+ public:
+  void reset() { bits_ = 0; }
+  void write_bits(uint32_t, int num_bits) { bits_ += static_cast<size_t>(num_bits); }
+  void write_ue(uint32_t value) { bits_ += static_cast<size_t>(2 * bit_length(value + 1) - 1); }
+  void write_se(int32_t value) { write_ue(se_to_ue(value)); }
+  size_t bit_position() const { return bits_; }
+
+ private:
+  size_t bits_ = 0;
+};
+
+/// Bitstream reader for decoder and roundtrip tests. Keeps a 64-bit window of upcoming bits
+/// (LSB = next bit) refilled a word at a time; reads past the end return zero bits.
 class BitstreamReader {
  public:
   BitstreamReader() = default;
   void set_data(const uint8_t* data, size_t size_bytes);
   void set_data(const std::vector<uint8_t>& data) { set_data(data.data(), data.size()); }
+  /// Next num_bits (<= 32) without consuming them.
+  uint32_t peek_bits(int num_bits);
+  void skip_bits(int num_bits);
   uint32_t read_bits(int num_bits);
+  /// Zero bits before the next 1 bit in stream order (capped at 32), without consuming.
+  /// This is the prefix length of an Exp-Golomb code.
+  int count_leading_zeros();
+  uint32_t read_ue();
+  int32_t read_se();
   uint8_t read_byte();
   void read_bytes(uint8_t* out, size_t len);
   void align_to_byte();
@@ -81,10 +236,67 @@ class BitstreamReader {
   size_t size_bytes() const { return size_bytes_; }
 
  private:
+  void refill();
+
   const uint8_t* data_ = nullptr;
   size_t size_bytes_ = 0;
-  size_t bit_pos_ = 0;
+  size_t bit_pos_ = 0;     // bits consumed
+  size_t next_byte_ = 0;   // next byte to load into the window
+  uint64_t window_ = 0;
+  int window_bits_ = 0;
 };
 
+inline uint32_t BitstreamReader::peek_bits(int num_bits) {
+  if (num_bits <= 0 || num_bits > 32) return 0;
+  if (window_bits_ < num_bits) refill();
+  return static_cast<uint32_t>(window_) & (0xFFFFFFFFu >> (32 - num_bits));
+}
+
+inline void BitstreamReader::skip_bits(int num_bits) {
+  if (num_bits <= 0 || num_bits > 32) return;
+  if (window_bits_ < num_bits) refill();
+  window_ >>= num_bits;
+  window_bits_ -= num_bits;
+  bit_pos_ += static_cast<size_t>(num_bits);
+}
+
+inline uint32_t BitstreamReader::read_bits(int num_bits) {
+  if (num_bits <= 0 || num_bits > 32) return 0;
+  if (window_bits_ < num_bits) refill();
+  uint32_t v = static_cast<uint32_t>(window_) & (0xFFFFFFFFu >> (32 - num_bits));
+  window_ >>= num_bits;
+  window_bits_ -= num_bits;
+  bit_pos_ += static_cast<size_t>(num_bits);
+  return v;
+}
+
+inline int BitstreamReader::count_leading_zeros() {
+  if (window_bits_ < 32) refill();
+  uint32_t low = static_cast<uint32_t>(window_);
+  if (low == 0) return 32;
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(low);
+#else
+  int n = 0;
+  while (!(low & 1u)) { low >>= 1; ++n; }
+  return n;
+#endif
+}
+
+inline uint32_t BitstreamReader::read_ue() {
+  int zeros = count_leading_zeros();
+  if (zeros >= 32) {  // no terminating 1 within 32 bits: corrupt or past the end
+    skip_bits(32);
+    return 0xFFFFFFFFu;
+  }
+  skip_bits(zeros + 1);
+  return ((1u << zeros) | read_bits(zeros)) - 1;
+}
+
+inline int32_t BitstreamReader::read_se() {
+  uint32_t k = read_ue();
+  return (k & 1u) ? static_cast<int32_t>((k >> 1) + 1) : -static_cast<int32_t>(k >> 1);
+}
+
 }  // namespace codec
 }  // namespace telehealth
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "SpeedPreset.h"
+
+namespace telehealth {
+namespace codec {
+
+/// Closed-loop speed control (EncoderConfig::adaptive_speed): fed the measured encode time
+/// of each frame, picks the speed preset for the next one so encoding keeps up with
+/// frame_budget_ms. It steps one preset faster when the smoothed time nears the budget (or
+/// a single frame badly overruns it) and one slower after a run of frames well inside it,
+/// unless that slower preset was already measured to overrun. Each step is held for a few
+/// frames so the average reflects the new preset before the next decision.
+class DeadlineController {
+ public:
+  DeadlineController(double budget_ms, SpeedPreset start);
+
+  /// Record the last frame's encode time (coded at preset()); returns the preset for the next frame.
+  SpeedPreset update(double encode_ms);
+
+  SpeedPreset preset() const { return preset_; }
+  /// Exponentially weighted encode time at the current preset (0 before the first update).
+  double average_ms() const { return average_ms_; }
+  void set_budget_ms(double budget_ms) { budget_ms_ = budget_ms; }
+
+ private:
+  void step_to(SpeedPreset preset);
+
+  double budget_ms_;
+  SpeedPreset preset_;
+  double average_ms_ = 0;
+  double preset_ms_[kSpeedPresets] = {};  // last smoothed time seen at each preset (0 = never run)
+  int hold_frames_ = 0;                   // frames before the next step is allowed
+  int fast_frames_ = 0;                   // consecutive frames well inside the budget
+};
+
+}  // namespace codec
+}  // namespace telehealth
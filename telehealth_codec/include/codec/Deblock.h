@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Frame.h"
+#include "MotionVector.h"
+#include "Simd.h"
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// What the deblocking filter needs to know about a coded MB. Encoder and decoder fill one
+/// per MB as they code it.
+struct MbDeblockInfo {
+  MotionVector mv;
+  uint8_t cbp = 0;     // coded block pattern (bits 0-3 luma 8x8, 4-5 chroma)
+  bool intra = false;
+};
+
+/// Adaptive in-loop deblocking over 8x8 transform edges and MB edges, with H.264-style
+/// alpha/beta/tc0 thresholds from the frame QP (or the MB row's, with per-row QPs: the edge
+/// between two rows then takes their rounded mean). Boundary strength per 8-sample edge segment:
+/// 4 at MB edges touching an intra MB (strong filter), 3 inside intra MBs, 2 where either
+/// block has coefficients, 1 across MB edges whose MVs differ, 0 (unfiltered) otherwise.
+/// Chroma filters MB edges only, with the strength of the matching luma segment.
+///
+/// The filter works one MB row at a time: first every vertical edge of the row, then its
+/// horizontal edges (the top one reaching three lines into the row above). Rows are filtered
+/// in increasing order, each once it is fully reconstructed, so encoders can run it a row
+/// behind the MB loop.
+class DeblockFilter {
+ public:
+  /// Fastest kernels the CPU supports.
+  DeblockFilter();
+  /// Specific kernels; unavailable ones fall back to the best available below them.
+  explicit DeblockFilter(SimdLevel level);
+
+  SimdLevel level() const { return level_; }
+
+  /// Filter MB row mb_y of frame; info holds one entry per MB of the frame in raster order.
+  /// qp_above: QP of row mb_y - 1 when rows have their own QPs (-1: qp).
+  void filter_row(FrameYUV& frame, const MbDeblockInfo* info, int mb_y, int qp, int qp_above = -1) const;
+  /// All rows in order; row_qp, if given, holds each MB row's QP (qp is then unused).
+  void filter_frame(FrameYUV& frame, const MbDeblockInfo* info, int qp, const uint8_t* row_qp = nullptr) const;
+
+ private:
+  SimdLevel level_;
+};
+
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Bitstream.h"
+#include "EntropyCoder.h"
+#include "EntropyMode.h"
+#include "Frame.h"
+#include "MotionVector.h"
+#include "QuantMatrix.h"
+#include <memory>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+class MotionCompensation;
+class Transform;
+class Quantizer;
+class DeblockFilter;
+struct HuffmanTables;
+class IntraPredictor;
+struct MbDeblockInfo;
+
+/// Decodes EncodedFrames of one stream into the same reconstruction the encoder predicts
+/// from (reconstruct_macroblock or reconstruct_intra_macroblock, then DeblockFilter when the
+/// frame flags it).
+class Decoder {
+ public:
+  /// matrices is only read for the Custom preset (the weights that follow the file header).
+  explicit Decoder(const BitstreamFileHeader& header, const QuantMatrices& matrices = QuantMatrices());
+  ~Decoder();
+
+  /// False if the header's version is not a known entropy mode.
+  bool ok() const { return ok_; }
+  /// Decode one frame in stream order. Returns false on a malformed frame or a P-frame
+  /// without a reference; frame() then keeps the last good picture.
+  bool decode(const EncodedFrame& frame);
+  /// Last decoded picture, at the size it was coded at (kFrameFlagResolution frames may be
+  /// smaller than the file header's size).
+  const FrameYUV& frame() const { return *last_; }
+  /// Whether the last decode() rebuilt exactly the encoder's reconstruction: an I-frame, or a
+  /// P-frame whose reference slot holds the frame its ref_tag names and was itself intact.
+  /// After a lost frame, P-frames still decode (from the stale reference) but are not
+  /// intact; a receiver acknowledges intact frames (Encoder::acknowledge) and reports the
+  /// first one that is not (Encoder::report_loss).
+  bool intact() const { return intact_; }
+
+ private:
+  /// MB rows [first_row, end_row) from one substream's MV and coeff payload bytes; rows above
+  /// top_row are not predicted from. A wavefront row continues from the row above's contexts
+  /// (wpp_above) and saves its own after its second MB (wpp_save); both null otherwise.
+  void decode_slice(const EncodedFrame& frame, int top_row, int first_row, int end_row, const uint8_t* mv,
+                    size_t mv_len, const uint8_t* coeff, size_t coeff_len,
+                    const EntropyCoder::ContextState* wpp_above, EntropyCoder::ContextState* wpp_save);
+
+  bool ok_ = false;
+  EntropyMode mode_ = EntropyMode::ExpGolomb;
+  int stream_width_ = 0;   // file header size, for frames without kFrameFlagResolution
+  int stream_height_ = 0;
+  int width_ = 0;          // size of the frames being decoded
+  int height_ = 0;
+  int mb_cols_ = 0;
+  int mb_rows_ = 0;
+  std::unique_ptr<FrameYUV> refs_[kReferenceSlots];  // reference slots; null until stored
+  uint32_t ref_ids_[kReferenceSlots] = {};           // frame ID held by each slot
+  bool ref_intact_[kReferenceSlots] = {};            // slot holds an intact picture
+  bool intact_ = false;
+  const FrameYUV* reference_ = nullptr;              // slot the frame being decoded predicts from
+  std::unique_ptr<FrameYUV> recon_;
+  std::unique_ptr<FrameYUV> spare_;                  // last picture when it went to no slot 0
+  const FrameYUV* last_ = nullptr;
+  std::unique_ptr<MotionCompensation> mc_;
+  std::unique_ptr<Transform> transform_;
+  std::unique_ptr<Quantizer> quantizer_;
+  std::unique_ptr<DeblockFilter> deblock_;
+  std::unique_ptr<IntraPredictor> intra_;
+  std::unique_ptr<HuffmanTables> huffman_tables_;
+  bool huffman_active_ = false;  // tables received since the last I-frame
+  std::vector<MotionVector> mv_field_;
+  std::vector<MbDeblockInfo> mb_info_;
+  std::vector<uint8_t> row_qp_;  // kFrameQpRowDeltas: QP of each MB row, for deblock_
+};
+
+}  // namespace codec
+}  // namespace telehealth
@@ -1,13 +1,20 @@
 #pragma once
 
 #include "Bitstream.h"
+#include "Block.h"
 #include "EncoderConfig.h"
 #include "Frame.h"
 #include "MotionVector.h"
+#include "RateControl.h"
 #include <memory>
 #include <vector>
 
 namespace telehealth {
+namespace util {
+class ThreadPool;
+class RowProgress;
+}  // namespace util
+
 namespace codec {
 
 class MotionEstimation;
@@ -16,6 +23,16 @@ class Transform;
 class Quantizer;
 class EntropyCoder;
 class RateControl;
+struct HuffmanTables;
+struct HuffmanStats;
+class DeblockFilter;
+struct MbDeblockInfo;
+class IntraPredictor;
+struct IntraMbModes;
+class FrameScaler;
+class DeadlineController;
+class SceneChangeDetector;
+struct FrameComplexity;
 
 class Encoder {
  public:
@@ -23,27 +40,206 @@ class Encoder {
   ~Encoder();
 
   /// Encode one YUV frame. Returns encoded frame (raw_bytes filled for streaming).
-  EncodedFrame encode(const FrameYUV& frame, const FrameMeta& meta);
+  /// Lookahead: the caller holds back config().lookahead_frames frames, analyzes each with a
+  /// SceneChangeDetector (at the encoder's scene_change_threshold) as it arrives, and passes
+  /// count analyses, this frame's first, then those of the frames behind it. Scene cuts then
+  /// come from lookahead[0] and rate control plans around the frames ahead. Pass them with
+  /// every frame or with none: the encoder's own detector only sees frames encoded without.
+  EncodedFrame encode(const FrameYUV& frame, const FrameMeta& meta, const FrameComplexity* lookahead = nullptr,
+                      int count = 0);
   /// Encode one YUV frame (refcounted Frame, I420).
-  EncodedFrame encode(const Frame& frame, const FrameMeta& meta);
+  EncodedFrame encode(const Frame& frame, const FrameMeta& meta, const FrameComplexity* lookahead = nullptr,
+                      int count = 0);
 
   const EncoderConfig& config() const { return config_; }
+  /// File header describing this encoder's stream (version/entropy mode, dimensions, fps, quant matrix preset).
+  BitstreamFileHeader file_header() const;
+  /// Matrices in use; written after the file header when the preset is Custom.
+  const QuantMatrices& quant_matrices() const;
+  /// Decoder-side reconstruction of the last encoded frame (the next P-frame's reference);
+  /// null before the first encode().
+  const FrameYUV* reconstructed_frame() const { return last_recon_; }
+
+  /// Receiver feedback: frame_id decoded. A long-term reference holding it becomes a
+  /// recovery point. Like encode(), not safe to call concurrently with it.
+  void acknowledge(uint32_t frame_id);
+  /// Receiver feedback: a frame failed to decode, so the receiver's short-term reference is
+  /// stale. The next frame predicts from the newest acknowledged long-term reference, or is
+  /// an I-frame when there is none.
+  void report_loss();
+
+  /// Rate control target; with max_downscale the coded size follows it (RateControl::downscale).
+  void set_target_bitrate_kbps(uint32_t kbps);
+
+  /// Stats of the last encoded frame: bits, encode time and the speed preset it was coded
+  /// with. With adaptive_speed, config().speed_preset is the preset of the next frame.
+  const FrameStats& last_frame_stats() const { return last_stats_; }
 
  private:
-  EncodedFrame encode_i_frame(const FrameYUV& frame, const FrameMeta& meta);
-  EncodedFrame encode_p_frame(const FrameYUV& frame, const FrameMeta& meta);
-  EncodedFrame encode_i_frame(const Frame& frame, const FrameMeta& meta);
-  EncodedFrame encode_p_frame(const Frame& frame, const FrameMeta& meta);
-  void copy_frame_to_reference(const Frame& frame);
+  /// Read-only I420 planes of either frame type, so both encode() overloads share one path.
+  struct SourceView {
+    const uint8_t* y = nullptr;
+    const uint8_t* u = nullptr;
+    const uint8_t* v = nullptr;
+    int stride_y = 0;
+    int stride_uv = 0;
+    int width = 0;
+    int height = 0;
+  };
+
+  static SourceView view_of(const FrameYUV& frame);
+  static SourceView view_of(const Frame& frame);
+  static void macroblock_views(const SourceView& src, BlockCoord coord,
+                               BlockViewConst* out_y, BlockViewConst* out_u, BlockViewConst* out_v);
+
+  /// Entropy contexts a wavefront row leaves for the row below (defined with EntropyCoder).
+  struct RowContexts;
+
+  /// Substream: MB rows [first_row, end_row) with their own writers and entropy state. It is
+  /// a whole slice, or with config_.wavefront one MB row of the slice starting at top_row
+  /// (rows above top_row are never predicted from). Slices share only read-only encoder
+  /// state and disjoint parts of mv_buffer_, so they code in parallel; wavefront rows also
+  /// wait on the row above through row_progress_.
+  struct Slice {
+    int first_row = 0;
+    int end_row = 0;
+    int top_row = 0;
+    std::unique_ptr<EntropyCoder> entropy;     // coefficient payload
+    std::unique_ptr<EntropyCoder> mv_entropy;  // MV payload (separate coder state in arithmetic mode)
+    BitstreamWriter mv_out;
+    BitstreamWriter coeff_out;
+    std::unique_ptr<RowContexts> contexts;     // wavefront: saved after the row's second MB
+    uint64_t motion_cost = 0;                  // P-frames: summed motion search cost of the substream's MBs
+    RowRateControl row_rc;                     // frame_byte_cap: row QPs against the substream's share
+    bool drop_residual = false;                // guaranteed_byte_cap: the next MB codes no residual
+    int dropped_mbs = 0;                       // MBs the substream coded without residual
+    double dropped_mb_bits = 0;                // guaranteed_byte_cap: most a residual-free MB costs (per row)
+    double row_delta_bits = 0;                 // guaranteed_byte_cap: most a row QP delta costs (per row)
+    double reserve_bits = 0;                   // guaranteed_byte_cap: kept for the MBs and rows after this MB
+  };
+
+  EncodedFrame encode_view(const SourceView& src, const FrameMeta& meta, const FrameComplexity* lookahead,
+                           int count);
+  EncodedFrame encode_i_frame(const SourceView& src, const FrameMeta& meta);
+  EncodedFrame encode_p_frame(const SourceView& src, const FrameMeta& meta);
+  /// Split mb_rows into config_.num_slices row groups, and those into one substream per row
+  /// with config_.wavefront (reused while the geometry holds).
+  void setup_slices(int mb_rows);
+  /// Code every slice (on the pool when there is one) and concatenate the payloads into
+  /// out.mv_bytes / out.coeff_bytes with the slice offset table.
+  void encode_slices(const SourceView& src, int qp, EncodedFrame& out);
+  void encode_i_slice(const SourceView& src, int qp, Slice& slice);
+  void encode_p_slice(const SourceView& src, int qp, Slice& slice);
+  /// Called after each coded MB row: the first slice deblocks the row above it, a row behind
+  /// the MB loop. Rows the first slice cannot reach wait for the slices to join.
+  /// With wavefront rows, the filter waits until the row above has filtered its own row above.
+  void deblock_behind(const Slice& slice, int mb_y);
+  /// Bits the substream has cost so far (EntropyCoder::coded_bits of its writers).
+  static size_t substream_bits(const Slice& slice, bool p_frame);
+  /// Start MB row mb_y: with frame_byte_cap its QP comes from the substream's row rate
+  /// control and, after the substream's first row, is sent as a delta. Returns the row QP
+  /// (qp without a cap) and records it in row_qp_.
+  int begin_row(Slice& slice, int mb_y, int qp, bool p_frame);
+  /// guaranteed_byte_cap: before MB (mb_x, mb_y), set slice.reserve_bits to what the rest of
+  /// the substream needs without residual (its MBs and row QP deltas), and
+  /// slice.drop_residual when there is no room for more.
+  void limit_macroblock(Slice& slice, int mb_x, int mb_y, int mb_cols, bool p_frame);
+  /// guaranteed_byte_cap: whether the MB's coded blocks (coeff, cbp), with its CBP and intra
+  /// modes, as priced by the entropy coder, still leave slice.reserve_bits of the budget.
+  bool residual_fits(const Slice& slice, const int32_t* coeff, uint32_t cbp, bool p_frame,
+                     const IntraMbModes* intra_modes) const;
+  /// guaranteed_byte_cap: most a residual-free MB costs on the substream's coders now (CBP,
+  /// then an MVD within twice search_range or unsplit intra modes).
+  double dropped_mb_bits(const Slice& slice, bool p_frame) const;
+  /// begin_slice() on the substream's coders; a wavefront row first waits for the row above
+  /// to pass its second MB and starts from the contexts it saved there.
+  void begin_substream(Slice& slice, int mb_cols, bool p_frame);
+  /// Wavefront rows: before MB mb_x, wait until the row above has coded its top-right MB.
+  void wavefront_wait(const Slice& slice, int mb_x, int mb_cols);
+  /// Wavefront rows: after MB mb_x, save the contexts (second MB) and publish progress.
+  void wavefront_done(Slice& slice, int mb_x, int mb_cols);
+  /// Source MB with its last column/row repeated past the frame edge, so the transform and
+  /// SATD always see whole 8x8 blocks.
+  struct PaddedMb {
+    uint8_t y[MB_SIZE * MB_SIZE];
+    uint8_t u[MB_CHROMA_SIZE * MB_CHROMA_SIZE];
+    uint8_t v[MB_CHROMA_SIZE * MB_CHROMA_SIZE];
+  };
+  static void pad_macroblock(const BlockViewConst& yv, const BlockViewConst& uv, const BlockViewConst& vv,
+                             PaddedMb* out);
+  /// Best 16x16 luma prediction by SATD + mode cost; returns that cost.
+  uint32_t choose_intra_16x16(BlockCoord coord, const PaddedMb& src, int lambda, const Slice& slice,
+                              IntraMbModes* modes, uint8_t* pred) const;
+  /// Intra MB (I-frames, and P-frame MBs that motion search cannot predict): 16x16 or four
+  /// 8x8 luma predictions and a chroma mode, chosen by SATD + mode cost.
+  void encode_intra_macroblock(BlockCoord coord, const PaddedMb& src, int qp, Slice& slice, bool p_frame);
+  /// CBP (with the intra flag in P-frames), the intra modes when given, then the coded
+  /// blocks of coeff[kCbpBlocks * 64].
+  void encode_mb_coefficients(const int32_t* coeff, uint32_t cbp, int qp, Slice& slice, bool p_frame,
+                              const IntraMbModes* intra_modes);
+  void encode_p_macroblock(BlockCoord coord, const BlockViewConst& yv,
+                           const BlockViewConst& uv, const BlockViewConst& vv,
+                           int qp, Slice& slice);
+  /// Reference picture slot (kReferenceSlots): slot 0 trades buffers with recon_, long-term
+  /// slots hold copies.
+  struct ReferenceSlot {
+    std::unique_ptr<FrameYUV> picture;  // null until a frame is stored
+    uint32_t frame_id = 0;
+    bool acked = false;  // the receiver reported frame_id decoded
+  };
+  /// Long-term slots in use (slots 1..n): long_term_refs, less the slot three temporal layers take.
+  int long_term_slots() const;
+  /// Newest acknowledged long-term slot, or -1.
+  int acked_long_term_slot() const;
+  /// Long-term slot for a new long-term reference: an empty one, else the oldest that is not
+  /// the newest acknowledged one.
+  int free_long_term_slot() const;
+
+  /// Huffman mode: an I-frame restarts training; the first T0 P-frame after huffman_training_frames
+  /// builds the GOP's tables and returns true (the tables are sent with it, so every temporal
+  /// operating point receives them).
+  bool begin_huffman_frame(bool intra);
+  /// Huffman mode: fold a training P-frame's counts into the GOP statistics. Intra counts are
+  /// dropped, since only P-frames are coded with the tables.
+  void end_huffman_frame(bool intra);
 
   EncoderConfig config_;
-  std::unique_ptr<FrameYUV> reference_;
+  ReferenceSlot refs_[kReferenceSlots];
+  const FrameYUV* reference_ = nullptr;   // slot picture the frame being coded predicts from
+  const FrameYUV* last_recon_ = nullptr;  // reconstruction of the last coded frame
+  bool loss_reported_ = false;
+  uint32_t next_long_term_ = 0;  // first frame ID that may become the next long-term reference
+  int layer_phase_ = 0;          // position in the temporal layer pattern of the next frame
+  int temporal_layer_ = 0;       // layer of the frame being coded
+  std::unique_ptr<FrameYUV> recon_;      // reconstruction of the frame being coded (slices write disjoint rows)
   std::unique_ptr<MotionEstimation> me_;
   std::unique_ptr<MotionCompensation> mc_;
   std::unique_ptr<Transform> transform_;
   std::unique_ptr<Quantizer> quantizer_;
-  std::unique_ptr<EntropyCoder> entropy_;
+  std::vector<Slice> slices_;
+  int num_slices_ = 1;                            // slices (substreams are rows with wavefront)
+  std::unique_ptr<util::ThreadPool> slice_pool_;  // null when slices run on the calling thread
+  std::unique_ptr<util::RowProgress> row_progress_;  // wavefront: MBs coded per row (+1 once deblocked behind)
   std::unique_ptr<RateControl> rate_control_;
+  std::unique_ptr<DeadlineController> deadline_;  // null unless config_.adaptive_speed
+  std::unique_ptr<SceneChangeDetector> scene_;    // cuts, and complexity for rate_control_, without lookahead
+  FrameStats last_stats_;
+  std::unique_ptr<DeblockFilter> deblock_;  // null when config_.deblock is off
+  std::unique_ptr<IntraPredictor> intra_;
+  std::vector<MbDeblockInfo> mb_info_;      // per MB of the frame being coded, for deblock_
+  std::unique_ptr<HuffmanTables> huffman_tables_;
+  std::unique_ptr<HuffmanStats> huffman_stats_;
+  bool huffman_active_ = false;  // tables built for the current GOP
+  int huffman_frames_ = 0;       // training P-frames coded in the current GOP
+  int refresh_phase_ = 0;  // intra refresh: band of the next P-frame (0 .. intra_refresh_frames - 1)
+  int refresh_begin_ = 0;  // intra refresh: MB columns [refresh_begin_, refresh_end_) of this frame's band
+  int refresh_end_ = 0;
+  int qp_ = 0;                            // QP of the frame being coded (RateControl::frame_qp)
+  double payload_cap_bits_ = 0;           // frame_byte_cap less the frame's header, size and Huffman tables
+  std::vector<uint8_t> row_qp_;           // QP of each MB row of the frame being coded
+  int downscale_ = 1;                     // divisor of the source size frames are coded at (changes at I-frames)
+  std::unique_ptr<FrameScaler> scaler_;   // source downscaler (created on first use)
+  std::unique_ptr<FrameYUV> scaled_;      // downscaled source of the frame being coded
   std::vector<MotionVector> mv_buffer_;
   std::vector<int32_t> coeff_buffer_;
   std::vector<int16_t> residual_buffer_;
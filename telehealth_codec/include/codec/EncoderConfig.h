@@ -1,5 +1,8 @@
 #pragma once
 
+#include "EntropyMode.h"
+#include "QuantMatrix.h"
+#include "SpeedPreset.h"
 #include <cstdint>
 #include <string>
 
@@ -10,16 +13,63 @@ struct EncoderConfig {
   int width = 640;
   int height = 480;
   int fps = 30;
-  int gop_size = 30;           // I-frame every N frames
+  int gop_size = 30;           // I-frame every N frames (unless intra_refresh_frames is set)
+  int intra_refresh_frames = 0;  // >0: no periodic I-frames; a band of intra MB columns sweeps the frame every N P-frames
+  int long_term_refs = 0;        // long-term reference slots (0-3; 0-2 with 3 temporal layers) kept for loss recovery (Encoder::report_loss)
+  int long_term_interval = 30;   // with long_term_refs: a T0 frame every N frames is also stored as a long-term reference
+  int temporal_layers = 1;       // 1-3: hierarchical-P layers T0/T1/T2 (full, 1/2 and 1/4 frame rate operating points)
+  int scene_change_threshold = 40;  // 0-100: force an I-frame when low-res inter cost tops (100 - this)% of intra cost (0 = off)
+  int lookahead_frames = 0;    // 0-3: frames analyzed ahead of the one being coded for rate control (adds as many frames of latency; see Encoder::encode)
   int search_range = 16;       // ±pixels for motion search
   int qp_default = 28;         // default quantization parameter
   int qp_min = 18;
   int qp_max = 42;
   uint32_t target_bitrate_kbps = 500;
+  int vbv_buffer_ms = 250;     // rate control leaky bucket, in ms at the target bitrate (kept about half full)
+  bool constant_qp = false;    // code every frame at qp_default (no rate control)
+  uint32_t frame_byte_cap = 0;  // >0: MB-row rate control keeps each serialize_frame() record within this many bytes (e.g. N packets)
+  bool guaranteed_byte_cap = false;  // with frame_byte_cap: rows near the limit jump up to QP 51, MBs drop residual they cannot afford (turns wavefront off; ignored in rANS mode)
+  int max_downscale = 1;       // 1 (off), 2 or 4: rate control may code at width/N x height/N instead of overshooting at qp_max
   bool use_diamond_search = false;  // else full search
-  int early_termination_threshold = 0;  // 0 = disabled
+  int early_termination_threshold = 0;  // motion search stops at a candidate costing at most this (0 = disabled)
+  bool intra_split = true;     // intra MBs also try four 8x8 luma predictions
+  bool inter_intra = true;     // P-frame MBs with a residual left after motion search also try intra
+  SpeedPreset speed_preset = SpeedPreset::Slow;  // preset the search / mode fields match; adaptive_speed starts here
+  bool adaptive_speed = false;  // step between speed presets to keep encode time within frame_budget_ms
   int frame_budget_ms = 33;    // target ms per frame for real-time
+  QuantMatrixPreset quant_matrix = QuantMatrixPreset::Flat;
+  QuantMatrices custom_quant_matrices;  // used when quant_matrix == Custom
+  EntropyMode entropy_mode = EntropyMode::ExpGolomb;  // written as the file header version
+  int huffman_training_frames = 2;  // Huffman mode: P-frames after each I-frame whose symbols build the GOP's tables
+  int num_slices = 1;          // MB-row groups coded independently (clamped to the MB row count)
+  int slice_threads = 0;       // threads for slices / wavefront rows; 0 = hardware threads
+  bool wavefront = false;      // code MB rows as parallel substreams two MBs apart (see kFrameFlagWavefront)
+  bool deblock = true;         // in-loop deblocking filter on the reconstruction (signalled per frame)
 };
 
+/// Set the motion search and mode decision fields of config to preset (SpeedPreset).
+inline void apply_speed_preset(SpeedPreset preset, EncoderConfig* config) {
+  static const struct {
+    bool diamond;
+    int range;
+    int early_exit;
+    bool intra_split;
+    bool inter_intra;
+  } kSettings[kSpeedPresets] = {
+      {true, 4, 1024, false, false},  // ultrafast
+      {true, 8, 512, false, true},    // veryfast
+      {true, 8, 256, true, true},     // fast
+      {true, 16, 0, true, true},      // medium
+      {false, 16, 0, true, true},     // slow
+  };
+  const auto& s = kSettings[static_cast<int>(preset)];
+  config->use_diamond_search = s.diamond;
+  config->search_range = s.range;
+  config->early_termination_threshold = s.early_exit;
+  config->intra_split = s.intra_split;
+  config->inter_intra = s.inter_intra;
+  config->speed_preset = preset;
+}
+
 }  // namespace codec
 }  // namespace telehealth
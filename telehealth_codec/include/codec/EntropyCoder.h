@@ -1,7 +1,12 @@
 #pragma once
 
 #include "Bitstream.h"
+#include "EntropyMode.h"
+#include "HuffmanTable.h"
+#include "IntraPrediction.h"
 #include "MotionVector.h"
+#include "RangeCoder.h"
+#include "RansCoder.h"
 #include <cstdint>
 #include <vector>
 
@@ -11,20 +16,180 @@ namespace codec {
 /// Zigzag order for 8x8
 extern const int kZigzag8x8[64];
 
-/// Encode quantized coeffs: zigzag + RLE zeros + simple VLC (Huffman-like).
+/// Blocks per MB in the coded block pattern: bits 0-3 luma (raster), bit 4 U, bit 5 V.
+constexpr int kCbpBlocks = 6;
+/// Flag next to the CBP bits marking an intra MB of a P-frame (I-frame MBs are all intra).
+constexpr uint32_t kCbpIntraMb = 1u << kCbpBlocks;
+
+/// Encode quantized coeffs: zigzag + RLE zeros + fixed-width, Exp-Golomb or per-GOP Huffman
+/// codes, context-adaptive binary range coding, or interleaved rANS. Arithmetic and rANS
+/// modes are stateful: one instance per output stream, bracketed by begin_slice()/end_slice().
+/// Arithmetic mode resets its context models there; rANS mode buffers the slice's symbols
+/// and codes them at end_slice() (the decoder decodes them all at begin_slice()).
 class EntropyCoder {
  public:
-  EntropyCoder() = default;
+  /// MVD components with |d| <= kMvdCostRange are table lookups in mvd_cost().
+  static constexpr int kMvdCostRange = 128;
+  /// run_level_cost() table bounds: run < 64, |level| <= kLevelCostMax.
+  static constexpr int kLevelCostMax = 32;
+
+  explicit EntropyCoder(EntropyMode mode = EntropyMode::Fixed);
+
+  EntropyMode mode() const { return mode_; }
+
+  /// Start/end a slice on the writer (byte aligned). No-ops for the VLC modes; in rANS mode
+  /// nothing reaches the writer before end_slice().
+  void begin_slice(BitstreamWriter& out);
+  void end_slice(BitstreamWriter& out);
+  /// Start a slice on the reader; must match the encoder's begin_slice position.
+  void begin_slice(BitstreamReader& in);
+
+  /// Context models for arithmetic mode, reset at each slice start (or
+  /// taken from a ContextState).
+  struct BinContexts {
+    BinContext cbp[2][2];       // luma/chroma, then the previous CBP bin (carried across MBs)
+    BinContext sig[63];         // by scan position
+    BinContext last[63];
+    BinContext level_gt1[5];    // 0: a level > 1 already coded, else 1 + min(ones so far, 3)
+    BinContext level_abs[5];    // by min(levels > 1 so far, 4)
+    BinContext mv[2][7];        // per component, by prefix bin index
+    BinContext intra_mb;        // P-frame intra flag
+    BinContext intra_split;
+    BinContext intra_mode[2][3];  // luma/chroma: high bit, then low bit given the high bit
+    void reset();
+  };
+  /// Adaptive state a wavefront row starts from: the arithmetic-mode contexts and CBP
+  /// history of the row above after its second MB. The other modes keep no such state.
+  struct ContextState {
+    BinContexts ctx;
+    uint32_t prev_cbp = 0;
+  };
+  ContextState context_state() const { return ContextState{ctx_, prev_cbp_}; }
+  /// begin_slice() continuing from state instead of the initial contexts.
+  void begin_slice(BitstreamWriter& out, const ContextState& state);
+  void begin_slice(BitstreamReader& in, const ContextState& state);
+
+  /// Huffman mode: tables for the coming frames (owned by the caller; nullptr while training).
+  /// Without tables the Exp-Golomb syntax is written and the symbols the Huffman syntax
+  /// would use are counted into huffman_stats(). Rebuilds the cost tables.
+  void set_huffman_tables(const HuffmanTables* tables);
+  const HuffmanTables* huffman_tables() const { return huffman_; }
+  const HuffmanStats& huffman_stats() const { return huffman_stats_; }
+  void reset_huffman_stats() { huffman_stats_.reset(); }
+
+  /// Any nonzero coefficient, i.e. the block's CBP bit.
+  static bool is_coded(const int32_t* coeff);
+
+  /// Coded block pattern for one MB, sent before its coded blocks. Fixed: 6 bits;
+  /// Exp-Golomb: ue(cbp); Huffman: one symbol; arithmetic: one bin per block, context from
+  /// luma/chroma and the previous bin; rANS: one symbol of the Huffman-mode CBP alphabet.
+  /// In P-frames (p_frame) the pattern also carries kCbpIntraMb: fixed mode sends it as a
+  /// seventh bit and arithmetic mode as a leading bin; the other modes send an escape
+  /// (ue(64) or kHuffmanCbpIntra) before the pattern of intra MBs only.
+  void encode_cbp(uint32_t cbp, BitstreamWriter& out, bool p_frame = false);
+  uint32_t decode_cbp(BitstreamReader& in, bool p_frame = false);
 
+  /// Prediction modes of an intra MB, after its CBP: split flag, 2 bits per luma mode (one,
+  /// or four when split), 2 bits for the chroma mode. Raw bits in the VLC modes (rANS: side
+  /// bits); context-coded bins in arithmetic mode.
+  void encode_intra_modes(const IntraMbModes& modes, BitstreamWriter& out);
+  IntraMbModes decode_intra_modes(BitstreamReader& in);
+
+  /// Zigzag run/level pairs of a block whose CBP bit is set (absent blocks send nothing).
+  /// Fixed mode ends the pairs with an end-of-block run code unless the last coefficient is
+  /// at scan position 63; Exp-Golomb mode sends ue(nonzero count - 1) first and then
+  /// ue(run), ue(|level| - 1) and a sign bit per coefficient. Arithmetic mode codes a
+  /// significance/last map followed by the levels in reverse scan order. Huffman mode sends
+  /// one (run class, level class) symbol per coefficient plus escapes and a sign bit, then
+  /// end-of-block unless the last coefficient is at scan position 63. rANS mode codes the
+  /// same symbols against per-slice frequencies, with the escapes and signs as side bits.
   void encode_block_8x8(const int32_t* coeff, int qp, BitstreamWriter& out);
   void decode_block_8x8(BitstreamReader& in, int qp, int32_t* coeff_out);
 
-  void encode_mv(MotionVector mv, BitstreamWriter& out);
-  MotionVector decode_mv(BitstreamReader& in);
+  /// Codes the difference mv - pred (pred from predict_mv); decode_mv adds pred back.
+  void encode_mv(MotionVector mv, MotionVector pred, BitstreamWriter& out);
+  MotionVector decode_mv(BitstreamReader& in, MotionVector pred);
+
+  /// MB-row QP change (kFrameQpRowDeltas), -63..63: se(delta) in the VLC modes (rANS: side
+  /// bits), seven bypass bins of delta + 64 in arithmetic mode.
+  void encode_qp_delta(int delta, BitstreamWriter& out);
+  int decode_qp_delta(BitstreamReader& in);
 
-  /// Encode full MB: 4x 8x8 blocks (luma 16x16) + 2x 8x8 chroma
+  /// Bits the slice on out has cost so far: the bits written plus those the coder still holds
+  /// (arithmetic mode: the pending interval and its flush; rANS mode: the side bits and an
+  /// estimate of the buffered symbols and frequency tables, as nothing is written before
+  /// end_slice()).
+  size_t coded_bits(const BitstreamWriter& out) const;
+
+  /// Encode full MB: 4x 8x8 blocks (luma 16x16) + 2x 8x8 chroma; mv is coded without prediction
   void encode_mb(const int32_t* coeff_y, const int32_t* coeff_u, const int32_t* coeff_v,
                  const MotionVector* mv, bool is_p_frame, int qp, BitstreamWriter& out);
+
+  /// Rate estimates in 1/16 bit (kBitCostShift) for RD decisions. They never write bits or
+  /// change coder state. VLC modes are exact, except that Huffman mode keeps pricing MVDs as
+  /// Exp-Golomb: its MVD table was trained on MVs chosen under those prices, and pricing with
+  /// the table itself drifts motion search toward MVDs that cost more than they save.
+  /// Arithmetic mode prices bins with the current context probabilities; its MVD table is a
+  /// snapshot taken by refresh_costs(). rANS frequencies are only known at the end of the
+  /// slice, so rANS mode prices everything as Exp-Golomb.
+  uint32_t mvd_cost(int dx, int dy) const {
+    return mvd_component_cost(0, dx) + mvd_component_cost(1, dy);
+  }
+  /// Most an MVD with components within +-range costs as written (Huffman mode prices its
+  /// own table here), for budgets that must hold whatever motion search picks.
+  uint32_t mvd_cost_bound(int range) const;
+  /// One (run, level) pair of the VLC syntax; arithmetic mode uses the Exp-Golomb pair cost.
+  uint32_t run_level_cost(int run, int level) const;
+  uint32_t cbp_cost(uint32_t cbp, bool p_frame = false) const;
+  uint32_t intra_modes_cost(const IntraMbModes& modes) const;
+  /// One encode_qp_delta().
+  uint32_t qp_delta_cost(int delta) const;
+  /// Whole block as encode_block_8x8 would code it (block must be coded).
+  uint32_t block_cost(const int32_t* coeff) const;
+  /// Re-snapshot the arithmetic-mode MVD costs from the adapted contexts (no-op for VLC modes).
+  void refresh_costs();
+
+ private:
+  /// VLC syntax written and priced: Huffman mode falls back to Exp-Golomb until it has
+  /// tables, and rANS mode (which writes its own syntax) prices as Exp-Golomb.
+  EntropyMode syntax() const {
+    if (mode_ == EntropyMode::Rans || (mode_ == EntropyMode::Huffman && !huffman_)) return EntropyMode::ExpGolomb;
+    return mode_;
+  }
+  EntropyMode mvd_price_syntax() const {
+    return mode_ == EntropyMode::Huffman ? EntropyMode::ExpGolomb : syntax();
+  }
+  /// Run/level and MVD cost tables of the VLC syntaxes.
+  void build_vlc_costs();
+
+  void decode_block_arithmetic(BitstreamReader& in, int32_t* coeff_out);
+  void end_rans_slice(BitstreamWriter& out);
+  void begin_rans_slice(BitstreamReader& in);
+  int decode_mv_component(BinContext* ctx, BitstreamReader& in);
+
+  uint32_t mvd_component_cost(int comp, int d) const {
+    int a = d < 0 ? -d : d;
+    if (a > kMvdCostRange) return mvd_cost_far(comp, d);
+    return mvd_cost_[static_cast<size_t>(comp * (2 * kMvdCostRange + 1) + d + kMvdCostRange)];
+  }
+  uint32_t mvd_cost_far(int comp, int d) const;
+
+  EntropyMode mode_;
+  std::vector<uint16_t> mvd_cost_;         // [component][d + kMvdCostRange]
+  std::vector<uint16_t> run_level_cost_;   // [run][|level| - 1], VLC modes
+  BinContexts ctx_;
+  uint32_t prev_cbp_ = 0;
+  const HuffmanTables* huffman_ = nullptr;
+  HuffmanStats huffman_stats_;
+  /// rANS mode: the slice's symbols per alphabet (pair, CBP, MVD) with their escape and sign
+  /// bits in rans_side_; the decoder fills rans_symbols_ at begin_slice().
+  static constexpr int kRansAlphabets = 3;
+  std::vector<uint8_t> rans_symbols_[kRansAlphabets];
+  size_t rans_pos_[kRansAlphabets] = {};
+  BitstreamWriter rans_side_;
+  std::vector<uint8_t> rans_stream_;
+  RangeEncoder rc_enc_;
+  RangeDecoder rc_dec_;
 };
 
 }  // namespace codec
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Coefficient/MV syntax; selected by BitstreamFileHeader::version.
+enum class EntropyMode : uint8_t {
+  Fixed = 0,      // version 1: 4-bit runs, 12-bit levels, raw 16-bit MV components
+  ExpGolomb = 1,  // version 2: ue/se Exp-Golomb runs, levels and MV components
+  Arithmetic = 2, // version 3: context-adaptive binary range coding
+  Huffman = 3,    // version 4: canonical Huffman tables trained and sent once per GOP
+  Rans = 4,       // version 5: interleaved rANS with per-slice frequency tables
+};
+
+constexpr uint16_t bitstream_version(EntropyMode mode) {
+  return static_cast<uint16_t>(static_cast<int>(mode) + 1);
+}
+
+inline const char* entropy_mode_name(EntropyMode mode) {
+  switch (mode) {
+    case EntropyMode::Fixed: return "fixed";
+    case EntropyMode::ExpGolomb: return "exp-golomb";
+    case EntropyMode::Arithmetic: return "arithmetic";
+    case EntropyMode::Huffman: return "huffman";
+    case EntropyMode::Rans: return "rans";
+  }
+  return "unknown";
+}
+
+/// Mode for a file header version; false if the version is unknown.
+inline bool entropy_mode_for_version(uint16_t version, EntropyMode* mode) {
+  if (version < 1 || version > 5) return false;
+  *mode = static_cast<EntropyMode>(version - 1);
+  return true;
+}
+
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Bitstream.h"
+#include <cstdint>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+/// Canonical Huffman code over a small alphabet, length-limited to kMaxLength bits so that a
+/// single peek of kMaxLength bits decodes any symbol. Codes are stored bit-reversed for the
+/// LSB-first stream: encoding is one table read plus one write_bits().
+class HuffmanCode {
+ public:
+  static constexpr int kMaxLength = 12;
+
+  /// Build from symbol counts. Every symbol gets a code (counts are offset by one), so
+  /// symbols unseen while counting stay codable.
+  void build(const uint32_t* counts, int num_symbols);
+  /// Install code lengths (1..kMaxLength each); false unless they form a complete prefix code.
+  bool set_lengths(const uint8_t* lengths, int num_symbols);
+
+  int num_symbols() const { return static_cast<int>(lengths_.size()); }
+  int length(int symbol) const { return lengths_[static_cast<size_t>(symbol)]; }
+
+  template <class Writer>
+  void write(Writer& out, int symbol) const {
+    out.write_bits(codes_[static_cast<size_t>(symbol)], lengths_[static_cast<size_t>(symbol)]);
+  }
+  int read(BitstreamReader& in) const {
+    uint16_t e = lookup_[in.peek_bits(kMaxLength)];
+    in.skip_bits(e & 0xF);
+    return e >> 4;
+  }
+
+  /// Lengths as 4-bit fields in symbol order (the alphabet size is implied by the syntax).
+  void write_lengths(BitstreamWriter& out) const;
+  bool read_lengths(BitstreamReader& in, int num_symbols);
+
+ private:
+  std::vector<uint8_t> lengths_;
+  std::vector<uint16_t> codes_;   // bit-reversed canonical codes
+  std::vector<uint16_t> lookup_;  // [next kMaxLength bits] -> symbol << 4 | length
+};
+
+/// Huffman-mode alphabets. Coefficient pairs join a run class (runs >= 15 escape to
+/// ue(run - 15)) with a level class (|level| >= 8 escapes to ue(|level| - 8)); the last
+/// symbol is end-of-block. CBP symbols are the pattern, plus an escape marking an intra MB in
+/// a P-frame (its pattern follows as a second symbol). MVD components are se-mapped values,
+/// 32 and above escaping to ue.
+constexpr int kHuffmanRunClasses = 16;
+constexpr int kHuffmanLevelClasses = 8;
+constexpr int kHuffmanPairSymbols = kHuffmanRunClasses * kHuffmanLevelClasses + 1;
+constexpr int kHuffmanEndOfBlock = kHuffmanPairSymbols - 1;
+constexpr int kHuffmanCbpSymbols = 65;
+constexpr int kHuffmanCbpIntra = kHuffmanCbpSymbols - 1;
+constexpr int kHuffmanMvdSymbols = 33;
+
+/// Table set of one GOP in Huffman mode, sent in the first frame that uses it.
+struct HuffmanTables {
+  HuffmanCode pair;
+  HuffmanCode cbp;
+  HuffmanCode mvd;
+
+  void write(BitstreamWriter& out) const;
+  bool read(BitstreamReader& in);
+};
+
+/// Symbol counts gathered over the training frames of a GOP.
+struct HuffmanStats {
+  uint32_t pair[kHuffmanPairSymbols];
+  uint32_t cbp[kHuffmanCbpSymbols];
+  uint32_t mvd[kHuffmanMvdSymbols];
+
+  HuffmanStats() { reset(); }
+  void reset();
+  void add(const HuffmanStats& other);
+  void build(HuffmanTables* out) const;
+};
+
+}  // namespace codec
+}  // namespace telehealth
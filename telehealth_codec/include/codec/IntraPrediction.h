@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Simd.h"
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Spatial prediction modes for 16x16 and 8x8 blocks (H.264 Intra_16x16 / chroma numbering
+/// aside, the predictions are the H.264 ones).
+enum class IntraMode : uint8_t { DC = 0, Horizontal = 1, Vertical = 2, Plane = 3 };
+constexpr int kIntraModes = 4;
+
+/// Prediction choices of one intra MB: one 16x16 luma mode, or one per 8x8 luma block
+/// (raster order, each predicted from the reconstruction of the blocks before it), and one
+/// mode shared by both chroma planes.
+struct IntraMbModes {
+  bool split = false;
+  IntraMode luma[4] = {IntraMode::DC, IntraMode::DC, IntraMode::DC, IntraMode::DC};
+  IntraMode chroma = IntraMode::DC;
+};
+
+/// Reconstructed samples around a size x size block. Sides that are unavailable (frame or
+/// slice edge) read as 128; samples past the right or bottom frame edge repeat the last one.
+struct IntraNeighbors {
+  uint8_t top[16];
+  uint8_t left[16];
+  uint8_t top_left = 128;
+  bool has_top = false;
+  bool has_left = false;
+
+  /// Gather from plane (plane_w x plane_h) for the block at (x, y). has_top / has_left say
+  /// whether the row above / column to the left may be used (the caller knows slice and
+  /// MB boundaries); the corner needs both.
+  void gather(const uint8_t* plane, int stride, int plane_w, int plane_h, int x, int y, int size,
+              bool top_ok, bool left_ok);
+};
+
+/// DC / horizontal / vertical / plane predictors and 8x8 SATD for mode decisions, with SSE2
+/// kernels for plane prediction and SATD picked at construction.
+///
+/// - DC: rounded mean of the available top and left samples (128 with neither).
+/// - Horizontal / vertical: repeat the left column / top row.
+/// - Plane: H.264 plane prediction (the 16x16 luma form, or the 8x8 chroma form for size 8).
+class IntraPredictor {
+ public:
+  /// Fastest kernels the CPU supports.
+  IntraPredictor();
+  /// Specific kernels; unavailable ones fall back to the best available below them.
+  explicit IntraPredictor(SimdLevel level);
+
+  SimdLevel level() const { return level_; }
+
+  /// size x size prediction (size 8 or 16) into dst.
+  void predict(IntraMode mode, const IntraNeighbors& nb, int size, uint8_t* dst, int dst_stride) const;
+  /// Sum of absolute 8x8 Hadamard coefficients of src - pred. A flat difference d scores
+  /// 64|d|, like its SAD.
+  uint32_t satd_8x8(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride) const;
+
+ private:
+  SimdLevel level_;
+};
+
+}  // namespace codec
+}  // namespace telehealth
@@ -21,6 +21,13 @@ class MotionCompensation {
                      BlockCoord pos,
                      MotionVector mv) const;
 
+  /// Chroma prediction of one MB: 8x8 (clipped at the frame edge) per plane at half the
+  /// luma MV, truncated toward zero as in predict_frame.
+  void predict_chroma_block(BlockView pred_u, BlockView pred_v,
+                            const FrameYUV& ref_frame,
+                            BlockCoord pos,
+                            MotionVector mv) const;
+
   /// Build full predicted frame from ref and MV array (one MV per macroblock).
   void predict_frame(FrameYUV& pred_frame,
                      const FrameYUV& ref_frame,
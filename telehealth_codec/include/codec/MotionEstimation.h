@@ -4,36 +4,62 @@
 #include "Frame.h"
 #include "MotionVector.h"
 #include "EncoderConfig.h"
+#include <climits>
 #include <cstdint>
 
 namespace telehealth {
 namespace codec {
 
+class EntropyCoder;
+
 class MotionEstimation {
  public:
   explicit MotionEstimation(const EncoderConfig& config);
 
-  /// Full search: find best MV in [−range, +range] using SAD.
+  /// Full search: find best MV in [−range, +range] minimizing SAD + lambda * MVD bits,
+  /// with the MVD taken against pred (see predict_mv). lambda = 0 is plain SAD. MVD bits come
+  /// from rate->mvd_cost() when given, else from the Exp-Golomb length (mvd_bits).
+  /// Candidates that read luma columns right of max_ref_x are skipped (intra refresh keeps
+  /// refreshed MBs on refreshed samples); the cost is 0xFFFFFFFF when none is left.
+  /// With an early_termination_threshold, (0, 0) and pred are tried first and the search
+  /// stops there if the better of them costs at most the threshold.
   MotionResult estimate(const BlockViewConst& cur_block,
                         const FrameYUV& ref_frame,
-                        BlockCoord pos) const;
+                        BlockCoord pos,
+                        MotionVector pred = MotionVector(), int lambda = 0,
+                        const EntropyCoder* rate = nullptr,
+                        int max_ref_x = INT_MAX) const;
   MotionResult estimate(const BlockViewConst& cur_block,
                         const Frame& ref_frame,
-                        BlockCoord pos) const;
+                        BlockCoord pos,
+                        MotionVector pred = MotionVector(), int lambda = 0,
+                        const EntropyCoder* rate = nullptr,
+                        int max_ref_x = INT_MAX) const;
 
-  /// Diamond search (faster, optional).
+  /// Diamond search (faster, optional). Starts from the better of (0, 0) and pred; stops
+  /// refining once the best cost is at most early_termination_threshold.
   MotionResult estimate_diamond(const BlockViewConst& cur_block,
                                 const FrameYUV& ref_frame,
-                                BlockCoord pos) const;
+                                BlockCoord pos,
+                                MotionVector pred = MotionVector(), int lambda = 0,
+                                const EntropyCoder* rate = nullptr,
+                                int max_ref_x = INT_MAX) const;
   MotionResult estimate_diamond(const BlockViewConst& cur_block,
                                 const Frame& ref_frame,
-                                BlockCoord pos) const;
+                                BlockCoord pos,
+                                MotionVector pred = MotionVector(), int lambda = 0,
+                                const EntropyCoder* rate = nullptr,
+                                int max_ref_x = INT_MAX) const;
 
   uint32_t sad_block(const BlockViewConst& cur, const BlockViewConst& ref) const;
   int search_range() const { return config_.search_range; }
 
+  /// SAD-domain Lagrange multiplier for MV rate at qp (sqrt(0.85 * 2^((qp - 12) / 3))).
+  static int lambda_for_qp(int qp);
+
  private:
   EncoderConfig config_;
+  static uint32_t rd_cost(uint32_t sad, MotionVector mv, MotionVector pred, int lambda, const EntropyCoder* rate);
   bool in_bounds(const FrameYUV& frame, int x, int y, int w, int h) const;
   bool in_bounds(const Frame& frame, int x, int y, int w, int h) const;
 };
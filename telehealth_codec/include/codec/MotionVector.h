@@ -20,5 +20,37 @@ struct MotionResult {
   uint32_t cost = 0;  // SAD or similar
 };
 
+inline int median3(int a, int b, int c) {
+  return a > b ? (b > c ? b : (a > c ? c : a)) : (a > c ? a : (b > c ? c : b));
+}
+
+/// Median MV predictor for MB (mb_x, mb_y) from an MB-raster MV field in which every MB
+/// before it in raster order is already coded. Neighbours are left (A), top (B) and top-right
+/// (C, or top-left when C is outside the frame); in the first row of the frame or of the
+/// MB's slice (slice_first_row) the predictor is A, so slices never predict across.
+/// Shared by the encoder, the decoder and rate-constrained motion search.
+inline MotionVector predict_mv(const MotionVector* field, int mb_cols, int mb_x, int mb_y,
+                               int slice_first_row = 0) {
+  MotionVector a = mb_x > 0 ? field[mb_y * mb_cols + mb_x - 1] : MotionVector();
+  if (mb_y <= slice_first_row) return a;
+  const MotionVector* above = field + (mb_y - 1) * mb_cols;
+  MotionVector b = above[mb_x];
+  MotionVector c = mb_x + 1 < mb_cols ? above[mb_x + 1] : (mb_x > 0 ? above[mb_x - 1] : MotionVector());
+  return MotionVector(static_cast<int16_t>(median3(a.dx, b.dx, c.dx)),
+                      static_cast<int16_t>(median3(a.dy, b.dy, c.dy)));
+}
+
+/// Approximate bits for one MVD component: the signed Exp-Golomb code length.
+inline int mvd_component_bits(int d) {
+  unsigned k = d > 0 ? 2u * static_cast<unsigned>(d) : 2u * static_cast<unsigned>(-d) + 1u;  // se index + 1
+  int len = 0;
+  while (k) { k >>= 1; ++len; }
+  return 2 * len - 1;
+}
+
+inline int mvd_bits(MotionVector mv, MotionVector pred) {
+  return mvd_component_bits(mv.dx - pred.dx) + mvd_component_bits(mv.dy - pred.dy);
+}
+
 }  // namespace codec
 }  // namespace telehealth
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Which quantization matrix applies to an 8x8 block.
+enum class QuantMatrixKind : uint8_t { IntraLuma = 0, InterLuma = 1, IntraChroma = 2, InterChroma = 3 };
+constexpr int kNumQuantMatrices = 4;
+
+/// Matrix set signalled in BitstreamFileHeader::quant_matrix.
+enum class QuantMatrixPreset : uint8_t {
+  Flat = 0,        // every frequency uses the QP scale unchanged
+  Perceptual = 1,  // coarser steps for the finer Haar bands, chroma coarser than luma
+  Custom = 2,      // QuantMatrices follow the file header
+};
+
+/// Per-frequency weights (raster order, 16 = unit weight) for each QuantMatrixKind.
+struct QuantMatrices {
+  uint8_t weights[kNumQuantMatrices][64];
+
+  QuantMatrices();  // flat
+  static QuantMatrices from_preset(QuantMatrixPreset preset);
+  const uint8_t* matrix(QuantMatrixKind kind) const { return weights[static_cast<int>(kind)]; }
+};
+
+}  // namespace codec
+}  // namespace telehealth
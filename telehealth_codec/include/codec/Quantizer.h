@@ -1,21 +1,50 @@
 #pragma once
 
+#include "QuantMatrix.h"
 #include <cstdint>
+#include <vector>
 
 namespace telehealth {
 namespace codec {
 
-/// Quantize/dequantize with QP. Simple scale-based for MVP.
+/// Quantize/dequantize with QP and per-frequency matrices. All step sizes are precomputed
+/// per (qp, matrix) at construction, so a weighted block costs the same as a flat one.
 class Quantizer {
  public:
-  Quantizer() = default;
+  static constexpr int kMaxQp = 51;
+
+  Quantizer();
+  explicit Quantizer(const QuantMatrices& matrices);
 
   /// Quantize 8x8 coeffs in place (int32 -> int16 or int32 with scale)
-  void quantize_8x8(int32_t* coeff, int qp);
-  void dequantize_8x8(const int32_t* coeff_in, int32_t* coeff_out, int qp);
+  void quantize_8x8(int32_t* coeff, int qp, QuantMatrixKind kind);
+  void dequantize_8x8(const int32_t* coeff_in, int32_t* coeff_out, int qp, QuantMatrixKind kind) const;
 
   /// QP to scale factor (simplified)
   static int qp_to_scale(int qp);
+
+  /// Largest 8x8 residual SAD that is guaranteed to quantize to an all-zero block at qp.
+  /// Every basis entry of the forward transform is in {-1, 0, 1} and the output is >> 3,
+  /// so |coeff| <= ceil(SAD / 8); a coefficient rounds to zero while |coeff| < ceil(step / 2),
+  /// checked against the smallest step in the block's matrix.
+  uint32_t zero_block_sad_threshold(int qp, QuantMatrixKind kind) const {
+    return zero_threshold_[table_index(qp, kind)];
+  }
+
+  const QuantMatrices& matrices() const { return matrices_; }
+
+ private:
+  static int table_index(int qp, QuantMatrixKind kind) {
+    int q = qp < 0 ? 0 : (qp > kMaxQp ? kMaxQp : qp);
+    return q * kNumQuantMatrices + static_cast<int>(kind);
+  }
+  const int32_t* steps(int qp, QuantMatrixKind kind) const {
+    return step_table_.data() + table_index(qp, kind) * 64;
+  }
+
+  QuantMatrices matrices_;
+  std::vector<int32_t> step_table_;       // [qp][kind][64] step sizes
+  std::vector<uint32_t> zero_threshold_;  // [qp][kind]
 };
 
 }  // namespace codec
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Bitstream.h"
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Adaptive probability that the next bin is 0, in units of 1/2048.
+using BinContext = uint16_t;
+constexpr int kBinProbBits = 11;
+constexpr BinContext kBinProbInit = 1 << (kBinProbBits - 1);
+constexpr int kBinAdaptShift = 5;
+
+/// -log2(p) in 1/16 bit (kBitCostShift) for p = (i + 0.5) / 128.
+extern const uint16_t kBinCostTable[128];
+
+/// Estimated cost of coding bin with ctx, in 1/16 bit; does not adapt ctx.
+inline uint32_t bin_cost(BinContext ctx, int bin) {
+  uint32_t p = bin ? (1u << kBinProbBits) - ctx : ctx;
+  return kBinCostTable[p >> (kBinProbBits - 7)];
+}
+
+/// Binary range encoder (LZMA-style carry propagation). Renormalizes a whole byte per step,
+/// so each coded bin costs one multiply and at most two byte shifts. Bytes go to the
+/// writer through write_byte(), so the writer must be byte aligned between begin() and finish().
+class RangeEncoder {
+ public:
+  void begin();
+  void encode_bin(BinContext& ctx, int bin, BitstreamWriter& out);
+  /// Equiprobable bins (signs, Exp-Golomb suffixes); no context.
+  void encode_bypass(uint32_t value, int num_bits, BitstreamWriter& out);
+  /// Flush the final interval; afterwards the writer holds every byte of the slice.
+  void finish(BitstreamWriter& out);
+  /// Bytes not yet in the writer that finish() would add at most (carry chain plus interval).
+  size_t pending_bytes() const { return static_cast<size_t>(cache_size_) + 4; }
+
+ private:
+  static constexpr uint32_t kTop = 1u << 24;
+  void shift_low(BitstreamWriter& out);
+
+  uint64_t low_ = 0;
+  uint32_t range_ = 0xFFFFFFFFu;
+  uint8_t cache_ = 0;
+  uint64_t cache_size_ = 1;
+};
+
+class RangeDecoder {
+ public:
+  /// Reads the 5 start bytes of a slice.
+  void begin(BitstreamReader& in);
+  int decode_bin(BinContext& ctx, BitstreamReader& in);
+  uint32_t decode_bypass(int num_bits, BitstreamReader& in);
+
+ private:
+  static constexpr uint32_t kTop = 1u << 24;
+
+  uint32_t range_ = 0xFFFFFFFFu;
+  uint32_t code_ = 0;
+};
+
+inline void RangeEncoder::encode_bin(BinContext& ctx, int bin, BitstreamWriter& out) {
+  uint32_t bound = (range_ >> kBinProbBits) * ctx;
+  if (bin == 0) {
+    range_ = bound;
+    ctx = static_cast<BinContext>(ctx + (((1 << kBinProbBits) - ctx) >> kBinAdaptShift));
+  } else {
+    low_ += bound;
+    range_ -= bound;
+    ctx = static_cast<BinContext>(ctx - (ctx >> kBinAdaptShift));
+  }
+  while (range_ < kTop) {
+    range_ <<= 8;
+    shift_low(out);
+  }
+}
+
+inline int RangeDecoder::decode_bin(BinContext& ctx, BitstreamReader& in) {
+  uint32_t bound = (range_ >> kBinProbBits) * ctx;
+  int bin;
+  if (code_ < bound) {
+    range_ = bound;
+    ctx = static_cast<BinContext>(ctx + (((1 << kBinProbBits) - ctx) >> kBinAdaptShift));
+    bin = 0;
+  } else {
+    code_ -= bound;
+    range_ -= bound;
+    ctx = static_cast<BinContext>(ctx - (ctx >> kBinAdaptShift));
+    bin = 1;
+  }
+  while (range_ < kTop) {
+    range_ <<= 8;
+    code_ = (code_ << 8) | in.read_byte();
+  }
+  return bin;
+}
+
+}  // namespace codec
+}  // namespace telehealth
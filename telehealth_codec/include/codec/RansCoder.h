@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Bitstream.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+/// Interleaved rANS lanes: symbol i of a stream is coded by state i % kRansLanes.
+constexpr int kRansLanes = 4;
+/// Largest frequency-table total, 1 << kRansMaxProbBits.
+constexpr int kRansMaxProbBits = 12;
+
+/// Static symbol frequencies of one alphabet for one slice, normalized to 1 << prob_bits().
+/// Only symbols that occur get a nonzero frequency; small slices use a smaller total so the
+/// table costs fewer bits to send.
+class RansTable {
+ public:
+  /// Normalize exact counts (at least one nonzero).
+  void build(const uint32_t* counts, int num_symbols);
+  /// 4-bit prob_bits, then ue(freq) per symbol.
+  void write(BitstreamWriter& out) const;
+  /// False if the frequencies do not sum to the total.
+  bool read(BitstreamReader& in, int num_symbols);
+
+  int prob_bits() const { return prob_bits_; }
+  uint32_t freq(int symbol) const { return freq_[static_cast<size_t>(symbol)]; }
+  uint32_t start(int symbol) const { return start_[static_cast<size_t>(symbol)]; }
+  /// [slot] -> symbol << 24 | (freq - 1) << 12 | start, for slot < 1 << prob_bits().
+  const uint32_t* slots() const { return slots_.data(); }
+
+ private:
+  void finish();
+
+  int prob_bits_ = 0;
+  std::vector<uint32_t> freq_;
+  std::vector<uint32_t> start_;
+  std::vector<uint32_t> slots_;
+};
+
+/// Encode symbols with kRansLanes interleaved 32-bit rANS states (16-bit renormalization).
+/// Appends the final states (4 bytes each, little-endian) followed by the 16-bit words in
+/// decoder order.
+void rans_encode(const uint8_t* symbols, size_t count, const RansTable& table, std::vector<uint8_t>* out);
+
+/// Decode count symbols from data (as produced by rans_encode). The lanes advance in lockstep
+/// over one shared table and read renormalization words in lane order, so the inner loop
+/// has kRansLanes independent dependency chains (and maps directly to SIMD gathers).
+/// False if the stream is truncated.
+bool rans_decode(const uint8_t* data, size_t size, const RansTable& table, uint8_t* symbols, size_t count);
+
+}  // namespace codec
+}  // namespace telehealth
@@ -2,6 +2,7 @@
 
 #include "EncoderConfig.h"
 #include "Bitstream.h"
+#include "SceneChange.h"
 #include <cstdint>
 
 namespace telehealth {
@@ -10,25 +11,122 @@ namespace codec {
 struct FrameStats {
   uint32_t frame_id = 0;
   uint32_t bits_used = 0;
-  double sad_sum = 0;   // sum of SADs (scene activity)
+  double sad_sum = 0;   // sum of P-frame motion search costs (SAD + MV rate; 0 for I-frames)
   bool force_keyframe = false;
+  bool scene_change = false;  // SceneChangeDetector started a new scene (coded as an I-frame)
+  int qp = 0;                 // QP the frame was coded with (its first MB row's, with frame_byte_cap)
+  int max_row_qp = 0;         // highest MB-row QP (above qp when frame_byte_cap raised rows)
+  int dropped_mbs = 0;        // guaranteed_byte_cap: MBs coded without residual to stay within the cap
+  double vbv_fullness = 0;    // RateControl buffer fullness after the frame (0-1)
+  double encode_ms = 0;  // wall time Encoder::encode() spent on the frame
+  SpeedPreset preset = SpeedPreset::Slow;  // speed preset the frame was coded with
 };
 
+/// Predictive rate control: frame_qp() picks each frame's QP before it is coded, update()
+/// feeds back the bits it took.
+///
+/// Rate model: per frame type, bits ~ K * c * pixels / qstep(qp), with qstep ~ 2^(qp / 6) (the
+/// Quantizer's scale), c the frame's complexity from its FrameComplexity (1 + thumbnail motion
+/// cost per sample for P-frames, 1 + mean luma gradient for I-frames; 1 when no analysis is
+/// passed) and K a running average over the last coded frames of that type. The bit target comes from a leaky bucket
+/// (VBV) that fills with each frame and drains at the target bitrate: P-frames get a frame
+/// interval's worth, I-frames four of those, both corrected towards a half-full buffer and
+/// capped at the space left in it, so the queue in front of the network (and the latency it
+/// adds) stays near vbv_buffer_ms / 2. With lookahead (EncoderConfig::lookahead_frames), a
+/// scene cut or a motion burst among the upcoming frames lowers that set point to a quarter,
+/// reached by the frames before it, so the expensive one finds room. With frame_byte_cap the
+/// target stays below 85% of the cap; RowRateControl keeps each frame under the cap itself.
 class RateControl {
  public:
   explicit RateControl(const EncoderConfig& config);
 
-  int choose_qp(const FrameStats& stats);
+  /// QP for the next frame, of type ftype and pixels luma samples (qp_default with
+  /// constant_qp or for the first frame; the first P-frame, and the first after a scene cut,
+  /// is estimated from the I-frame model). frames, when given, holds count analyses: the
+  /// frame's own, then those of the frames queued behind it.
+  int frame_qp(FrameType ftype, int pixels, const FrameComplexity* frames = nullptr, int count = 0);
+  /// After coding the frame frame_qp() was asked for: stats.bits_used at qp updates the
+  /// model (normalized by complexity, the frame's analysis if any, and scaled up for
+  /// stats.dropped_mbs), the buffer and downscale().
+  void update(const FrameStats& stats, FrameType ftype, int qp, int pixels,
+              const FrameComplexity* complexity = nullptr);
   FrameType choose_frame_type(uint32_t frame_id, const FrameStats* previous) const;
 
+  /// New target bitrate; the buffer keeps its fullness and resizes to vbv_buffer_ms of it.
   void set_target_bitrate_kbps(uint32_t kbps) { target_kbps_ = kbps; }
 
+  /// A scene cut: the P-frame model and the over/under budget history describe the old scene,
+  /// so they start over (the I-frame model is still the best guess for the new scene's I-frame).
+  void reset_for_scene_change();
+
+  /// Dynamic resolution (config max_downscale > 1): the divisor of the source size frames
+  /// should be coded at (1, 2 or 4), updated by update(). It halves the size once frames
+  /// keep overshooting with QP already at qp_max, and doubles it back once they use so few
+  /// bits that four times the pixels would fit.
+  int downscale() const { return downscale_; }
+
+  /// VBV buffer: bits waiting to drain, capacity, and their ratio (0-1).
+  uint32_t buffer_bits() const { return static_cast<uint32_t>(buffer_bits_); }
+  uint32_t buffer_size() const;
+  double buffer_fullness() const;
+  /// Bit target behind the last frame_qp().
+  uint32_t frame_target_bits() const { return target_bits_; }
+
  private:
+  /// Bits per frame interval at the target bitrate.
+  double frame_bits() const;
+
+  /// Complexity K of one frame type (bits * qstep / (c * pixels)), averaged over its frames.
+  struct Model {
+    double complexity = 0;
+    int frames = 0;  // 0: no estimate yet
+  };
+
   EncoderConfig config_;
   uint32_t target_kbps_ = 500;
-  int current_qp_ = 28;
-  uint32_t window_bits_ = 0;
-  int frame_count_ = 0;
+  Model models_[2];           // indexed by FrameType (I, P)
+  int last_qp_[2] = {};       // last QP per frame type
+  double buffer_bits_ = 0;
+  uint32_t target_bits_ = 0;
+  int downscale_ = 1;
+  int over_budget_frames_ = 0;   // consecutive frames over budget at qp_max
+  int under_budget_frames_ = 0;  // consecutive frames that would fit at twice the size
+};
+
+/// MB-row rate control inside one substream, for EncoderConfig::frame_byte_cap. Before each
+/// row it picks the row's QP from what the substream has spent against its share of the cap,
+/// with RateControl's model (bits ~ K / qstep) fitted to the rows coded so far; rows never go
+/// below the frame QP, and may pass qp_max up to QP 51, since the cap outranks it. The normal
+/// mode moves at most 3 up or 1 down per row. The guaranteed mode plans on three quarters of
+/// what is left and jumps as far as that takes; the MB loop prices each MB's residual with
+/// the entropy coder and codes it only where fits() leaves room for the rest of the
+/// substream without residual. Bits are EntropyCoder::coded_bits() counts; rANS mode, where
+/// they are an estimate, only runs the normal mode.
+class RowRateControl {
+ public:
+  /// Start a substream of rows MB rows with budget_bits, at frame_qp.
+  void begin(double budget_bits, int rows, int frame_qp, bool guaranteed);
+  /// QP of the next row (the frame QP for the first); spent_bits: the substream's bits so far.
+  int next_row(size_t spent_bits);
+  /// Guaranteed mode: the next MB should not try to code residual, as the budget over the
+  /// reserve_bits kept for what follows it covers little more than the mb_bits a
+  /// residual-free MB may cost.
+  bool drop_residual(size_t spent_bits, double mb_bits, double reserve_bits) const;
+  /// Guaranteed mode: whether an MB costing mb_bits still leaves reserve_bits of the budget
+  /// (always true in the normal mode).
+  bool fits(size_t spent_bits, double mb_bits, double reserve_bits) const {
+    return !guaranteed_ || static_cast<double>(spent_bits) + mb_bits + reserve_bits <= budget_bits_;
+  }
+
+ private:
+  double budget_bits_ = 0;
+  int rows_ = 0;
+  int row_ = 0;  // rows started
+  int frame_qp_ = 0;
+  bool guaranteed_ = false;
+  int qp_ = 0;  // QP of the current row
+  size_t row_start_bits_ = 0;
+  double complexity_ = 0;  // K = row bits * qstep, averaged over the coded rows
 };
 
 }  // namespace codec
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Block.h"
+#include "Frame.h"
+#include "IntraPrediction.h"
+#include "MotionVector.h"
+#include "QuantMatrix.h"
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+class MotionCompensation;
+class Quantizer;
+class Transform;
+
+/// Inter prediction of one MB from ref at mv: luma 16x16 (stride MB_SIZE) at the integer MV,
+/// chroma 8x8 per plane (stride 8) at mv / 2. Only the part inside the frame is written.
+void predict_inter_macroblock(const MotionCompensation& mc, const FrameYUV& ref, BlockCoord coord,
+                              MotionVector mv, uint8_t* pred_y, uint8_t* pred_u, uint8_t* pred_v);
+
+/// Intra prediction of MB coord from the samples of recon around it; top_ok says whether the
+/// MB row above is in the same slice. Luma block b (0-3, raster) of a split MB also sees the
+/// blocks of the MB before it; b = -1 predicts the whole 16x16 luma block.
+void predict_intra_luma(const IntraPredictor& predictor, const FrameYUV& recon, BlockCoord coord, int b,
+                        bool top_ok, IntraMode mode, uint8_t* pred, int pred_stride);
+/// Both 8x8 chroma blocks of MB coord (stride 8).
+void predict_intra_chroma(const IntraPredictor& predictor, const FrameYUV& recon, BlockCoord coord,
+                          bool top_ok, IntraMode mode, uint8_t* pred_u, uint8_t* pred_v);
+
+/// One 8x8 block: pred (or zero when null) plus the dequantized residual when coded, clipped
+/// into dst (which may be smaller than 8x8 at frame edges).
+void reconstruct_block_8x8(const int32_t* coeff, bool coded, int qp, QuantMatrixKind kind,
+                           const uint8_t* pred, int pred_stride, BlockView dst,
+                           const Quantizer& quantizer, const Transform& transform);
+
+/// Rebuild one MB of recon from its quantized coefficients (kCbpBlocks * 64, luma blocks in
+/// raster order, then U, V). Blocks whose CBP bit is set are dequantized, inverse transformed
+/// and added to the prediction; the others copy it. The prediction pointers (layout as in
+/// predict_inter_macroblock) are null for MBs coded without prediction. Shared by the
+/// encoder's closed loop and the decoder, so both produce the same reference.
+void reconstruct_macroblock(FrameYUV& recon, BlockCoord coord, const int32_t* coeff, uint32_t cbp,
+                            int qp, bool intra, const uint8_t* pred_y, const uint8_t* pred_u,
+                            const uint8_t* pred_v, const Quantizer& quantizer, const Transform& transform);
+
+/// Rebuild an intra MB: predict with modes from the reconstructed neighbours (a split MB one
+/// 8x8 luma block at a time, in raster order) and add the coded residual. Encoder and
+/// decoder both finish intra MBs here.
+void reconstruct_intra_macroblock(FrameYUV& recon, BlockCoord coord, const int32_t* coeff, uint32_t cbp,
+                                  int qp, const IntraMbModes& modes, bool top_ok,
+                                  const IntraPredictor& predictor, const Quantizer& quantizer,
+                                  const Transform& transform);
+
+}  // namespace codec
+}  // namespace telehealth
@@ -22,5 +22,14 @@ void compute_residual_8x8(const uint8_t* cur, int cur_stride,
                           const uint8_t* pred, int pred_stride,
                           int16_t* residual_out);
 
+/// Reconstruct dst = clip(pred + residual) over w x h. pred may be null (blocks coded
+/// without prediction); residual is the inverse-transform output.
+void reconstruct_block(const int32_t* residual, int residual_stride,
+                       const uint8_t* pred, int pred_stride,
+                       uint8_t* dst, int dst_stride, int w, int h);
+
+/// Sum of absolute residual values over an 8x8 sub-block (cheap all-zero predictor).
+uint32_t residual_sad_8x8(const int16_t* residual, int stride);
+
 }  // namespace codec
 }  // namespace telehealth
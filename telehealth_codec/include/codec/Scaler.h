@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Frame.h"
+#include "Simd.h"
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Bilinear plane scaler for resolution switching: downscales the source in front of the
+/// encoder, and upscales decoded pictures back to the stream's display size.
+///
+/// Separable: each output row blends the two nearest source rows, then each output sample
+/// the two nearest samples of that row, with 6-bit weights at centre-aligned positions
+/// (`(i + 0.5) * src / dst - 0.5`, clamped to the plane). A 2:1 axis lands exactly between
+/// two samples, so halving is a rounded 2x2 average; SSE2 kernels cover the row blend and
+/// halving and match the scalar code bit for bit.
+class FrameScaler {
+ public:
+  /// Fastest kernels the CPU supports.
+  FrameScaler();
+  /// Specific kernels; unavailable ones fall back to the best available below them.
+  explicit FrameScaler(SimdLevel level);
+
+  SimdLevel level() const { return level_; }
+
+  /// Scale one plane (src_w x src_h) into dst (dst_w x dst_h).
+  void scale_plane(const uint8_t* src, int src_stride, int src_w, int src_h, uint8_t* dst, int dst_stride,
+                   int dst_w, int dst_h) const;
+  /// Scale all three planes into dst, which keeps its allocated size (4:2:0, chroma w/2 x h/2).
+  void scale(const FrameYUV& src, FrameYUV& dst) const;
+  void scale(const Frame& src, FrameYUV& dst) const;
+
+ private:
+  SimdLevel level_;
+};
+
+}  // namespace codec
+}  // namespace telehealth
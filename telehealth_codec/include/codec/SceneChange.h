@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+/// Low-resolution cost estimate of one source frame (SceneChangeDetector::analyze), used for
+/// scene cuts and by RateControl to scale its bit predictions.
+struct FrameComplexity {
+  uint32_t inter_cost = 0;  // summed thumbnail motion search SAD (the intra cost when there is no previous frame)
+  uint32_t intra_cost = 0;  // summed thumbnail SAD from each block's mean
+  uint32_t samples = 0;     // thumbnail samples the costs cover (0: frame too small to analyze)
+  uint32_t detail = 0;      // mean absolute luma gradient (horizontal + vertical), in 1/16 levels
+  bool scene_change = false;
+};
+
+/// Scene-cut detector run on each source frame ahead of the frame type decision.
+///
+/// Works on a 1/8-size luma thumbnail (8x8 block means). Each 4x4 thumbnail block (32x32
+/// source samples) gets a small motion search (+-2 thumbnail samples, +-16 source samples)
+/// against the previous frame's thumbnail, and an intra estimate (SAD from its own mean);
+/// the fine detail the thumbnail loses is measured as the mean full-size luma gradient.
+/// A frame whose summed inter cost exceeds (100 - threshold)% of its intra cost, and whose
+/// luma histogram has also moved by a fifth or more, is a new scene: prediction from the last
+/// frame would cost about as much as coding it afresh. The histogram check keeps fast motion
+/// and sharp detail moving by less than a thumbnail sample (which the coarse search cannot
+/// follow) from cutting.
+class SceneChangeDetector {
+ public:
+  /// threshold in percent, like EncoderConfig::scene_change_threshold (0 never reports a cut).
+  explicit SceneChangeDetector(int threshold);
+
+  /// Analyze the next source frame's luma; true if it starts a new scene. The first frame,
+  /// frames after a size change and frames within a few of the last cut (or of the first
+  /// frame) never do.
+  bool analyze(const uint8_t* y, int stride, int width, int height);
+
+  /// Costs and decision of the last analyze().
+  const FrameComplexity& complexity() const { return last_; }
+  uint32_t inter_cost() const { return last_.inter_cost; }
+  uint32_t intra_cost() const { return last_.intra_cost; }
+  /// Share of luma samples whose histogram bin changed in the last analyze(), in percent.
+  int histogram_change() const { return histogram_change_; }
+
+ private:
+  int threshold_;
+  int thumb_w_ = 0;
+  int thumb_h_ = 0;
+  std::vector<uint8_t> thumb_;       // current frame
+  std::vector<uint8_t> prev_thumb_;  // previous frame (empty until one is analyzed)
+  uint32_t histogram_[32] = {};      // luma in 8-level bins, current frame
+  uint32_t prev_histogram_[32] = {};
+  int frames_since_cut_ = 0;
+  FrameComplexity last_;
+  int histogram_change_ = 0;
+};
+
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace telehealth {
+namespace codec {
+
+/// Kernel sets of the codec's SIMD paths (deblocking, intra prediction). Every set produces
+/// output identical to Scalar, so the choice never changes the bitstream.
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+/// Whether this build and CPU can run level's kernels.
+bool simd_level_available(SimdLevel level);
+/// Highest available level not above max.
+SimdLevel best_simd_level(SimdLevel max = SimdLevel::Avx2);
+
+}  // namespace codec
+}  // namespace telehealth
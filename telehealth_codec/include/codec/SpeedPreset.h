@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace telehealth {
+namespace codec {
+
+/// Encoder effort levels, fastest first. Each fixes the motion search (algorithm, range,
+/// early termination) and which extra mode decisions run (8x8 intra partitions, intra for
+/// P-frame MBs); see apply_speed_preset(). None changes the bitstream syntax.
+enum class SpeedPreset : uint8_t {
+  Ultrafast = 0,  // diamond +-4, early exit, 16x16 intra only, no intra in P-frames
+  Veryfast = 1,   // diamond +-8, early exit, 16x16 intra only
+  Fast = 2,       // diamond +-8, early exit
+  Medium = 3,     // diamond +-16
+  Slow = 4,       // full search +-16 (the EncoderConfig defaults)
+};
+constexpr int kSpeedPresets = 5;
+
+inline const char* speed_preset_name(SpeedPreset preset) {
+  switch (preset) {
+    case SpeedPreset::Ultrafast: return "ultrafast";
+    case SpeedPreset::Veryfast: return "veryfast";
+    case SpeedPreset::Fast: return "fast";
+    case SpeedPreset::Medium: return "medium";
+    case SpeedPreset::Slow: return "slow";
+  }
+  return "unknown";
+}
+
+/// Preset for a speed_preset_name(); false if the name is unknown.
+inline bool speed_preset_for_name(const std::string& name, SpeedPreset* preset) {
+  for (int i = 0; i < kSpeedPresets; ++i)
+    if (name == speed_preset_name(static_cast<SpeedPreset>(i))) {
+      *preset = static_cast<SpeedPreset>(i);
+      return true;
+    }
+  return false;
+}
+
+}  // namespace codec
+}  // namespace telehealth
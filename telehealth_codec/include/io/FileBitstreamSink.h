@@ -1,6 +1,7 @@
 #pragma once
 
 #include <codec/Bitstream.h>
+#include <codec/QuantMatrix.h>
 #include <string>
 #include <cstdio>
 
@@ -14,6 +15,8 @@ class FileBitstreamSink {
   bool open(const std::string& path);
   void close();
   bool write_file_header(const codec::BitstreamFileHeader& h);
+  /// Header plus, for the Custom preset, the matrices the decoder needs.
+  bool write_file_header(const codec::BitstreamFileHeader& h, const codec::QuantMatrices& matrices);
   bool write_frame(const codec::BitstreamFrameHeader& h,
                    const uint8_t* mv_data, size_t mv_len,
                    const uint8_t* coeff_data, size_t coeff_len);
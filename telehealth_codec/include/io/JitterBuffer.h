@@ -16,6 +16,7 @@ class JitterBuffer {
   struct Config {
     int reassembly_timeout_ms = 100;
     uint32_t stream_id = 0;
+    int max_temporal_layer = 255;  // packets of higher temporal layers are dropped (thinning under congestion)
   };
 
   JitterBuffer();
@@ -25,6 +26,7 @@ class JitterBuffer {
     frame_ready_ = std::move(cb);
   }
   void tick(int elapsed_ms);
+  void set_max_temporal_layer(int layer) { config_.max_temporal_layer = layer; }
 
  private:
   struct IncompleteFrame {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -12,12 +13,32 @@ struct PacketHeader {
   uint32_t frame_id = 0;
   uint16_t packet_id = 0;
   uint16_t total_packets = 0;
+  uint8_t temporal_layer = 0;  // codec temporal layer of the frame: relays may drop higher layers
+  uint8_t reserved[3] = {};    // keeps timestamp_us 8-byte aligned, so the struct has no padding
   uint64_t timestamp_us = 0;
   uint32_t payload_size = 0;  // bytes in this packet
+  uint32_t reserved2 = 0;
 };
 
-constexpr size_t PACKET_HEADER_SIZE = 24;
+constexpr size_t PACKET_HEADER_SIZE = 32;
+static_assert(sizeof(PacketHeader) == PACKET_HEADER_SIZE, "PacketHeader is sent as raw bytes");
 constexpr size_t DEFAULT_MTU = 1200;
 
+/// Receiver -> sender feedback on the same UDP path. Ack: frame_id decoded intact (a
+/// long-term reference holding it can be recovered from). Loss: frame_id was the first frame
+/// that did not, so the sender should recover (codec::Encoder::report_loss).
+enum class FeedbackType : uint8_t { Ack = 0, Loss = 1 };
+
+struct FeedbackPacket {
+  uint32_t magic = 0x54434642;  // "TCFB"
+  uint32_t stream_id = 0;
+  uint32_t frame_id = 0;
+  uint8_t type = 0;  // FeedbackType
+  uint8_t reserved[3] = {};
+};
+
+constexpr size_t FEEDBACK_PACKET_SIZE = 16;
+static_assert(sizeof(FeedbackPacket) == FEEDBACK_PACKET_SIZE, "FeedbackPacket is sent as raw bytes");
+
 }  // namespace io
 }  // namespace telehealth
@@ -15,8 +15,14 @@ class UdpPacketSink {
   bool open(const std::string& host, uint16_t port);
   void close();
   bool send_packet(const uint8_t* payload, size_t payload_size, const PacketHeader& header);
+  /// Frames of a temporal layer above max_temporal_layer() are dropped here (returns true).
   bool send_frame(const std::vector<uint8_t>& frame_data, uint32_t frame_id, uint64_t timestamp_us,
-                  uint32_t stream_id = 0);
+                  uint32_t stream_id = 0, int temporal_layer = 0);
+  /// Congestion: send only temporal layers up to this one (0 = base layer, 1/4 rate with three layers).
+  void set_max_temporal_layer(int layer) { max_temporal_layer_ = layer; }
+  int max_temporal_layer() const { return max_temporal_layer_; }
+  /// Receiver feedback arriving on this socket; waits up to timeout_ms. False if none.
+  bool poll_feedback(FeedbackPacket* out, int timeout_ms = 0);
   bool is_open() const { return socket_ >= 0; }
 
  private:
@@ -24,6 +30,7 @@ class UdpPacketSink {
   std::string host_;
   uint16_t port_ = 0;
   size_t mtu_ = DEFAULT_MTU;
+  int max_temporal_layer_ = 255;
 };
 
 }  // namespace io
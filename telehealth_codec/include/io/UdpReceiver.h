@@ -19,11 +19,15 @@ class UdpReceiver {
   void close();
   void set_frame_callback(FrameCallback cb) { frame_callback_ = std::move(cb); }
   void poll(int timeout_ms = 10);
+  /// Send feedback to the address the last packet came from. False before any packet.
+  bool send_feedback(const FeedbackPacket& feedback);
   bool is_open() const { return socket_ >= 0; }
 
  private:
   int socket_ = -1;
   uint16_t port_ = 0;
+  uint32_t peer_addr_ = 0;  // sender of the last packet (network byte order)
+  uint16_t peer_port_ = 0;
   FrameCallback frame_callback_;
   std::vector<uint8_t> recv_buf_;
 };
@@ -4,10 +4,17 @@
 #include "Stage.h"
 #include "codec/Frame.h"
 #include "codec/Bitstream.h"
+#include "codec/RateControl.h"
+#include "codec/SceneChange.h"
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace telehealth {
+namespace codec {
+class Encoder;
+}  // namespace codec
+
 namespace pipeline {
 
 /// Item between capture and convert: refcounted RGB frame (shared across stages)
@@ -18,16 +25,22 @@ struct CaptureItem {
 /// Item between convert and encode: refcounted I420 frame (shared across stages)
 struct ConvertedItem {
   std::shared_ptr<codec::Frame> frame;
+  codec::FrameComplexity complexity;  // filled by the lookahead stage (when lookahead_frames > 0)
 };
 
 /// Item between encode and send: encoded frame
 struct EncodedItem {
   codec::EncodedFrame frame;
   codec::FrameMeta meta;
+  codec::FrameStats stats;  // QP, buffer fullness, encode time and speed preset of the frame
 };
 
-/// Pipeline: Capture -> Convert -> Encode -> Packetize/Send
-/// Uses bounded queues; drop oldest on overflow.
+/// Pipeline: Capture -> Convert -> [Lookahead] -> Encode -> Packetize/Send
+/// Uses bounded queues; drop oldest on overflow. Frames keep the size they were captured at;
+/// the encoder codes a size change (or its own downscale) as an I-frame. With lookahead_frames,
+/// a lookahead thread analyzes each converted frame (codec::SceneChangeDetector) and the
+/// encode stage holds that many frames back, so rate control sees them coming; a frame waits
+/// at most one queue timeout (100 ms) for the ones behind it when the source stalls.
 class Pipeline {
  public:
   struct Config {
@@ -39,6 +52,17 @@ class Pipeline {
     int fps = 30;
     int qp_default = 28;
     int gop_size = 30;
+    int long_term_refs = 0;  // codec::EncoderConfig::long_term_refs
+    int temporal_layers = 1;  // codec::EncoderConfig::temporal_layers
+    uint32_t target_bitrate_kbps = 500;
+    int vbv_buffer_ms = 250;  // codec::EncoderConfig::vbv_buffer_ms
+    int max_downscale = 1;    // codec::EncoderConfig::max_downscale
+    codec::SpeedPreset speed_preset = codec::SpeedPreset::Slow;  // start preset with adaptive_speed
+    bool adaptive_speed = false;  // codec::EncoderConfig::adaptive_speed
+    int frame_budget_ms = 33;     // encode time per frame adaptive_speed keeps within
+    int lookahead_frames = 0;     // codec::EncoderConfig::lookahead_frames (0-3; frames of added latency)
+    uint32_t frame_byte_cap = 0;       // codec::EncoderConfig::frame_byte_cap (0: off)
+    bool guaranteed_byte_cap = false;  // codec::EncoderConfig::guaranteed_byte_cap
   };
 
   explicit Pipeline(Config config);
@@ -54,10 +78,28 @@ class Pipeline {
   void push_capture(CaptureItem item);
   bool pop_encoded(EncodedItem& out, int timeout_ms = -1);
 
+  /// Receiver feedback (codec::Encoder::acknowledge / report_loss), from any thread; the
+  /// encode stage applies it before its next frame.
+  void acknowledge(uint32_t frame_id);
+  void report_loss();
+  /// New rate control target (e.g. from a bandwidth estimate), applied like feedback.
+  void set_target_bitrate_kbps(uint32_t kbps);
+
  private:
+  /// Feedback waiting for the encode stage.
+  struct Feedback {
+    std::mutex mutex;
+    std::vector<uint32_t> acked;
+    bool loss = false;
+    uint32_t target_kbps = 0;  // 0: unchanged
+  };
+
   Config config_;
+  std::unique_ptr<codec::Encoder> encoder_;  // one stream: P-frames and references persist across frames
+  std::unique_ptr<Feedback> feedback_;
   std::unique_ptr<BoundedQueue<CaptureItem>> capture_queue_;
   std::unique_ptr<BoundedQueue<ConvertedItem>> convert_queue_;
+  std::unique_ptr<BoundedQueue<ConvertedItem>> lookahead_queue_;  // null without lookahead
   std::unique_ptr<BoundedQueue<EncodedItem>> encode_queue_;
   std::vector<std::unique_ptr<Stage>> stages_;
 };
@@ -3,7 +3,7 @@
 namespace telehealth {
 namespace util {
 
-/// Placeholder for CPU feature detection (SSE/AVX). Use for SIMD dispatch later.
+/// CPU feature detection (SSE/AVX) for runtime SIMD dispatch.
 bool has_sse4_1();
 bool has_avx2();
 
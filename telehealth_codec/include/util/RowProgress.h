@@ -0,0 +1,28 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace telehealth {
+namespace util {
+
+/// Per-row progress counters for wavefront loops: each row publishes how far it has got and
+/// the row below waits until enough of it is done.
+class RowProgress {
+ public:
+  /// rows counters, all zero. Not safe while rows are running.
+  void reset(int rows);
+  /// Raise row's counter to value (counters only grow) and wake waiters.
+  void publish(int row, int value);
+  /// Block until row's counter reaches value.
+  void wait(int row, int value);
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<int> progress_;
+};
+
+}  // namespace util
+}  // namespace telehealth
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace telehealth {
+namespace util {
+
+/// Fixed set of worker threads for fork/join loops (e.g. encoding slices of one frame).
+class ThreadPool {
+ public:
+  /// num_workers extra threads; the thread calling parallel_for() also runs tasks.
+  explicit ThreadPool(int num_workers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int num_workers() const { return static_cast<int>(workers_.size()); }
+
+  /// Run fn(0) .. fn(count - 1) across the pool; returns when every call has finished.
+  /// Not reentrant: one parallel_for at a time per pool.
+  void parallel_for(int count, const std::function<void(int)>& fn);
+
+ private:
+  void worker_loop();
+  /// Claim and run tasks of the current job until none are left (lock held on entry/exit).
+  void run_tasks(std::unique_lock<std::mutex>& lock);
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)>* job_ = nullptr;
+  int next_ = 0;
+  int count_ = 0;
+  int pending_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace util
+}  // namespace telehealth
@@ -1,4 +1,5 @@
 #include <codec/Bitstream.h>
+#include <codec/Block.h>
 #include <algorithm>
 #include <cstring>
 
@@ -7,73 +8,86 @@ namespace codec {
 
 void BitstreamWriter::reset() {
   buffer_.clear();
-  bit_pos_ = 0;
+  acc_ = 0;
+  acc_bits_ = 0;
 }
 
-void BitstreamWriter::write_bits(uint32_t value, int num_bits) {
-  if (num_bits <= 0 || num_bits > 32) return;
-  size_t need_bytes = (bit_pos_ + num_bits + 7) / 8;
-  if (buffer_.size() < need_bytes)
-    buffer_.resize(need_bytes, 0);
-  uint8_t* p = buffer_.data();
-  uint32_t v = value & ((1u << num_bits) - 1);
-  for (int i = 0; i < num_bits; ++i) {
-    if (v & (1u << i))
-      p[(bit_pos_ + i) / 8] |= (1 << ((bit_pos_ + i) % 8));
-  }
-  bit_pos_ += num_bits;
+void BitstreamWriter::reserve(size_t bytes) {
+  buffer_.reserve(bytes);
+}
+
+uint8_t* BitstreamWriter::grow(size_t extra_bytes) {
+  size_t n = buffer_.size();
+  if (buffer_.capacity() < n + extra_bytes)
+    buffer_.reserve(std::max(n + extra_bytes, std::max<size_t>(64, buffer_.capacity() * 2)));
+  buffer_.resize(n + extra_bytes);
+  return buffer_.data() + n;
+}
+
+void BitstreamWriter::flush_word() {
+  uint8_t* p = grow(4);
+  p[0] = static_cast<uint8_t>(acc_);
+  p[1] = static_cast<uint8_t>(acc_ >> 8);
+  p[2] = static_cast<uint8_t>(acc_ >> 16);
+  p[3] = static_cast<uint8_t>(acc_ >> 24);
+  acc_ >>= 32;
+  acc_bits_ -= 32;
 }
 
 void BitstreamWriter::write_byte(uint8_t b) {
   flush_byte_align();
-  size_t byte_idx = bit_pos_ / 8;
-  if (byte_idx >= buffer_.size())
-    buffer_.resize(byte_idx + 1, 0);
-  buffer_[byte_idx] = b;
-  bit_pos_ += 8;
+  *grow(1) = b;
 }
 
 void BitstreamWriter::write_bytes(const uint8_t* data, size_t len) {
   flush_byte_align();
-  size_t byte_idx = bit_pos_ / 8;
-  if (buffer_.size() < byte_idx + len)
-    buffer_.resize(byte_idx + len, 0);
-  std::memcpy(buffer_.data() + byte_idx, data, len);
-  bit_pos_ += len * 8;
+  if (len) std::memcpy(grow(len), data, len);
 }
 
 void BitstreamWriter::flush_byte_align() {
-  if (bit_pos_ % 8 != 0)
-    bit_pos_ = (bit_pos_ + 7) & ~7;
-  if (bit_pos_ / 8 > buffer_.size())
-    buffer_.resize(bit_pos_ / 8, 0);
+  if (acc_bits_ == 0) return;
+  int bytes = (acc_bits_ + 7) / 8;
+  uint8_t* p = grow(static_cast<size_t>(bytes));
+  for (int i = 0; i < bytes; ++i)
+    p[i] = static_cast<uint8_t>(acc_ >> (8 * i));
+  acc_ = 0;
+  acc_bits_ = 0;
 }
 
 void BitstreamReader::set_data(const uint8_t* data, size_t size_bytes) {
   data_ = data;
   size_bytes_ = size_bytes;
   bit_pos_ = 0;
+  next_byte_ = 0;
+  window_ = 0;
+  window_bits_ = 0;
 }
 
-uint32_t BitstreamReader::read_bits(int num_bits) {
-  if (num_bits <= 0 || num_bits > 32) return 0;
-  uint32_t v = 0;
-  for (int i = 0; i < num_bits; ++i) {
-    size_t byte_idx = (bit_pos_ + i) / 8;
-    if (byte_idx >= size_bytes_) break;
-    if (data_[byte_idx] & (1 << ((bit_pos_ + i) % 8)))
-      v |= (1u << i);
+void BitstreamReader::refill() {
+  if (next_byte_ + 8 <= size_bytes_) {
+    // Load 8 bytes at once and keep as many whole bytes as fit above the pending bits.
+    uint64_t word = 0;
+    for (int i = 0; i < 8; ++i)
+      word |= static_cast<uint64_t>(data_[next_byte_ + i]) << (8 * i);
+    int take = (63 - window_bits_) / 8;
+    window_ |= word << window_bits_;
+    window_ &= ~0ull >> (64 - window_bits_ - take * 8);  // drop the bytes not yet taken
+    next_byte_ += static_cast<size_t>(take);
+    window_bits_ += take * 8;
+    return;
+  }
+  // Tail of the buffer: bytes past the end read as zero padding.
+  while (window_bits_ <= 56) {
+    uint64_t b = next_byte_ < size_bytes_ ? data_[next_byte_] : 0;
+    window_ |= b << window_bits_;
+    ++next_byte_;
+    window_bits_ += 8;
   }
-  bit_pos_ += num_bits;
-  return v;
 }
 
 uint8_t BitstreamReader::read_byte() {
   align_to_byte();
-  size_t byte_idx = bit_pos_ / 8;
-  uint8_t b = byte_idx < size_bytes_ ? data_[byte_idx] : 0;
-  bit_pos_ += 8;
-  return b;
+  return static_cast<uint8_t>(read_bits(8));
 }
 
 void BitstreamReader::read_bytes(uint8_t* out, size_t len) {
@@ -84,16 +98,101 @@ void BitstreamReader::read_bytes(uint8_t* out, size_t len) {
   if (copy) std::memcpy(out, data_ + byte_idx, copy);
   if (copy < len) std::memset(out + copy, 0, len - copy);
   bit_pos_ += len * 8;
+  next_byte_ = bit_pos_ / 8;
+  window_ = 0;
+  window_bits_ = 0;
 }
 
 void BitstreamReader::align_to_byte() {
   if (bit_pos_ % 8 != 0)
-    bit_pos_ = (bit_pos_ + 7) & ~7;
+    skip_bits(static_cast<int>(8 - bit_pos_ % 8));
 }
 
 bool BitstreamReader::eof() const {
   return (bit_pos_ + 7) / 8 >= size_bytes_;
 }
 
+BitstreamFrameHeader frame_header(const EncodedFrame& frame) {
+  BitstreamFrameHeader h;
+  h.frame_type = frame.type == FrameType::I ? 0 : 1;
+  h.frame_id = frame.frame_id;
+  h.timestamp_us = frame.timestamp_us;
+  h.qp = static_cast<uint8_t>(frame.qp | (frame.row_qp ? kFrameQpRowDeltas : 0));
+  h.mv_payload_bytes = static_cast<uint32_t>(frame.mv_bytes.size());
+  h.coeff_payload_bytes = static_cast<uint32_t>(frame.coeff_bytes.size());
+  h.num_slices = frame.num_slices;
+  h.flags = frame.flags;
+  h.ref_slots = frame.ref_slots;
+  h.ref_tag = frame.ref_tag;
+  return h;
+}
+
+std::vector<uint8_t> serialize_frame(const EncodedFrame& frame) {
+  const BitstreamFrameHeader h = frame_header(frame);
+  const size_t size_bytes = (h.flags & kFrameFlagResolution) ? sizeof(BitstreamFrameSize) : 0;
+  const size_t table_bytes = frame.slice_offsets.size() * sizeof(uint32_t);
+  std::vector<uint8_t> out(sizeof(h) + size_bytes + table_bytes + frame.mv_bytes.size() + frame.coeff_bytes.size());
+  uint8_t* p = out.data();
+  std::memcpy(p, &h, sizeof(h));
+  p += sizeof(h);
+  if (size_bytes) {
+    BitstreamFrameSize size;
+    size.width = frame.width;
+    size.height = frame.height;
+    std::memcpy(p, &size, sizeof(size));
+    p += sizeof(size);
+  }
+  if (table_bytes) std::memcpy(p, frame.slice_offsets.data(), table_bytes);
+  p += table_bytes;
+  if (!frame.mv_bytes.empty()) std::memcpy(p, frame.mv_bytes.data(), frame.mv_bytes.size());
+  p += frame.mv_bytes.size();
+  if (!frame.coeff_bytes.empty()) std::memcpy(p, frame.coeff_bytes.data(), frame.coeff_bytes.size());
+  return out;
+}
+
+size_t parse_frame(const uint8_t* data, size_t size, int frame_height, EncodedFrame* out) {
+  BitstreamFrameHeader h;
+  if (size < sizeof(h)) return 0;
+  std::memcpy(&h, data, sizeof(h));
+  size_t offset = sizeof(h);
+  out->type = h.frame_type == 0 ? FrameType::I : FrameType::P;
+  out->frame_id = h.frame_id;
+  out->timestamp_us = h.timestamp_us;
+  out->qp = static_cast<uint8_t>(h.qp & ~kFrameQpRowDeltas);
+  out->row_qp = (h.qp & kFrameQpRowDeltas) != 0;
+  out->num_slices = h.num_slices;
+  out->flags = h.flags;
+  out->ref_slots = h.ref_slots;
+  out->ref_tag = h.ref_tag;
+  out->width = out->height = 0;
+  if (h.flags & kFrameFlagResolution) {
+    BitstreamFrameSize fs;
+    if (offset + sizeof(fs) > size) return 0;
+    std::memcpy(&fs, data + offset, sizeof(fs));
+    offset += sizeof(fs);
+    out->width = fs.width;
+    out->height = fs.height;
+    frame_height = fs.height;
+  }
+  // Substream offset table: one entry pair per slice, or per MB row for wavefront frames.
+  const size_t substreams = (h.flags & kFrameFlagWavefront) ? static_cast<size_t>((frame_height + MB_SIZE - 1) / MB_SIZE)
+                                                            : std::max<size_t>(h.num_slices, 1);
+  out->slice_offsets.clear();
+  if (substreams > 1) {
+    const size_t table_bytes = 2 * (substreams - 1) * sizeof(uint32_t);
+    if (offset + table_bytes > size) return 0;
+    out->slice_offsets.resize(2 * (substreams - 1));
+    std::memcpy(out->slice_offsets.data(), data + offset, table_bytes);
+    offset += table_bytes;
+  }
+  const size_t payload = static_cast<size_t>(h.mv_payload_bytes) + h.coeff_payload_bytes;
+  if (offset + payload > size) return 0;
+  const uint8_t* p = data + offset;
+  out->mv_bytes.assign(p, p + h.mv_payload_bytes);
+  out->coeff_bytes.assign(p + h.mv_payload_bytes, p + payload);
+  out->raw_bytes.assign(data, p + payload);
+  return offset + payload;
+}
+
 }  // namespace codec
 }  // namespace telehealth
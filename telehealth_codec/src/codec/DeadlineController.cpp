@@ -0,0 +1,61 @@
+#include <codec/DeadlineController.h>
+#include <algorithm>
+
+namespace telehealth {
+namespace codec {
+
+namespace {
+
+// Smoothing of the per-frame encode time (weight of the newest frame).
+constexpr double kAverageWeight = 0.25;
+// Step faster above this share of the budget (smoothed), or at once above kOverrun.
+constexpr double kHighWater = 0.85;
+constexpr double kOverrun = 1.5;
+// Step slower after kSlowerFrames consecutive frames under this share of the budget.
+constexpr double kLowWater = 0.5;
+constexpr int kSlowerFrames = 30;
+// Frames after a step before the next one.
+constexpr int kHoldFrames = 4;
+
+}  // namespace
+
+DeadlineController::DeadlineController(double budget_ms, SpeedPreset start)
+    : budget_ms_(budget_ms), preset_(start) {}
+
+void DeadlineController::step_to(SpeedPreset preset) {
+  preset_ms_[static_cast<int>(preset_)] = average_ms_;
+  preset_ = preset;
+  average_ms_ = preset_ms_[static_cast<int>(preset)];
+  hold_frames_ = kHoldFrames;
+  fast_frames_ = 0;
+}
+
+SpeedPreset DeadlineController::update(double encode_ms) {
+  average_ms_ = average_ms_ > 0 ? average_ms_ + kAverageWeight * (encode_ms - average_ms_) : encode_ms;
+  if (budget_ms_ <= 0) return preset_;
+  if (hold_frames_ > 0) {
+    hold_frames_--;
+    return preset_;
+  }
+
+  const int index = static_cast<int>(preset_);
+  if ((average_ms_ > kHighWater * budget_ms_ || encode_ms > kOverrun * budget_ms_) && index > 0) {
+    step_to(static_cast<SpeedPreset>(index - 1));
+    return preset_;
+  }
+  fast_frames_ = average_ms_ < kLowWater * budget_ms_ ? fast_frames_ + 1 : 0;
+  if (fast_frames_ >= kSlowerFrames && index + 1 < kSpeedPresets) {
+    // A slower preset that was measured over the high water mark would only bounce back.
+    const double known = preset_ms_[index + 1];
+    if (known > 0 && known > kHighWater * budget_ms_) {
+      fast_frames_ = 0;
+      preset_ms_[index + 1] = std::max(known * (1 - kAverageWeight), encode_ms);  // let it age out
+      return preset_;
+    }
+    step_to(static_cast<SpeedPreset>(index + 1));
+  }
+  return preset_;
+}
+
+}  // namespace codec
+}  // namespace telehealth
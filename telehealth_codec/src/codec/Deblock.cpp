@@ -0,0 +1,203 @@
+#include <codec/Deblock.h>
+#include <codec/Block.h>
+#include "DeblockKernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+// H.264 alpha / beta / tc0 tables, indexed by QP (0-51); the filter is off below 16.
+static const uint8_t kAlpha[52] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 5, 6, 7, 8, 9, 10, 12, 13,
+  15, 17, 20, 22, 25, 28, 32, 36, 40, 45, 50, 56, 63, 71, 80, 90, 101, 113, 127, 144, 162, 182, 203, 226, 255, 255};
+static const uint8_t kBeta[52] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,
+  6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18};
+static const uint8_t kTc0[52][3] = {
+  {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+  {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 1},
+  {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 1, 1}, {0, 1, 1}, {1, 1, 1}, {1, 1, 1}, {1, 1, 1}, {1, 1, 1},
+  {1, 1, 2}, {1, 1, 2}, {1, 1, 2}, {1, 1, 2}, {1, 2, 3}, {1, 2, 3}, {2, 2, 3}, {2, 2, 4}, {2, 3, 4},
+  {2, 3, 4}, {3, 3, 5}, {3, 4, 6}, {3, 4, 6}, {4, 5, 7}, {4, 5, 8}, {4, 6, 9}, {5, 7, 10}, {6, 8, 11},
+  {6, 8, 13}, {7, 10, 14}, {8, 11, 16}, {9, 12, 18}, {10, 13, 20}, {11, 15, 23}, {13, 17, 25}};
+
+static DeblockParams params_for_qp(int qp) {
+  const int index = std::clamp(qp, 0, 51);
+  DeblockParams p;
+  p.alpha = kAlpha[index];
+  p.beta = kBeta[index];
+  for (int bs = 1; bs <= 3; ++bs) p.tc0[bs] = kTc0[index][bs - 1];
+  return p;
+}
+
+static inline int clip3(int lo, int hi, int v) { return v < lo ? lo : (v > hi ? hi : v); }
+static inline uint8_t clip_pixel(int v) { return static_cast<uint8_t>(clip3(0, 255, v)); }
+
+void deblock_luma_edge_scalar(uint8_t* q0, int lane_step, int across, int n, const uint8_t* bs,
+                              const DeblockParams& prm) {
+  for (int i = 0; i < n; ++i) {
+    const int strength = bs[i / 8];
+    if (!strength) continue;
+    uint8_t* s = q0 + i * lane_step;
+    const int p3 = s[-4 * across], p2 = s[-3 * across], p1 = s[-2 * across], p0 = s[-across];
+    const int q0v = s[0], q1 = s[across], q2 = s[2 * across], q3 = s[3 * across];
+    if (std::abs(p0 - q0v) >= prm.alpha || std::abs(p1 - p0) >= prm.beta || std::abs(q1 - q0v) >= prm.beta)
+      continue;
+    const bool ap = std::abs(p2 - p0) < prm.beta;
+    const bool aq = std::abs(q2 - q0v) < prm.beta;
+    if (strength == 4) {
+      const bool gate = std::abs(p0 - q0v) < (prm.alpha >> 2) + 2;
+      if (ap && gate) {
+        s[-across] = static_cast<uint8_t>((p2 + 2 * p1 + 2 * p0 + 2 * q0v + q1 + 4) >> 3);
+        s[-2 * across] = static_cast<uint8_t>((p2 + p1 + p0 + q0v + 2) >> 2);
+        s[-3 * across] = static_cast<uint8_t>((2 * p3 + 3 * p2 + p1 + p0 + q0v + 4) >> 3);
+      } else {
+        s[-across] = static_cast<uint8_t>((2 * p1 + p0 + q1 + 2) >> 2);
+      }
+      if (aq && gate) {
+        s[0] = static_cast<uint8_t>((q2 + 2 * q1 + 2 * q0v + 2 * p0 + p1 + 4) >> 3);
+        s[across] = static_cast<uint8_t>((q2 + q1 + q0v + p0 + 2) >> 2);
+        s[2 * across] = static_cast<uint8_t>((2 * q3 + 3 * q2 + q1 + q0v + p0 + 4) >> 3);
+      } else {
+        s[0] = static_cast<uint8_t>((2 * q1 + q0v + p1 + 2) >> 2);
+      }
+      continue;
+    }
+    const int tc0 = prm.tc0[strength];
+    const int tc = tc0 + ap + aq;
+    const int delta = clip3(-tc, tc, ((q0v - p0) * 4 + (p1 - q1) + 4) >> 3);
+    s[-across] = clip_pixel(p0 + delta);
+    s[0] = clip_pixel(q0v - delta);
+    if (ap) s[-2 * across] = static_cast<uint8_t>(p1 + clip3(-tc0, tc0, (p2 + ((p0 + q0v + 1) >> 1) - (p1 << 1)) >> 1));
+    if (aq) s[across] = static_cast<uint8_t>(q1 + clip3(-tc0, tc0, (q2 + ((p0 + q0v + 1) >> 1) - (q1 << 1)) >> 1));
+  }
+}
+
+void deblock_chroma_edge_scalar(uint8_t* q0, int lane_step, int across, int n, const uint8_t* bs,
+                                int lanes_per_bs, const DeblockParams& prm) {
+  for (int i = 0; i < n; ++i) {
+    const int strength = bs[i / lanes_per_bs];
+    if (!strength) continue;
+    uint8_t* s = q0 + i * lane_step;
+    const int p1 = s[-2 * across], p0 = s[-across], q0v = s[0], q1 = s[across];
+    if (std::abs(p0 - q0v) >= prm.alpha || std::abs(p1 - p0) >= prm.beta || std::abs(q1 - q0v) >= prm.beta)
+      continue;
+    if (strength == 4) {
+      s[-across] = static_cast<uint8_t>((2 * p1 + p0 + q1 + 2) >> 2);
+      s[0] = static_cast<uint8_t>((2 * q1 + q0v + p1 + 2) >> 2);
+    } else {
+      const int tc = prm.tc0[strength] + 1;
+      const int delta = clip3(-tc, tc, ((q0v - p0) * 4 + (p1 - q1) + 4) >> 3);
+      s[-across] = clip_pixel(p0 + delta);
+      s[0] = clip_pixel(q0v - delta);
+    }
+  }
+}
+
+// Strength of the edge between 8x8 block bp of MB a and block bq of MB b (a == b inside an MB).
+static uint8_t boundary_strength(const MbDeblockInfo& a, int bp, const MbDeblockInfo& b, int bq, bool mb_edge) {
+  if (a.intra || b.intra) return mb_edge ? 4 : 3;
+  if (((a.cbp >> bp) | (b.cbp >> bq)) & 1u) return 2;
+  if (mb_edge && (a.mv.dx != b.mv.dx || a.mv.dy != b.mv.dy)) return 1;
+  return 0;
+}
+
+DeblockFilter::DeblockFilter() : level_(best_simd_level()) {}
+
+DeblockFilter::DeblockFilter(SimdLevel level) : level_(best_simd_level(level)) {}
+
+// Horizontal luma edge over n columns: widest kernel first, scalar for the remainder.
+static void filter_luma_h(SimdLevel level, uint8_t* q0, int stride, int n, const uint8_t* bs,
+                          const DeblockParams& prm) {
+  int i = 0;
+#if defined(TELECODEC_X86_SIMD)
+  if (level == SimdLevel::Avx2) {
+    i = n & ~31;
+    deblock_luma_h_avx2(q0, stride, i, bs, prm);
+  }
+  if (level != SimdLevel::Scalar) {
+    int m = i + ((n - i) & ~15);
+    deblock_luma_h_sse2(q0 + i, stride, m - i, bs + i / 8, prm);
+    i = m;
+  }
+#else
+  (void)level;
+#endif
+  deblock_luma_edge_scalar(q0 + i, 1, stride, n - i, bs + i / 8, prm);
+}
+
+void DeblockFilter::filter_row(FrameYUV& frame, const MbDeblockInfo* info, int mb_y, int qp, int qp_above) const {
+  const DeblockParams prm = params_for_qp(qp);
+  const DeblockParams top_prm = qp_above < 0 ? prm : params_for_qp((qp + qp_above + 1) / 2);
+  if ((prm.alpha == 0 || prm.beta == 0) && (top_prm.alpha == 0 || top_prm.beta == 0)) return;
+  const int width = frame.width, height = frame.height;
+  const int mb_cols = (width + MB_SIZE - 1) / MB_SIZE;
+  const int y0 = mb_y * MB_SIZE;
+  const int rows = std::min(MB_SIZE, height - y0);
+  const int chroma_rows = std::min(MB_CHROMA_SIZE, height / 2 - y0 / 2);
+  const MbDeblockInfo* cur = info + mb_y * mb_cols;
+
+  // Vertical edges, wherever the q side has its four columns. Each edge has an upper and a
+  // lower 8-row segment; chroma rows 0-3 / 4-7 take their strengths.
+  for (int x = 8; x + 4 <= width && prm.alpha != 0 && prm.beta != 0; x += 8) {
+    const bool mb_edge = x % MB_SIZE == 0;
+    const MbDeblockInfo& q = cur[x / MB_SIZE];
+    const MbDeblockInfo& p = mb_edge ? cur[x / MB_SIZE - 1] : q;
+    uint8_t bs[2];
+    for (int half = 0; half < 2; ++half)
+      bs[half] = boundary_strength(p, 2 * half + (mb_edge ? 1 : 0), q, 2 * half + (mb_edge ? 0 : 1), mb_edge);
+    if (!(bs[0] | bs[1])) continue;
+    uint8_t* q0 = frame.y_row(y0) + x;
+#if defined(TELECODEC_X86_SIMD)
+    if (rows == MB_SIZE && level_ != SimdLevel::Scalar)
+      deblock_luma_v16_sse2(q0, frame.stride_y, bs, prm);
+    else
+#endif
+      deblock_luma_edge_scalar(q0, frame.stride_y, 1, rows, bs, prm);
+    if (mb_edge && x / 2 + 2 <= width / 2) {
+      deblock_chroma_edge_scalar(frame.u_row(y0 / 2) + x / 2, frame.stride_uv, 1, chroma_rows, bs, 4, prm);
+      deblock_chroma_edge_scalar(frame.v_row(y0 / 2) + x / 2, frame.stride_uv, 1, chroma_rows, bs, 4, prm);
+    }
+  }
+
+  // Horizontal edges: the MB top edge (against the row above) and the internal edge, with a
+  // strength per 8-column segment.
+  const int segments = (width + 7) / 8;
+  std::vector<uint8_t> bs(static_cast<size_t>(segments));
+  for (int edge = 0; edge < 2; ++edge) {
+    const bool mb_edge = edge == 0;
+    const DeblockParams& edge_prm = mb_edge ? top_prm : prm;
+    if (edge_prm.alpha == 0 || edge_prm.beta == 0) continue;
+    if (mb_edge ? (mb_y == 0 || rows < 4) : rows < 12) continue;
+    bool any = false;
+    for (int s = 0; s < segments; ++s) {
+      const int bx = s % 2;
+      const MbDeblockInfo& q = cur[s / 2];
+      uint8_t strength = mb_edge ? boundary_strength(cur[s / 2 - mb_cols], 2 + bx, q, bx, true)
+                                 : boundary_strength(q, bx, q, 2 + bx, false);
+      bs[static_cast<size_t>(s)] = strength;
+      any |= strength != 0;
+    }
+    if (!any) continue;
+    filter_luma_h(level_, frame.y_row(y0 + 8 * edge), frame.stride_y, width, bs.data(), edge_prm);
+    if (mb_edge && chroma_rows >= 2) {
+      deblock_chroma_edge_scalar(frame.u_row(y0 / 2), 1, frame.stride_uv, width / 2, bs.data(), 4, edge_prm);
+      deblock_chroma_edge_scalar(frame.v_row(y0 / 2), 1, frame.stride_uv, width / 2, bs.data(), 4, edge_prm);
+    }
+  }
+}
+
+void DeblockFilter::filter_frame(FrameYUV& frame, const MbDeblockInfo* info, int qp, const uint8_t* row_qp) const {
+  const int mb_rows = (frame.height + MB_SIZE - 1) / MB_SIZE;
+  for (int mb_y = 0; mb_y < mb_rows; ++mb_y) {
+    if (row_qp)
+      filter_row(frame, info, mb_y, row_qp[mb_y], mb_y > 0 ? row_qp[mb_y - 1] : -1);
+    else
+      filter_row(frame, info, mb_y, qp);
+  }
+}
+
+}  // namespace codec
+}  // namespace telehealth
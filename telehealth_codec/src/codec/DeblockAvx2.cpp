@@ -0,0 +1,55 @@
+// Built with AVX2 enabled; only called after util::has_avx2().
+#include "DeblockSimd.h"
+#include <immintrin.h>
+
+namespace telehealth {
+namespace codec {
+namespace {
+
+struct Avx2 {
+  using T = __m256i;
+  static T zero() { return _mm256_setzero_si256(); }
+  static T set1_8(int v) { return _mm256_set1_epi8(static_cast<char>(v)); }
+  static T set1_16(int v) { return _mm256_set1_epi16(static_cast<short>(v)); }
+  static T or_(T a, T b) { return _mm256_or_si256(a, b); }
+  static T and_(T a, T b) { return _mm256_and_si256(a, b); }
+  static T andnot(T a, T b) { return _mm256_andnot_si256(a, b); }  // ~a & b
+  static T subs_u8(T a, T b) { return _mm256_subs_epu8(a, b); }
+  static T sub8(T a, T b) { return _mm256_sub_epi8(a, b); }
+  static T cmpeq8(T a, T b) { return _mm256_cmpeq_epi8(a, b); }
+  // Unpack and pack work within 128-bit halves; used in pairs, lanes come back in order.
+  static T unpacklo8(T a, T b) { return _mm256_unpacklo_epi8(a, b); }
+  static T unpackhi8(T a, T b) { return _mm256_unpackhi_epi8(a, b); }
+  static T add16(T a, T b) { return _mm256_add_epi16(a, b); }
+  static T sub16(T a, T b) { return _mm256_sub_epi16(a, b); }
+  static T slli16(T a, int n) { return _mm256_slli_epi16(a, n); }
+  static T srai16(T a, int n) { return _mm256_srai_epi16(a, n); }
+  static T min16(T a, T b) { return _mm256_min_epi16(a, b); }
+  static T max16(T a, T b) { return _mm256_max_epi16(a, b); }
+  static T packus16(T a, T b) { return _mm256_packus_epi16(a, b); }
+};
+
+using Filter = LumaEdgeSimd<Avx2>;
+
+// Boundary strengths of four 8-lane segments, one byte per lane.
+__m256i lane_strengths(const uint8_t* bs) {
+  __m128i lo = _mm_unpacklo_epi64(_mm_set1_epi8(static_cast<char>(bs[0])), _mm_set1_epi8(static_cast<char>(bs[1])));
+  __m128i hi = _mm_unpacklo_epi64(_mm_set1_epi8(static_cast<char>(bs[2])), _mm_set1_epi8(static_cast<char>(bs[3])));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+}  // namespace
+
+void deblock_luma_h_avx2(uint8_t* q0, int stride, int n, const uint8_t* bs, const DeblockParams& p) {
+  for (int i = 0; i < n; i += 32, bs += 4) {
+    if (!(bs[0] | bs[1] | bs[2] | bs[3])) continue;
+    uint8_t* s = q0 + i;
+    __m256i r[8];
+    for (int k = 0; k < 8; ++k) r[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + (k - 4) * stride));
+    Filter::filter(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], lane_strengths(bs), p);
+    for (int k = 1; k < 7; ++k) _mm256_storeu_si256(reinterpret_cast<__m256i*>(s + (k - 4) * stride), r[k]);
+  }
+}
+
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+/// Thresholds of one QP: an edge line is filtered only where |p0 - q0| < alpha and
+/// |p1 - p0|, |q1 - q0| < beta. tc0[bs] bounds the normal filter for boundary strengths 1-3;
+/// strength 4 (intra MB edges) selects the strong filter.
+struct DeblockParams {
+  int alpha = 0;
+  int beta = 0;
+  int tc0[4] = {};
+};
+
+// Kernels filter n lines ("lanes") across one edge. Lane i starts at q0 + i * lane_step, its
+// samples across the edge are q0[k * across] (p0 at k = -1, q0 at k = 0). Lane i uses boundary
+// strength bs[i / lanes_per_bs]; luma segments are 8 lanes.
+
+/// Luma: reads p3..q3, changes up to p2..q2.
+void deblock_luma_edge_scalar(uint8_t* q0, int lane_step, int across, int n, const uint8_t* bs,
+                              const DeblockParams& p);
+/// Chroma: reads p1..q1, changes p0 and q0.
+void deblock_chroma_edge_scalar(uint8_t* q0, int lane_step, int across, int n, const uint8_t* bs,
+                                int lanes_per_bs, const DeblockParams& p);
+
+#if defined(TELECODEC_X86_SIMD)
+/// Horizontal luma edge (lanes are consecutive columns, across = stride); n a multiple of 16.
+void deblock_luma_h_sse2(uint8_t* q0, int stride, int n, const uint8_t* bs, const DeblockParams& p);
+/// Vertical luma edge of 16 rows (transposed in registers); bs[0] rows 0-7, bs[1] rows 8-15.
+void deblock_luma_v16_sse2(uint8_t* q0, int stride, const uint8_t* bs, const DeblockParams& p);
+/// Horizontal luma edge, 32 lanes per step; n a multiple of 32.
+void deblock_luma_h_avx2(uint8_t* q0, int stride, int n, const uint8_t* bs, const DeblockParams& p);
+#endif
+
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,96 @@
+#pragma once
+
+// Luma edge filter on SIMD registers, shared by the SSE2 and AVX2 kernels. V supplies the
+// vector type and operations; each ISA translation unit instantiates it with internal
+// linkage, so code built with different target flags is never merged by the linker.
+
+#include "DeblockKernels.h"
+
+namespace telehealth {
+namespace codec {
+namespace {
+
+template <class V>
+struct LumaEdgeSimd {
+  using T = typename V::T;
+
+  static T select(T mask, T a, T b) { return V::or_(V::and_(mask, a), V::andnot(mask, b)); }
+  static T absdiff(T a, T b) { return V::or_(V::subs_u8(a, b), V::subs_u8(b, a)); }
+  // Byte lanes where x < thr (thr >= 1), as all-ones masks.
+  static T less(T x, int thr) { return V::cmpeq8(V::subs_u8(x, V::set1_8(thr - 1)), V::zero()); }
+
+  // Candidate outputs for one side of the edge in 16-bit lanes (p side; the q side passes
+  // its samples in the same roles): normal-filter p1, strong p0..p2, weak intra p0.
+  enum { kN1, kS0, kS1, kS2, kW0, kSideOutputs };
+  static void side16(T p3, T p2, T p1, T p0, T q0, T q1, T tc0, T* o) {
+    const T one = V::set1_16(1), two = V::set1_16(2), four = V::set1_16(4);
+    T avg = V::srai16(V::add16(V::add16(p0, q0), one), 1);
+    T d1 = V::srai16(V::sub16(V::add16(p2, avg), V::add16(p1, p1)), 1);
+    o[kN1] = V::add16(p1, V::min16(V::max16(d1, V::sub16(V::zero(), tc0)), tc0));
+    T p1p0q0 = V::add16(V::add16(p1, p0), q0);
+    o[kS0] = V::srai16(V::add16(V::add16(p2, V::add16(p1, p1)),
+                                V::add16(V::add16(V::add16(p0, p0), V::add16(q0, q0)), V::add16(q1, four))), 3);
+    o[kS1] = V::srai16(V::add16(V::add16(p2, p1p0q0), two), 2);
+    o[kS2] = V::srai16(V::add16(V::add16(V::add16(p3, p3), V::add16(V::add16(p2, p2), p2)), V::add16(p1p0q0, four)), 3);
+    o[kW0] = V::srai16(V::add16(V::add16(V::add16(p1, p1), p0), V::add16(q1, two)), 2);
+  }
+
+  // Filter one register of lanes in place; bs holds each lane's boundary strength.
+  static void filter(T p3, T& p2, T& p1, T& p0, T& q0, T& q1, T& q2, T q3, T bs, const DeblockParams& prm) {
+    const T zero = V::zero();
+    const T d_pq = absdiff(p0, q0);
+    const T filt = V::andnot(V::cmpeq8(bs, zero),
+                             V::and_(less(d_pq, prm.alpha),
+                                     V::and_(less(absdiff(p1, p0), prm.beta), less(absdiff(q1, q0), prm.beta))));
+    const T ap = less(absdiff(p2, p0), prm.beta);
+    const T aq = less(absdiff(q2, q0), prm.beta);
+    const T strong = V::cmpeq8(bs, V::set1_8(4));
+    const T gate = less(d_pq, (prm.alpha >> 2) + 2);
+    const T tc0 = V::or_(V::and_(V::cmpeq8(bs, V::set1_8(1)), V::set1_8(prm.tc0[1])),
+                         V::or_(V::and_(V::cmpeq8(bs, V::set1_8(2)), V::set1_8(prm.tc0[2])),
+                                V::and_(V::cmpeq8(bs, V::set1_8(3)), V::set1_8(prm.tc0[3]))));
+    const T tc = V::sub8(V::sub8(tc0, ap), aq);  // tc0 + ap + aq (masks are -1)
+
+    // 16-bit candidates per half, packed back to bytes (packus clips to [0, 255]).
+    T cp[2][kSideOutputs], cq[2][kSideOutputs], np0[2], nq0[2];
+    for (int half = 0; half < 2; ++half) {
+      auto widen = [&](T v) { return half ? V::unpackhi8(v, zero) : V::unpacklo8(v, zero); };
+      T P3 = widen(p3), P2 = widen(p2), P1 = widen(p1), P0 = widen(p0);
+      T Q0 = widen(q0), Q1 = widen(q1), Q2 = widen(q2), Q3 = widen(q3);
+      T TC0 = widen(tc0), TC = widen(tc);
+      T delta = V::srai16(V::add16(V::add16(V::slli16(V::sub16(Q0, P0), 2), V::sub16(P1, Q1)), V::set1_16(4)), 3);
+      delta = V::min16(V::max16(delta, V::sub16(zero, TC)), TC);
+      np0[half] = V::add16(P0, delta);
+      nq0[half] = V::sub16(Q0, delta);
+      side16(P3, P2, P1, P0, Q0, Q1, TC0, cp[half]);
+      side16(Q3, Q2, Q1, Q0, P0, P1, TC0, cq[half]);
+    }
+    auto pack = [](const T* lo, const T* hi, int k) { return V::packus16(lo[k], hi[k]); };
+    const T n_p0 = V::packus16(np0[0], np0[1]);
+    const T n_q0 = V::packus16(nq0[0], nq0[1]);
+
+    const T strong_p = V::and_(strong, V::and_(ap, gate));
+    const T strong_q = V::and_(strong, V::and_(aq, gate));
+    const T intra_p0 = select(strong_p, pack(cp[0], cp[1], kS0), pack(cp[0], cp[1], kW0));
+    const T intra_q0 = select(strong_q, pack(cq[0], cq[1], kS0), pack(cq[0], cq[1], kW0));
+    const T new_p1 = select(strong, select(strong_p, pack(cp[0], cp[1], kS1), p1),
+                            select(ap, pack(cp[0], cp[1], kN1), p1));
+    const T new_q1 = select(strong, select(strong_q, pack(cq[0], cq[1], kS1), q1),
+                            select(aq, pack(cq[0], cq[1], kN1), q1));
+    const T new_p2 = select(strong_p, pack(cp[0], cp[1], kS2), p2);
+    const T new_q2 = select(strong_q, pack(cq[0], cq[1], kS2), q2);
+    const T new_p0 = select(strong, intra_p0, n_p0);
+    const T new_q0 = select(strong, intra_q0, n_q0);
+
+    p0 = select(filt, new_p0, p0);
+    q0 = select(filt, new_q0, q0);
+    p1 = select(filt, new_p1, p1);
+    q1 = select(filt, new_q1, q1);
+    p2 = select(filt, new_p2, p2);
+    q2 = select(filt, new_q2, q2);
+  }
+};
+
+}  // namespace
+}  // namespace codec
+}  // namespace telehealth
@@ -0,0 +1,99 @@
+#include "DeblockSimd.h"
+#include <emmintrin.h>
+
+namespace telehealth {
+namespace codec {
+namespace {
+
+struct Sse2 {
+  using T = __m128i;
+  static T zero() { return _mm_setzero_si128(); }
+  static T set1_8(int v) { return _mm_set1_epi8(static_cast<char>(v)); }
+  static T set1_16(int v) { return _mm_set1_epi16(static_cast<short>(v)); }
+  static T or_(T a, T b) { return _mm_or_si128(a, b); }
+  static T and_(T a, T b) { return _mm_and_si128(a, b); }
+  static T andnot(T a, T b) { return _mm_andnot_si128(a, b); }  // ~a & b
+  static T subs_u8(T a, T b) { return _mm_subs_epu8(a, b); }
+  static T sub8(T a, T b) { return _mm_sub_epi8(a, b); }
+  static T cmpeq8(T a, T b) { return _mm_cmpeq_epi8(a, b); }
+  static T unpacklo8(T a, T b) { return _mm_unpacklo_epi8(a, b); }
+  static T unpackhi8(T a, T b) { return _mm_unpackhi_epi8(a, b); }
+  static T add16(T a, T b) { return _mm_add_epi16(a, b); }
+  static T sub16(T a, T b) { return _mm_sub_epi16(a, b); }
+  static T slli16(T a, int n) { return _mm_slli_epi16(a, n); }
+  static T srai16(T a, int n) { return _mm_srai_epi16(a, n); }
+  static T min16(T a, T b) { return _mm_min_epi16(a, b); }
+  static T max16(T a, T b) { return _mm_max_epi16(a, b); }
+  static T packus16(T a, T b) { return _mm_packus_epi16(a, b); }
+};
+
+using Filter = LumaEdgeSimd<Sse2>;
+
+// Boundary strengths of two 8-lane segments, one byte per lane.
+__m128i lane_strengths(const uint8_t* bs) {
+  return _mm_unpacklo_epi64(_mm_set1_epi8(static_cast<char>(bs[0])), _mm_set1_epi8(static_cast<char>(bs[1])));
+}
+
+}  // namespace
+
+void deblock_luma_h_sse2(uint8_t* q0, int stride, int n, const uint8_t* bs, const DeblockParams& p) {
+  for (int i = 0; i < n; i += 16, bs += 2) {
+    if (!(bs[0] | bs[1])) continue;
+    uint8_t* s = q0 + i;
+    __m128i r[8];
+    for (int k = 0; k < 8; ++k) r[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + (k - 4) * stride));
+    Filter::filter(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], lane_strengths(bs), p);
+    for (int k = 1; k < 7; ++k) _mm_storeu_si128(reinterpret_cast<__m128i*>(s + (k - 4) * stride), r[k]);
+  }
+}
+
+void deblock_luma_v16_sse2(uint8_t* q0, int stride, const uint8_t* bs, const DeblockParams& p) {
+  // 16 rows of p3..q3 (8 bytes each) -> 8 registers of 16 lanes (one per sample position).
+  uint8_t* base = q0 - 4;
+  __m128i a[8];
+  for (int k = 0; k < 8; ++k)
+    a[k] = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(base + (2 * k) * stride)),
+                             _mm_loadl_epi64(reinterpret_cast<const __m128i*>(base + (2 * k + 1) * stride)));
+  __m128i b[8];  // b[2g] columns 0-3, b[2g + 1] columns 4-7 of rows 4g..4g+3
+  for (int g = 0; g < 4; ++g) {
+    b[2 * g] = _mm_unpacklo_epi16(a[2 * g], a[2 * g + 1]);
+    b[2 * g + 1] = _mm_unpackhi_epi16(a[2 * g], a[2 * g + 1]);
+  }
+  __m128i c[8];  // c[2j] / c[2j + 1]: column pair j for rows 0-7 / 8-15
+  for (int h = 0; h < 2; ++h) {
+    c[h * 4 + 0] = _mm_unpacklo_epi32(b[4 * 0 + h], b[4 * 0 + 2 + h]);
+    c[h * 4 + 1] = _mm_unpacklo_epi32(b[4 * 1 + h], b[4 * 1 + 2 + h]);
+    c[h * 4 + 2] = _mm_unpackhi_epi32(b[4 * 0 + h], b[4 * 0 + 2 + h]);
+    c[h * 4 + 3] = _mm_unpackhi_epi32(b[4 * 1 + h], b[4 * 1 + 2 + h]);
+  }
+  __m128i col[8];
+  for (int j = 0; j < 4; ++j) {
+    col[2 * j] = _mm_unpacklo_epi64(c[2 * j], c[2 * j + 1]);
+    col[2 * j + 1] = _mm_unpackhi_epi64(c[2 * j], c[2 * j + 1]);
+  }
+
+  Filter::filter(col[0], col[1], col[2], col[3], col[4], col[5], col[6], col[7], lane_strengths(bs), p);
+
+  // Back to rows: interleave column pairs, then 4-column groups, then halves.
+  __m128i e[8];  // e[2m] rows 0-7, e[2m + 1] rows 8-15 of columns 2m, 2m + 1
+  for (int m = 0; m < 4; ++m) {
+    e[2 * m] = _mm_unpacklo_epi8(col[2 * m], col[2 * m + 1]);
+    e[2 * m + 1] = _mm_unpackhi_epi8(col[2 * m], col[2 * m + 1]);
+  }
+  for (int h = 0; h < 2; ++h) {
+    __m128i lo03 = _mm_unpacklo_epi16(e[h], e[2 + h]);   // rows 8h..8h+3, columns 0-3
+    __m128i hi03 = _mm_unpackhi_epi16(e[h], e[2 + h]);   // rows 8h+4..8h+7, columns 0-3
+    __m128i lo47 = _mm_unpacklo_epi16(e[4 + h], e[6 + h]);
+    __m128i hi47 = _mm_unpackhi_epi16(e[4 + h], e[6 + h]);
+    __m128i rows[4] = {_mm_unpacklo_epi32(lo03, lo47), _mm_unpackhi_epi32(lo03, lo47),
+                       _mm_unpacklo_epi32(hi03, hi47), _mm_unpackhi_epi32(hi03, hi47)};
+    for (int k = 0; k < 4; ++k) {
+      uint8_t* row = base + (8 * h + 2 * k) * stride;
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(row), rows[k]);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(row + stride), _mm_unpackhi_epi64(rows[k], rows[k]));
+    }
+  }
+}
+
+}  // namespace codec
+}  // namespace telehealth
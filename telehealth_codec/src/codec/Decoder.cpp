@@ -0,0 +1,202 @@
+#include <codec/Decoder.h>
+#include <codec/MotionCompensation.h>
+#include <codec/Transform.h>
+#include <codec/Quantizer.h>
+#include <codec/EntropyCoder.h>
+#include <codec/HuffmanTable.h>
+#include <codec/Reconstruct.h>
+#include <codec/Deblock.h>
+#include <codec/IntraPrediction.h>
+#include <codec/Block.h>
+#include <algorithm>
+#include <utility>
+
+namespace telehealth {
+namespace codec {
+
+Decoder::Decoder(const BitstreamFileHeader& header, const QuantMatrices& matrices)
+    : stream_width_(header.width), stream_height_(header.height), width_(header.width), height_(header.height) {
+  ok_ = header.magic == 0x54434F44 && entropy_mode_for_version(header.version, &mode_) &&
+        width_ > 0 && height_ > 0;
+  mb_cols_ = (width_ + MB_SIZE - 1) / MB_SIZE;
+  mb_rows_ = (height_ + MB_SIZE - 1) / MB_SIZE;
+  const auto preset = static_cast<QuantMatrixPreset>(header.quant_matrix);
+  mc_ = std::make_unique<MotionCompensation>();
+  transform_ = std::make_unique<Transform>();
+  quantizer_ = std::make_unique<Quantizer>(preset == QuantMatrixPreset::Custom
+                                               ? matrices
+                                               : QuantMatrices::from_preset(preset));
+  deblock_ = std::make_unique<DeblockFilter>();
+  intra_ = std::make_unique<IntraPredictor>();
+  huffman_tables_ = std::make_unique<HuffmanTables>();
+  spare_ = std::make_unique<FrameYUV>();
+  last_ = spare_.get();
+  recon_ = std::make_unique<FrameYUV>();
+  recon_->allocate(width_, height_);
+  mv_field_.resize(static_cast<size_t>(mb_cols_ * mb_rows_));
+  mb_info_.resize(static_cast<size_t>(mb_cols_ * mb_rows_));
+  row_qp_.resize(static_cast<size_t>(mb_rows_));
+}
+
+Decoder::~Decoder() = default;
+
+bool Decoder::decode(const EncodedFrame& frame) {
+  intact_ = false;
+  if (!ok_) return false;
+  const bool intra = frame.type == FrameType::I;
+  const bool slotted = (frame.flags & kFrameFlagReferenceSlots) != 0;
+  const int ref_slot = slotted ? frame.ref_slots & 0x03 : 0;
+  const unsigned replaced = slotted ? frame.ref_slots >> 4 : 1u;
+  // Dynamic resolution: a frame of a new size is an I-frame, and P-frames predict from
+  // pictures of their own size.
+  const int width = (frame.flags & kFrameFlagResolution) ? frame.width : stream_width_;
+  const int height = (frame.flags & kFrameFlagResolution) ? frame.height : stream_height_;
+  if (width != width_ || height != height_) {
+    if (!intra || width <= 0 || height <= 0) return false;
+    width_ = width;
+    height_ = height;
+    mb_cols_ = (width_ + MB_SIZE - 1) / MB_SIZE;
+    mb_rows_ = (height_ + MB_SIZE - 1) / MB_SIZE;
+    mv_field_.resize(static_cast<size_t>(mb_cols_ * mb_rows_));
+    mb_info_.resize(static_cast<size_t>(mb_cols_ * mb_rows_));
+    row_qp_.resize(static_cast<size_t>(mb_rows_));
+  }
+  if (recon_->width != width_ || recon_->height != height_) recon_->allocate(width_, height_);
+  reference_ = refs_[ref_slot].get();
+  if (!intra && (!reference_ || reference_->width != width_ || reference_->height != height_)) return false;
+  const bool intact = intra || (ref_intact_[ref_slot] && (!slotted || (ref_ids_[ref_slot] & 0xFF) == frame.ref_tag));
+
+  const int slices = std::max(1, static_cast<int>(frame.num_slices));
+  const bool wavefront = (frame.flags & kFrameFlagWavefront) != 0;
+  const int n = wavefront ? mb_rows_ : slices;  // substreams
+  if (slices > mb_rows_ || frame.slice_offsets.size() != static_cast<size_t>(2 * (n - 1))) return false;
+
+  // Huffman mode: an I-frame (or a recovery frame) drops the GOP's tables; the frame that
+  // carries new ones has them ahead of the first slice's coefficients.
+  size_t coeff_start = 0;
+  if (intra || (frame.flags & kFrameFlagHuffmanReset)) huffman_active_ = false;
+  if (frame.flags & kFrameFlagHuffmanTables) {
+    if (mode_ != EntropyMode::Huffman) return false;
+    BitstreamReader in;
+    in.set_data(frame.coeff_bytes);
+    if (!huffman_tables_->read(in)) return false;
+    coeff_start = in.byte_position();
+    huffman_active_ = true;
+  }
+
+  std::vector<size_t> mv_bounds(static_cast<size_t>(n + 1)), coeff_bounds(static_cast<size_t>(n + 1));
+  mv_bounds[0] = 0;
+  coeff_bounds[0] = coeff_start;
+  for (int i = 1; i < n; ++i) {
+    mv_bounds[static_cast<size_t>(i)] = frame.slice_offsets[static_cast<size_t>(i - 1)];
+    coeff_bounds[static_cast<size_t>(i)] = frame.slice_offsets[static_cast<size_t>(n - 2 + i)];
+  }
+  mv_bounds[static_cast<size_t>(n)] = frame.mv_bytes.size();
+  coeff_bounds[static_cast<size_t>(n)] = frame.coeff_bytes.size();
+  for (int i = 0; i < n; ++i)
+    if (mv_bounds[static_cast<size_t>(i)] > mv_bounds[static_cast<size_t>(i + 1)] ||
+        coeff_bounds[static_cast<size_t>(i)] > coeff_bounds[static_cast<size_t>(i + 1)])
+      return false;
+
+  // Wavefront rows decode in order here, each from the contexts the row above saved.
+  EntropyCoder::ContextState saved[2][2];  // [row parity][MV, coeff]
+  for (int s = 0, i = 0; s < slices; ++s) {
+    const int top_row = s * mb_rows_ / slices, end_row = (s + 1) * mb_rows_ / slices;
+    for (int row = top_row; row < end_row; row = wavefront ? row + 1 : end_row, ++i) {
+      const size_t m0 = mv_bounds[static_cast<size_t>(i)], m1 = mv_bounds[static_cast<size_t>(i + 1)];
+      const size_t c0 = coeff_bounds[static_cast<size_t>(i)], c1 = coeff_bounds[static_cast<size_t>(i + 1)];
+      decode_slice(frame, top_row, row, wavefront ? row + 1 : end_row, frame.mv_bytes.data() + m0, m1 - m0,
+                   frame.coeff_bytes.data() + c0, c1 - c0,
+                   wavefront && row > top_row ? saved[(row - 1) & 1] : nullptr,
+                   wavefront ? saved[row & 1] : nullptr);
+    }
+  }
+  if (frame.flags & kFrameFlagDeblock)
+    deblock_->filter_frame(*recon_, mb_info_.data(), frame.qp, frame.row_qp ? row_qp_.data() : nullptr);
+
+  for (int s = 1; s < kReferenceSlots; ++s)
+    if (replaced & (1u << s)) {
+      if (!refs_[s]) refs_[s] = std::make_unique<FrameYUV>();
+      *refs_[s] = *recon_;
+      ref_ids_[s] = frame.frame_id;
+      ref_intact_[s] = intact;
+    }
+  std::unique_ptr<FrameYUV>& kept = (replaced & 1u) ? refs_[0] : spare_;
+  if (replaced & 1u) {
+    ref_ids_[0] = frame.frame_id;
+    ref_intact_[0] = intact;
+  }
+  std::swap(kept, recon_);
+  intact_ = intact;
+  last_ = kept.get();
+  if (!recon_) recon_ = std::make_unique<FrameYUV>();
+  if (recon_->empty()) recon_->allocate(width_, height_);
+  return true;
+}
+
+void Decoder::decode_slice(const EncodedFrame& frame, int top_row, int first_row, int end_row, const uint8_t* mv,
+                           size_t mv_len, const uint8_t* coeff, size_t coeff_len,
+                           const EntropyCoder::ContextState* wpp_above, EntropyCoder::ContextState* wpp_save) {
+  const bool intra = frame.type == FrameType::I;
+  int qp = frame.qp;
+  const HuffmanTables* tables = huffman_active_ ? huffman_tables_.get() : nullptr;
+  EntropyCoder entropy(mode_), mv_entropy(mode_);
+  entropy.set_huffman_tables(tables);
+  mv_entropy.set_huffman_tables(tables);
+  BitstreamReader mv_in, coeff_in;
+  mv_in.set_data(mv, mv_len);
+  coeff_in.set_data(coeff, coeff_len);
+  if (wpp_above) {
+    if (!intra) mv_entropy.begin_slice(mv_in, wpp_above[0]);
+    entropy.begin_slice(coeff_in, wpp_above[1]);
+  } else {
+    if (!intra) mv_entropy.begin_slice(mv_in);
+    entropy.begin_slice(coeff_in);
+  }
+
+  uint8_t pred[MB_SIZE * MB_SIZE], pred_u[64], pred_v[64];
+  int32_t coeff_mb[kCbpBlocks * 64];
+  for (int mb_y = first_row; mb_y < end_row; ++mb_y) {
+    if (frame.row_qp && mb_y > first_row)
+      qp = std::clamp(qp + entropy.decode_qp_delta(coeff_in), 0, Quantizer::kMaxQp);
+    row_qp_[static_cast<size_t>(mb_y)] = static_cast<uint8_t>(qp);
+    for (int mb_x = 0; mb_x < mb_cols_; ++mb_x) {
+      const BlockCoord coord{mb_x, mb_y};
+      const size_t idx = static_cast<size_t>(mb_y * mb_cols_ + mb_x);
+      // The CBP comes first: in P-frames it says whether the MB is intra (no MV sent).
+      uint32_t cbp = entropy.decode_cbp(coeff_in, !intra);
+      const bool intra_mb = intra || (cbp & kCbpIntraMb);
+      cbp &= ~kCbpIntraMb;
+      MotionVector mv_mb;
+      IntraMbModes modes;
+      if (intra_mb) {
+        modes = entropy.decode_intra_modes(coeff_in);
+        if (!intra) mv_field_[idx] = MotionVector();
+      } else {
+        const MotionVector pred_mv = predict_mv(mv_field_.data(), mb_cols_, mb_x, mb_y, top_row);
+        mv_mb = mv_entropy.decode_mv(mv_in, pred_mv);
+        mv_field_[idx] = mv_mb;
+        predict_inter_macroblock(*mc_, *reference_, coord, mv_mb, pred, pred_u, pred_v);
+      }
+      for (int b = 0; b < kCbpBlocks; ++b)
+        if (cbp & (1u << b)) entropy.decode_block_8x8(coeff_in, qp, coeff_mb + b * 64);
+      if (intra_mb)
+        reconstruct_intra_macroblock(*recon_, coord, coeff_mb, cbp, qp, modes, mb_y > top_row, *intra_,
+                                     *quantizer_, *transform_);
+      else
+        reconstruct_macroblock(*recon_, coord, coeff_mb, cbp, qp, false, pred, pred_u, pred_v,
+                               *quantizer_, *transform_);
+      MbDeblockInfo& info = mb_info_[idx];
+      info.mv = mv_mb;
+      info.cbp = static_cast<uint8_t>(cbp);
+      info.intra = intra_mb;
+      if (wpp_save && mb_x == std::min(2, mb_cols_) - 1) {
+        wpp_save[0] = mv_entropy.context_state();
+        wpp_save[1] = entropy.context_state();
+      }
+    }
+  }
+}
+
+}  // namespace codec
+}  // namespace telehealth
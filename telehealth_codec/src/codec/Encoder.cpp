@@ -4,310 +4,952 @@
 #include <codec/Transform.h>
 #include <codec/Quantizer.h>
 #include <codec/EntropyCoder.h>
+#include <codec/HuffmanTable.h>
 #include <codec/RateControl.h>
+#include <codec/DeadlineController.h>
+#include <codec/SceneChange.h>
 #include <codec/Block.h>
 #include <codec/Residual.h>
+#include <codec/Reconstruct.h>
+#include <codec/Deblock.h>
+#include <codec/IntraPrediction.h>
+#include <codec/Scaler.h>
+#include <util/RowProgress.h>
+#include <util/ThreadPool.h>
+#include <util/Timer.h>
 #include <cstring>
 #include <algorithm>
+#include <thread>
 
 namespace telehealth {
 namespace codec {
 
+struct Encoder::RowContexts {
+  EntropyCoder::ContextState mv;
+  EntropyCoder::ContextState coeff;
+};
+
 Encoder::Encoder(const EncoderConfig& config)
     : config_(config) {
-  me_ = std::make_unique<MotionEstimation>(config);
+  // Adaptive speed starts from speed_preset's settings rather than the individual fields.
+  if (config.adaptive_speed) apply_speed_preset(config.speed_preset, &config_);
+  // rANS mode writes nothing before the end of the slice and coded_bits() only estimates
+  // it, so MBs cannot be priced against a hard budget: it keeps the normal cap.
+  if (config_.entropy_mode == EntropyMode::Rans) config_.guaranteed_byte_cap = false;
+  // Wavefront rows are substreams of one row, so they have no row QP deltas to meet a
+  // guaranteed cap with: it codes whole slices instead.
+  if (config_.frame_byte_cap > 0 && config_.guaranteed_byte_cap) config_.wavefront = false;
+  me_ = std::make_unique<MotionEstimation>(config_);
   mc_ = std::make_unique<MotionCompensation>();
   transform_ = std::make_unique<Transform>();
-  quantizer_ = std::make_unique<Quantizer>();
-  entropy_ = std::make_unique<EntropyCoder>();
+  quantizer_ = std::make_unique<Quantizer>(config.quant_matrix == QuantMatrixPreset::Custom
+                                               ? config.custom_quant_matrices
+                                               : QuantMatrices::from_preset(config.quant_matrix));
   rate_control_ = std::make_unique<RateControl>(config);
+  if (config.adaptive_speed)
+    deadline_ = std::make_unique<DeadlineController>(config.frame_budget_ms, config.speed_preset);
+  scene_ = std::make_unique<SceneChangeDetector>(config.scene_change_threshold);
+  huffman_tables_ = std::make_unique<HuffmanTables>();
+  huffman_stats_ = std::make_unique<HuffmanStats>();
 
   int mb_cols = (config.width + MB_SIZE - 1) / MB_SIZE;
   int mb_rows = (config.height + MB_SIZE - 1) / MB_SIZE;
   mv_buffer_.resize(static_cast<size_t>(mb_cols * mb_rows));
   coeff_buffer_.resize(static_cast<size_t>(mb_cols * mb_rows * (4 * 64 + 2 * 64)));
   residual_buffer_.resize(static_cast<size_t>(mb_cols * mb_rows * 16 * 16));
+  mb_info_.resize(static_cast<size_t>(mb_cols * mb_rows));
+  if (config.deblock) deblock_ = std::make_unique<DeblockFilter>();
+  intra_ = std::make_unique<IntraPredictor>();
+  setup_slices(mb_rows);
+
+  int threads = config.slice_threads > 0 ? config.slice_threads
+                                         : static_cast<int>(std::thread::hardware_concurrency());
+  int workers = std::min(static_cast<int>(slices_.size()), std::max(threads, 1)) - 1;
+  if (workers > 0) slice_pool_ = std::make_unique<util::ThreadPool>(workers);
+  if (config_.wavefront) row_progress_ = std::make_unique<util::RowProgress>();
 }
 
 Encoder::~Encoder() = default;
 
-EncodedFrame Encoder::encode(const FrameYUV& frame, const FrameMeta& meta) {
+BitstreamFileHeader Encoder::file_header() const {
+  BitstreamFileHeader h;
+  h.version = bitstream_version(config_.entropy_mode);
+  h.width = static_cast<uint16_t>(config_.width);
+  h.height = static_cast<uint16_t>(config_.height);
+  h.fps = static_cast<uint8_t>(config_.fps);
+  h.quant_matrix = static_cast<uint8_t>(config_.quant_matrix);
+  return h;
+}
+
+const QuantMatrices& Encoder::quant_matrices() const {
+  return quantizer_->matrices();
+}
+
+Encoder::SourceView Encoder::view_of(const FrameYUV& frame) {
+  SourceView v;
+  v.y = frame.y_plane.data();
+  v.u = frame.u_plane.data();
+  v.v = frame.v_plane.data();
+  v.stride_y = frame.stride_y;
+  v.stride_uv = frame.stride_uv;
+  v.width = frame.width;
+  v.height = frame.height;
+  return v;
+}
+
+Encoder::SourceView Encoder::view_of(const Frame& frame) {
+  SourceView v;
+  v.y = frame.y_plane_ptr();
+  v.u = frame.u_plane_ptr();
+  v.v = frame.v_plane_ptr();
+  v.stride_y = frame.stride_y();
+  v.stride_uv = frame.stride_uv();
+  v.width = frame.width();
+  v.height = frame.height();
+  return v;
+}
+
+void Encoder::macroblock_views(const SourceView& src, BlockCoord coord,
+                               BlockViewConst* out_y, BlockViewConst* out_u, BlockViewConst* out_v) {
+  int px = coord.mb_x * MB_SIZE;
+  int py = coord.mb_y * MB_SIZE;
+  int w = std::min(MB_SIZE, src.width - px);
+  int h = std::min(MB_SIZE, src.height - py);
+
+  int cpx = coord.mb_x * MB_CHROMA_SIZE;
+  int cpy = coord.mb_y * MB_CHROMA_SIZE;
+  int cw = std::min(MB_CHROMA_SIZE, src.width / 2 - cpx);
+  int ch = std::min(MB_CHROMA_SIZE, src.height / 2 - cpy);
+
+  *out_y = BlockViewConst(src.y + py * src.stride_y + px, src.stride_y, w, h);
+  *out_u = BlockViewConst(src.u + cpy * src.stride_uv + cpx, src.stride_uv, cw, ch);
+  *out_v = BlockViewConst(src.v + cpy * src.stride_uv + cpx, src.stride_uv, cw, ch);
+}
+
+EncodedFrame Encoder::encode(const FrameYUV& frame, const FrameMeta& meta, const FrameComplexity* lookahead,
+                             int count) {
+  return encode_view(view_of(frame), meta, lookahead, count);
+}
+
+EncodedFrame Encoder::encode(const Frame& frame, const FrameMeta& meta, const FrameComplexity* lookahead,
+                             int count) {
+  return encode_view(view_of(frame), meta, lookahead, count);
+}
+
+EncodedFrame Encoder::encode_view(const SourceView& source, const FrameMeta& meta,
+                                  const FrameComplexity* lookahead, int count) {
+  util::Timer timer;
+  timer.start();
   FrameStats stats;
   stats.frame_id = static_cast<uint32_t>(meta.frame_id);
+  stats.preset = config_.speed_preset;
+
+  // After a reported loss the receiver's slot 0 is stale, so the frame predicts from the
+  // newest long-term reference it acknowledged (or is an I-frame).
+  int recovery_slot = 0;
+  FrameStats previous;
+  if (loss_reported_) {
+    recovery_slot = acked_long_term_slot();
+    previous.force_keyframe = recovery_slot < 0;
+    recovery_slot = std::max(recovery_slot, 0);
+    loss_reported_ = false;
+  }
+  // Dynamic resolution: references keep their size, so the coded size only changes at an
+  // I-frame. A smaller size is wanted when bandwidth has collapsed, so it forces one now (at
+  // a quarter of the pixels); a larger one waits for the next GOP I-frame or, with intra
+  // refresh, the start of the next sweep (and is forced when neither comes).
+  const int want = rate_control_->downscale();
+  const bool boundary = config_.intra_refresh_frames > 0 ? refresh_phase_ == 0 : config_.gop_size <= 0;
+  if (want > downscale_ || (want < downscale_ && boundary)) previous.force_keyframe = true;
+  // A scene cut is coded as an I-frame: a P-frame would spend its bits on useless vectors and
+  // leave a poor reference for the next. The detector sees every source frame at full size
+  // (here, or ahead of time in the caller's lookahead).
+  if (!lookahead || count <= 0) {
+    scene_->analyze(source.y, source.stride_y, source.width, source.height);
+    lookahead = &scene_->complexity();
+    count = 1;
+  }
+  if (lookahead[0].scene_change) {
+    stats.scene_change = true;
+    previous.force_keyframe = true;
+    rate_control_->reset_for_scene_change();
+  }
+  FrameType ftype = rate_control_->choose_frame_type(stats.frame_id, &previous);
+  auto coded_size = [&](int divisor, int* w, int* h) {
+    *w = divisor > 1 ? std::max(MB_SIZE, (source.width / divisor) & ~1) : source.width;
+    *h = divisor > 1 ? std::max(MB_SIZE, (source.height / divisor) & ~1) : source.height;
+  };
+  int w = 0, h = 0;
+  coded_size(downscale_, &w, &h);
+  const FrameYUV* last = refs_[0].picture.get();
+  if (!last || last->width != w || last->height != h) ftype = FrameType::I;  // the source itself changed size
+  if (ftype == FrameType::I) {
+    downscale_ = want;
+    coded_size(downscale_, &w, &h);
+  }
+  SourceView src = source;
+  if (downscale_ > 1) {
+    if (!scaler_) scaler_ = std::make_unique<FrameScaler>();
+    if (!scaled_ || scaled_->width != w || scaled_->height != h) {
+      scaled_ = std::make_unique<FrameYUV>();
+      scaled_->allocate(w, h);
+    }
+    scaler_->scale_plane(source.y, source.stride_y, source.width, source.height, scaled_->y_plane.data(),
+                         scaled_->stride_y, w, h);
+    scaler_->scale_plane(source.u, source.stride_uv, source.width / 2, source.height / 2, scaled_->u_plane.data(),
+                         scaled_->stride_uv, w / 2, h / 2);
+    scaler_->scale_plane(source.v, source.stride_uv, source.width / 2, source.height / 2, scaled_->v_plane.data(),
+                         scaled_->stride_uv, w / 2, h / 2);
+    src = view_of(*scaled_);
+  }
+  const bool resized = !last || last->width != src.width || last->height != src.height;
+  if (ftype == FrameType::I && resized) {
+    // Long-term references of the old size cannot be predicted from; this frame starts over.
+    for (int s = 1; s < kReferenceSlots; ++s) {
+      refs_[s].picture.reset();
+      refs_[s].acked = false;
+    }
+    next_long_term_ = stats.frame_id;
+    const size_t mbs = static_cast<size_t>(((src.width + MB_SIZE - 1) / MB_SIZE) * ((src.height + MB_SIZE - 1) / MB_SIZE));
+    if (mv_buffer_.size() < mbs) {
+      mv_buffer_.resize(mbs);
+      coeff_buffer_.resize(mbs * (4 * 64 + 2 * 64));
+      residual_buffer_.resize(mbs * 16 * 16);
+      mb_info_.resize(mbs);
+    }
+  }
+
+  // Temporal layers: hierarchical P over 2^(layers - 1) frames (T0 T2 T1 T2 with three),
+  // restarting at I-frames and recovery frames. T0 predicts from and replaces slot 0, T1
+  // predicts from the T0 before it and replaces kTemporalLayerSlot, and top-layer frames
+  // predict from the frame before them and replace nothing, so dropping them is harmless.
+  const int layers = std::clamp(config_.temporal_layers, 1, kMaxTemporalLayers);
+  const int period = 1 << (layers - 1);
+  if (ftype == FrameType::I || recovery_slot != 0) layer_phase_ = 0;
+  const int phase = layer_phase_;
+  layer_phase_ = (layer_phase_ + 1) % period;
+  int trailing = 0;  // the frame at phase - 2^trailing is the one predicted from
+  while (phase && !(phase & (1 << trailing))) ++trailing;
+  temporal_layer_ = phase == 0 ? 0 : layers - 1 - trailing;
+  int ref_slot = recovery_slot;
+  unsigned replaced = 1u;
+  if (temporal_layer_ > 0) {
+    ref_slot = phase - (1 << trailing) == 0 ? 0 : kTemporalLayerSlot;
+    replaced = temporal_layer_ == layers - 1 ? 0u : 1u << kTemporalLayerSlot;
+  }
+  // Long-term references come from T0 frames, which every operating point receives.
+  if (long_term_slots() > 0 && config_.long_term_interval > 0 && temporal_layer_ == 0 &&
+      stats.frame_id >= next_long_term_) {
+    replaced |= 1u << free_long_term_slot();
+    next_long_term_ = stats.frame_id + static_cast<uint32_t>(config_.long_term_interval);
+  }
 
-  FrameType ftype = rate_control_->choose_frame_type(stats.frame_id, nullptr);
   EncodedFrame out;
   out.frame_id = stats.frame_id;
   out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
 
+  reference_ = refs_[ref_slot].picture.get();
+  const bool intra = ftype == FrameType::I || !reference_ || reference_->empty();
+  if (!recon_ || recon_->width != src.width || recon_->height != src.height) {
+    recon_ = std::make_unique<FrameYUV>();
+    recon_->allocate(src.width, src.height);
+  }
+  // A recovery frame also restarts Huffman training: the lost frame may have carried tables.
+  const bool huffman_reset = config_.entropy_mode == EntropyMode::Huffman && !intra && recovery_slot != 0;
+  const bool send_tables = begin_huffman_frame(intra || huffman_reset);
+  qp_ = rate_control_->frame_qp(ftype, src.width * src.height, lookahead, count);
+  BitstreamWriter tables;
+  if (send_tables) huffman_tables_->write(tables);
+  const bool resolution = src.width != config_.width || src.height != config_.height;
+  // Byte cap: what the slices may spend once the header, the size and the tables are in.
+  if (config_.frame_byte_cap > 0) {
+    const size_t fixed =
+        sizeof(BitstreamFrameHeader) + (resolution ? sizeof(BitstreamFrameSize) : 0) + tables.buffer().size();
+    payload_cap_bits_ = 8.0 * (static_cast<double>(config_.frame_byte_cap) - static_cast<double>(fixed));
+  }
   if (ftype == FrameType::I) {
-    out = encode_i_frame(frame, meta);
+    out = encode_i_frame(src, meta);
   } else {
-    out = encode_p_frame(frame, meta);
+    out = encode_p_frame(src, meta);
+  }
+  end_huffman_frame(intra);
+  out.flags |= kFrameFlagReferenceSlots | (huffman_reset ? kFrameFlagHuffmanReset : 0) |
+               static_cast<uint8_t>(temporal_layer_ << kFrameFlagTemporalLayerShift);
+  if (resolution) {
+    out.flags |= kFrameFlagResolution;
+    out.width = static_cast<uint16_t>(src.width);
+    out.height = static_cast<uint16_t>(src.height);
+  }
+  out.ref_slots = static_cast<uint8_t>((out.type == FrameType::P ? ref_slot : 0) | replaced << 4);
+  out.ref_tag = static_cast<uint8_t>(refs_[ref_slot].frame_id);
+  if (send_tables) {
+    const std::vector<uint8_t>& bytes = tables.buffer();
+    out.coeff_bytes.insert(out.coeff_bytes.begin(), bytes.begin(), bytes.end());
+    for (size_t i = out.slice_offsets.size() / 2; i < out.slice_offsets.size(); ++i)
+      out.slice_offsets[i] += static_cast<uint32_t>(bytes.size());
+    out.flags |= kFrameFlagHuffmanTables;
   }
 
   stats.bits_used = out.total_bytes() * 8;
-  out.qp = static_cast<uint8_t>(rate_control_->choose_qp(stats));
-
-  if (!reference_) {
-    reference_ = std::make_unique<FrameYUV>();
-    reference_->allocate(frame.width, frame.height);
+  if (out.type == FrameType::P)
+    for (const Slice& s : slices_) stats.sad_sum += static_cast<double>(s.motion_cost);
+  stats.qp = out.qp;
+  // Rows raised by the byte cap: the model sees the mean QP the bits were spent at.
+  const int mb_rows = (src.height + MB_SIZE - 1) / MB_SIZE;
+  int qp_sum = 0;
+  for (int r = 0; r < mb_rows; ++r) {
+    qp_sum += row_qp_[static_cast<size_t>(r)];
+    stats.max_row_qp = std::max<int>(stats.max_row_qp, row_qp_[static_cast<size_t>(r)]);
+  }
+  for (const Slice& s : slices_) stats.dropped_mbs += s.dropped_mbs;
+  rate_control_->update(stats, out.type, (qp_sum + mb_rows / 2) / mb_rows, src.width * src.height, lookahead);
+  stats.vbv_fullness = rate_control_->buffer_fullness();
+
+  // Closed loop: the next frame predicts from what a decoder reconstructs, not the source.
+  for (int s = 1; s < kReferenceSlots; ++s)
+    if (replaced & (1u << s)) {
+      if (!refs_[s].picture) refs_[s].picture = std::make_unique<FrameYUV>();
+      *refs_[s].picture = *recon_;
+      refs_[s].frame_id = out.frame_id;
+      refs_[s].acked = false;
+    }
+  last_recon_ = recon_.get();
+  if (replaced & 1u) {
+    std::swap(refs_[0].picture, recon_);
+    refs_[0].frame_id = out.frame_id;
+    refs_[0].acked = false;
+    last_recon_ = refs_[0].picture.get();
   }
-  *reference_ = frame;
 
-  out.raw_bytes.clear();
-  out.raw_bytes.insert(out.raw_bytes.end(), out.mv_bytes.begin(), out.mv_bytes.end());
-  out.raw_bytes.insert(out.raw_bytes.end(), out.coeff_bytes.begin(), out.coeff_bytes.end());
+  out.raw_bytes = serialize_frame(out);
+
+  // Deadline-aware speed: the measured time picks the preset of the next frame. Presets only
+  // change encoder-side search and mode decisions, so the switch needs no signalling.
+  timer.stop();
+  stats.encode_ms = timer.elapsed_ms();
+  last_stats_ = stats;
+  if (deadline_) {
+    const SpeedPreset next = deadline_->update(stats.encode_ms);
+    if (next != config_.speed_preset) {
+      apply_speed_preset(next, &config_);
+      me_ = std::make_unique<MotionEstimation>(config_);
+    }
+  }
   return out;
 }
 
-EncodedFrame Encoder::encode(const Frame& frame, const FrameMeta& meta) {
-  FrameStats stats;
-  stats.frame_id = static_cast<uint32_t>(meta.frame_id);
+void Encoder::acknowledge(uint32_t frame_id) {
+  for (ReferenceSlot& slot : refs_)
+    if (slot.picture && slot.frame_id == frame_id) slot.acked = true;
+}
 
-  FrameType ftype = rate_control_->choose_frame_type(stats.frame_id, nullptr);
-  EncodedFrame out;
-  out.frame_id = stats.frame_id;
-  out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
+void Encoder::report_loss() {
+  loss_reported_ = true;
+}
 
-  if (ftype == FrameType::I) {
-    out = encode_i_frame(frame, meta);
-  } else {
-    out = encode_p_frame(frame, meta);
-  }
+void Encoder::set_target_bitrate_kbps(uint32_t kbps) {
+  rate_control_->set_target_bitrate_kbps(kbps);
+}
 
-  stats.bits_used = out.total_bytes() * 8;
-  out.qp = static_cast<uint8_t>(rate_control_->choose_qp(stats));
+int Encoder::long_term_slots() const {
+  const int available = config_.temporal_layers >= 3 ? kTemporalLayerSlot - 1 : kReferenceSlots - 1;
+  return std::max(0, std::min(config_.long_term_refs, available));
+}
 
-  copy_frame_to_reference(frame);
+int Encoder::acked_long_term_slot() const {
+  int best = -1;
+  for (int s = 1; s <= long_term_slots(); ++s)
+    if (refs_[s].acked && (best < 0 || refs_[s].frame_id > refs_[best].frame_id)) best = s;
+  return best;
+}
 
-  out.raw_bytes.clear();
-  out.raw_bytes.insert(out.raw_bytes.end(), out.mv_bytes.begin(), out.mv_bytes.end());
-  out.raw_bytes.insert(out.raw_bytes.end(), out.coeff_bytes.begin(), out.coeff_bytes.end());
-  return out;
+int Encoder::free_long_term_slot() const {
+  const int n = long_term_slots();
+  const int keep = n > 1 ? acked_long_term_slot() : -1;
+  int oldest = -1;
+  for (int s = 1; s <= n; ++s) {
+    if (!refs_[s].picture) return s;
+    if (s != keep && (oldest < 0 || refs_[s].frame_id < refs_[oldest].frame_id)) oldest = s;
+  }
+  return oldest;
 }
 
-void Encoder::copy_frame_to_reference(const Frame& frame) {
-  if (!reference_) {
-    reference_ = std::make_unique<FrameYUV>();
-    reference_->allocate(frame.width(), frame.height());
+bool Encoder::begin_huffman_frame(bool intra) {
+  if (config_.entropy_mode != EntropyMode::Huffman) return false;
+  bool activate = false;
+  if (intra) {
+    huffman_active_ = false;
+    huffman_frames_ = 0;
+    huffman_stats_->reset();
+  } else if (!huffman_active_ && huffman_frames_ >= config_.huffman_training_frames && temporal_layer_ == 0) {
+    huffman_stats_->build(huffman_tables_.get());
+    huffman_active_ = activate = true;
+  } else {
+    return false;
   }
-  const int w = frame.width();
-  const int h = frame.height();
-  const int sy = frame.stride_y();
-  const int suv = frame.stride_uv();
-  for (int y = 0; y < h; ++y)
-    std::memcpy(reference_->y_row(y), frame.y_row(y), static_cast<size_t>(std::min(sy, reference_->stride_y)));
-  for (int y = 0; y < h / 2; ++y) {
-    std::memcpy(reference_->u_row(y), frame.u_row(y), static_cast<size_t>(std::min(suv, reference_->stride_uv)));
-    std::memcpy(reference_->v_row(y), frame.v_row(y), static_cast<size_t>(std::min(suv, reference_->stride_uv)));
+  const HuffmanTables* tables = huffman_active_ ? huffman_tables_.get() : nullptr;
+  for (Slice& s : slices_) {
+    s.entropy->set_huffman_tables(tables);
+    s.mv_entropy->set_huffman_tables(tables);
+    s.entropy->reset_huffman_stats();
+    s.mv_entropy->reset_huffman_stats();
   }
+  return activate;
 }
 
-EncodedFrame Encoder::encode_i_frame(const FrameYUV& frame, const FrameMeta& meta) {
+void Encoder::end_huffman_frame(bool intra) {
+  if (config_.entropy_mode != EntropyMode::Huffman || huffman_active_) return;
+  for (Slice& s : slices_) {
+    if (!intra) {
+      huffman_stats_->add(s.entropy->huffman_stats());
+      huffman_stats_->add(s.mv_entropy->huffman_stats());
+    }
+    s.entropy->reset_huffman_stats();
+    s.mv_entropy->reset_huffman_stats();
+  }
+  if (!intra) huffman_frames_++;
+}
+
+EncodedFrame Encoder::encode_i_frame(const SourceView& src, const FrameMeta& meta) {
   EncodedFrame out;
   out.type = FrameType::I;
   out.frame_id = static_cast<uint32_t>(meta.frame_id);
   out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
-  out.qp = static_cast<uint8_t>(config_.qp_default);
-
-  BitstreamWriter bs;
-  int mb_cols = (frame.width + MB_SIZE - 1) / MB_SIZE;
-  int mb_rows = (frame.height + MB_SIZE - 1) / MB_SIZE;
-  size_t coeff_offset = 0;
-
-  for_each_macroblock_const(frame, [&](BlockCoord coord, BlockViewConst yv, BlockViewConst uv, BlockViewConst vv) {
-    (void)uv; (void)vv;
-    int32_t coeff[64];
-    for (int by = 0; by < 2; ++by) {
-      for (int bx = 0; bx < 2; ++bx) {
-        int16_t res[64];
-        for (int i = 0; i < 64; ++i) {
-          int yy = by * 8 + i / 8, xx = bx * 8 + i % 8;
-          res[i] = static_cast<int16_t>(yv.ptr[yy * yv.stride + xx]);
-        }
-        transform_->forward_8x8(res, 8, coeff);
-        quantizer_->quantize_8x8(coeff, out.qp);
-        entropy_->encode_block_8x8(coeff, out.qp, bs);
+  out.qp = static_cast<uint8_t>(qp_);
+  refresh_phase_ = 0;  // everything is refreshed; the next sweep starts at the left edge
+  encode_slices(src, out.qp, out);
+  return out;
+}
+
+void Encoder::setup_slices(int mb_rows) {
+  int n = std::max(1, std::min({config_.num_slices, mb_rows, 255}));
+  const int streams = config_.wavefront ? mb_rows : n;
+  if (num_slices_ == n && static_cast<int>(slices_.size()) == streams && slices_.back().end_row == mb_rows)
+    return;
+  num_slices_ = n;
+  slices_.resize(static_cast<size_t>(streams));
+  for (int i = 0; i < streams; ++i) {
+    Slice& s = slices_[static_cast<size_t>(i)];
+    if (config_.wavefront) {
+      const int slice = ((i + 1) * n - 1) / mb_rows;  // largest k with k * mb_rows / n <= i
+      s.first_row = i;
+      s.end_row = i + 1;
+      s.top_row = slice * mb_rows / n;
+      if (!s.contexts) s.contexts = std::make_unique<RowContexts>();
+    } else {
+      s.first_row = s.top_row = i * mb_rows / n;
+      s.end_row = (i + 1) * mb_rows / n;
+    }
+    if (!s.entropy) {
+      s.entropy = std::make_unique<EntropyCoder>(config_.entropy_mode);
+      s.mv_entropy = std::make_unique<EntropyCoder>(config_.entropy_mode);
+      if (huffman_active_) {
+        s.entropy->set_huffman_tables(huffman_tables_.get());
+        s.mv_entropy->set_huffman_tables(huffman_tables_.get());
       }
     }
-    int32_t cu[64], cv[64];
-    std::memset(cu, 0, sizeof(cu));
-    std::memset(cv, 0, sizeof(cv));
-    for (int i = 0; i < 64; ++i) {
-      if (i < uv.w * uv.h) cu[i] = uv.ptr[i / uv.w * uv.stride + i % uv.w];
-      if (i < vv.w * vv.h) cv[i] = vv.ptr[i / vv.w * vv.stride + i % vv.w];
+  }
+}
+
+void Encoder::encode_slices(const SourceView& src, int qp, EncodedFrame& out) {
+  setup_slices((src.height + MB_SIZE - 1) / MB_SIZE);
+  const bool intra = out.type == FrameType::I;
+  const int mb_cols = (src.width + MB_SIZE - 1) / MB_SIZE;
+  const int mb_rows = (src.height + MB_SIZE - 1) / MB_SIZE;
+  const int n = static_cast<int>(slices_.size());
+  // Byte cap: each substream gets its rows' share of the payload budget, less its offset
+  // table entries and a few bytes for the byte alignment and coder flushes at its end.
+  const double budget = payload_cap_bits_ - 8.0 * (sizeof(uint32_t) * 2 * (n - 1) + 8 * n);
+  out.row_qp = config_.frame_byte_cap > 0;
+  row_qp_.assign(static_cast<size_t>(mb_rows), static_cast<uint8_t>(qp));
+  auto code_slice = [&](int i) {
+    Slice& s = slices_[static_cast<size_t>(i)];
+    s.mv_out.reset();
+    s.coeff_out.reset();
+    s.drop_residual = false;
+    s.dropped_mbs = 0;
+    if (out.row_qp)
+      s.row_rc.begin(budget * (s.end_row - s.first_row) / mb_rows, s.end_row - s.first_row, qp,
+                     config_.guaranteed_byte_cap);
+    if (intra)
+      encode_i_slice(src, qp, s);
+    else
+      encode_p_slice(src, qp, s);
+  };
+  mb_info_.resize(static_cast<size_t>(mb_cols * mb_rows));
+  if (row_progress_) row_progress_->reset(mb_rows);
+  // The pool hands out substreams in order, so a wavefront row only ever waits on a row
+  // that is already running or done.
+  if (slice_pool_ && n > 1) {
+    slice_pool_->parallel_for(n, code_slice);
+  } else {
+    for (int i = 0; i < n; ++i) code_slice(i);
+  }
+  if (deblock_) {
+    for (int mb_y = mb_rows / num_slices_ - 1; mb_y < mb_rows; ++mb_y)
+      deblock_->filter_row(*recon_, mb_info_.data(), mb_y, row_qp_[static_cast<size_t>(mb_y)],
+                           mb_y > 0 ? row_qp_[static_cast<size_t>(mb_y - 1)] : -1);
+    out.flags |= kFrameFlagDeblock;
+  }
+  if (config_.wavefront) out.flags |= kFrameFlagWavefront;
+
+  out.mv_bytes.clear();
+  out.coeff_bytes.clear();
+  out.num_slices = static_cast<uint8_t>(num_slices_);
+  out.slice_offsets.assign(static_cast<size_t>(2 * (n - 1)), 0);
+  for (int i = 0; i < n; ++i) {
+    const Slice& s = slices_[static_cast<size_t>(i)];
+    if (i > 0) {
+      out.slice_offsets[static_cast<size_t>(i - 1)] = static_cast<uint32_t>(out.mv_bytes.size());
+      out.slice_offsets[static_cast<size_t>(n - 2 + i)] = static_cast<uint32_t>(out.coeff_bytes.size());
     }
-    quantizer_->quantize_8x8(cu, out.qp);
-    quantizer_->quantize_8x8(cv, out.qp);
-    entropy_->encode_block_8x8(cu, out.qp, bs);
-    entropy_->encode_block_8x8(cv, out.qp, bs);
-  });
-
-  bs.flush_byte_align();
-  out.coeff_bytes = bs.buffer();
-  return out;
+    out.mv_bytes.insert(out.mv_bytes.end(), s.mv_out.buffer().begin(), s.mv_out.buffer().end());
+    out.coeff_bytes.insert(out.coeff_bytes.end(), s.coeff_out.buffer().begin(), s.coeff_out.buffer().end());
+  }
 }
 
-EncodedFrame Encoder::encode_i_frame(const Frame& frame, const FrameMeta& meta) {
-  EncodedFrame out;
-  out.type = FrameType::I;
-  out.frame_id = static_cast<uint32_t>(meta.frame_id);
-  out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
-  out.qp = static_cast<uint8_t>(config_.qp_default);
-
-  BitstreamWriter bs;
-  int mb_cols = (frame.width() + MB_SIZE - 1) / MB_SIZE;
-  int mb_rows = (frame.height() + MB_SIZE - 1) / MB_SIZE;
-
-  for_each_macroblock_const(frame, [&](BlockCoord coord, BlockViewConst yv, BlockViewConst uv, BlockViewConst vv) {
-    (void)coord;
-    (void)uv; (void)vv;
-    int32_t coeff[64];
-    for (int by = 0; by < 2; ++by) {
-      for (int bx = 0; bx < 2; ++bx) {
-        int16_t res[64];
-        for (int i = 0; i < 64; ++i) {
-          int yy = by * 8 + i / 8, xx = bx * 8 + i % 8;
-          res[i] = static_cast<int16_t>(yv.ptr[yy * yv.stride + xx]);
-        }
-        transform_->forward_8x8(res, 8, coeff);
-        quantizer_->quantize_8x8(coeff, out.qp);
-        entropy_->encode_block_8x8(coeff, out.qp, bs);
-      }
+void Encoder::deblock_behind(const Slice& slice, int mb_y) {
+  const int mb_cols = (recon_->width + MB_SIZE - 1) / MB_SIZE;
+  if (deblock_ && slice.top_row == 0 && mb_y > 0) {
+    // Filtering row mb_y - 1 reaches into the rows above it, so it must follow the filtering
+    // of row mb_y - 2, which the wavefront row above does when it finishes.
+    if (row_progress_) row_progress_->wait(mb_y - 1, mb_cols + 1);
+    deblock_->filter_row(*recon_, mb_info_.data(), mb_y - 1, row_qp_[static_cast<size_t>(mb_y - 1)],
+                         mb_y > 1 ? row_qp_[static_cast<size_t>(mb_y - 2)] : -1);
+  }
+  if (row_progress_) row_progress_->publish(mb_y, mb_cols + 1);
+}
+
+size_t Encoder::substream_bits(const Slice& slice, bool p_frame) {
+  return slice.entropy->coded_bits(slice.coeff_out) + (p_frame ? slice.mv_entropy->coded_bits(slice.mv_out) : 0);
+}
+
+int Encoder::begin_row(Slice& slice, int mb_y, int qp, bool p_frame) {
+  if (config_.frame_byte_cap > 0) {
+    const int row_qp = slice.row_rc.next_row(substream_bits(slice, p_frame));
+    if (mb_y > slice.first_row)
+      slice.entropy->encode_qp_delta(row_qp - row_qp_[static_cast<size_t>(mb_y - 1)], slice.coeff_out);
+    qp = row_qp;
+    if (config_.guaranteed_byte_cap) {
+      // Arithmetic-mode prices follow the adapted contexts, so they are taken per row.
+      slice.dropped_mb_bits = dropped_mb_bits(slice, p_frame);
+      slice.row_delta_bits =
+          static_cast<double>(slice.entropy->qp_delta_cost(Quantizer::kMaxQp)) / (1 << kBitCostShift);
     }
-    int32_t cu[64], cv[64];
-    std::memset(cu, 0, sizeof(cu));
-    std::memset(cv, 0, sizeof(cv));
-    for (int i = 0; i < 64; ++i) {
-      if (i < uv.w * uv.h) cu[i] = uv.ptr[i / uv.w * uv.stride + i % uv.w];
-      if (i < vv.w * vv.h) cv[i] = vv.ptr[i / vv.w * vv.stride + i % vv.w];
+  }
+  row_qp_[static_cast<size_t>(mb_y)] = static_cast<uint8_t>(qp);
+  return qp;
+}
+
+void Encoder::limit_macroblock(Slice& slice, int mb_x, int mb_y, int mb_cols, bool p_frame) {
+  if (config_.frame_byte_cap == 0 || !config_.guaranteed_byte_cap) return;
+  const int left = (slice.end_row - mb_y) * mb_cols - mb_x;
+  slice.reserve_bits = (left - 1) * slice.dropped_mb_bits + (slice.end_row - mb_y - 1) * slice.row_delta_bits;
+  slice.drop_residual =
+      slice.row_rc.drop_residual(substream_bits(slice, p_frame), slice.dropped_mb_bits, slice.reserve_bits);
+  if (slice.drop_residual) slice.dropped_mbs++;
+}
+
+bool Encoder::residual_fits(const Slice& slice, const int32_t* coeff, uint32_t cbp, bool p_frame,
+                            const IntraMbModes* intra_modes) const {
+  if (config_.frame_byte_cap == 0 || !config_.guaranteed_byte_cap || cbp == 0) return true;
+  uint32_t cost = slice.entropy->cbp_cost(cbp | (p_frame && intra_modes ? kCbpIntraMb : 0u), p_frame);
+  if (intra_modes) cost += slice.entropy->intra_modes_cost(*intra_modes);
+  for (int i = 0; i < kCbpBlocks; ++i)
+    if (cbp & (1u << i)) cost += slice.entropy->block_cost(coeff + i * 64);
+  return slice.row_rc.fits(substream_bits(slice, p_frame), static_cast<double>(cost) / (1 << kBitCostShift),
+                           slice.reserve_bits);
+}
+
+double Encoder::dropped_mb_bits(const Slice& slice, bool p_frame) const {
+  IntraMbModes modes;
+  uint32_t modes_cost = 0;
+  for (int luma = 0; luma < kIntraModes; ++luma)
+    for (int chroma = 0; chroma < kIntraModes; ++chroma) {
+      modes.luma[0] = static_cast<IntraMode>(luma);
+      modes.chroma = static_cast<IntraMode>(chroma);
+      modes_cost = std::max(modes_cost, slice.entropy->intra_modes_cost(modes));
     }
-    quantizer_->quantize_8x8(cu, out.qp);
-    quantizer_->quantize_8x8(cv, out.qp);
-    entropy_->encode_block_8x8(cu, out.qp, bs);
-    entropy_->encode_block_8x8(cv, out.qp, bs);
-  });
-
-  bs.flush_byte_align();
-  out.coeff_bytes = bs.buffer();
-  return out;
+  uint32_t cost = slice.entropy->cbp_cost(0, false) + modes_cost;
+  if (p_frame) {
+    // Refresh bands and MBs without a match are intra even in P-frames.
+    const uint32_t inter =
+        slice.entropy->cbp_cost(0, true) + slice.mv_entropy->mvd_cost_bound(2 * config_.search_range);
+    cost = std::max(inter, slice.entropy->cbp_cost(kCbpIntraMb, true) + modes_cost);
+  }
+  return static_cast<double>(cost) / (1 << kBitCostShift);
 }
 
-EncodedFrame Encoder::encode_p_frame(const FrameYUV& frame, const FrameMeta& meta) {
-  EncodedFrame out;
-  out.type = FrameType::P;
-  out.frame_id = static_cast<uint32_t>(meta.frame_id);
-  out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
-  out.qp = static_cast<uint8_t>(config_.qp_default);
+void Encoder::begin_substream(Slice& slice, int mb_cols, bool p_frame) {
+  if (!row_progress_ || slice.first_row == slice.top_row) {
+    if (p_frame) slice.mv_entropy->begin_slice(slice.mv_out);
+    slice.entropy->begin_slice(slice.coeff_out);
+    return;
+  }
+  row_progress_->wait(slice.first_row - 1, std::min(2, mb_cols));
+  const RowContexts& above = *slices_[static_cast<size_t>(slice.first_row - 1)].contexts;
+  if (p_frame) slice.mv_entropy->begin_slice(slice.mv_out, above.mv);
+  slice.entropy->begin_slice(slice.coeff_out, above.coeff);
+}
 
-  if (!reference_ || reference_->empty()) {
-    return encode_i_frame(frame, meta);
+void Encoder::wavefront_wait(const Slice& slice, int mb_x, int mb_cols) {
+  // MV prediction reads the top-right MB; intra prediction only the MBs above and top-left.
+  if (row_progress_ && slice.first_row > slice.top_row)
+    row_progress_->wait(slice.first_row - 1, std::min(mb_x + 2, mb_cols));
+}
+
+void Encoder::wavefront_done(Slice& slice, int mb_x, int mb_cols) {
+  if (!row_progress_) return;
+  if (mb_x == std::min(2, mb_cols) - 1) {
+    slice.contexts->mv = slice.mv_entropy->context_state();
+    slice.contexts->coeff = slice.entropy->context_state();
   }
+  row_progress_->publish(slice.first_row, mb_x + 1);
+}
 
-  const FrameYUV& ref = *reference_;
-  int mb_cols = (frame.width + MB_SIZE - 1) / MB_SIZE;
-  int mb_rows = (frame.height + MB_SIZE - 1) / MB_SIZE;
-  mv_buffer_.resize(static_cast<size_t>(mb_cols * mb_rows));
+void Encoder::encode_i_slice(const SourceView& src, int qp, Slice& slice) {
+  int mb_cols = (src.width + MB_SIZE - 1) / MB_SIZE;
+  begin_substream(slice, mb_cols, false);
+  for (int mb_y = slice.first_row; mb_y < slice.end_row; ++mb_y) {
+    const int row_qp = begin_row(slice, mb_y, qp, false);
+    for (int mb_x = 0; mb_x < mb_cols; ++mb_x) {
+      BlockViewConst yv, uv, vv;
+      macroblock_views(src, BlockCoord{mb_x, mb_y}, &yv, &uv, &vv);
+      PaddedMb padded;
+      pad_macroblock(yv, uv, vv, &padded);
+      wavefront_wait(slice, mb_x, mb_cols);
+      limit_macroblock(slice, mb_x, mb_y, mb_cols, false);
+      encode_intra_macroblock(BlockCoord{mb_x, mb_y}, padded, row_qp, slice, false);
+      wavefront_done(slice, mb_x, mb_cols);
+    }
+    deblock_behind(slice, mb_y);
+  }
+  slice.entropy->end_slice(slice.coeff_out);
+  slice.coeff_out.flush_byte_align();
+}
+
+void Encoder::pad_macroblock(const BlockViewConst& yv, const BlockViewConst& uv, const BlockViewConst& vv,
+                             PaddedMb* out) {
+  auto pad = [](const BlockViewConst& v, int size, uint8_t* dst) {
+    if (v.w <= 0 || v.h <= 0) {
+      std::memset(dst, 128, static_cast<size_t>(size * size));
+      return;
+    }
+    for (int y = 0; y < size; ++y)
+      for (int x = 0; x < size; ++x) dst[y * size + x] = v.ptr[std::min(y, v.h - 1) * v.stride + std::min(x, v.w - 1)];
+  };
+  pad(yv, MB_SIZE, out->y);
+  pad(uv, MB_CHROMA_SIZE, out->u);
+  pad(vv, MB_CHROMA_SIZE, out->v);
+}
+
+// RD weight of a mode's bits (1/16 bit) against SATD.
+static uint32_t weigh_bits(int lambda, uint32_t bits) {
+  return (static_cast<uint32_t>(lambda) * bits + (1u << (kBitCostShift - 1))) >> kBitCostShift;
+}
+
+uint32_t Encoder::choose_intra_16x16(BlockCoord coord, const PaddedMb& src, int lambda, const Slice& slice,
+                                     IntraMbModes* modes, uint8_t* pred) const {
+  const bool top_ok = coord.mb_y > slice.top_row;
+  uint32_t best = UINT32_MAX;
+  uint8_t cand_pred[MB_SIZE * MB_SIZE];
+  for (int m = 0; m < kIntraModes; ++m) {
+    IntraMbModes cand;
+    cand.luma[0] = static_cast<IntraMode>(m);
+    predict_intra_luma(*intra_, *recon_, coord, -1, top_ok, cand.luma[0], cand_pred, MB_SIZE);
+    uint32_t cost = weigh_bits(lambda, slice.entropy->intra_modes_cost(cand));
+    for (int b = 0; b < 4; ++b) {
+      const int off = (b / 2) * 8 * MB_SIZE + (b % 2) * 8;
+      cost += intra_->satd_8x8(src.y + off, MB_SIZE, cand_pred + off, MB_SIZE);
+    }
+    if (cost < best) {
+      best = cost;
+      modes->luma[0] = cand.luma[0];
+      std::memcpy(pred, cand_pred, sizeof(cand_pred));
+    }
+  }
+  return best;
+}
 
-  BitstreamWriter mv_writer, coeff_writer;
-  int mb_idx = 0;
-
-  for_each_macroblock_const(frame, [&](BlockCoord coord, BlockViewConst yv, BlockViewConst uv, BlockViewConst vv) {
-    MotionResult res = config_.use_diamond_search
-        ? me_->estimate_diamond(yv, ref, coord)
-        : me_->estimate(yv, ref, coord);
-    mv_buffer_[mb_idx++] = res.mv;
-    entropy_->encode_mv(res.mv, mv_writer);
-
-    FrameYUV pred_one;
-    pred_one.allocate(MB_SIZE, MB_SIZE);
-    BlockView pv(pred_one.y_plane.data(), pred_one.stride_y, yv.w, yv.h);
-    mc_->predict_block(pv, ref, coord, res.mv);
-    BlockViewConst pvc(pred_one.y_plane.data(), pred_one.stride_y, yv.w, yv.h);
-
-    int16_t residual[256];
-    compute_residual(yv, pvc, residual);
-
-    int32_t coeff[4 * 64];
-    for (int by = 0; by < 2; ++by) {
-      for (int bx = 0; bx < 2; ++bx) {
-        int i = by * 2 + bx;
-        transform_->forward_8x8(residual + by * 8 * 16 + bx * 8, 16, coeff + i * 64);
-        quantizer_->quantize_8x8(coeff + i * 64, out.qp);
-        entropy_->encode_block_8x8(coeff + i * 64, out.qp, coeff_writer);
+void Encoder::encode_intra_macroblock(BlockCoord coord, const PaddedMb& src, int qp, Slice& slice, bool p_frame) {
+  const bool top_ok = coord.mb_y > slice.top_row;
+  const int lambda = MotionEstimation::lambda_for_qp(qp);
+  BlockView ry, ru, rv;
+  get_macroblock_views(*recon_, coord, &ry, &ru, &rv);
+  // 8x8 luma blocks wholly outside the frame are never shown, so they code no residual.
+  auto visible = [&](int b) { return ry.w > (b % 2) * 8 && ry.h > (b / 2) * 8; };
+  auto code_block = [&](const uint8_t* s, int s_stride, const uint8_t* p, int p_stride, QuantMatrixKind kind,
+                        int32_t* c) {
+    if (slice.drop_residual) return false;
+    int16_t res[64];
+    for (int y = 0; y < 8; ++y)
+      for (int x = 0; x < 8; ++x)
+        res[y * 8 + x] = static_cast<int16_t>(s[y * s_stride + x] - p[y * p_stride + x]);
+    transform_->forward_8x8(res, 8, c);
+    quantizer_->quantize_8x8(c, qp, kind);
+    return EntropyCoder::is_coded(c);
+  };
+
+  IntraMbModes modes;
+  uint8_t pred16[MB_SIZE * MB_SIZE];
+  const uint32_t cost16 = choose_intra_16x16(coord, src, lambda, slice, &modes, pred16);
+
+  // Split: each 8x8 block picks its mode against the blocks already rebuilt, so it is coded
+  // and reconstructed while choosing. Faster speed presets skip it (intra_split off), and
+  // so do MBs without residual.
+  IntraMbModes split = modes;
+  split.split = true;
+  int32_t coeff[kCbpBlocks * 64] = {};
+  uint32_t cbp = 0;
+  const bool try_split = config_.intra_split && !slice.drop_residual;
+  uint32_t cost8 = try_split ? 0 : UINT32_MAX;
+  for (int b = 0; b < 4 && try_split; ++b) {
+    const int off = (b / 2) * 8 * MB_SIZE + (b % 2) * 8;
+    uint8_t pred[64], best_pred[64];
+    uint32_t best = UINT32_MAX;
+    for (int m = 0; m < kIntraModes; ++m) {
+      predict_intra_luma(*intra_, *recon_, coord, b, top_ok, static_cast<IntraMode>(m), pred, 8);
+      uint32_t satd = intra_->satd_8x8(src.y + off, MB_SIZE, pred, 8);
+      if (satd < best) {
+        best = satd;
+        split.luma[b] = static_cast<IntraMode>(m);
+        std::memcpy(best_pred, pred, sizeof(pred));
       }
     }
-    int32_t cu[64], cv[64];
-    std::memset(cu, 0, sizeof(cu));
-    std::memset(cv, 0, sizeof(cv));
-    entropy_->encode_block_8x8(cu, out.qp, coeff_writer);
-    entropy_->encode_block_8x8(cv, out.qp, coeff_writer);
-  });
-
-  mv_writer.flush_byte_align();
-  coeff_writer.flush_byte_align();
-  out.mv_bytes = mv_writer.buffer();
-  out.coeff_bytes = coeff_writer.buffer();
-  return out;
+    cost8 += best;
+    if (!visible(b)) continue;
+    const bool coded = code_block(src.y + off, MB_SIZE, best_pred, 8, QuantMatrixKind::IntraLuma, coeff + b * 64);
+    if (coded) cbp |= 1u << b;
+    BlockView dst(ry.ptr + (b / 2) * 8 * ry.stride + (b % 2) * 8, ry.stride,
+                  std::clamp(ry.w - (b % 2) * 8, 0, 8), std::clamp(ry.h - (b / 2) * 8, 0, 8));
+    reconstruct_block_8x8(coeff + b * 64, coded, qp, QuantMatrixKind::IntraLuma, best_pred, 8, dst,
+                          *quantizer_, *transform_);
+  }
+  if (try_split) cost8 += weigh_bits(lambda, slice.entropy->intra_modes_cost(split));
+
+  if (cost8 < cost16) {
+    modes = split;
+  } else {
+    cbp = 0;
+    std::memset(coeff, 0, 4 * 64 * sizeof(int32_t));
+    for (int b = 0; b < 4; ++b) {
+      if (!visible(b)) continue;
+      const int off = (b / 2) * 8 * MB_SIZE + (b % 2) * 8;
+      if (code_block(src.y + off, MB_SIZE, pred16 + off, MB_SIZE, QuantMatrixKind::IntraLuma, coeff + b * 64))
+        cbp |= 1u << b;
+    }
+  }
+
+  uint8_t pred_u[64], pred_v[64], best_u[64], best_v[64];
+  uint32_t best_chroma = UINT32_MAX;
+  for (int m = 0; m < kIntraModes; ++m) {
+    predict_intra_chroma(*intra_, *recon_, coord, top_ok, static_cast<IntraMode>(m), pred_u, pred_v);
+    uint32_t satd = intra_->satd_8x8(src.u, MB_CHROMA_SIZE, pred_u, MB_CHROMA_SIZE) +
+                    intra_->satd_8x8(src.v, MB_CHROMA_SIZE, pred_v, MB_CHROMA_SIZE);
+    if (satd < best_chroma) {
+      best_chroma = satd;
+      modes.chroma = static_cast<IntraMode>(m);
+      std::memcpy(best_u, pred_u, sizeof(pred_u));
+      std::memcpy(best_v, pred_v, sizeof(pred_v));
+    }
+  }
+  if (code_block(src.u, MB_CHROMA_SIZE, best_u, MB_CHROMA_SIZE, QuantMatrixKind::IntraChroma, coeff + 4 * 64))
+    cbp |= 1u << 4;
+  if (code_block(src.v, MB_CHROMA_SIZE, best_v, MB_CHROMA_SIZE, QuantMatrixKind::IntraChroma, coeff + 5 * 64))
+    cbp |= 1u << 5;
+
+  // Over the guaranteed cap the MB is chosen again without residual: split blocks were
+  // already predicted from rebuilt blocks that included theirs.
+  if (!residual_fits(slice, coeff, cbp, p_frame, &modes)) {
+    slice.drop_residual = true;
+    slice.dropped_mbs++;
+    encode_intra_macroblock(coord, src, qp, slice, p_frame);
+    return;
+  }
+  encode_mb_coefficients(coeff, cbp, qp, slice, p_frame, &modes);
+  reconstruct_intra_macroblock(*recon_, coord, coeff, cbp, qp, modes, top_ok, *intra_, *quantizer_, *transform_);
+  const int mb_cols = (recon_->width + MB_SIZE - 1) / MB_SIZE;
+  MbDeblockInfo& info = mb_info_[static_cast<size_t>(coord.mb_y * mb_cols + coord.mb_x)];
+  info.mv = MotionVector();
+  info.cbp = static_cast<uint8_t>(cbp);
+  info.intra = true;
+}
+
+void Encoder::encode_mb_coefficients(const int32_t* coeff, uint32_t cbp, int qp, Slice& slice, bool p_frame,
+                                     const IntraMbModes* intra_modes) {
+  slice.entropy->encode_cbp(cbp | (p_frame && intra_modes ? kCbpIntraMb : 0u), slice.coeff_out, p_frame);
+  if (intra_modes) slice.entropy->encode_intra_modes(*intra_modes, slice.coeff_out);
+  for (int i = 0; i < kCbpBlocks; ++i)
+    if (cbp & (1u << i)) slice.entropy->encode_block_8x8(coeff + i * 64, qp, slice.coeff_out);
 }
 
-EncodedFrame Encoder::encode_p_frame(const Frame& frame, const FrameMeta& meta) {
+EncodedFrame Encoder::encode_p_frame(const SourceView& src, const FrameMeta& meta) {
   EncodedFrame out;
   out.type = FrameType::P;
   out.frame_id = static_cast<uint32_t>(meta.frame_id);
   out.timestamp_us = static_cast<uint64_t>(meta.timestamp_us);
-  out.qp = static_cast<uint8_t>(config_.qp_default);
+  out.qp = static_cast<uint8_t>(qp_);
 
   if (!reference_ || reference_->empty()) {
-    return encode_i_frame(frame, meta);
+    return encode_i_frame(src, meta);
   }
 
-  const FrameYUV& ref = *reference_;
-  int mb_cols = (frame.width() + MB_SIZE - 1) / MB_SIZE;
-  int mb_rows = (frame.height() + MB_SIZE - 1) / MB_SIZE;
+  int mb_cols = (src.width + MB_SIZE - 1) / MB_SIZE;
+  int mb_rows = (src.height + MB_SIZE - 1) / MB_SIZE;
   mv_buffer_.resize(static_cast<size_t>(mb_cols * mb_rows));
+  // Intra refresh: this frame's band of intra columns. Columns left of it were refreshed
+  // earlier in the sweep and may only predict from refreshed samples (encode_p_macroblock).
+  // With temporal layers only T0 frames, which predict from T0, carry bands: the others are
+  // never predicted from by T0.
+  const int n = config_.intra_refresh_frames;
+  refresh_begin_ = refresh_end_ = 0;
+  if (n > 0 && temporal_layer_ == 0) {
+    refresh_begin_ = refresh_phase_ * mb_cols / n;
+    refresh_end_ = (refresh_phase_ + 1) * mb_cols / n;
+    refresh_phase_ = (refresh_phase_ + 1) % n;
+  }
+  encode_slices(src, out.qp, out);
+  return out;
+}
 
-  BitstreamWriter mv_writer, coeff_writer;
-  int mb_idx = 0;
-
-  for_each_macroblock_const(frame, [&](BlockCoord coord, BlockViewConst yv, BlockViewConst uv, BlockViewConst vv) {
-    MotionResult res = config_.use_diamond_search
-        ? me_->estimate_diamond(yv, ref, coord)
-        : me_->estimate(yv, ref, coord);
-    mv_buffer_[mb_idx++] = res.mv;
-    entropy_->encode_mv(res.mv, mv_writer);
-
-    FrameYUV pred_one;
-    pred_one.allocate(MB_SIZE, MB_SIZE);
-    BlockView pv(pred_one.y_plane.data(), pred_one.stride_y, yv.w, yv.h);
-    mc_->predict_block(pv, ref, coord, res.mv);
-    BlockViewConst pvc(pred_one.y_plane.data(), pred_one.stride_y, yv.w, yv.h);
-
-    int16_t residual[256];
-    compute_residual(yv, pvc, residual);
-
-    int32_t coeff[4 * 64];
-    for (int by = 0; by < 2; ++by) {
-      for (int bx = 0; bx < 2; ++bx) {
-        int i = by * 2 + bx;
-        transform_->forward_8x8(residual + by * 8 * 16 + bx * 8, 16, coeff + i * 64);
-        quantizer_->quantize_8x8(coeff + i * 64, out.qp);
-        entropy_->encode_block_8x8(coeff + i * 64, out.qp, coeff_writer);
-      }
+void Encoder::encode_p_slice(const SourceView& src, int qp, Slice& slice) {
+  int mb_cols = (src.width + MB_SIZE - 1) / MB_SIZE;
+  begin_substream(slice, mb_cols, true);
+  slice.motion_cost = 0;
+  for (int mb_y = slice.first_row; mb_y < slice.end_row; ++mb_y) {
+    slice.mv_entropy->refresh_costs();  // arithmetic mode: MVD prices follow the adapted contexts
+    const int row_qp = begin_row(slice, mb_y, qp, true);
+    for (int mb_x = 0; mb_x < mb_cols; ++mb_x) {
+      BlockCoord coord{mb_x, mb_y};
+      BlockViewConst yv, uv, vv;
+      macroblock_views(src, coord, &yv, &uv, &vv);
+      wavefront_wait(slice, mb_x, mb_cols);
+      limit_macroblock(slice, mb_x, mb_y, mb_cols, true);
+      encode_p_macroblock(coord, yv, uv, vv, row_qp, slice);
+      wavefront_done(slice, mb_x, mb_cols);
     }
-    int32_t cu[64], cv[64];
-    std::memset(cu, 0, sizeof(cu));
-    std::memset(cv, 0, sizeof(cv));
-    entropy_->encode_block_8x8(cu, out.qp, coeff_writer);
-    entropy_->encode_block_8x8(cv, out.qp, coeff_writer);
-  });
-
-  mv_writer.flush_byte_align();
-  coeff_writer.flush_byte_align();
-  out.mv_bytes = mv_writer.buffer();
-  out.coeff_bytes = coeff_writer.buffer();
-  return out;
+    deblock_behind(slice, mb_y);
+  }
+  slice.mv_entropy->end_slice(slice.mv_out);
+  slice.entropy->end_slice(slice.coeff_out);
+  slice.mv_out.flush_byte_align();
+  slice.coeff_out.flush_byte_align();
+}
+
+void Encoder::encode_p_macroblock(BlockCoord coord, const BlockViewConst& yv,
+                                  const BlockViewConst& uv, const BlockViewConst& vv,
+                                  int qp, Slice& slice) {
+  const FrameYUV& ref = *reference_;
+  const int mb_cols = (ref.width + MB_SIZE - 1) / MB_SIZE;
+  const MotionVector mv_pred = predict_mv(mv_buffer_.data(), mb_cols, coord.mb_x, coord.mb_y,
+                                          slice.top_row);
+  const int lambda = MotionEstimation::lambda_for_qp(qp);
+  MotionVector& mv_slot = mv_buffer_[static_cast<size_t>(coord.mb_y * mb_cols + coord.mb_x)];
+
+  // Intra refresh: the band is coded intra. MBs left of it were refreshed earlier in the
+  // sweep and must not pick up unrefreshed samples again, so their prediction stays left of
+  // the band's left edge in the reference, less the 3 samples deblocking may have mixed in
+  // from the unrefreshed side (chroma, at half the MV, stays clear of its 1-sample reach).
+  const bool refresh = coord.mb_x >= refresh_begin_ && coord.mb_x < refresh_end_;
+  const int max_ref_x = coord.mb_x < refresh_begin_ ? refresh_begin_ * MB_SIZE - 4 : INT_MAX;
+  MotionResult res;
+  if (!refresh) {
+    res = config_.use_diamond_search
+        ? me_->estimate_diamond(yv, ref, coord, mv_pred, lambda, slice.mv_entropy.get(), max_ref_x)
+        : me_->estimate(yv, ref, coord, mv_pred, lambda, slice.mv_entropy.get(), max_ref_x);
+  }
+  if (!refresh && res.cost != 0xFFFFFFFFu) slice.motion_cost += res.cost;
+  if (refresh || res.cost == 0xFFFFFFFFu) {  // band MB, or no prediction inside the refreshed area
+    PaddedMb padded;
+    pad_macroblock(yv, uv, vv, &padded);
+    mv_slot = MotionVector();
+    encode_intra_macroblock(coord, padded, qp, slice, true);
+    return;
+  }
+
+  uint8_t pred[MB_SIZE * MB_SIZE], pred_u[64], pred_v[64];
+  predict_inter_macroblock(*mc_, ref, coord, res.mv, pred, pred_u, pred_v);
+  BlockViewConst pvc(pred, MB_SIZE, yv.w, yv.h);
+
+  int16_t residual[256] = {};
+  compute_residual(yv, pvc, residual);
+
+  // Blocks whose residual SAD is under the quantizer's provable bound would quantize to
+  // all zeros, so they skip the transform and stay out of the CBP.
+  const uint32_t zero_threshold = quantizer_->zero_block_sad_threshold(qp, QuantMatrixKind::InterLuma);
+
+  // Where the match leaves a residual worth coding (uncovered background, a hand entering
+  // the frame), try intra: both sides are compared by SATD plus their side-info bits.
+  // Without residual (guaranteed_byte_cap) the MB is the motion-compensated prediction.
+  const bool drop = slice.drop_residual;
+  bool try_intra = config_.inter_intra && !drop && yv.w == MB_SIZE && yv.h == MB_SIZE;
+  if (try_intra) {
+    try_intra = false;
+    for (int i = 0; i < 4 && !try_intra; ++i)
+      try_intra = residual_sad_8x8(residual + (i / 2) * 8 * 16 + (i % 2) * 8, 16) > zero_threshold;
+  }
+  if (try_intra) {
+    PaddedMb padded;
+    pad_macroblock(yv, uv, vv, &padded);
+    uint32_t inter_satd = 0;
+    for (int i = 0; i < 4; ++i) {
+      const int off = (i / 2) * 8 * MB_SIZE + (i % 2) * 8;
+      inter_satd += intra_->satd_8x8(padded.y + off, MB_SIZE, pred + off, MB_SIZE);
+    }
+    const uint32_t inter_cost =
+        inter_satd + weigh_bits(lambda, slice.mv_entropy->mvd_cost(res.mv.dx - mv_pred.dx, res.mv.dy - mv_pred.dy));
+    IntraMbModes modes;
+    uint8_t pred16[MB_SIZE * MB_SIZE];
+    const uint32_t escape_bits = slice.entropy->cbp_cost(kCbpIntraMb, true) - slice.entropy->cbp_cost(0, true);
+    const uint32_t intra_cost =
+        choose_intra_16x16(coord, padded, lambda, slice, &modes, pred16) + weigh_bits(lambda, escape_bits);
+    if (intra_cost < inter_cost) {
+      mv_slot = MotionVector();
+      encode_intra_macroblock(coord, padded, qp, slice, true);
+      return;
+    }
+  }
+  mv_slot = res.mv;
+  slice.mv_entropy->encode_mv(res.mv, mv_pred, slice.mv_out);
+  int32_t coeff[kCbpBlocks * 64];
+  uint32_t cbp = 0;
+  for (int by = 0; by < 2; ++by) {
+    for (int bx = 0; bx < 2; ++bx) {
+      int i = by * 2 + bx;
+      const int16_t* blk = residual + by * 8 * 16 + bx * 8;
+      if (drop || residual_sad_8x8(blk, 16) <= zero_threshold) continue;
+      transform_->forward_8x8(blk, 16, coeff + i * 64);
+      quantizer_->quantize_8x8(coeff + i * 64, qp, QuantMatrixKind::InterLuma);
+      if (EntropyCoder::is_coded(coeff + i * 64)) cbp |= 1u << i;
+    }
+  }
+
+  // Chroma follows the luma MV at half resolution; its residual takes CBP bits 4 and 5.
+  const uint32_t chroma_zero = quantizer_->zero_block_sad_threshold(qp, QuantMatrixKind::InterChroma);
+  const BlockViewConst* chroma_src[2] = {&uv, &vv};
+  const uint8_t* chroma_pred[2] = {pred_u, pred_v};
+  for (int c = 0; c < 2; ++c) {
+    const BlockViewConst& cur = *chroma_src[c];
+    int16_t cres[64] = {};
+    for (int y = 0; y < cur.h; ++y)
+      for (int x = 0; x < cur.w; ++x)
+        cres[y * 8 + x] = static_cast<int16_t>(cur.ptr[y * cur.stride + x] - chroma_pred[c][y * 8 + x]);
+    if (drop || residual_sad_8x8(cres, 8) <= chroma_zero) continue;
+    int32_t* cc = coeff + (4 + c) * 64;
+    transform_->forward_8x8(cres, 8, cc);
+    quantizer_->quantize_8x8(cc, qp, QuantMatrixKind::InterChroma);
+    if (EntropyCoder::is_coded(cc)) cbp |= 1u << (4 + c);
+  }
+  if (!residual_fits(slice, coeff, cbp, true, nullptr)) {
+    cbp = 0;
+    slice.dropped_mbs++;
+  }
+  encode_mb_coefficients(coeff, cbp, qp, slice, true, nullptr);
+  reconstruct_macroblock(*recon_, coord, coeff, cbp, qp, false, pred, pred_u, pred_v, *quantizer_, *transform_);
+  MbDeblockInfo& info = mb_info_[static_cast<size_t>(coord.mb_y * mb_cols + coord.mb_x)];
+  info.mv = res.mv;
+  info.cbp = static_cast<uint8_t>(cbp);
+  info.intra = false;
 }
 
 }  // namespace codec
@@ -2,6 +2,7 @@
 #include <codec/Block.h>
 #include <algorithm>
 #include <cstring>
+#include <iterator>
 
 namespace telehealth {
 namespace codec {
@@ -17,10 +18,17 @@ const int kZigzag8x8[64] = {
   53, 60, 61, 54, 47, 55, 62, 63
 };
 
-static void encode_coeff_run(BitstreamWriter& out, int run, int level) {
-  if (run > 15) {
-    out.write_bits(0xF, 4);
-    out.write_bits(static_cast<uint32_t>(run - 16), 8);
+// Fixed-mode run nibble: 0-13 literal, 14 = escape (6 more run bits), 15 = end of block.
+constexpr uint32_t kRunEscape = 14;
+constexpr uint32_t kRunEndOfBlock = 15;
+
+// The VLC syntax is written against any writer with write_bits/write_ue/write_se, so the same
+// code drives BitstreamWriter and the BitCounter used for rate estimates.
+template <class Writer>
+static void write_coeff_run(Writer& out, int run, int level) {
+  if (run >= static_cast<int>(kRunEscape)) {
+    out.write_bits(kRunEscape, 4);
+    out.write_bits(static_cast<uint32_t>(run) - kRunEscape, 6);
   } else {
     out.write_bits(static_cast<uint32_t>(run), 4);
   }
@@ -30,65 +38,858 @@ static void encode_coeff_run(BitstreamWriter& out, int run, int level) {
   out.write_bits(static_cast<uint32_t>(s), 1);
 }
 
-static void decode_coeff_run(BitstreamReader& in, int& run, int& level) {
-  run = static_cast<int>(in.read_bits(4));
-  if (run == 15)
-    run += static_cast<int>(in.read_bits(8));
+// Returns false at the end-of-block code.
+static bool decode_coeff_run(BitstreamReader& in, int& run, int& level) {
+  uint32_t code = in.read_bits(4);
+  if (code == kRunEndOfBlock) return false;
+  run = static_cast<int>(code);
+  if (code == kRunEscape)
+    run += static_cast<int>(in.read_bits(6));
   level = static_cast<int>(in.read_bits(12));
   if (in.read_bits(1))
     level = -level;
+  return true;
 }
 
-void EntropyCoder::encode_block_8x8(const int32_t* coeff, int qp, BitstreamWriter& out) {
+template <class Writer>
+static void write_block_fixed(Writer& out, const int32_t* coeff) {
   int run = 0;
   for (int i = 0; i < 64; ++i) {
-    int idx = kZigzag8x8[i];
-    int v = coeff[idx];
+    int v = coeff[kZigzag8x8[i]];
     if (v == 0) {
       run++;
     } else {
-      encode_coeff_run(out, run, v);
+      write_coeff_run(out, run, v);
       run = 0;
     }
   }
-  encode_coeff_run(out, run, 0);
+  if (run > 0) out.write_bits(kRunEndOfBlock, 4);
+}
+
+template <class Writer>
+static void write_exp_golomb_pair(Writer& out, int run, int level) {
+  out.write_ue(static_cast<uint32_t>(run));
+  out.write_ue(static_cast<uint32_t>(std::abs(level) - 1));
+  out.write_bits(level < 0 ? 1u : 0u, 1);
+}
+
+template <class Writer>
+static void write_block_exp_golomb(Writer& out, const int32_t* coeff) {
+  int nonzero = 0;
+  for (int i = 0; i < 64; ++i)
+    nonzero += coeff[i] != 0;
+  out.write_ue(static_cast<uint32_t>(nonzero - 1));
+  int run = 0;
+  for (int i = 0; i < 64; ++i) {
+    int v = coeff[kZigzag8x8[i]];
+    if (v == 0) {
+      run++;
+      continue;
+    }
+    write_exp_golomb_pair(out, run, v);
+    run = 0;
+  }
+}
+
+static void decode_block_exp_golomb(BitstreamReader& in, int32_t* coeff_out) {
+  uint32_t nonzero = std::min<uint32_t>(in.read_ue(), 63) + 1;
+  uint32_t k = 0;
+  for (uint32_t n = 0; n < nonzero; ++n) {
+    k += in.read_ue();
+    if (k >= 64) break;
+    int level = static_cast<int>(std::min<uint32_t>(in.read_ue(), 0x7FFFFFFE) + 1);
+    coeff_out[kZigzag8x8[k]] = in.read_bits(1) ? -level : level;
+    k++;
+  }
+}
+
+// Huffman-mode symbols go to a sink: the table-driven writer, a counter gathering the
+// training statistics (escape suffixes and signs are not counted), or the rANS symbol buffers.
+enum HuffmanTableId { kPairTable, kCbpTable, kMvdTable };
+
+template <class Writer>
+struct HuffmanSymbolWriter {
+  const HuffmanTables& tables;
+  Writer& out;
+  void symbol(HuffmanTableId t, int s) {
+    (t == kPairTable ? tables.pair : t == kCbpTable ? tables.cbp : tables.mvd).write(out, s);
+  }
+  void write_bits(uint32_t value, int num_bits) { out.write_bits(value, num_bits); }
+  void write_ue(uint32_t value) { out.write_ue(value); }
+};
+
+struct HuffmanSymbolCounter {
+  HuffmanStats& stats;
+  void symbol(HuffmanTableId t, int s) {
+    ++(t == kPairTable ? stats.pair : t == kCbpTable ? stats.cbp : stats.mvd)[s];
+  }
+  void write_bits(uint32_t, int) {}
+  void write_ue(uint32_t) {}
+};
+
+struct RansSymbolSink {
+  std::vector<uint8_t>* symbols;  // per HuffmanTableId
+  BitstreamWriter& side;
+  void symbol(HuffmanTableId t, int s) { symbols[t].push_back(static_cast<uint8_t>(s)); }
+  void write_bits(uint32_t value, int num_bits) { side.write_bits(value, num_bits); }
+  void write_ue(uint32_t value) { side.write_ue(value); }
+};
+
+// Decoding counterparts: symbols from the Huffman tables or the decoded rANS buffers, escape
+// suffixes and signs from the reader.
+struct HuffmanSymbolSource {
+  const HuffmanTables& tables;
+  BitstreamReader& in;
+  int symbol(HuffmanTableId t) {
+    return (t == kPairTable ? tables.pair : t == kCbpTable ? tables.cbp : tables.mvd).read(in);
+  }
+  uint32_t read_bits(int num_bits) { return in.read_bits(num_bits); }
+  uint32_t read_ue() { return in.read_ue(); }
+};
+
+struct RansSymbolSource {
+  const std::vector<uint8_t>* symbols;
+  size_t* pos;
+  BitstreamReader& in;
+  int symbol(HuffmanTableId t) {
+    return pos[t] < symbols[t].size() ? symbols[t][pos[t]++] : 0;  // 0 past the end (corrupt slice)
+  }
+  uint32_t read_bits(int num_bits) { return in.read_bits(num_bits); }
+  uint32_t read_ue() { return in.read_ue(); }
+};
+
+template <class Sink>
+static void code_huffman_pair(Sink& sink, int run, int level) {
+  int a = std::abs(level);
+  int run_class = std::min(run, kHuffmanRunClasses - 1);
+  int level_class = std::min(a, kHuffmanLevelClasses);
+  sink.symbol(kPairTable, run_class * kHuffmanLevelClasses + level_class - 1);
+  if (run_class == kHuffmanRunClasses - 1) sink.write_ue(static_cast<uint32_t>(run - run_class));
+  if (level_class == kHuffmanLevelClasses) sink.write_ue(static_cast<uint32_t>(a - level_class));
+  sink.write_bits(level < 0 ? 1u : 0u, 1);
+}
+
+template <class Sink>
+static void code_block_huffman(Sink& sink, const int32_t* coeff) {
+  int run = 0;
+  for (int i = 0; i < 64; ++i) {
+    int v = coeff[kZigzag8x8[i]];
+    if (v == 0) {
+      run++;
+      continue;
+    }
+    code_huffman_pair(sink, run, v);
+    run = 0;
+  }
+  if (run > 0) sink.symbol(kPairTable, kHuffmanEndOfBlock);
+}
+
+template <class Sink>
+static void code_mvd_huffman(Sink& sink, int d) {
+  constexpr uint32_t kEscape = kHuffmanMvdSymbols - 1;
+  uint32_t v = se_to_ue(d);
+  if (v < kEscape) {
+    sink.symbol(kMvdTable, static_cast<int>(v));
+  } else {
+    sink.symbol(kMvdTable, static_cast<int>(kEscape));
+    sink.write_ue(v - kEscape);
+  }
+}
+
+template <class Source>
+static void decode_block_symbols(Source& in, int32_t* coeff_out) {
+  int k = 0;
+  while (k < 64) {
+    int sym = in.symbol(kPairTable);
+    if (sym == kHuffmanEndOfBlock) break;
+    int run = sym / kHuffmanLevelClasses;
+    int level = sym % kHuffmanLevelClasses + 1;
+    if (run == kHuffmanRunClasses - 1) run += static_cast<int>(std::min<uint32_t>(in.read_ue(), 64));
+    if (level == kHuffmanLevelClasses) level += static_cast<int>(std::min<uint32_t>(in.read_ue(), 0x7FFFFFF0));
+    k += run;
+    if (k >= 64) break;
+    coeff_out[kZigzag8x8[k]] = in.read_bits(1) ? -level : level;
+    k++;
+  }
+}
+
+template <class Source>
+static int decode_mvd_symbols(Source& in) {
+  constexpr uint32_t kEscape = kHuffmanMvdSymbols - 1;
+  uint32_t v = static_cast<uint32_t>(in.symbol(kMvdTable));
+  if (v == kEscape) v += std::min<uint32_t>(in.read_ue(), 0x1FFFF);
+  return (v & 1) ? static_cast<int>((v + 1) / 2) : -static_cast<int>(v / 2);
+}
+
+// VLC writers; a non-null huffman selects the Huffman syntax.
+template <class Writer>
+static void write_pair(Writer& out, EntropyMode mode, const HuffmanTables* huffman, int run, int level) {
+  if (huffman) {
+    HuffmanSymbolWriter<Writer> sink{*huffman, out};
+    code_huffman_pair(sink, run, level);
+  } else if (mode == EntropyMode::Fixed) {
+    write_coeff_run(out, run, level);
+  } else {
+    write_exp_golomb_pair(out, run, level);
+  }
+}
+
+template <class Writer>
+static void write_block(Writer& out, EntropyMode mode, const HuffmanTables* huffman, const int32_t* coeff) {
+  if (huffman) {
+    HuffmanSymbolWriter<Writer> sink{*huffman, out};
+    code_block_huffman(sink, coeff);
+  } else if (mode == EntropyMode::ExpGolomb) {
+    write_block_exp_golomb(out, coeff);
+  } else {
+    write_block_fixed(out, coeff);
+  }
+}
+
+template <class Writer>
+static void write_mvd_component(Writer& out, EntropyMode mode, const HuffmanTables* huffman, int d) {
+  if (huffman) {
+    HuffmanSymbolWriter<Writer> sink{*huffman, out};
+    code_mvd_huffman(sink, d);
+  } else if (mode == EntropyMode::ExpGolomb) {
+    out.write_se(d);
+  } else {
+    out.write_bits(static_cast<uint32_t>(d & 0xFFFF), 16);
+  }
+}
+
+template <class Writer>
+static void write_mvd(Writer& out, EntropyMode mode, const HuffmanTables* huffman, int dx, int dy) {
+  write_mvd_component(out, mode, huffman, dx);
+  write_mvd_component(out, mode, huffman, dy);
+}
+
+template <class Writer>
+static void write_cbp(Writer& out, EntropyMode mode, const HuffmanTables* huffman, uint32_t cbp, bool p_frame) {
+  if (mode == EntropyMode::Fixed) {
+    out.write_bits(cbp, p_frame ? kCbpBlocks + 1 : kCbpBlocks);
+    return;
+  }
+  const bool intra = p_frame && (cbp & kCbpIntraMb);
+  cbp &= kCbpIntraMb - 1;
+  if (huffman) {
+    if (intra) huffman->cbp.write(out, kHuffmanCbpIntra);
+    huffman->cbp.write(out, static_cast<int>(cbp));
+  } else {
+    if (intra) out.write_ue(static_cast<uint32_t>(kHuffmanCbpIntra));
+    out.write_ue(cbp);
+  }
+}
+
+template <class Writer>
+static void write_intra_modes(Writer& out, const IntraMbModes& modes) {
+  out.write_bits(modes.split ? 1u : 0u, 1);
+  for (int i = 0; i < (modes.split ? 4 : 1); ++i) out.write_bits(static_cast<uint32_t>(modes.luma[i]), 2);
+  out.write_bits(static_cast<uint32_t>(modes.chroma), 2);
+}
+
+static IntraMbModes read_intra_modes(BitstreamReader& in) {
+  IntraMbModes modes;
+  modes.split = in.read_bits(1) != 0;
+  for (int i = 0; i < (modes.split ? 4 : 1); ++i) modes.luma[i] = static_cast<IntraMode>(in.read_bits(2));
+  modes.chroma = static_cast<IntraMode>(in.read_bits(2));
+  return modes;
+}
+
+// Arithmetic-mode bins go to a sink: the range encoder, or a cost accumulator that prices
+// each bin from its context without adapting it.
+struct RangeBinSink {
+  RangeEncoder& rc;
+  BitstreamWriter& out;
+  void bin(BinContext& ctx, int b) { rc.encode_bin(ctx, b, out); }
+  void bypass(uint32_t value, int num_bits) { rc.encode_bypass(value, num_bits, out); }
+};
+
+struct BinCostSink {
+  uint32_t cost = 0;
+  void bin(const BinContext& ctx, int b) { cost += bin_cost(ctx, b); }
+  void bypass(uint32_t, int num_bits) { cost += static_cast<uint32_t>(num_bits) << kBitCostShift; }
+};
+
+// Unary prefix of min(v, cutoff) bins over ctx[min(bin, num_ctx - 1)], then a k-th order
+// Exp-Golomb bypass suffix for v - cutoff (the UEGk binarization of H.264 CABAC).
+template <class Sink, class Ctx>
+static void code_ueg(Sink& sink, uint32_t v, Ctx* ctx, int num_ctx, uint32_t cutoff, int k) {
+  for (uint32_t i = 0; i < cutoff; ++i) {
+    int bin = v > i ? 1 : 0;
+    sink.bin(ctx[std::min<int>(static_cast<int>(i), num_ctx - 1)], bin);
+    if (!bin) return;
+  }
+  uint32_t rest = v - cutoff;
+  while (rest >= (1u << k)) {
+    sink.bypass(1, 1);
+    rest -= 1u << k;
+    k++;
+  }
+  sink.bypass(0, 1);
+  sink.bypass(rest, k);
+}
+
+static uint32_t decode_ueg(RangeDecoder& rc, BinContext* ctx, int num_ctx, uint32_t cutoff, int k,
+                           BitstreamReader& in) {
+  uint32_t v = 0;
+  while (v < cutoff) {
+    if (!rc.decode_bin(ctx[std::min<int>(static_cast<int>(v), num_ctx - 1)], in)) return v;
+    v++;
+  }
+  while (k < 31 && rc.decode_bypass(1, in)) {
+    v += 1u << k;
+    k++;
+  }
+  return v + rc.decode_bypass(k, in);
+}
+
+template <class Sink, class Contexts>
+static void code_block_arithmetic(Sink& sink, Contexts& ctx, const int32_t* coeff) {
+  int last = 0;
+  for (int i = 0; i < 64; ++i)
+    if (coeff[kZigzag8x8[i]] != 0) last = i;
+  // Significance map; a block whose only nonzero is position 63 sends no last flag.
+  for (int i = 0; i < 63; ++i) {
+    int sig = coeff[kZigzag8x8[i]] != 0 ? 1 : 0;
+    sink.bin(ctx.sig[i], sig);
+    if (sig) {
+      sink.bin(ctx.last[i], i == last ? 1 : 0);
+      if (i == last) break;
+    }
+  }
+  int ones = 0, greater = 0;
+  for (int i = last; i >= 0; --i) {
+    int v = coeff[kZigzag8x8[i]];
+    if (v == 0) continue;
+    uint32_t mag = static_cast<uint32_t>(std::abs(v) - 1);
+    sink.bin(ctx.level_gt1[greater ? 0 : 1 + std::min(ones, 3)], mag > 0 ? 1 : 0);
+    if (mag > 0) {
+      code_ueg(sink, mag - 1, &ctx.level_abs[std::min(greater, 4)], 1, 13, 0);
+      greater++;
+    } else {
+      ones++;
+    }
+    sink.bypass(v < 0 ? 1u : 0u, 1);
+  }
+}
+
+template <class Sink, class Ctx>
+static void code_mv_component(Sink& sink, Ctx* ctx, int v) {
+  code_ueg(sink, static_cast<uint32_t>(std::abs(v)), ctx, 7, 9, 3);
+  if (v != 0) sink.bypass(v < 0 ? 1u : 0u, 1);
+}
+
+template <class Sink, class Contexts>
+static void code_intra_mode_arithmetic(Sink& sink, Contexts& ctx, int plane, IntraMode mode) {
+  const int hi = (static_cast<int>(mode) >> 1) & 1;
+  sink.bin(ctx.intra_mode[plane][0], hi);
+  sink.bin(ctx.intra_mode[plane][1 + hi], static_cast<int>(mode) & 1);
+}
+
+template <class Sink, class Contexts>
+static void code_intra_modes_arithmetic(Sink& sink, Contexts& ctx, const IntraMbModes& modes) {
+  sink.bin(ctx.intra_split, modes.split ? 1 : 0);
+  for (int i = 0; i < (modes.split ? 4 : 1); ++i) code_intra_mode_arithmetic(sink, ctx, 0, modes.luma[i]);
+  code_intra_mode_arithmetic(sink, ctx, 1, modes.chroma);
+}
+
+template <class Sink, class Contexts>
+static void code_cbp_arithmetic(Sink& sink, Contexts& ctx, uint32_t cbp, uint32_t prev_cbp, bool p_frame) {
+  if (p_frame) sink.bin(ctx.intra_mb, (cbp & kCbpIntraMb) ? 1 : 0);
+  int prev_bin = static_cast<int>(prev_cbp >> (kCbpBlocks - 1)) & 1;
+  for (int i = 0; i < kCbpBlocks; ++i) {
+    int bin = (cbp >> i) & 1;
+    sink.bin(ctx.cbp[i < 4 ? 0 : 1][prev_bin], bin);
+    prev_bin = bin;
+  }
+}
+
+EntropyCoder::EntropyCoder(EntropyMode mode)
+    : mode_(mode),
+      mvd_cost_(static_cast<size_t>(2 * (2 * kMvdCostRange + 1))),
+      run_level_cost_(static_cast<size_t>(64 * kLevelCostMax)) {
+  ctx_.reset();
+  build_vlc_costs();
+  refresh_costs();
+}
+
+void EntropyCoder::build_vlc_costs() {
+  const EntropyMode syn = syntax();
+  for (int run = 0; run < 64; ++run) {
+    for (int level = 1; level <= kLevelCostMax; ++level) {
+      BitCounter bits;
+      write_pair(bits, syn, huffman_, run, level);
+      run_level_cost_[static_cast<size_t>(run * kLevelCostMax + level - 1)] =
+          static_cast<uint16_t>(bits.bit_position() << kBitCostShift);
+    }
+  }
+  if (mode_ == EntropyMode::Arithmetic) return;
+  for (int comp = 0; comp < 2; ++comp) {
+    for (int d = -kMvdCostRange; d <= kMvdCostRange; ++d) {
+      BitCounter bits;
+      write_mvd_component(bits, mvd_price_syntax(), nullptr, d);
+      mvd_cost_[static_cast<size_t>(comp * (2 * kMvdCostRange + 1) + d + kMvdCostRange)] =
+          static_cast<uint16_t>(bits.bit_position() << kBitCostShift);
+    }
+  }
+}
+
+void EntropyCoder::set_huffman_tables(const HuffmanTables* tables) {
+  if (mode_ != EntropyMode::Huffman) return;
+  huffman_ = tables;
+  build_vlc_costs();
+}
+
+void EntropyCoder::BinContexts::reset() {
+  std::fill(&cbp[0][0], &cbp[0][0] + 2 * 2, kBinProbInit);
+  std::fill(std::begin(sig), std::end(sig), kBinProbInit);
+  std::fill(std::begin(last), std::end(last), kBinProbInit);
+  std::fill(std::begin(level_gt1), std::end(level_gt1), kBinProbInit);
+  std::fill(std::begin(level_abs), std::end(level_abs), kBinProbInit);
+  std::fill(&mv[0][0], &mv[0][0] + 2 * 7, kBinProbInit);
+  intra_mb = kBinProbInit;
+  intra_split = kBinProbInit;
+  std::fill(&intra_mode[0][0], &intra_mode[0][0] + 2 * 3, kBinProbInit);
+}
+
+void EntropyCoder::begin_slice(BitstreamWriter& out) {
+  if (mode_ == EntropyMode::Rans) {
+    out.flush_byte_align();
+    for (auto& s : rans_symbols_) s.clear();
+    rans_side_.reset();
+    return;
+  }
+  if (mode_ != EntropyMode::Arithmetic) return;
+  out.flush_byte_align();
+  ctx_.reset();
+  prev_cbp_ = 0;
+  rc_enc_.begin();
+  refresh_costs();
+}
+
+void EntropyCoder::begin_slice(BitstreamWriter& out, const ContextState& state) {
+  begin_slice(out);
+  if (mode_ != EntropyMode::Arithmetic) return;
+  ctx_ = state.ctx;
+  prev_cbp_ = state.prev_cbp;
+  refresh_costs();
+}
+
+void EntropyCoder::end_slice(BitstreamWriter& out) {
+  if (mode_ == EntropyMode::Rans) {
+    end_rans_slice(out);
+    return;
+  }
+  if (mode_ != EntropyMode::Arithmetic) return;
+  rc_enc_.finish(out);
+}
+
+// rANS slice: per alphabet ue(symbol count) and, if nonzero, its frequency table; then
+// ue(byte length) of each nonempty alphabet's rANS stream; byte align; the streams; the
+// side bits.
+void EntropyCoder::end_rans_slice(BitstreamWriter& out) {
+  static const int kAlphabetSize[kRansAlphabets] = {kHuffmanPairSymbols, kHuffmanCbpSymbols, kHuffmanMvdSymbols};
+  rans_stream_.clear();
+  size_t stream_bytes[kRansAlphabets] = {};
+  for (int a = 0; a < kRansAlphabets; ++a) {
+    const std::vector<uint8_t>& syms = rans_symbols_[a];
+    out.write_ue(static_cast<uint32_t>(syms.size()));
+    if (syms.empty()) continue;
+    uint32_t counts[kHuffmanPairSymbols] = {};
+    for (uint8_t s : syms) counts[s]++;
+    RansTable table;
+    table.build(counts, kAlphabetSize[a]);
+    table.write(out);
+    size_t before = rans_stream_.size();
+    rans_encode(syms.data(), syms.size(), table, &rans_stream_);
+    stream_bytes[a] = rans_stream_.size() - before;
+  }
+  for (int a = 0; a < kRansAlphabets; ++a)
+    if (!rans_symbols_[a].empty()) out.write_ue(static_cast<uint32_t>(stream_bytes[a]));
+  out.write_bytes(rans_stream_.data(), rans_stream_.size());
+  rans_side_.flush_byte_align();
+  out.write_bytes(rans_side_.buffer().data(), rans_side_.buffer().size());
+}
+
+void EntropyCoder::begin_rans_slice(BitstreamReader& in) {
+  static const int kAlphabetSize[kRansAlphabets] = {kHuffmanPairSymbols, kHuffmanCbpSymbols, kHuffmanMvdSymbols};
+  constexpr uint32_t kMaxSymbols = 1u << 24;
+  RansTable tables[kRansAlphabets];
+  for (int a = 0; a < kRansAlphabets; ++a) {
+    rans_pos_[a] = 0;
+    rans_symbols_[a].assign(std::min(in.read_ue(), kMaxSymbols), 0);
+    if (!rans_symbols_[a].empty() && !tables[a].read(in, kAlphabetSize[a])) rans_symbols_[a].clear();
+  }
+  size_t stream_bytes[kRansAlphabets] = {};
+  for (int a = 0; a < kRansAlphabets; ++a)
+    if (!rans_symbols_[a].empty()) stream_bytes[a] = std::min(in.read_ue(), kMaxSymbols * 2 + 64);
+  in.align_to_byte();
+  for (int a = 0; a < kRansAlphabets; ++a) {
+    if (rans_symbols_[a].empty()) continue;
+    rans_stream_.resize(stream_bytes[a]);
+    in.read_bytes(rans_stream_.data(), rans_stream_.size());
+    if (!rans_decode(rans_stream_.data(), rans_stream_.size(), tables[a], rans_symbols_[a].data(),
+                     rans_symbols_[a].size()))
+      rans_symbols_[a].clear();
+  }
+}
+
+void EntropyCoder::begin_slice(BitstreamReader& in) {
+  if (mode_ == EntropyMode::Rans) {
+    in.align_to_byte();
+    begin_rans_slice(in);
+    return;
+  }
+  if (mode_ != EntropyMode::Arithmetic) return;
+  in.align_to_byte();
+  ctx_.reset();
+  prev_cbp_ = 0;
+  rc_dec_.begin(in);
+}
+
+void EntropyCoder::begin_slice(BitstreamReader& in, const ContextState& state) {
+  begin_slice(in);
+  if (mode_ != EntropyMode::Arithmetic) return;
+  ctx_ = state.ctx;
+  prev_cbp_ = state.prev_cbp;
+}
+
+void EntropyCoder::decode_block_arithmetic(BitstreamReader& in, int32_t* coeff_out) {
+  int pos[64];
+  int n = 0;
+  int i = 0;
+  for (; i < 63; ++i) {
+    if (rc_dec_.decode_bin(ctx_.sig[i], in)) {
+      pos[n++] = i;
+      if (rc_dec_.decode_bin(ctx_.last[i], in)) break;
+    }
+  }
+  if (i == 63) pos[n++] = 63;
+  int ones = 0, greater = 0;
+  for (int k = n - 1; k >= 0; --k) {
+    int level = 1;
+    if (rc_dec_.decode_bin(ctx_.level_gt1[greater ? 0 : 1 + std::min(ones, 3)], in)) {
+      uint32_t extra = decode_ueg(rc_dec_, &ctx_.level_abs[std::min(greater, 4)], 1, 13, 0, in);
+      level = static_cast<int>(std::min<uint32_t>(extra, 0x7FFFFFFD) + 2);
+      greater++;
+    } else {
+      ones++;
+    }
+    coeff_out[kZigzag8x8[pos[k]]] = rc_dec_.decode_bypass(1, in) ? -level : level;
+  }
+}
+
+int EntropyCoder::decode_mv_component(BinContext* ctx, BitstreamReader& in) {
+  int mag = static_cast<int>(std::min<uint32_t>(decode_ueg(rc_dec_, ctx, 7, 9, 3, in), 0xFFFF));
+  if (mag != 0 && rc_dec_.decode_bypass(1, in)) mag = -mag;
+  return mag;
+}
+
+bool EntropyCoder::is_coded(const int32_t* coeff) {
+  for (int i = 0; i < 64; ++i)
+    if (coeff[i] != 0) return true;
+  return false;
+}
+
+void EntropyCoder::encode_cbp(uint32_t cbp, BitstreamWriter& out, bool p_frame) {
+  if (!p_frame) cbp &= kCbpIntraMb - 1;
+  if (mode_ == EntropyMode::Arithmetic) {
+    RangeBinSink sink{rc_enc_, out};
+    code_cbp_arithmetic(sink, ctx_, cbp, prev_cbp_, p_frame);
+    prev_cbp_ = cbp;
+    return;
+  }
+  if (mode_ == EntropyMode::Rans) {
+    if (cbp & kCbpIntraMb) rans_symbols_[kCbpTable].push_back(static_cast<uint8_t>(kHuffmanCbpIntra));
+    rans_symbols_[kCbpTable].push_back(static_cast<uint8_t>(cbp & 63));
+    return;
+  }
+  if (mode_ == EntropyMode::Huffman && !huffman_) {
+    if (cbp & kCbpIntraMb) huffman_stats_.cbp[kHuffmanCbpIntra]++;
+    huffman_stats_.cbp[cbp & 63]++;
+  }
+  write_cbp(out, syntax(), huffman_, cbp, p_frame);
+}
+
+uint32_t EntropyCoder::decode_cbp(BitstreamReader& in, bool p_frame) {
+  uint32_t cbp = 0;
+  if (mode_ == EntropyMode::Arithmetic) {
+    if (p_frame && rc_dec_.decode_bin(ctx_.intra_mb, in)) cbp |= kCbpIntraMb;
+    int prev_bin = static_cast<int>(prev_cbp_ >> (kCbpBlocks - 1)) & 1;
+    for (int i = 0; i < kCbpBlocks; ++i) {
+      prev_bin = rc_dec_.decode_bin(ctx_.cbp[i < 4 ? 0 : 1][prev_bin], in);
+      cbp |= static_cast<uint32_t>(prev_bin) << i;
+    }
+    prev_cbp_ = cbp;
+    return cbp;
+  }
+  if (syntax() == EntropyMode::Fixed) {
+    cbp = in.read_bits(p_frame ? kCbpBlocks + 1 : kCbpBlocks);
+    return cbp & (p_frame ? 2 * kCbpIntraMb - 1 : kCbpIntraMb - 1);
+  }
+  auto read_symbol = [&]() -> uint32_t {
+    if (mode_ == EntropyMode::Rans)
+      return static_cast<uint32_t>(RansSymbolSource{rans_symbols_, rans_pos_, in}.symbol(kCbpTable));
+    if (huffman_) return static_cast<uint32_t>(huffman_->cbp.read(in));
+    return in.read_ue();
+  };
+  cbp = read_symbol();
+  if (p_frame && cbp == static_cast<uint32_t>(kHuffmanCbpIntra))
+    return kCbpIntraMb | (read_symbol() & (kCbpIntraMb - 1));
+  return cbp & (kCbpIntraMb - 1);
+}
+
+void EntropyCoder::encode_intra_modes(const IntraMbModes& modes, BitstreamWriter& out) {
+  if (mode_ == EntropyMode::Arithmetic) {
+    RangeBinSink sink{rc_enc_, out};
+    code_intra_modes_arithmetic(sink, ctx_, modes);
+    return;
+  }
+  if (mode_ == EntropyMode::Rans) {
+    write_intra_modes(rans_side_, modes);
+    return;
+  }
+  write_intra_modes(out, modes);
+}
+
+IntraMbModes EntropyCoder::decode_intra_modes(BitstreamReader& in) {
+  if (mode_ == EntropyMode::Arithmetic) {
+    auto mode = [&](int plane) {
+      const int hi = rc_dec_.decode_bin(ctx_.intra_mode[plane][0], in);
+      return static_cast<IntraMode>(hi * 2 + rc_dec_.decode_bin(ctx_.intra_mode[plane][1 + hi], in));
+    };
+    IntraMbModes modes;
+    modes.split = rc_dec_.decode_bin(ctx_.intra_split, in) != 0;
+    for (int i = 0; i < (modes.split ? 4 : 1); ++i) modes.luma[i] = mode(0);
+    modes.chroma = mode(1);
+    return modes;
+  }
+  return read_intra_modes(in);
+}
+
+void EntropyCoder::encode_block_8x8(const int32_t* coeff, int qp, BitstreamWriter& out) {
+  if (mode_ == EntropyMode::Arithmetic) {
+    RangeBinSink sink{rc_enc_, out};
+    code_block_arithmetic(sink, ctx_, coeff);
+    return;
+  }
+  if (mode_ == EntropyMode::Rans) {
+    RansSymbolSink sink{rans_symbols_, rans_side_};
+    code_block_huffman(sink, coeff);
+    return;
+  }
+  if (mode_ == EntropyMode::Huffman && !huffman_) {
+    HuffmanSymbolCounter counter{huffman_stats_};
+    code_block_huffman(counter, coeff);
+  }
+  write_block(out, syntax(), huffman_, coeff);
 }
 
 void EntropyCoder::decode_block_8x8(BitstreamReader& in, int qp, int32_t* coeff_out) {
   std::memset(coeff_out, 0, 64 * sizeof(int32_t));
+  if (mode_ == EntropyMode::Arithmetic) {
+    decode_block_arithmetic(in, coeff_out);
+    return;
+  }
+  if (mode_ == EntropyMode::Rans) {
+    RansSymbolSource source{rans_symbols_, rans_pos_, in};
+    decode_block_symbols(source, coeff_out);
+    return;
+  }
+  if (huffman_) {
+    HuffmanSymbolSource source{*huffman_, in};
+    decode_block_symbols(source, coeff_out);
+    return;
+  }
+  if (syntax() == EntropyMode::ExpGolomb) {
+    decode_block_exp_golomb(in, coeff_out);
+    return;
+  }
   int run, level;
   int k = 0;
-  for (;;) {
-    decode_coeff_run(in, run, level);
+  while (k < 64 && decode_coeff_run(in, run, level)) {
     k += run;
     if (k >= 64) break;
     coeff_out[kZigzag8x8[k]] = level;
     k++;
-    if (k >= 64) break;
   }
 }
 
-void EntropyCoder::encode_mv(MotionVector mv, BitstreamWriter& out) {
-  int dx = mv.dx, dy = mv.dy;
-  out.write_bits(static_cast<uint32_t>(dx & 0xFFFF), 16);
-  out.write_bits(static_cast<uint32_t>(dy & 0xFFFF), 16);
+void EntropyCoder::encode_mv(MotionVector mv, MotionVector pred, BitstreamWriter& out) {
+  int dx = mv.dx - pred.dx, dy = mv.dy - pred.dy;
+  if (mode_ == EntropyMode::Arithmetic) {
+    RangeBinSink sink{rc_enc_, out};
+    code_mv_component(sink, ctx_.mv[0], dx);
+    code_mv_component(sink, ctx_.mv[1], dy);
+    return;
+  }
+  if (mode_ == EntropyMode::Rans) {
+    RansSymbolSink sink{rans_symbols_, rans_side_};
+    code_mvd_huffman(sink, dx);
+    code_mvd_huffman(sink, dy);
+    return;
+  }
+  if (mode_ == EntropyMode::Huffman && !huffman_) {
+    HuffmanSymbolCounter counter{huffman_stats_};
+    code_mvd_huffman(counter, dx);
+    code_mvd_huffman(counter, dy);
+  }
+  write_mvd(out, syntax(), huffman_, dx, dy);
+}
+
+void EntropyCoder::encode_qp_delta(int delta, BitstreamWriter& out) {
+  delta = std::clamp(delta, -63, 63);
+  if (mode_ == EntropyMode::Arithmetic)
+    rc_enc_.encode_bypass(static_cast<uint32_t>(delta + 64), 7, out);
+  else if (mode_ == EntropyMode::Rans)
+    rans_side_.write_se(delta);
+  else
+    out.write_se(delta);
 }
 
-MotionVector EntropyCoder::decode_mv(BitstreamReader& in) {
-  MotionVector mv;
-  mv.dx = static_cast<int16_t>(in.read_bits(16));
-  mv.dy = static_cast<int16_t>(in.read_bits(16));
-  return mv;
+int EntropyCoder::decode_qp_delta(BitstreamReader& in) {
+  if (mode_ == EntropyMode::Arithmetic) return static_cast<int>(rc_dec_.decode_bypass(7, in)) - 64;
+  return in.read_se();
+}
+
+size_t EntropyCoder::coded_bits(const BitstreamWriter& out) const {
+  if (mode_ == EntropyMode::Arithmetic) return out.bit_position() + 8 * rc_enc_.pending_bytes();
+  if (mode_ != EntropyMode::Rans) return out.bit_position();
+  // Symbols at the Exp-Golomb rate of a typical pair, and a frequency table per alphabet.
+  constexpr size_t kRansSymbolBits = 5, kRansTableBits = 8 * 96;
+  size_t bits = out.bit_position() + rans_side_.bit_position();
+  for (const auto& s : rans_symbols_)
+    if (!s.empty()) bits += s.size() * kRansSymbolBits + kRansTableBits;
+  return bits;
+}
+
+MotionVector EntropyCoder::decode_mv(BitstreamReader& in, MotionVector pred) {
+  int dx, dy;
+  if (mode_ == EntropyMode::Arithmetic) {
+    dx = decode_mv_component(ctx_.mv[0], in);
+    dy = decode_mv_component(ctx_.mv[1], in);
+  } else if (mode_ == EntropyMode::Rans) {
+    RansSymbolSource source{rans_symbols_, rans_pos_, in};
+    dx = decode_mvd_symbols(source);
+    dy = decode_mvd_symbols(source);
+  } else if (huffman_) {
+    HuffmanSymbolSource source{*huffman_, in};
+    dx = decode_mvd_symbols(source);
+    dy = decode_mvd_symbols(source);
+  } else if (syntax() == EntropyMode::ExpGolomb) {
+    dx = in.read_se();
+    dy = in.read_se();
+  } else {
+    dx = static_cast<int16_t>(in.read_bits(16));
+    dy = static_cast<int16_t>(in.read_bits(16));
+  }
+  return MotionVector(static_cast<int16_t>(pred.dx + dx), static_cast<int16_t>(pred.dy + dy));
 }
 
 void EntropyCoder::encode_mb(const int32_t* coeff_y, const int32_t* coeff_u, const int32_t* coeff_v,
                              const MotionVector* mv, bool is_p_frame, int qp, BitstreamWriter& out) {
   if (is_p_frame && mv)
-    encode_mv(*mv, out);
-  for (int i = 0; i < 4; ++i)
-    encode_block_8x8(coeff_y + i * 64, qp, out);
-  encode_block_8x8(coeff_u, qp, out);
-  encode_block_8x8(coeff_v, qp, out);
+    encode_mv(*mv, MotionVector(), out);
+  const int32_t* blocks[kCbpBlocks] = {coeff_y, coeff_y + 64, coeff_y + 128, coeff_y + 192, coeff_u, coeff_v};
+  uint32_t cbp = 0;
+  for (int i = 0; i < kCbpBlocks; ++i)
+    if (is_coded(blocks[i])) cbp |= 1u << i;
+  encode_cbp(cbp, out);
+  for (int i = 0; i < kCbpBlocks; ++i)
+    if (cbp & (1u << i)) encode_block_8x8(blocks[i], qp, out);
+}
+
+uint32_t EntropyCoder::mvd_cost_far(int comp, int d) const {
+  if (mode_ == EntropyMode::Arithmetic) {
+    BinCostSink sink;
+    code_mv_component(sink, ctx_.mv[comp], d);
+    return sink.cost;
+  }
+  BitCounter bits;
+  write_mvd_component(bits, mvd_price_syntax(), nullptr, d);
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+uint32_t EntropyCoder::mvd_cost_bound(int range) const {
+  uint32_t worst[2] = {};
+  for (int comp = 0; comp < 2; ++comp)
+    for (int d = -range; d <= range; ++d) {
+      uint32_t cost;
+      if (mode_ == EntropyMode::Arithmetic) {
+        BinCostSink sink;
+        code_mv_component(sink, ctx_.mv[comp], d);
+        cost = sink.cost;
+      } else {
+        BitCounter bits;
+        write_mvd_component(bits, syntax(), huffman_, d);
+        cost = static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+      }
+      worst[comp] = std::max(worst[comp], cost);
+    }
+  return worst[0] + worst[1];
+}
+
+uint32_t EntropyCoder::run_level_cost(int run, int level) const {
+  int a = std::abs(level);
+  if (run >= 0 && run < 64 && a >= 1 && a <= kLevelCostMax)
+    return run_level_cost_[static_cast<size_t>(run * kLevelCostMax + a - 1)];
+  BitCounter bits;
+  write_pair(bits, syntax(), huffman_, run, level);
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+uint32_t EntropyCoder::cbp_cost(uint32_t cbp, bool p_frame) const {
+  if (!p_frame) cbp &= kCbpIntraMb - 1;
+  if (mode_ == EntropyMode::Arithmetic) {
+    BinCostSink sink;
+    code_cbp_arithmetic(sink, ctx_, cbp, prev_cbp_, p_frame);
+    return sink.cost;
+  }
+  BitCounter bits;
+  write_cbp(bits, syntax(), huffman_, cbp, p_frame);
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+uint32_t EntropyCoder::intra_modes_cost(const IntraMbModes& modes) const {
+  if (mode_ == EntropyMode::Arithmetic) {
+    BinCostSink sink;
+    code_intra_modes_arithmetic(sink, ctx_, modes);
+    return sink.cost;
+  }
+  BitCounter bits;
+  write_intra_modes(bits, modes);
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+uint32_t EntropyCoder::qp_delta_cost(int delta) const {
+  if (mode_ == EntropyMode::Arithmetic) return 7u << kBitCostShift;
+  BitCounter bits;
+  bits.write_se(std::clamp(delta, -63, 63));
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+uint32_t EntropyCoder::block_cost(const int32_t* coeff) const {
+  if (mode_ == EntropyMode::Arithmetic) {
+    BinCostSink sink;
+    code_block_arithmetic(sink, ctx_, coeff);
+    return sink.cost;
+  }
+  BitCounter bits;
+  write_block(bits, syntax(), huffman_, coeff);
+  return static_cast<uint32_t>(bits.bit_position() << kBitCostShift);
+}
+
+void EntropyCoder::refresh_costs() {
+  if (mode_ != EntropyMode::Arithmetic) return;
+  for (int comp = 0; comp < 2; ++comp) {
+    for (int d = -kMvdCostRange; d <= kMvdCostRange; ++d) {
+      BinCostSink sink;
+      code_mv_component(sink, ctx_.mv[comp], d);
+      mvd_cost_[static_cast<size_t>(comp * (2 * kMvdCostRange + 1) + d + kMvdCostRange)] =
+          static_cast<uint16_t>(std::min<uint32_t>(sink.cost, 0xFFFF));
+    }
+  }
 }
 
 }  // namespace codec
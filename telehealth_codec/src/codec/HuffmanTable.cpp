@@ -0,0 +1,150 @@
+#include <codec/HuffmanTable.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace telehealth {
+namespace codec {
+
+// Plain Huffman code lengths from weights (all > 0), returned as tree depths.
+static std::vector<int> huffman_depths(const std::vector<uint64_t>& weight) {
+  const int n = static_cast<int>(weight.size());
+  std::vector<int> parent(static_cast<size_t>(2 * n - 1), -1);
+  using Node = std::pair<uint64_t, int>;
+  std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+  for (int i = 0; i < n; ++i) heap.push({weight[static_cast<size_t>(i)], i});
+  int next = n;
+  while (heap.size() > 1) {
+    Node a = heap.top();
+    heap.pop();
+    Node b = heap.top();
+    heap.pop();
+    parent[static_cast<size_t>(a.second)] = next;
+    parent[static_cast<size_t>(b.second)] = next;
+    heap.push({a.first + b.first, next++});
+  }
+  std::vector<int> depth(static_cast<size_t>(n), 0);
+  for (int i = 0; i < n; ++i)
+    for (int p = parent[static_cast<size_t>(i)]; p >= 0; p = parent[static_cast<size_t>(p)])
+      depth[static_cast<size_t>(i)]++;
+  return depth;
+}
+
+void HuffmanCode::build(const uint32_t* counts, int num_symbols) {
+  std::vector<uint64_t> weight(static_cast<size_t>(num_symbols));
+  for (int i = 0; i < num_symbols; ++i) weight[static_cast<size_t>(i)] = static_cast<uint64_t>(counts[i]) + 1;
+  // Flatten the distribution until the longest code fits the lookup table.
+  for (;;) {
+    std::vector<int> depth = huffman_depths(weight);
+    if (*std::max_element(depth.begin(), depth.end()) <= kMaxLength) {
+      std::vector<uint8_t> lengths(depth.begin(), depth.end());
+      set_lengths(lengths.data(), num_symbols);
+      return;
+    }
+    for (auto& w : weight) w = (w + 1) / 2;
+  }
+}
+
+bool HuffmanCode::set_lengths(const uint8_t* lengths, int num_symbols) {
+  uint32_t kraft = 0;
+  for (int i = 0; i < num_symbols; ++i) {
+    if (lengths[i] < 1 || lengths[i] > kMaxLength) return false;
+    kraft += 1u << (kMaxLength - lengths[i]);
+  }
+  if (kraft != (1u << kMaxLength)) return false;
+
+  lengths_.assign(lengths, lengths + num_symbols);
+  codes_.assign(static_cast<size_t>(num_symbols), 0);
+  lookup_.assign(static_cast<size_t>(1) << kMaxLength, 0);
+  // Canonical order: by length, then symbol.
+  std::vector<int> order(static_cast<size_t>(num_symbols));
+  for (int i = 0; i < num_symbols; ++i) order[static_cast<size_t>(i)] = i;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return lengths[a] < lengths[b]; });
+  uint32_t code = 0;
+  int prev_len = lengths[order[0]];
+  for (int sym : order) {
+    int len = lengths[sym];
+    code <<= len - prev_len;
+    prev_len = len;
+    uint32_t rev = 0;
+    for (int b = 0; b < len; ++b) rev |= ((code >> b) & 1u) << (len - 1 - b);
+    codes_[static_cast<size_t>(sym)] = static_cast<uint16_t>(rev);
+    for (uint32_t k = 0; k < (1u << (kMaxLength - len)); ++k)
+      lookup_[rev | (k << len)] = static_cast<uint16_t>(sym << 4 | len);
+    code++;
+  }
+  return true;
+}
+
+void HuffmanCode::write_lengths(BitstreamWriter& out) const {
+  for (uint8_t len : lengths_) out.write_bits(len, 4);
+}
+
+bool HuffmanCode::read_lengths(BitstreamReader& in, int num_symbols) {
+  std::vector<uint8_t> lengths(static_cast<size_t>(num_symbols));
+  for (auto& len : lengths) len = static_cast<uint8_t>(in.read_bits(4));
+  return set_lengths(lengths.data(), num_symbols);
+}
+
+void HuffmanTables::write(BitstreamWriter& out) const {
+  pair.write_lengths(out);
+  cbp.write_lengths(out);
+  mvd.write_lengths(out);
+  out.flush_byte_align();
+}
+
+bool HuffmanTables::read(BitstreamReader& in) {
+  bool ok = pair.read_lengths(in, kHuffmanPairSymbols) && cbp.read_lengths(in, kHuffmanCbpSymbols) &&
+            mvd.read_lengths(in, kHuffmanMvdSymbols);
+  in.align_to_byte();
+  return ok;
+}
+
+void HuffmanStats::reset() {
+  std::memset(pair, 0, sizeof(pair));
+  std::memset(cbp, 0, sizeof(cbp));
+  std::memset(mvd, 0, sizeof(mvd));
+}
+
+void HuffmanStats::add(const HuffmanStats& other) {
+  for (int i = 0; i < kHuffmanPairSymbols; ++i) pair[i] += other.pair[i];
+  for (int i = 0; i < kHuffmanCbpSymbols; ++i) cbp[i] += other.cbp[i];
+  for (int i = 0; i < kHuffmanMvdSymbols; ++i) mvd[i] += other.mvd[i];
+}
+
+// Training counts blended with a prior shaped like the Exp-Golomb code lengths (a quarter of
+// the mass), so symbols that were rare in the training frames keep reasonable codes when the
+// content changes later in the GOP.
+static void build_with_prior(HuffmanCode* code, const uint32_t* counts, const int* eg_bits, int n) {
+  uint64_t total = 0;
+  for (int i = 0; i < n; ++i) total += counts[i];
+  std::vector<uint32_t> weight(static_cast<size_t>(n));
+  for (int i = 0; i < n; ++i) {
+    uint64_t w = static_cast<uint64_t>(counts[i]) * 256 + (((total + 64) * 16) >> std::min(eg_bits[i], 63));
+    weight[static_cast<size_t>(i)] = static_cast<uint32_t>(std::min<uint64_t>(w, 0xFFFFFFFEu));
+  }
+  code->build(weight.data(), n);
+}
+
+void HuffmanStats::build(HuffmanTables* out) const {
+  int pair_bits[kHuffmanPairSymbols];
+  for (int s = 0; s < kHuffmanEndOfBlock; ++s) {
+    uint32_t run = static_cast<uint32_t>(s / kHuffmanLevelClasses);
+    uint32_t level = static_cast<uint32_t>(s % kHuffmanLevelClasses);
+    pair_bits[s] = 2 * bit_length(run + 1) + 2 * bit_length(level + 1) - 1;
+  }
+  pair_bits[kHuffmanEndOfBlock] = 2;
+  int cbp_bits[kHuffmanCbpSymbols];
+  for (int s = 0; s < kHuffmanCbpSymbols; ++s) cbp_bits[s] = 2 * bit_length(static_cast<uint32_t>(s) + 1) - 1;
+  int mvd_bits[kHuffmanMvdSymbols];
+  for (int s = 0; s < kHuffmanMvdSymbols; ++s) mvd_bits[s] = 2 * bit_length(static_cast<uint32_t>(s) + 1) - 1;
+
+  build_with_prior(&out->pair, pair, pair_bits, kHuffmanPairSymbols);
+  build_with_prior(&out->cbp, cbp, cbp_bits, kHuffmanCbpSymbols);
+  build_with_prior(&out->mvd, mvd, mvd_bits, kHuffmanMvdSymbols);
+}
+
+}  // namespace codec
+}  // namespace telehealth
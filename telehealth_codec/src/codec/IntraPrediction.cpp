@@ -0,0 +1,117 @@
+#include <codec/IntraPrediction.h>
+#include "IntraPredictionKernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace telehealth {
+namespace codec {
+
+void IntraNeighbors::gather(const uint8_t* plane, int stride, int plane_w, int plane_h, int x, int y,
+                            int size, bool top_ok, bool left_ok) {
+  has_top = top_ok && y > 0;
+  has_left = left_ok && x > 0;
+  std::memset(top, 128, sizeof(top));
+  std::memset(left, 128, sizeof(left));
+  top_left = 128;
+  if (has_top) {
+    const uint8_t* row = plane + (y - 1) * stride;
+    for (int i = 0; i < size; ++i) top[i] = row[std::min(x + i, plane_w - 1)];
+  }
+  if (has_left) {
+    for (int i = 0; i < size; ++i) left[i] = plane[std::min(y + i, plane_h - 1) * stride + x - 1];
+  }
+  if (has_top && has_left) top_left = plane[(y - 1) * stride + x - 1];
+}
+
+void intra_plane_fill_scalar(int base, int b, int c, int size, uint8_t* dst, int stride) {
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+      dst[y * stride + x] = static_cast<uint8_t>(std::clamp((base + b * x + c * y) >> 5, 0, 255));
+}
+
+// Unnormalized 8-point Hadamard butterflies, in place.
+static void hadamard8(int* v, int step) {
+  for (int half = 4; half >= 1; half >>= 1)
+    for (int i = 0; i < 8; ++i)
+      if (!(i & half)) {
+        int a = v[i * step], b = v[(i + half) * step];
+        v[i * step] = a + b;
+        v[(i + half) * step] = a - b;
+      }
+}
+
+uint32_t satd_8x8_scalar(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride) {
+  int d[64];
+  for (int y = 0; y < 8; ++y)
+    for (int x = 0; x < 8; ++x) d[y * 8 + x] = src[y * src_stride + x] - pred[y * pred_stride + x];
+  for (int y = 0; y < 8; ++y) hadamard8(d + y * 8, 1);
+  for (int x = 0; x < 8; ++x) hadamard8(d + x, 8);
+  uint32_t sum = 0;
+  for (int v : d) sum += static_cast<uint32_t>(std::abs(v));
+  return sum;
+}
+
+IntraPredictor::IntraPredictor() : level_(best_simd_level()) {}
+
+IntraPredictor::IntraPredictor(SimdLevel level) : level_(best_simd_level(level)) {}
+
+void IntraPredictor::predict(IntraMode mode, const IntraNeighbors& nb, int size, uint8_t* dst,
+                             int dst_stride) const {
+  switch (mode) {
+    case IntraMode::Horizontal:
+      for (int y = 0; y < size; ++y) std::memset(dst + y * dst_stride, nb.left[y], static_cast<size_t>(size));
+      return;
+    case IntraMode::Vertical:
+      for (int y = 0; y < size; ++y) std::memcpy(dst + y * dst_stride, nb.top, static_cast<size_t>(size));
+      return;
+    case IntraMode::Plane: {
+      // H.264 8.3.3.4 (size 16) and 8.3.4.4 (size 8, chroma 4:2:0): gradients from the
+      // top row and left column around their centres, anchored on the far corners.
+      const int half = size / 2;
+      int h = 0, v = 0;
+      for (int i = 0; i < half; ++i) {
+        const int t = half - 2 - i, l = half - 2 - i;
+        h += (i + 1) * (nb.top[half + i] - (t >= 0 ? nb.top[t] : nb.top_left));
+        v += (i + 1) * (nb.left[half + i] - (l >= 0 ? nb.left[l] : nb.top_left));
+      }
+      const int scale = size == 16 ? 5 : 34;
+      const int b = (scale * h + 32) >> 6, c = (scale * v + 32) >> 6;
+      const int a = 16 * (nb.left[size - 1] + nb.top[size - 1]);
+      const int base = a - (half - 1) * (b + c) + 16;
+#if defined(TELECODEC_X86_SIMD)
+      if (level_ != SimdLevel::Scalar) {
+        intra_plane_fill_sse2(base, b, c, size, dst, dst_stride);
+        return;
+      }
+#endif
+      intra_plane_fill_scalar(base, b, c, size, dst, dst_stride);
+      return;
+    }
+    case IntraMode::DC:
+    default: {
+      int sum = 0, count = 0;
+      if (nb.has_top) {
+        for (int i = 0; i < size; ++i) sum += nb.top[i];
+        count += size;
+      }
+      if (nb.has_left) {
+        for (int i = 0; i < size; ++i) sum += nb.left[i];
+        count += size;
+      }
+      const int dc = count ? (sum + count / 2) / count : 128;
+      for (int y = 0; y < size; ++y) std::memset(dst + y * dst_stride, dc, static_cast<size_t>(size));
+      return;
+    }
+  }
+}
+
+uint32_t IntraPredictor::satd_8x8(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride) const {
+#if defined(TELECODEC_X86_SIMD)
+  if (level_ != SimdLevel::Scalar) return satd_8x8_sse2(src, src_stride, pred, pred_stride);
+#endif
+  return satd_8x8_scalar(src, src_stride, pred, pred_stride);
+}
+
+}  // namespace codec
+}  // namespace telehealth
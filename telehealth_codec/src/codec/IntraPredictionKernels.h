@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+// Plane prediction fill: dst[y][x] = clip((base + b * x + c * y) >> 5) over size x size, where
+// base already holds the rounding and the centre offset. Every intermediate fits in 16 bits
+// for 8-bit neighbours, which the SIMD kernels rely on.
+void intra_plane_fill_scalar(int base, int b, int c, int size, uint8_t* dst, int stride);
+uint32_t satd_8x8_scalar(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride);
+
+#if defined(TELECODEC_X86_SIMD)
+void intra_plane_fill_sse2(int base, int b, int c, int size, uint8_t* dst, int stride);
+uint32_t satd_8x8_sse2(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride);
+#endif
+
+}  // namespace codec
+}  // namespace telehealth
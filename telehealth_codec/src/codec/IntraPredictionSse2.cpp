@@ -0,0 +1,78 @@
+#include "IntraPredictionKernels.h"
+#include <emmintrin.h>
+
+namespace telehealth {
+namespace codec {
+
+void intra_plane_fill_sse2(int base, int b, int c, int size, uint8_t* dst, int stride) {
+  // Lanes hold base + b * x for x = 0..7 and 8..15; each row adds c.
+  const __m128i bx = _mm_mullo_epi16(_mm_set1_epi16(static_cast<short>(b)), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+  __m128i lo = _mm_add_epi16(_mm_set1_epi16(static_cast<short>(base)), bx);
+  __m128i hi = _mm_add_epi16(lo, _mm_set1_epi16(static_cast<short>(8 * b)));
+  const __m128i step = _mm_set1_epi16(static_cast<short>(c));
+  for (int y = 0; y < size; ++y) {
+    const __m128i plo = _mm_srai_epi16(lo, 5), phi = _mm_srai_epi16(hi, 5);
+    if (size == 16)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + y * stride), _mm_packus_epi16(plo, phi));
+    else
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + y * stride), _mm_packus_epi16(plo, plo));
+    lo = _mm_add_epi16(lo, step);
+    hi = _mm_add_epi16(hi, step);
+  }
+}
+
+// Butterflies between registers i and i + half, for half = 4, 2, 1.
+static inline void hadamard8_rows(__m128i* r) {
+  for (int half = 4; half >= 1; half >>= 1)
+    for (int i = 0; i < 8; ++i)
+      if (!(i & half)) {
+        const __m128i a = r[i], b = r[i + half];
+        r[i] = _mm_add_epi16(a, b);
+        r[i + half] = _mm_sub_epi16(a, b);
+      }
+}
+
+static inline void transpose8x8_epi16(__m128i* r) {
+  const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpackhi_epi16(r[0], r[1]);
+  const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]), a3 = _mm_unpackhi_epi16(r[2], r[3]);
+  const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]), a5 = _mm_unpackhi_epi16(r[4], r[5]);
+  const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+  const __m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+  const __m128i b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+  const __m128i b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+  const __m128i b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+  r[0] = _mm_unpacklo_epi64(b0, b4);
+  r[1] = _mm_unpackhi_epi64(b0, b4);
+  r[2] = _mm_unpacklo_epi64(b1, b5);
+  r[3] = _mm_unpackhi_epi64(b1, b5);
+  r[4] = _mm_unpacklo_epi64(b2, b6);
+  r[5] = _mm_unpackhi_epi64(b2, b6);
+  r[6] = _mm_unpacklo_epi64(b3, b7);
+  r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+uint32_t satd_8x8_sse2(const uint8_t* src, int src_stride, const uint8_t* pred, int pred_stride) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i r[8];
+  for (int y = 0; y < 8; ++y) {
+    const __m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + y * src_stride));
+    const __m128i p = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pred + y * pred_stride));
+    r[y] = _mm_sub_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(p, zero));
+  }
+  // Columns, transpose, columns again: the 2-D transform (|coefficients| stay below 2^14).
+  hadamard8_rows(r);
+  transpose8x8_epi16(r);
+  hadamard8_rows(r);
+  __m128i acc = zero;
+  const __m128i ones = _mm_set1_epi16(1);
+  for (int i = 0; i < 8; ++i) {
+    const __m128i a = _mm_max_epi16(r[i], _mm_sub_epi16(zero, r[i]));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(a, ones));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(acc));
+}
+
+}  // namespace codec
+}  // namespace telehealth
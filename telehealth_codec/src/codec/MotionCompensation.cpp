@@ -41,6 +41,18 @@ void MotionCompensation::predict_block(BlockView pred_out,
   }
 }
 
+void MotionCompensation::predict_chroma_block(BlockView pred_u, BlockView pred_v,
+                                              const FrameYUV& ref_frame,
+                                              BlockCoord pos,
+                                              MotionVector mv) const {
+  const int rx = std::clamp(pos.mb_x * MB_CHROMA_SIZE + mv.dx / 2, 0, ref_frame.width / 2 - pred_u.w);
+  const int ry = std::clamp(pos.mb_y * MB_CHROMA_SIZE + mv.dy / 2, 0, ref_frame.height / 2 - pred_u.h);
+  for (int y = 0; y < pred_u.h; ++y) {
+    std::memcpy(pred_u.row(y), ref_frame.u_row(ry + y) + rx, static_cast<size_t>(pred_u.w));
+    std::memcpy(pred_v.row(y), ref_frame.v_row(ry + y) + rx, static_cast<size_t>(pred_v.w));
+  }
+}
+
 void MotionCompensation::predict_frame(FrameYUV& pred_frame,
                                        const FrameYUV& ref_frame,
                                        const MotionVector* mvs,
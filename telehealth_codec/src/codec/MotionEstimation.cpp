@@ -1,4 +1,5 @@
 #include <codec/MotionEstimation.h>
+#include <codec/EntropyCoder.h>
 #include <algorithm>
 #include <cmath>
 #include <limits>
@@ -8,6 +9,18 @@ namespace codec {
 
 MotionEstimation::MotionEstimation(const EncoderConfig& config) : config_(config) {}
 
+uint32_t MotionEstimation::rd_cost(uint32_t sad, MotionVector mv, MotionVector pred, int lambda,
+                                   const EntropyCoder* rate) {
+  if (lambda == 0) return sad;
+  uint32_t bits = rate ? rate->mvd_cost(mv.dx - pred.dx, mv.dy - pred.dy)
+                       : static_cast<uint32_t>(mvd_bits(mv, pred)) << kBitCostShift;
+  return sad + ((static_cast<uint32_t>(lambda) * bits + (1u << (kBitCostShift - 1))) >> kBitCostShift);
+}
+
+int MotionEstimation::lambda_for_qp(int qp) {
+  return static_cast<int>(std::lround(std::sqrt(0.85 * std::pow(2.0, (qp - 12) / 3.0))));
+}
+
 bool MotionEstimation::in_bounds(const FrameYUV& frame, int x, int y, int w, int h) const {
   return x >= 0 && y >= 0 && x + w <= frame.width && y + h <= frame.height;
 }
@@ -31,7 +44,9 @@ uint32_t MotionEstimation::sad_block(const BlockViewConst& cur, const BlockViewC
 
 MotionResult MotionEstimation::estimate(const BlockViewConst& cur_block,
                                         const FrameYUV& ref_frame,
-                                        BlockCoord pos) const {
+                                        BlockCoord pos,
+                                        MotionVector pred, int lambda,
+                                        const EntropyCoder* rate, int max_ref_x) const {
   const int range = config_.search_range;
   const int base_x = pos.mb_x * MB_SIZE;
   const int base_y = pos.mb_y * MB_SIZE;
@@ -39,29 +54,38 @@ MotionResult MotionEstimation::estimate(const BlockViewConst& cur_block,
   MotionResult best;
   best.cost = 0xFFFFFFFFu;
 
-  for (int dy = -range; dy <= range; ++dy) {
-    for (int dx = -range; dx <= range; ++dx) {
-      int ref_x = base_x + dx;
-      int ref_y = base_y + dy;
-      if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h))
-        continue;
-
-      BlockViewConst ref_block(ref_frame.y_plane.data() + ref_y * ref_frame.stride_y + ref_x,
-                               ref_frame.stride_y, cur_block.w, cur_block.h);
-      uint32_t cost = sad_block(cur_block, ref_block);
-      if (cost < best.cost) {
-        best.cost = cost;
-        best.mv.dx = static_cast<int16_t>(dx);
-        best.mv.dy = static_cast<int16_t>(dy);
-      }
+  auto check = [&](int dx, int dy) {
+    int ref_x = base_x + dx;
+    int ref_y = base_y + dy;
+    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h) || ref_x + cur_block.w - 1 > max_ref_x) return;
+    BlockViewConst ref_block(ref_frame.y_plane.data() + ref_y * ref_frame.stride_y + ref_x,
+                             ref_frame.stride_y, cur_block.w, cur_block.h);
+    MotionVector mv(static_cast<int16_t>(dx), static_cast<int16_t>(dy));
+    uint32_t cost = rd_cost(sad_block(cur_block, ref_block), mv, pred, lambda, rate);
+    if (cost < best.cost) {
+      best.cost = cost;
+      best.mv = mv;
     }
+  };
+
+  // Early termination: a static or predicted match that is already cheap enough ends the
+  // search before the window scan.
+  const uint32_t good_enough = static_cast<uint32_t>(std::max(config_.early_termination_threshold, 0));
+  if (good_enough > 0) {
+    check(0, 0);
+    check(std::clamp<int>(pred.dx, -range, range), std::clamp<int>(pred.dy, -range, range));
+    if (best.cost <= good_enough) return best;
   }
+  for (int dy = -range; dy <= range; ++dy)
+    for (int dx = -range; dx <= range; ++dx) check(dx, dy);
   return best;
 }
 
 MotionResult MotionEstimation::estimate(const BlockViewConst& cur_block,
                                         const Frame& ref_frame,
-                                        BlockCoord pos) const {
+                                        BlockCoord pos,
+                                        MotionVector pred, int lambda,
+                                        const EntropyCoder* rate, int max_ref_x) const {
   const int range = config_.search_range;
   const int base_x = pos.mb_x * MB_SIZE;
   const int base_y = pos.mb_y * MB_SIZE;
@@ -69,29 +93,38 @@ MotionResult MotionEstimation::estimate(const BlockViewConst& cur_block,
   MotionResult best;
   best.cost = 0xFFFFFFFFu;
 
-  for (int dy = -range; dy <= range; ++dy) {
-    for (int dx = -range; dx <= range; ++dx) {
-      int ref_x = base_x + dx;
-      int ref_y = base_y + dy;
-      if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h))
-        continue;
-
-      BlockViewConst ref_block(ref_frame.y_plane_ptr() + ref_y * ref_frame.stride_y() + ref_x,
-                               ref_frame.stride_y(), cur_block.w, cur_block.h);
-      uint32_t cost = sad_block(cur_block, ref_block);
-      if (cost < best.cost) {
-        best.cost = cost;
-        best.mv.dx = static_cast<int16_t>(dx);
-        best.mv.dy = static_cast<int16_t>(dy);
-      }
+  auto check = [&](int dx, int dy) {
+    int ref_x = base_x + dx;
+    int ref_y = base_y + dy;
+    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h) || ref_x + cur_block.w - 1 > max_ref_x) return;
+    BlockViewConst ref_block(ref_frame.y_plane_ptr() + ref_y * ref_frame.stride_y() + ref_x,
+                             ref_frame.stride_y(), cur_block.w, cur_block.h);
+    MotionVector mv(static_cast<int16_t>(dx), static_cast<int16_t>(dy));
+    uint32_t cost = rd_cost(sad_block(cur_block, ref_block), mv, pred, lambda, rate);
+    if (cost < best.cost) {
+      best.cost = cost;
+      best.mv = mv;
     }
+  };
+
+  // Early termination: a static or predicted match that is already cheap enough ends the
+  // search before the window scan.
+  const uint32_t good_enough = static_cast<uint32_t>(std::max(config_.early_termination_threshold, 0));
+  if (good_enough > 0) {
+    check(0, 0);
+    check(std::clamp<int>(pred.dx, -range, range), std::clamp<int>(pred.dy, -range, range));
+    if (best.cost <= good_enough) return best;
   }
+  for (int dy = -range; dy <= range; ++dy)
+    for (int dx = -range; dx <= range; ++dx) check(dx, dy);
   return best;
 }
 
 MotionResult MotionEstimation::estimate_diamond(const BlockViewConst& cur_block,
                                                 const FrameYUV& ref_frame,
-                                                BlockCoord pos) const {
+                                                BlockCoord pos,
+                                                MotionVector pred, int lambda,
+                                                const EntropyCoder* rate, int max_ref_x) const {
   const int range = config_.search_range;
   const int base_x = pos.mb_x * MB_SIZE;
   const int base_y = pos.mb_y * MB_SIZE;
@@ -105,22 +138,24 @@ MotionResult MotionEstimation::estimate_diamond(const BlockViewConst& cur_block,
   auto check = [&](int dx, int dy) {
     int ref_x = base_x + dx;
     int ref_y = base_y + dy;
-    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h)) return;
+    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h) || ref_x + cur_block.w - 1 > max_ref_x) return;
     BlockViewConst ref_block(ref_frame.y_plane.data() + ref_y * ref_frame.stride_y + ref_x,
                              ref_frame.stride_y, cur_block.w, cur_block.h);
-    uint32_t cost = sad_block(cur_block, ref_block);
+    MotionVector mv(static_cast<int16_t>(dx), static_cast<int16_t>(dy));
+    uint32_t cost = rd_cost(sad_block(cur_block, ref_block), mv, pred, lambda, rate);
     if (cost < best.cost) {
       best.cost = cost;
-      best.mv.dx = static_cast<int16_t>(dx);
-      best.mv.dy = static_cast<int16_t>(dy);
+      best.mv = mv;
       cx = dx;
       cy = dy;
     }
   };
 
+  const uint32_t good_enough = static_cast<uint32_t>(std::max(config_.early_termination_threshold, 0));
   check(0, 0);
+  check(std::clamp<int>(pred.dx, -range, range), std::clamp<int>(pred.dy, -range, range));
   int step = range;
-  while (step > 0) {
+  while (step > 0 && best.cost > good_enough) {
     check(cx + step, cy);
     check(cx - step, cy);
     check(cx, cy + step);
@@ -136,7 +171,9 @@ MotionResult MotionEstimation::estimate_diamond(const BlockViewConst& cur_block,
 
 MotionResult MotionEstimation::estimate_diamond(const BlockViewConst& cur_block,
                                                 const Frame& ref_frame,
-                                                BlockCoord pos) const {
+                                                BlockCoord pos,
+                                                MotionVector pred, int lambda,
+                                                const EntropyCoder* rate, int max_ref_x) const {
   const int range = config_.search_range;
   const int base_x = pos.mb_x * MB_SIZE;
   const int base_y = pos.mb_y * MB_SIZE;
@@ -150,22 +187,24 @@ MotionResult MotionEstimation::estimate_diamond(const BlockViewConst& cur_block,
   auto check = [&](int dx, int dy) {
     int ref_x = base_x + dx;
     int ref_y = base_y + dy;
-    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h)) return;
+    if (!in_bounds(ref_frame, ref_x, ref_y, cur_block.w, cur_block.h) || ref_x + cur_block.w - 1 > max_ref_x) return;
     BlockViewConst ref_block(ref_frame.y_plane_ptr() + ref_y * ref_frame.stride_y() + ref_x,
                              ref_frame.stride_y(), cur_block.w, cur_block.h);
-    uint32_t cost = sad_block(cur_block, ref_block);
+    MotionVector mv(static_cast<int16_t>(dx), static_cast<int16_t>(dy));
+    uint32_t cost = rd_cost(sad_block(cur_block, ref_block), mv, pred, lambda, rate);
     if (cost < best.cost) {
       best.cost = cost;
-      best.mv.dx = static_cast<int16_t>(dx);
-      best.mv.dy = static_cast<int16_t>(dy);
+      best.mv = mv;
       cx = dx;
       cy = dy;
     }
   };
 
+  const uint32_t good_enough = static_cast<uint32_t>(std::max(config_.early_termination_threshold, 0));
   check(0, 0);
+  check(std::clamp<int>(pred.dx, -range, range), std::clamp<int>(pred.dy, -range, range));
   int step = range;
-  while (step > 0) {
+  while (step > 0 && best.cost > good_enough) {
     check(cx + step, cy);
     check(cx - step, cy);
     check(cx, cy + step);
@@ -5,24 +5,63 @@
 namespace telehealth {
 namespace codec {
 
+QuantMatrices::QuantMatrices() {
+  std::fill(&weights[0][0], &weights[0][0] + kNumQuantMatrices * 64, static_cast<uint8_t>(16));
+}
+
+QuantMatrices QuantMatrices::from_preset(QuantMatrixPreset preset) {
+  QuantMatrices m;
+  if (preset != QuantMatrixPreset::Perceptual) return m;
+  // Haar band of each transform row/column: DC, first split, quarter splits, finest.
+  static const int kBand[8] = {0, 1, 2, 2, 3, 3, 3, 3};
+  static const int kSlope[kNumQuantMatrices] = {3, 2, 4, 3};  // intra/inter luma, intra/inter chroma
+  for (int k = 0; k < kNumQuantMatrices; ++k)
+    for (int i = 0; i < 8; ++i)
+      for (int j = 0; j < 8; ++j)
+        m.weights[k][i * 8 + j] = static_cast<uint8_t>(16 + kSlope[k] * (kBand[i] + kBand[j]));
+  return m;
+}
+
+Quantizer::Quantizer() : Quantizer(QuantMatrices()) {}
+
+Quantizer::Quantizer(const QuantMatrices& matrices)
+    : matrices_(matrices),
+      step_table_(static_cast<size_t>((kMaxQp + 1) * kNumQuantMatrices * 64)),
+      zero_threshold_(static_cast<size_t>((kMaxQp + 1) * kNumQuantMatrices)) {
+  for (int qp = 0; qp <= kMaxQp; ++qp) {
+    int scale = qp_to_scale(qp);
+    for (int k = 0; k < kNumQuantMatrices; ++k) {
+      QuantMatrixKind kind = static_cast<QuantMatrixKind>(k);
+      int32_t* step = step_table_.data() + table_index(qp, kind) * 64;
+      int32_t min_step = step[0] = std::max(1, (scale * matrices_.weights[k][0] + 8) >> 4);
+      for (int i = 1; i < 64; ++i) {
+        step[i] = std::max(1, (scale * matrices_.weights[k][i] + 8) >> 4);
+        min_step = std::min(min_step, step[i]);
+      }
+      zero_threshold_[table_index(qp, kind)] = static_cast<uint32_t>(8 * ((min_step + 1) / 2 - 1));
+    }
+  }
+}
+
 int Quantizer::qp_to_scale(int qp) {
   if (qp <= 0) return 1;
   if (qp >= 51) return 256;
   return static_cast<int>(std::round(std::exp(qp * 0.115)));  // roughly 2^(qp/6)
 }
 
-void Quantizer::quantize_8x8(int32_t* coeff, int qp) {
-  int scale = qp_to_scale(qp);
+void Quantizer::quantize_8x8(int32_t* coeff, int qp, QuantMatrixKind kind) {
+  const int32_t* step = steps(qp, kind);
   for (int i = 0; i < 64; ++i) {
     int v = coeff[i];
-    coeff[i] = (v >= 0) ? (v + scale / 2) / scale : (v - scale / 2) / scale;
+    int s = step[i];
+    coeff[i] = (v >= 0) ? (v + s / 2) / s : (v - s / 2) / s;
   }
 }
 
-void Quantizer::dequantize_8x8(const int32_t* coeff_in, int32_t* coeff_out, int qp) {
-  int scale = qp_to_scale(qp);
+void Quantizer::dequantize_8x8(const int32_t* coeff_in, int32_t* coeff_out, int qp, QuantMatrixKind kind) const {
+  const int32_t* step = steps(qp, kind);
   for (int i = 0; i < 64; ++i)
-    coeff_out[i] = coeff_in[i] * scale;
+    coeff_out[i] = coeff_in[i] * step[i];
 }
 
 }  // namespace codec
@@ -0,0 +1,78 @@
+#include <codec/RangeCoder.h>
+
+namespace telehealth {
+namespace codec {
+
+// round(-log2((i + 0.5) / 128) * 16)
+const uint16_t kBinCostTable[128] = {
+  128, 103,  91,  83,  77,  73,  69,  65,  63,  60,  58,  56,  54,  52,  50,  49,
+   47,  46,  45,  43,  42,  41,  40,  39,  38,  37,  36,  35,  35,  34,  33,  32,
+   32,  31,  30,  30,  29,  28,  28,  27,  27,  26,  25,  25,  24,  24,  23,  23,
+   22,  22,  21,  21,  21,  20,  20,  19,  19,  18,  18,  18,  17,  17,  17,  16,
+   16,  15,  15,  15,  14,  14,  14,  13,  13,  13,  12,  12,  12,  12,  11,  11,
+   11,  10,  10,  10,  10,   9,   9,   9,   9,   8,   8,   8,   7,   7,   7,   7,
+    7,   6,   6,   6,   6,   5,   5,   5,   5,   4,   4,   4,   4,   4,   3,   3,
+    3,   3,   3,   2,   2,   2,   2,   2,   1,   1,   1,   1,   1,   0,   0,   0,
+};
+
+void RangeEncoder::begin() {
+  low_ = 0;
+  range_ = 0xFFFFFFFFu;
+  cache_ = 0;
+  cache_size_ = 1;
+}
+
+void RangeEncoder::shift_low(BitstreamWriter& out) {
+  if (static_cast<uint32_t>(low_) < 0xFF000000u || (low_ >> 32) != 0) {
+    uint8_t carry = static_cast<uint8_t>(low_ >> 32);
+    uint8_t byte = cache_;
+    do {
+      out.write_byte(static_cast<uint8_t>(byte + carry));
+      byte = 0xFF;
+    } while (--cache_size_ != 0);
+    cache_ = static_cast<uint8_t>(low_ >> 24);
+  }
+  cache_size_++;
+  low_ = (low_ & 0x00FFFFFFu) << 8;
+}
+
+void RangeEncoder::encode_bypass(uint32_t value, int num_bits, BitstreamWriter& out) {
+  for (int i = num_bits - 1; i >= 0; --i) {
+    range_ >>= 1;
+    if ((value >> i) & 1u) low_ += range_;
+    while (range_ < kTop) {
+      range_ <<= 8;
+      shift_low(out);
+    }
+  }
+}
+
+void RangeEncoder::finish(BitstreamWriter& out) {
+  for (int i = 0; i < 5; ++i)
+    shift_low(out);
+}
+
+void RangeDecoder::begin(BitstreamReader& in) {
+  range_ = 0xFFFFFFFFu;
+  code_ = 0;
+  for (int i = 0; i < 5; ++i)
+    code_ = (code_ << 8) | in.read_byte();
+}
+
+uint32_t RangeDecoder::decode_bypass(int num_bits, BitstreamReader& in) {
+  uint32_t value = 0;
+  for (int i = 0; i < num_bits; ++i) {
+    range_ >>= 1;
+    uint32_t bit = code_ >= range_ ? 1u : 0u;
+    if (bit) code_ -= range_;
+    value = (value << 1) | bit;
+    while (range_ < kTop) {
+      range_ <<= 8;
+      code_ = (code_ << 8) | in.read_byte();
+    }
+  }
+  return value;
+}
+
+}  // namespace codec
+}  // namespace telehealth
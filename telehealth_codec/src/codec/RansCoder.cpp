@@ -0,0 +1,142 @@
+#include <codec/RansCoder.h>
+#include <algorithm>
+
+namespace telehealth {
+namespace codec {
+
+// States live in [kRansLow, kRansLow << 16); renormalization moves 16 bits at a time.
+constexpr uint32_t kRansLow = 1u << 16;
+
+void RansTable::build(const uint32_t* counts, int num_symbols) {
+  uint64_t total = 0;
+  int used = 0;
+  for (int i = 0; i < num_symbols; ++i) {
+    total += counts[i];
+    used += counts[i] != 0;
+  }
+  prob_bits_ = std::min(kRansMaxProbBits,
+                        std::max(bit_length(static_cast<uint32_t>(std::min<uint64_t>(total, 1u << 30))),
+                                 bit_length(static_cast<uint32_t>(used)) + 1));
+  const uint32_t scale = 1u << prob_bits_;
+  freq_.assign(static_cast<size_t>(num_symbols), 0);
+  uint32_t sum = 0;
+  int largest = 0;
+  for (int i = 0; i < num_symbols; ++i) {
+    if (!counts[i]) continue;
+    uint32_t f = static_cast<uint32_t>(std::max<uint64_t>(1, static_cast<uint64_t>(counts[i]) * scale / total));
+    freq_[static_cast<size_t>(i)] = f;
+    sum += f;
+    if (f > freq_[static_cast<size_t>(largest)]) largest = i;
+  }
+  // Rounding leaves the total short (give the rest to the most frequent symbol) or, after
+  // bumping rare symbols to 1, over (take it back from the largest frequencies).
+  if (sum < scale) freq_[static_cast<size_t>(largest)] += scale - sum;
+  while (sum > scale) {
+    auto it = std::max_element(freq_.begin(), freq_.end());
+    uint32_t take = std::min(*it - 1, sum - scale);
+    *it -= take;
+    sum -= take;
+  }
+  finish();
+}
+
+void RansTable::finish() {
+  const size_t n = freq_.size();
+  start_.assign(n, 0);
+  slots_.assign(static_cast<size_t>(1) << prob_bits_, 0);
+  uint32_t cum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    start_[i] = cum;
+    for (uint32_t k = 0; k < freq_[i]; ++k)
+      slots_[cum + k] = static_cast<uint32_t>(i) << 24 | (freq_[i] - 1) << 12 | cum;
+    cum += freq_[i];
+  }
+}
+
+void RansTable::write(BitstreamWriter& out) const {
+  out.write_bits(static_cast<uint32_t>(prob_bits_), 4);
+  for (uint32_t f : freq_) out.write_ue(f);
+}
+
+bool RansTable::read(BitstreamReader& in, int num_symbols) {
+  prob_bits_ = static_cast<int>(in.read_bits(4));
+  if (prob_bits_ < 1 || prob_bits_ > kRansMaxProbBits) return false;
+  freq_.assign(static_cast<size_t>(num_symbols), 0);
+  uint32_t sum = 0;
+  for (auto& f : freq_) {
+    f = std::min<uint32_t>(in.read_ue(), 1u << kRansMaxProbBits);
+    sum += f;
+  }
+  if (sum != (1u << prob_bits_)) return false;
+  finish();
+  return true;
+}
+
+void rans_encode(const uint8_t* symbols, size_t count, const RansTable& table, std::vector<uint8_t>* out) {
+  const int n = table.prob_bits();
+  uint32_t state[kRansLanes];
+  for (auto& x : state) x = kRansLow;
+  std::vector<uint16_t> words;
+  words.reserve(count / 2 + 8);
+  // rANS is last-in first-out: encode backwards so the decoder runs forwards.
+  for (size_t i = count; i-- > 0;) {
+    uint32_t& x = state[i % kRansLanes];
+    const uint32_t f = table.freq(symbols[i]);
+    const uint64_t x_max = static_cast<uint64_t>((kRansLow >> n) << 16) * f;
+    if (x >= x_max) {
+      words.push_back(static_cast<uint16_t>(x));
+      x >>= 16;
+    }
+    x = ((x / f) << n) + (x % f) + table.start(symbols[i]);
+  }
+  size_t pos = out->size();
+  out->resize(pos + 4 * kRansLanes + 2 * words.size());
+  uint8_t* p = out->data() + pos;
+  for (uint32_t x : state) {
+    for (int b = 0; b < 4; ++b) *p++ = static_cast<uint8_t>(x >> (8 * b));
+  }
+  for (size_t i = words.size(); i-- > 0;) {
+    *p++ = static_cast<uint8_t>(words[i]);
+    *p++ = static_cast<uint8_t>(words[i] >> 8);
+  }
+}
+
+bool rans_decode(const uint8_t* data, size_t size, const RansTable& table, uint8_t* symbols, size_t count) {
+  if (size < 4 * kRansLanes) return false;
+  const int n = table.prob_bits();
+  const uint32_t mask = (1u << n) - 1;
+  const uint32_t* slots = table.slots();
+  uint32_t state[kRansLanes];
+  for (int l = 0; l < kRansLanes; ++l) {
+    const uint8_t* s = data + 4 * l;
+    state[l] = static_cast<uint32_t>(s[0]) | static_cast<uint32_t>(s[1]) << 8 |
+               static_cast<uint32_t>(s[2]) << 16 | static_cast<uint32_t>(s[3]) << 24;
+  }
+  const uint8_t* words = data + 4 * kRansLanes;
+  const uint8_t* end = data + size;
+  bool ok = true;
+  auto step = [&](uint32_t& x, uint8_t* sym) {
+    uint32_t slot = x & mask;
+    uint32_t e = slots[slot];
+    *sym = static_cast<uint8_t>(e >> 24);
+    x = (((e >> 12) & 0xFFF) + 1) * (x >> n) + slot - (e & 0xFFF);
+    if (x < kRansLow) {
+      if (words + 2 <= end) {
+        x = x << 16 | static_cast<uint32_t>(words[0]) | static_cast<uint32_t>(words[1]) << 8;
+        words += 2;
+      } else {
+        ok = false;
+        x = kRansLow;
+      }
+    }
+  };
+  size_t i = 0;
+  for (; i + kRansLanes <= count; i += kRansLanes) {
+    for (int l = 0; l < kRansLanes; ++l) step(state[l], symbols + i + l);
+  }
+  for (int l = 0; i < count; ++i, ++l) step(state[l], symbols + i);
+  return ok;
+}
+
+}  // namespace codec
+}  // namespace telehealth
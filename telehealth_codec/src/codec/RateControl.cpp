@@ -1,31 +1,190 @@
 #include <codec/RateControl.h>
+#include <codec/Quantizer.h>
 #include <algorithm>
+#include <cmath>
 
 namespace telehealth {
 namespace codec {
 
+namespace {
+
+// Consecutive over-budget frames at qp_max before the resolution drops.
+constexpr int kDownscaleFrames = 4;
+// I-frame bit target in frame intervals (the buffer absorbs the excess over the next frames).
+constexpr double kIFrameShare = 4.0;
+// Frames over which a buffer away from half full is brought back.
+constexpr double kBufferFrames = 8.0;
+// Largest P-frame QP decrease between frames (increases are not limited: they protect the buffer).
+constexpr int kMaxQpStep = 3;
+// Lowest I-frame QP below the last P-frame's: a much sharper keyframe would show as a pulse.
+constexpr int kIFrameQpOffset = 3;
+// P-frame complexity assumed from the I-frame model until a P-frame has been coded (high
+// rather than low: an overshoot costs latency, an undershoot only a few frames of quality).
+constexpr double kPFromIComplexity = 0.5;
+// Model averaging weight of the newest frame.
+constexpr double kModelWeight = 0.5;
+// ln(qstep) per QP: the Quantizer's scale is exp(0.115 * qp).
+constexpr double kQstepLog = 0.115;
+// Upcoming frame complexity, relative to the current frame's, that counts as a motion burst.
+constexpr double kBurstRatio = 1.5;
+// Share of frame_byte_cap the frame-level target may use; MB-row control absorbs the rest.
+constexpr double kCapTargetShare = 0.85;
+// MB-row control: largest QP rise per row (normal mode), and share of the remaining budget
+// the guaranteed mode plans on.
+constexpr int kMaxRowQpRise = 3;
+constexpr double kRowGuardShare = 0.75;
+
+// Model scale c of a frame of type ftype (1 without analysis): 1 + the mean luma gradient
+// for I-frames (texture), 1 + the thumbnail motion search cost per sample for P-frames.
+double complexity_scale(FrameType ftype, const FrameComplexity* c) {
+  if (!c || c->samples == 0) return 1.0;
+  if (ftype == FrameType::I) return 1.0 + c->detail / 16.0;
+  return 1.0 + static_cast<double>(c->inter_cost) / c->samples;
+}
+
+}  // namespace
+
 RateControl::RateControl(const EncoderConfig& config)
-    : config_(config), target_kbps_(config.target_bitrate_kbps), current_qp_(config.qp_default) {}
+    : config_(config), target_kbps_(config.target_bitrate_kbps) {}
 
 FrameType RateControl::choose_frame_type(uint32_t frame_id, const FrameStats* previous) const {
   if (frame_id == 0) return FrameType::I;
-  if (config_.gop_size > 0 && (frame_id % config_.gop_size) == 0)
+  // Intra refresh replaces the periodic keyframe with a sweeping band of intra MBs.
+  if (config_.intra_refresh_frames <= 0 && config_.gop_size > 0 && (frame_id % config_.gop_size) == 0)
     return FrameType::I;
   if (previous && previous->force_keyframe) return FrameType::I;
   return FrameType::P;
 }
 
-int RateControl::choose_qp(const FrameStats& stats) {
-  frame_count_++;
-  window_bits_ += stats.bits_used;
+void RateControl::reset_for_scene_change() {
+  models_[static_cast<int>(FrameType::P)] = Model();
+  last_qp_[static_cast<int>(FrameType::P)] = last_qp_[static_cast<int>(FrameType::I)];
+  over_budget_frames_ = 0;
+  under_budget_frames_ = 0;
+}
+
+double RateControl::frame_bits() const {
+  return static_cast<double>(target_kbps_) * 1000.0 / (config_.fps > 0 ? config_.fps : 30);
+}
+
+uint32_t RateControl::buffer_size() const {
+  const double size = static_cast<double>(target_kbps_) * std::max(config_.vbv_buffer_ms, 0);
+  return static_cast<uint32_t>(std::max(size, 2 * frame_bits()));
+}
+
+double RateControl::buffer_fullness() const {
+  return std::min(buffer_bits_ / std::max<uint32_t>(buffer_size(), 1), 1.0);
+}
 
-  int target_bits_per_frame = (target_kbps_ * 1000) / (config_.fps > 0 ? config_.fps : 30);
-  if (stats.bits_used > static_cast<uint32_t>(target_bits_per_frame * 120 / 100))
-    current_qp_ = std::min(config_.qp_max, current_qp_ + 2);
-  else if (stats.bits_used < static_cast<uint32_t>(target_bits_per_frame * 80 / 100))
-    current_qp_ = std::max(config_.qp_min, current_qp_ - 1);
+int RateControl::frame_qp(FrameType ftype, int pixels, const FrameComplexity* frames, int count) {
+  const int t = static_cast<int>(ftype);
+  const double size = buffer_size();
+  const double room = std::max(size - buffer_bits_, 0.0);
+  // An expensive frame ahead (a cut, which will be an I-frame, or much more motion) is met
+  // with a buffer a quarter full instead of half, reached over the frames before it.
+  int peak = 0;
+  for (int i = count - 1; i >= 1; --i)
+    if (frames[i].scene_change ||
+        complexity_scale(FrameType::P, &frames[i]) >= kBurstRatio * complexity_scale(FrameType::P, frames))
+      peak = i;
+  double target = frame_bits() * (ftype == FrameType::I ? kIFrameShare : 1.0);
+  if (peak > 0)
+    target += std::min(size / 4 - buffer_bits_, 0.0) / peak;
+  else
+    target += (size / 2 - buffer_bits_) / kBufferFrames;
+  target = std::clamp(target, frame_bits() / 4, std::max(room, frame_bits() / 4));
+  if (config_.frame_byte_cap > 0) target = std::min(target, config_.frame_byte_cap * 8.0 * kCapTargetShare);
+  target_bits_ = static_cast<uint32_t>(target);
+
+  if (config_.constant_qp) return std::clamp(config_.qp_default, config_.qp_min, config_.qp_max);
+  int qp = last_qp_[t] > 0 ? last_qp_[t] : config_.qp_default;
+  const Model& intra = models_[static_cast<int>(FrameType::I)];
+  const bool from_intra = ftype == FrameType::P && models_[t].frames == 0 && intra.frames > 0;
+  if ((models_[t].frames > 0 || from_intra) && pixels > 0) {
+    // bits = K * c * pixels / qstep  =>  qstep = K * c * pixels / bits; a P-frame estimated
+    // from the I-frame model takes c as an I-frame would, like the frames it was fitted to.
+    const double k = from_intra ? intra.complexity * kPFromIComplexity : models_[t].complexity;
+    const double scale = count > 0 ? complexity_scale(from_intra ? FrameType::I : ftype, frames) : 1.0;
+    const double qstep = k * scale * pixels / target;
+    const int model_qp = static_cast<int>(std::lround(std::log(std::max(qstep, 1.0)) / kQstepLog));
+    // A P-frame QP drops a few steps per frame, so one easy frame does not swing quality.
+    qp = ftype == FrameType::P && !from_intra && last_qp_[t] > 0 ? std::max(model_qp, last_qp_[t] - kMaxQpStep)
+                                                                 : model_qp;
+  }
+  const int p_qp = last_qp_[static_cast<int>(FrameType::P)];
+  if (ftype == FrameType::I && p_qp > 0) qp = std::max(qp, p_qp - kIFrameQpOffset);
+  return std::clamp(qp, config_.qp_min, config_.qp_max);
+}
+
+void RateControl::update(const FrameStats& stats, FrameType ftype, int qp, int pixels,
+                         const FrameComplexity* complexity) {
+  const int t = static_cast<int>(ftype);
+  last_qp_[t] = qp;
+  if (ftype == FrameType::I && last_qp_[static_cast<int>(FrameType::P)] == 0) last_qp_[static_cast<int>(FrameType::P)] = qp;
+  if (pixels > 0 && stats.bits_used > 0) {
+    // MBs the byte cap coded without residual would have cost about as much as the others.
+    const double coded_share = std::max(1.0 - stats.dropped_mbs * 256.0 / pixels, 0.1);
+    const double k = stats.bits_used / coded_share * std::exp(qp * kQstepLog) /
+                     (pixels * complexity_scale(ftype, complexity));
+    Model& m = models_[t];
+    m.complexity = m.frames == 0 ? k : m.complexity + kModelWeight * (k - m.complexity);
+    m.frames++;
+  }
+
+  // Leaky bucket: the frame enters, a frame interval at the target rate drains.
+  buffer_bits_ = std::max(buffer_bits_ + stats.bits_used - frame_bits(), 0.0);
+
+  // Past qp_max, quantization cannot save more bits without wrecking the picture, while
+  // halving each dimension quarters the pixels. Going back up waits for a second of frames
+  // small enough that the larger size (about three times the bits) would fit.
+  const int max_downscale = config_.max_downscale >= 4 ? 4 : config_.max_downscale >= 2 ? 2 : 1;
+  if (max_downscale > 1) {
+    const double target = frame_bits();
+    over_budget_frames_ = qp >= config_.qp_max && stats.bits_used > target ? over_budget_frames_ + 1 : 0;
+    under_budget_frames_ = downscale_ > 1 && stats.bits_used * 3 < target ? under_budget_frames_ + 1 : 0;
+    if (over_budget_frames_ >= kDownscaleFrames && downscale_ < max_downscale) {
+      downscale_ *= 2;
+      over_budget_frames_ = 0;
+    } else if (under_budget_frames_ >= std::max(config_.fps, 1)) {
+      downscale_ /= 2;
+      under_budget_frames_ = 0;
+    }
+  }
+}
+
+void RowRateControl::begin(double budget_bits, int rows, int frame_qp, bool guaranteed) {
+  budget_bits_ = budget_bits;
+  rows_ = rows;
+  row_ = 0;
+  frame_qp_ = frame_qp;
+  guaranteed_ = guaranteed;
+  qp_ = frame_qp;
+  row_start_bits_ = 0;
+  complexity_ = 0;
+}
+
+int RowRateControl::next_row(size_t spent_bits) {
+  if (row_ > 0) {
+    const double k = static_cast<double>(spent_bits - row_start_bits_) * std::exp(qp_ * kQstepLog);
+    complexity_ = row_ == 1 ? k : complexity_ + kModelWeight * (k - complexity_);
+  }
+  row_start_bits_ = spent_bits;
+  if (row_++ == 0) return qp_ = frame_qp_;
+
+  const double left = budget_bits_ - static_cast<double>(spent_bits);
+  int qp = Quantizer::kMaxQp;
+  if (left > 0) {
+    // Per remaining row: K / qstep = share  =>  qstep = K / share.
+    const double share = left * (guaranteed_ ? kRowGuardShare : 1.0) / (rows_ - row_ + 1);
+    qp = static_cast<int>(std::lround(std::log(std::max(complexity_ / share, 1.0)) / kQstepLog));
+  }
+  qp = std::max({qp, frame_qp_, qp_ - 1});
+  if (!guaranteed_) qp = std::min(qp, qp_ + kMaxRowQpRise);
+  return qp_ = std::min(qp, Quantizer::kMaxQp);
+}
 
-  return std::clamp(current_qp_, config_.qp_min, config_.qp_max);
+bool RowRateControl::drop_residual(size_t spent_bits, double mb_bits, double reserve_bits) const {
+  return !fits(spent_bits, 2 * mb_bits, reserve_bits);
 }
 
 }  // namespace codec
@@ -0,0 +1,113 @@
+#include <codec/Reconstruct.h>
+#include <codec/MotionCompensation.h>
+#include <codec/Quantizer.h>
+#include <codec/Residual.h>
+#include <codec/Transform.h>
+#include <algorithm>
+#include <cstring>
+
+namespace telehealth {
+namespace codec {
+
+void predict_inter_macroblock(const MotionCompensation& mc, const FrameYUV& ref, BlockCoord coord,
+                              MotionVector mv, uint8_t* pred_y, uint8_t* pred_u, uint8_t* pred_v) {
+  const int w = std::min(MB_SIZE, ref.width - coord.mb_x * MB_SIZE);
+  const int h = std::min(MB_SIZE, ref.height - coord.mb_y * MB_SIZE);
+  const int cw = std::min(MB_CHROMA_SIZE, ref.width / 2 - coord.mb_x * MB_CHROMA_SIZE);
+  const int ch = std::min(MB_CHROMA_SIZE, ref.height / 2 - coord.mb_y * MB_CHROMA_SIZE);
+  mc.predict_block(BlockView(pred_y, MB_SIZE, w, h), ref, coord, mv);
+  mc.predict_chroma_block(BlockView(pred_u, MB_CHROMA_SIZE, cw, ch), BlockView(pred_v, MB_CHROMA_SIZE, cw, ch),
+                          ref, coord, mv);
+}
+
+void predict_intra_luma(const IntraPredictor& predictor, const FrameYUV& recon, BlockCoord coord, int b,
+                        bool top_ok, IntraMode mode, uint8_t* pred, int pred_stride) {
+  const int size = b < 0 ? MB_SIZE : 8;
+  const int bx = b < 0 ? 0 : b % 2, by = b < 0 ? 0 : b / 2;
+  IntraNeighbors nb;
+  nb.gather(recon.y_plane.data(), recon.stride_y, recon.width, recon.height, coord.mb_x * MB_SIZE + bx * 8,
+            coord.mb_y * MB_SIZE + by * 8, size, top_ok || by == 1, true);
+  predictor.predict(mode, nb, size, pred, pred_stride);
+}
+
+void predict_intra_chroma(const IntraPredictor& predictor, const FrameYUV& recon, BlockCoord coord,
+                          bool top_ok, IntraMode mode, uint8_t* pred_u, uint8_t* pred_v) {
+  const int x = coord.mb_x * MB_CHROMA_SIZE, y = coord.mb_y * MB_CHROMA_SIZE;
+  IntraNeighbors nb;
+  nb.gather(recon.u_plane.data(), recon.stride_uv, recon.width / 2, recon.height / 2, x, y, MB_CHROMA_SIZE,
+            top_ok, true);
+  predictor.predict(mode, nb, MB_CHROMA_SIZE, pred_u, MB_CHROMA_SIZE);
+  nb.gather(recon.v_plane.data(), recon.stride_uv, recon.width / 2, recon.height / 2, x, y, MB_CHROMA_SIZE,
+            top_ok, true);
+  predictor.predict(mode, nb, MB_CHROMA_SIZE, pred_v, MB_CHROMA_SIZE);
+}
+
+void reconstruct_block_8x8(const int32_t* coeff, bool coded, int qp, QuantMatrixKind kind,
+                           const uint8_t* pred, int pred_stride, BlockView dst,
+                           const Quantizer& quantizer, const Transform& transform) {
+  if (dst.w <= 0 || dst.h <= 0) return;
+  if (!coded) {
+    for (int y = 0; y < dst.h; ++y) {
+      if (pred)
+        std::memcpy(dst.row(y), pred + y * pred_stride, static_cast<size_t>(dst.w));
+      else
+        std::memset(dst.row(y), 0, static_cast<size_t>(dst.w));
+    }
+    return;
+  }
+  int32_t dequant[64], residual[64];
+  quantizer.dequantize_8x8(coeff, dequant, qp, kind);
+  transform.inverse_8x8(dequant, residual, 8);
+  reconstruct_block(residual, 8, pred, pred_stride, dst.ptr, dst.stride, dst.w, dst.h);
+}
+
+void reconstruct_macroblock(FrameYUV& recon, BlockCoord coord, const int32_t* coeff, uint32_t cbp,
+                            int qp, bool intra, const uint8_t* pred_y, const uint8_t* pred_u,
+                            const uint8_t* pred_v, const Quantizer& quantizer, const Transform& transform) {
+  BlockView ry, ru, rv;
+  get_macroblock_views(recon, coord, &ry, &ru, &rv);
+  const QuantMatrixKind luma = intra ? QuantMatrixKind::IntraLuma : QuantMatrixKind::InterLuma;
+  const QuantMatrixKind chroma = intra ? QuantMatrixKind::IntraChroma : QuantMatrixKind::InterChroma;
+  for (int i = 0; i < 4; ++i) {
+    const int bx = i % 2, by = i / 2;
+    BlockView dst(ry.ptr + by * 8 * ry.stride + bx * 8, ry.stride,
+                  std::clamp(ry.w - bx * 8, 0, 8), std::clamp(ry.h - by * 8, 0, 8));
+    const uint8_t* p = pred_y ? pred_y + by * 8 * MB_SIZE + bx * 8 : nullptr;
+    reconstruct_block_8x8(coeff + i * 64, (cbp >> i) & 1u, qp, luma, p, MB_SIZE, dst, quantizer, transform);
+  }
+  reconstruct_block_8x8(coeff + 4 * 64, (cbp >> 4) & 1u, qp, chroma, pred_u, MB_CHROMA_SIZE, ru, quantizer, transform);
+  reconstruct_block_8x8(coeff + 5 * 64, (cbp >> 5) & 1u, qp, chroma, pred_v, MB_CHROMA_SIZE, rv, quantizer, transform);
+}
+
+void reconstruct_intra_macroblock(FrameYUV& recon, BlockCoord coord, const int32_t* coeff, uint32_t cbp,
+                                  int qp, const IntraMbModes& modes, bool top_ok,
+                                  const IntraPredictor& predictor, const Quantizer& quantizer,
+                                  const Transform& transform) {
+  uint8_t pred[MB_SIZE * MB_SIZE], pred_u[64], pred_v[64];
+  if (!modes.split) {
+    predict_intra_luma(predictor, recon, coord, -1, top_ok, modes.luma[0], pred, MB_SIZE);
+    predict_intra_chroma(predictor, recon, coord, top_ok, modes.chroma, pred_u, pred_v);
+    reconstruct_macroblock(recon, coord, coeff, cbp, qp, true, pred, pred_u, pred_v, quantizer, transform);
+    return;
+  }
+  // Chroma neighbours lie outside the MB, so predict chroma before any luma is rebuilt.
+  predict_intra_chroma(predictor, recon, coord, top_ok, modes.chroma, pred_u, pred_v);
+  BlockView ry, ru, rv;
+  get_macroblock_views(recon, coord, &ry, &ru, &rv);
+  for (int i = 0; i < 4; ++i) {
+    const int bx = i % 2, by = i / 2;
+    BlockView dst(ry.ptr + by * 8 * ry.stride + bx * 8, ry.stride,
+                  std::clamp(ry.w - bx * 8, 0, 8), std::clamp(ry.h - by * 8, 0, 8));
+    if (dst.w <= 0 || dst.h <= 0) continue;
+    predict_intra_luma(predictor, recon, coord, i, top_ok, modes.luma[i], pred, 8);
+    reconstruct_block_8x8(coeff + i * 64, (cbp >> i) & 1u, qp, QuantMatrixKind::IntraLuma, pred, 8, dst,
+                          quantizer, transform);
+  }
+  reconstruct_block_8x8(coeff + 4 * 64, (cbp >> 4) & 1u, qp, QuantMatrixKind::IntraChroma, pred_u,
+                        MB_CHROMA_SIZE, ru, quantizer, transform);
+  reconstruct_block_8x8(coeff + 5 * 64, (cbp >> 5) & 1u, qp, QuantMatrixKind::IntraChroma, pred_v,
+                        MB_CHROMA_SIZE, rv, quantizer, transform);
+}
+
+}  // namespace codec
+}  // namespace telehealth
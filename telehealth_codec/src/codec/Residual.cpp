@@ -26,5 +26,28 @@ void compute_residual_8x8(const uint8_t* cur, int cur_stride,
   }
 }
 
+void reconstruct_block(const int32_t* residual, int residual_stride,
+                       const uint8_t* pred, int pred_stride,
+                       uint8_t* dst, int dst_stride, int w, int h) {
+  for (int y = 0; y < h; ++y) {
+    const int32_t* r = residual + y * residual_stride;
+    uint8_t* d = dst + y * dst_stride;
+    for (int x = 0; x < w; ++x) {
+      int v = r[x] + (pred ? pred[y * pred_stride + x] : 0);
+      d[x] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+  }
+}
+
+uint32_t residual_sad_8x8(const int16_t* residual, int stride) {
+  uint32_t sad = 0;
+  for (int y = 0; y < 8; ++y) {
+    const int16_t* r = residual + y * stride;
+    for (int x = 0; x < 8; ++x)
+      sad += static_cast<uint32_t>(r[x] < 0 ? -r[x] : r[x]);
+  }
+  return sad;
+}
+
 }  // namespace codec
 }  // namespace telehealth
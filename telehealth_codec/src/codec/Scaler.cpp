@@ -0,0 +1,100 @@
+#include <codec/Scaler.h>
+#include "ScalerKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace telehealth {
+namespace codec {
+
+namespace {
+
+// Source position of output sample i in 1/64 sample units: (i + 0.5) * src / dst - 0.5,
+// clamped to [0, src - 1].
+int source_position(int i, int src, int dst) {
+  const int64_t pos = (static_cast<int64_t>(2 * i + 1) * src * 32) / dst - 32;
+  return static_cast<int>(std::clamp<int64_t>(pos, 0, static_cast<int64_t>(src - 1) * 64));
+}
+
+}  // namespace
+
+void scale_blend_rows_scalar(const uint8_t* a, const uint8_t* b, int f, uint8_t* dst, int n) {
+  for (int x = 0; x < n; ++x) dst[x] = static_cast<uint8_t>((a[x] * (64 - f) + b[x] * f + 32) >> 6);
+}
+
+void scale_halve_row_scalar(const uint8_t* src, uint8_t* dst, int n) {
+  for (int x = 0; x < n; ++x) dst[x] = static_cast<uint8_t>((src[2 * x] + src[2 * x + 1] + 1) >> 1);
+}
+
+FrameScaler::FrameScaler() : level_(best_simd_level()) {}
+
+FrameScaler::FrameScaler(SimdLevel level) : level_(best_simd_level(level)) {}
+
+void FrameScaler::scale_plane(const uint8_t* src, int src_stride, int src_w, int src_h, uint8_t* dst,
+                              int dst_stride, int dst_w, int dst_h) const {
+  if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) return;
+  auto blend = scale_blend_rows_scalar;
+  auto halve = scale_halve_row_scalar;
+#if defined(TELECODEC_X86_SIMD)
+  if (level_ != SimdLevel::Scalar) {
+    blend = scale_blend_rows_sse2;
+    halve = scale_halve_row_sse2;
+  }
+#endif
+  const bool halving = dst_w * 2 == src_w;
+  std::vector<int> col0, col1, col_f;
+  if (!halving && dst_w != src_w) {
+    col0.resize(static_cast<size_t>(dst_w));
+    col1.resize(static_cast<size_t>(dst_w));
+    col_f.resize(static_cast<size_t>(dst_w));
+    for (int x = 0; x < dst_w; ++x) {
+      const int pos = source_position(x, src_w, dst_w);
+      col0[static_cast<size_t>(x)] = pos >> 6;
+      col1[static_cast<size_t>(x)] = std::min((pos >> 6) + 1, src_w - 1);
+      col_f[static_cast<size_t>(x)] = pos & 63;
+    }
+  }
+  std::vector<uint8_t> row(static_cast<size_t>(src_w));
+  for (int y = 0; y < dst_h; ++y) {
+    const int pos = source_position(y, src_h, dst_h);
+    const uint8_t* a = src + (pos >> 6) * src_stride;
+    const uint8_t* line = a;
+    if (pos & 63) {
+      blend(a, src + std::min((pos >> 6) + 1, src_h - 1) * src_stride, pos & 63, row.data(), src_w);
+      line = row.data();
+    }
+    uint8_t* out = dst + y * dst_stride;
+    if (dst_w == src_w) {
+      std::memcpy(out, line, static_cast<size_t>(dst_w));
+    } else if (halving) {
+      halve(line, out, dst_w);
+    } else {
+      for (int x = 0; x < dst_w; ++x) {
+        const int f = col_f[static_cast<size_t>(x)];
+        out[x] = static_cast<uint8_t>(
+            (line[col0[static_cast<size_t>(x)]] * (64 - f) + line[col1[static_cast<size_t>(x)]] * f + 32) >> 6);
+      }
+    }
+  }
+}
+
+void FrameScaler::scale(const FrameYUV& src, FrameYUV& dst) const {
+  scale_plane(src.y_plane.data(), src.stride_y, src.width, src.height, dst.y_plane.data(), dst.stride_y,
+              dst.width, dst.height);
+  scale_plane(src.u_plane.data(), src.stride_uv, src.width / 2, src.height / 2, dst.u_plane.data(), dst.stride_uv,
+              dst.width / 2, dst.height / 2);
+  scale_plane(src.v_plane.data(), src.stride_uv, src.width / 2, src.height / 2, dst.v_plane.data(), dst.stride_uv,
+              dst.width / 2, dst.height / 2);
+}
+
+void FrameScaler::scale(const Frame& src, FrameYUV& dst) const {
+  scale_plane(src.y_plane_ptr(), src.stride_y(), src.width(), src.height(), dst.y_plane.data(), dst.stride_y,
+              dst.width, dst.height);
+  scale_plane(src.u_plane_ptr(), src.stride_uv(), src.width() / 2, src.height() / 2, dst.u_plane.data(),
+              dst.stride_uv, dst.width / 2, dst.height / 2);
+  scale_plane(src.v_plane_ptr(), src.stride_uv(), src.width() / 2, src.height() / 2, dst.v_plane.data(),
+              dst.stride_uv, dst.width / 2, dst.height / 2);
+}
+
+}  // namespace codec
+}  // namespace telehealth
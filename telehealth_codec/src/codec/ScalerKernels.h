@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace telehealth {
+namespace codec {
+
+// Row blend: dst[x] = (a[x] * (64 - f) + b[x] * f + 32) >> 6 for x < n, f in [0, 64].
+void scale_blend_rows_scalar(const uint8_t* a, const uint8_t* b, int f, uint8_t* dst, int n);
+// Halving: dst[x] = (src[2x] + src[2x + 1] + 1) >> 1 for x < n (the blend at f = 32).
+void scale_halve_row_scalar(const uint8_t* src, uint8_t* dst, int n);
+
+#if defined(TELECODEC_X86_SIMD)
+void scale_blend_rows_sse2(const uint8_t* a, const uint8_t* b, int f, uint8_t* dst, int n);
+void scale_halve_row_sse2(const uint8_t* src, uint8_t* dst, int n);
+#endif
+
+}  // namespace codec
+}  // namespace telehealth
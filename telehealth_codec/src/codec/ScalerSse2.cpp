@@ -0,0 +1,42 @@
+#include "ScalerKernels.h"
+#include <emmintrin.h>
+
+namespace telehealth {
+namespace codec {
+
+void scale_blend_rows_sse2(const uint8_t* a, const uint8_t* b, int f, uint8_t* dst, int n) {
+  // a * (64 - f) + b * f + 32 <= 255 * 64 + 32 fits in 16 bits.
+  const __m128i wa = _mm_set1_epi16(static_cast<short>(64 - f)), wb = _mm_set1_epi16(static_cast<short>(f));
+  const __m128i round = _mm_set1_epi16(32), zero = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const __m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+    const __m128i rb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+    const __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(ra, zero), wa),
+                                                   _mm_mullo_epi16(_mm_unpacklo_epi8(rb, zero), wb)),
+                                     round);
+    const __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(ra, zero), wa),
+                                                   _mm_mullo_epi16(_mm_unpackhi_epi8(rb, zero), wb)),
+                                     round);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_packus_epi16(_mm_srli_epi16(lo, 6), _mm_srli_epi16(hi, 6)));
+  }
+  if (x < n) scale_blend_rows_scalar(a + x, b + x, f, dst + x, n - x);
+}
+
+void scale_halve_row_sse2(const uint8_t* src, uint8_t* dst, int n) {
+  // Even and odd samples of 32 inputs -> two registers of 16, then one rounded average.
+  const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+  int x = 0;
+  for (; x + 16 <= n; x += 16) {
+    const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x));
+    const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x + 16));
+    const __m128i even = _mm_packus_epi16(_mm_and_si128(r0, low_bytes), _mm_and_si128(r1, low_bytes));
+    const __m128i odd = _mm_packus_epi16(_mm_srli_epi16(r0, 8), _mm_srli_epi16(r1, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_avg_epu8(even, odd));
+  }
+  if (x < n) scale_halve_row_scalar(src + 2 * x, dst + x, n - x);
+}
+
+}  // namespace codec
+}  // namespace telehealth
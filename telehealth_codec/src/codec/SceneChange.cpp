@@ -0,0 +1,105 @@
+#include <codec/SceneChange.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+namespace telehealth {
+namespace codec {
+
+namespace {
+
+constexpr int kThumbScale = 8;   // source samples per thumbnail sample, each axis
+constexpr int kBlock = 4;        // thumbnail block analyzed as a unit
+constexpr int kSearch = 2;       // thumbnail search range
+constexpr int kMinSceneFrames = 5;  // frames after a cut before the next (a flash is one scene)
+// Mean inter cost per thumbnail sample below which a frame never cuts (noise on flat content).
+constexpr uint32_t kMinInterCost = 2;
+// Histogram change (percent of samples) below which a frame never cuts.
+constexpr int kMinHistogramChange = 20;
+
+uint32_t block_sad(const uint8_t* a, const uint8_t* b, int stride) {
+  uint32_t sad = 0;
+  for (int y = 0; y < kBlock; ++y)
+    for (int x = 0; x < kBlock; ++x) sad += static_cast<uint32_t>(std::abs(a[y * stride + x] - b[y * stride + x]));
+  return sad;
+}
+
+}  // namespace
+
+SceneChangeDetector::SceneChangeDetector(int threshold) : threshold_(std::clamp(threshold, 0, 100)) {}
+
+bool SceneChangeDetector::analyze(const uint8_t* y, int stride, int width, int height) {
+  const int tw = width / kThumbScale, th = height / kThumbScale;
+  if (tw != thumb_w_ || th != thumb_h_) {
+    thumb_w_ = tw;
+    thumb_h_ = th;
+    prev_thumb_.clear();
+  }
+  thumb_.resize(static_cast<size_t>(tw * th));
+  std::fill(std::begin(histogram_), std::end(histogram_), 0u);
+  // Detail the thumbnail averages away: absolute luma gradients, to the left and above.
+  uint64_t gradient = 0;
+  for (int ty = 0; ty < th; ++ty)
+    for (int tx = 0; tx < tw; ++tx) {
+      uint32_t sum = 0;
+      const uint8_t* p = y + ty * kThumbScale * stride + tx * kThumbScale;
+      for (int r = 0; r < kThumbScale; ++r, p += stride)
+        for (int c = 0; c < kThumbScale; ++c) {
+          sum += p[c];
+          histogram_[p[c] >> 3]++;
+          if (c > 0 || tx > 0) gradient += static_cast<uint32_t>(std::abs(p[c] - p[c - 1]));
+          if (r > 0 || ty > 0) gradient += static_cast<uint32_t>(std::abs(p[c] - p[c - stride]));
+        }
+      thumb_[static_cast<size_t>(ty * tw + tx)] = static_cast<uint8_t>((sum + 32) >> 6);
+    }
+
+  last_ = FrameComplexity();
+  if (tw > 0 && th > 0)
+    last_.detail = static_cast<uint32_t>(gradient * 16 / (static_cast<uint64_t>(tw) * th * kThumbScale * kThumbScale));
+  histogram_change_ = 0;
+  frames_since_cut_++;
+  const bool have_previous = !prev_thumb_.empty();
+  if (have_previous) {
+    uint64_t moved = 0;
+    for (int b = 0; b < 32; ++b)
+      moved += static_cast<uint32_t>(std::abs(static_cast<int>(histogram_[b]) - static_cast<int>(prev_histogram_[b])));
+    histogram_change_ = static_cast<int>(moved * 50 / (static_cast<uint64_t>(tw) * th * 64));
+  }
+  for (int by = 0; by + kBlock <= th; by += kBlock)
+    for (int bx = 0; bx + kBlock <= tw; bx += kBlock) {
+      const uint8_t* cur = thumb_.data() + by * tw + bx;
+      uint32_t sum = 0;
+      for (int r = 0; r < kBlock; ++r)
+        for (int c = 0; c < kBlock; ++c) sum += cur[r * tw + c];
+      const int mean = static_cast<int>((sum + kBlock * kBlock / 2) / (kBlock * kBlock));
+      uint32_t intra = 0;
+      for (int r = 0; r < kBlock; ++r)
+        for (int c = 0; c < kBlock; ++c) intra += static_cast<uint32_t>(std::abs(cur[r * tw + c] - mean));
+      last_.intra_cost += intra;
+      last_.samples += kBlock * kBlock;
+      if (!have_previous) {
+        last_.inter_cost += intra;  // nothing to predict from
+        continue;
+      }
+      uint32_t best = UINT32_MAX;
+      for (int dy = -kSearch; dy <= kSearch; ++dy)
+        for (int dx = -kSearch; dx <= kSearch; ++dx) {
+          if (bx + dx < 0 || by + dy < 0 || bx + dx + kBlock > tw || by + dy + kBlock > th) continue;
+          best = std::min(best, block_sad(cur, prev_thumb_.data() + (by + dy) * tw + bx + dx, tw));
+        }
+      last_.inter_cost += best;
+    }
+  std::swap(thumb_, prev_thumb_);
+  std::copy(std::begin(histogram_), std::end(histogram_), std::begin(prev_histogram_));
+
+  const uint32_t samples = last_.samples;
+  last_.scene_change =
+      have_previous && threshold_ > 0 && samples > 0 && frames_since_cut_ >= kMinSceneFrames &&
+      last_.inter_cost >= kMinInterCost * samples && histogram_change_ >= kMinHistogramChange &&
+      static_cast<uint64_t>(last_.inter_cost) * 100 > static_cast<uint64_t>(last_.intra_cost) * (100 - threshold_);
+  if (last_.scene_change) frames_since_cut_ = 0;
+  return last_.scene_change;
+}
+
+}  // namespace codec
+}  // namespace telehealth
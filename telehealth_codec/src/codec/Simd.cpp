@@ -0,0 +1,28 @@
+#include <codec/Simd.h>
+#include <util/CpuFeatures.h>
+
+namespace telehealth {
+namespace codec {
+
+bool simd_level_available(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::Scalar:
+      return true;
+#if defined(TELECODEC_X86_SIMD)
+    case SimdLevel::Sse2:
+      return true;  // baseline on x86-64
+    case SimdLevel::Avx2:
+      return util::has_avx2();
+#endif
+    default:
+      return false;
+  }
+}
+
+SimdLevel best_simd_level(SimdLevel max) {
+  while (!simd_level_available(max)) max = static_cast<SimdLevel>(static_cast<int>(max) - 1);
+  return max;
+}
+
+}  // namespace codec
+}  // namespace telehealth
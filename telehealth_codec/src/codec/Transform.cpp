@@ -5,8 +5,10 @@
 namespace telehealth {
 namespace codec {
 
-// Simple integer 8x8 DCT-like transform (Hadamard-style for speed)
+// Simple integer 8x8 DCT-like transform (Haar-style for speed)
 // Forward: scale and round; inverse: scale back.
+// The basis rows are orthogonal with squared norms 8, 8, 4, 4, 2, 2, 2, 2, so with the
+// forward output scaled by 1/8 the exact inverse is C^T (w_i * w_j * Y) C / 8, w = 8 / norm^2.
 static const int c8[8][8] = {
   {1,1,1,1,1,1,1,1},
   {1,1,1,1,-1,-1,-1,-1},
@@ -33,18 +35,20 @@ static void transform_8x8_core(const int16_t* in, int in_stride, int32_t* out) {
       int32_t sum = 0;
       for (int k = 0; k < 8; ++k)
         sum += tmp[i * 8 + k] * c8[j][k];
-      out[i * 8 + j] = sum >> 3;
+      out[i * 8 + j] = (sum + 4) >> 3;
     }
   }
 }
 
+static const int kInverseWeight[8] = {1, 1, 2, 2, 4, 4, 4, 4};
+
 static void itransform_8x8_core(const int32_t* in, int32_t* out, int out_stride) {
   int32_t tmp[64];
   for (int i = 0; i < 8; ++i) {
     for (int j = 0; j < 8; ++j) {
       int32_t sum = 0;
       for (int k = 0; k < 8; ++k)
-        sum += c8[k][i] * in[k * 8 + j];
+        sum += c8[k][i] * in[k * 8 + j] * kInverseWeight[k] * kInverseWeight[j];
       tmp[i * 8 + j] = sum;
     }
   }
@@ -53,7 +57,7 @@ static void itransform_8x8_core(const int32_t* in, int32_t* out, int out_stride)
       int32_t sum = 0;
       for (int k = 0; k < 8; ++k)
         sum += tmp[i * 8 + k] * c8[k][j];
-      out[i * out_stride + j] = sum >> 3;
+      out[i * out_stride + j] = (sum + 4) >> 3;
     }
   }
 }
@@ -62,7 +66,7 @@ void Transform::forward_8x8(const int16_t* residual, int residual_stride, int32_
   transform_8x8_core(residual, residual_stride, coeff_out);
 }
 
-void Transform::inverse_8x8(const int32_t* coeff, int32_t* residual_out, int residual_stride) {
+void Transform::inverse_8x8(const int32_t* coeff, int32_t* residual_out, int residual_stride) const {
   itransform_8x8_core(coeff, residual_out, residual_stride);
 }
 
@@ -76,7 +80,7 @@ void Transform::forward_16x16(const int16_t* residual, int residual_stride, int3
   }
 }
 
-void Transform::inverse_16x16(const int32_t* coeff, int16_t* residual_out, int residual_stride) {
+void Transform::inverse_16x16(const int32_t* coeff, int16_t* residual_out, int residual_stride) const {
   int32_t tmp[64];
   for (int by = 0; by < 2; ++by) {
     for (int bx = 0; bx < 2; ++bx) {
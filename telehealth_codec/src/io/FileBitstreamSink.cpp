@@ -27,6 +27,13 @@ bool FileBitstreamSink::write_file_header(const codec::BitstreamFileHeader& h) {
   return std::fwrite(&h, sizeof(h), 1, file_) == 1;
 }
 
+bool FileBitstreamSink::write_file_header(const codec::BitstreamFileHeader& h,
+                                          const codec::QuantMatrices& matrices) {
+  if (!write_file_header(h)) return false;
+  if (h.quant_matrix != static_cast<uint8_t>(codec::QuantMatrixPreset::Custom)) return true;
+  return std::fwrite(matrices.weights, sizeof(matrices.weights), 1, file_) == 1;
+}
+
 bool FileBitstreamSink::write_frame(const codec::BitstreamFrameHeader& h,
                                     const uint8_t* mv_data, size_t mv_len,
                                     const uint8_t* coeff_data, size_t coeff_len) {
@@ -38,15 +45,10 @@ bool FileBitstreamSink::write_frame(const codec::BitstreamFrameHeader& h,
 }
 
 bool FileBitstreamSink::write_frame(const codec::EncodedFrame& frame) {
-  codec::BitstreamFrameHeader h;
-  h.frame_type = frame.type == codec::FrameType::I ? 0 : 1;
-  h.frame_id = frame.frame_id;
-  h.timestamp_us = frame.timestamp_us;
-  h.qp = frame.qp;
-  h.mv_payload_bytes = static_cast<uint32_t>(frame.mv_bytes.size());
-  h.coeff_payload_bytes = static_cast<uint32_t>(frame.coeff_bytes.size());
-  return write_frame(h, frame.mv_bytes.data(), frame.mv_bytes.size(),
-                     frame.coeff_bytes.data(), frame.coeff_bytes.size());
+  // The serialize_frame() record: header, coded size, substream offset table, payloads.
+  if (!file_) return false;
+  const std::vector<uint8_t> record = codec::serialize_frame(frame);
+  return std::fwrite(record.data(), 1, record.size(), file_) == record.size();
 }
 
 }  // namespace io
@@ -15,6 +15,7 @@ void JitterBuffer::push_packet(const uint8_t* data, size_t size) {
   PacketHeader h;
   std::memcpy(&h, data, PACKET_HEADER_SIZE);
   if (h.stream_id != config_.stream_id) return;
+  if (h.temporal_layer > config_.max_temporal_layer) return;
 
   auto& frame = incomplete_[h.frame_id];
   frame.frame_id = h.frame_id;
@@ -1,5 +1,7 @@
 #include <io/UdpPacketSink.h>
+#include <algorithm>
 #include <cstring>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -47,8 +49,9 @@ bool UdpPacketSink::send_packet(const uint8_t* payload, size_t payload_size, con
 }
 
 bool UdpPacketSink::send_frame(const std::vector<uint8_t>& frame_data, uint32_t frame_id, uint64_t timestamp_us,
-                               uint32_t stream_id) {
+                               uint32_t stream_id, int temporal_layer) {
   if (socket_ < 0 || frame_data.empty()) return false;
+  if (temporal_layer > max_temporal_layer_) return true;
   size_t payload_max = mtu_ - PACKET_HEADER_SIZE;
   size_t total = frame_data.size();
   uint16_t total_packets = static_cast<uint16_t>((total + payload_max - 1) / payload_max);
@@ -61,6 +64,7 @@ bool UdpPacketSink::send_frame(const std::vector<uint8_t>& frame_data, uint32_t
     h.frame_id = frame_id;
     h.packet_id = i;
     h.total_packets = total_packets;
+    h.temporal_layer = static_cast<uint8_t>(temporal_layer);
     h.timestamp_us = timestamp_us;
     h.payload_size = static_cast<uint32_t>(len);
     if (!send_packet(frame_data.data() + off, len, h))
@@ -69,5 +73,19 @@ bool UdpPacketSink::send_frame(const std::vector<uint8_t>& frame_data, uint32_t
   return true;
 }
 
+bool UdpPacketSink::poll_feedback(FeedbackPacket* out, int timeout_ms) {
+  if (socket_ < 0 || !out) return false;
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(socket_, &fds);
+  struct timeval tv { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+  if (select(socket_ + 1, &fds, nullptr, nullptr, &tv) <= 0) return false;
+  FeedbackPacket fb;
+  ssize_t n = recv(socket_, &fb, sizeof(fb), 0);
+  if (n != static_cast<ssize_t>(FEEDBACK_PACKET_SIZE) || fb.magic != FeedbackPacket().magic) return false;
+  *out = fb;
+  return true;
+}
+
 }  // namespace io
 }  // namespace telehealth
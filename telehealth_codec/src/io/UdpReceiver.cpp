@@ -55,10 +55,12 @@ void UdpReceiver::poll(int timeout_ms) {
   ssize_t n = recvfrom(socket_, recv_buf_.data(), recv_buf_.size(), 0,
                       reinterpret_cast<struct sockaddr*>(&from), &fromlen);
   if (n < static_cast<ssize_t>(PACKET_HEADER_SIZE)) return;
+  peer_addr_ = from.sin_addr.s_addr;
+  peer_port_ = from.sin_port;
 
   PacketHeader h;
   std::memcpy(&h, recv_buf_.data(), PACKET_HEADER_SIZE);
-  size_t payload_len = std::min(static_cast<size_t>(h.payload_size), recv_buf_.size() - PACKET_HEADER_SIZE);
+  size_t payload_len = std::min(static_cast<size_t>(h.payload_size), static_cast<size_t>(n) - PACKET_HEADER_SIZE);
   if (h.total_packets == 1) {
     frame_callback_(h.frame_id, h.timestamp_us, recv_buf_.data() + PACKET_HEADER_SIZE, payload_len);
     return;
@@ -79,5 +81,17 @@ void UdpReceiver::poll(int timeout_ms) {
   }
 }
 
+bool UdpReceiver::send_feedback(const FeedbackPacket& feedback) {
+  if (socket_ < 0 || peer_port_ == 0) return false;
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = peer_port_;
+  addr.sin_addr.s_addr = peer_addr_;
+  ssize_t sent = sendto(socket_, &feedback, FEEDBACK_PACKET_SIZE, 0, reinterpret_cast<struct sockaddr*>(&addr),
+                        sizeof(addr));
+  return sent == static_cast<ssize_t>(FEEDBACK_PACKET_SIZE);
+}
+
 }  // namespace io
 }  // namespace telehealth
@@ -2,6 +2,8 @@
 #include <codec/YuvConverter.h>
 #include <codec/Encoder.h>
 #include <codec/EncoderConfig.h>
+#include <algorithm>
+#include <deque>
 
 namespace telehealth {
 namespace pipeline {
@@ -18,37 +20,91 @@ Pipeline::Pipeline(Config config)
   enc_cfg.fps = config.fps;
   enc_cfg.qp_default = config.qp_default;
   enc_cfg.gop_size = config.gop_size;
+  enc_cfg.long_term_refs = config.long_term_refs;
+  enc_cfg.temporal_layers = config.temporal_layers;
+  enc_cfg.target_bitrate_kbps = config.target_bitrate_kbps;
+  enc_cfg.vbv_buffer_ms = config.vbv_buffer_ms;
+  enc_cfg.max_downscale = config.max_downscale;
+  codec::apply_speed_preset(config.speed_preset, &enc_cfg);
+  enc_cfg.adaptive_speed = config.adaptive_speed;
+  enc_cfg.frame_budget_ms = config.frame_budget_ms;
+  enc_cfg.lookahead_frames = std::clamp(config.lookahead_frames, 0, 3);
+  enc_cfg.frame_byte_cap = config.frame_byte_cap;
+  enc_cfg.guaranteed_byte_cap = config.guaranteed_byte_cap;
+  encoder_ = std::make_unique<codec::Encoder>(enc_cfg);
+  feedback_ = std::make_unique<Feedback>();
 
   auto* cap_q = capture_queue_.get();
   auto* conv_q = convert_queue_.get();
   auto* enc_q = encode_queue_.get();
-  int w = config.width, h = config.height, qp = config.qp_default, gop = config.gop_size;
+  auto* encoder = encoder_.get();
+  auto* feedback = feedback_.get();
+  const size_t lookahead = static_cast<size_t>(enc_cfg.lookahead_frames);
+  if (lookahead > 0)
+    lookahead_queue_ = std::make_unique<BoundedQueue<ConvertedItem>>(config.queue_convert + lookahead);
+  auto* look_q = lookahead_queue_.get();
 
-  stages_.push_back(std::make_unique<Stage>("convert", [cap_q, conv_q, w, h]() {
+  stages_.push_back(std::make_unique<Stage>("convert", [cap_q, conv_q]() {
     auto item = cap_q->pop(100);
     if (!item || !item->frame || item->frame->empty()) return true;
     codec::YuvConverter conv;
-    std::shared_ptr<codec::Frame> out = codec::Frame::make_i420(w, h);
+    std::shared_ptr<codec::Frame> out = codec::Frame::make_i420(item->frame->width(), item->frame->height());
     out->set_meta(item->frame->frame_id(), item->frame->timestamp_us(), item->frame->pts_sec());
     conv.rgb_to_yuv420(*item->frame, *out);
-    conv_q->push(ConvertedItem{std::move(out)});
+    conv_q->push(ConvertedItem{std::move(out), {}});
     return true;
   }));
 
-  stages_.push_back(std::make_unique<Stage>("encode", [conv_q, enc_q, w, h, qp, gop]() {
-    auto item = conv_q->pop(100);
-    if (!item || !item->frame || item->frame->empty()) return true;
-    codec::EncoderConfig cfg;
-    cfg.width = w; cfg.height = h; cfg.qp_default = qp; cfg.gop_size = gop;
-    codec::Encoder enc(cfg);
+  if (look_q) {
+    // Analysis runs a frame ahead of encoding, on its own thread, so it adds no encode time.
+    auto detector = std::make_shared<codec::SceneChangeDetector>(enc_cfg.scene_change_threshold);
+    stages_.push_back(std::make_unique<Stage>("lookahead", [conv_q, look_q, detector]() {
+      auto item = conv_q->pop(100);
+      if (!item || !item->frame || item->frame->empty()) return true;
+      const codec::Frame& f = *item->frame;
+      detector->analyze(f.y_plane_ptr(), f.stride_y(), f.width(), f.height());
+      item->complexity = detector->complexity();
+      look_q->push(std::move(*item));
+      return true;
+    }));
+  }
+
+  // window: frames taken from the queue and not yet encoded (the front is next; more than one
+  // only with lookahead).
+  auto window = std::make_shared<std::deque<ConvertedItem>>();
+  auto* in_q = look_q ? look_q : conv_q;
+  stages_.push_back(std::make_unique<Stage>("encode", [in_q, enc_q, encoder, feedback, window, lookahead]() {
+    auto item = in_q->pop(100);
+    const bool got = item && item->frame && !item->frame->empty();
+    if (got) window->push_back(std::move(*item));
+    // Hold the front frame until lookahead frames are queued behind it, or the source stalls.
+    if (window->empty() || (got && window->size() <= lookahead)) return true;
+    ConvertedItem current = std::move(window->front());
+    std::vector<codec::FrameComplexity> upcoming;
+    if (lookahead > 0) {
+      upcoming.push_back(current.complexity);
+      for (size_t i = 1; i < window->size(); ++i) upcoming.push_back((*window)[i].complexity);
+    }
+    window->pop_front();
+    {
+      std::lock_guard<std::mutex> lock(feedback->mutex);
+      for (uint32_t id : feedback->acked) encoder->acknowledge(id);
+      feedback->acked.clear();
+      if (feedback->loss) encoder->report_loss();
+      feedback->loss = false;
+      if (feedback->target_kbps) encoder->set_target_bitrate_kbps(feedback->target_kbps);
+      feedback->target_kbps = 0;
+    }
     codec::FrameMeta meta;
-    meta.frame_id = item->frame->frame_id();
-    meta.timestamp_us = item->frame->timestamp_us();
-    meta.pts_sec = item->frame->pts_sec();
-    codec::EncodedFrame ef = enc.encode(*item->frame, meta);
+    meta.frame_id = current.frame->frame_id();
+    meta.timestamp_us = current.frame->timestamp_us();
+    meta.pts_sec = current.frame->pts_sec();
+    codec::EncodedFrame ef = encoder->encode(*current.frame, meta, upcoming.empty() ? nullptr : upcoming.data(),
+                                             static_cast<int>(upcoming.size()));
     EncodedItem out;
     out.frame = std::move(ef);
     out.meta = meta;
+    out.stats = encoder->last_frame_stats();
     enc_q->push(std::move(out));
     return true;
   }));
@@ -79,5 +135,20 @@ bool Pipeline::pop_encoded(EncodedItem& out, int timeout_ms) {
   return true;
 }
 
+void Pipeline::acknowledge(uint32_t frame_id) {
+  std::lock_guard<std::mutex> lock(feedback_->mutex);
+  feedback_->acked.push_back(frame_id);
+}
+
+void Pipeline::report_loss() {
+  std::lock_guard<std::mutex> lock(feedback_->mutex);
+  feedback_->loss = true;
+}
+
+void Pipeline::set_target_bitrate_kbps(uint32_t kbps) {
+  std::lock_guard<std::mutex> lock(feedback_->mutex);
+  feedback_->target_kbps = kbps;
+}
+
 }  // namespace pipeline
 }  // namespace telehealth
@@ -0,0 +1,27 @@
+#include <util/RowProgress.h>
+#include <algorithm>
+
+namespace telehealth {
+namespace util {
+
+void RowProgress::reset(int rows) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  progress_.assign(static_cast<size_t>(std::max(rows, 0)), 0);
+}
+
+void RowProgress::publish(int row, int value) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int& p = progress_[static_cast<size_t>(row)];
+    p = std::max(p, value);
+  }
+  cv_.notify_all();
+}
+
+void RowProgress::wait(int row, int value) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [&] { return progress_[static_cast<size_t>(row)] >= value; });
+}
+
+}  // namespace util
+}  // namespace telehealth
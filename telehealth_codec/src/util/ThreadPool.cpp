@@ -0,0 +1,60 @@
+#include <util/ThreadPool.h>
+
+namespace telehealth {
+namespace util {
+
+ThreadPool::ThreadPool(int num_workers) {
+  for (int i = 0; i < num_workers; ++i)
+    workers_.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& t : workers_)
+    t.join();
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)>& fn) {
+  if (count <= 0) return;
+  if (workers_.empty() || count == 1) {
+    for (int i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_ = &fn;
+  next_ = 0;
+  count_ = count;
+  pending_ = count;
+  work_cv_.notify_all();
+  run_tasks(lock);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+  job_ = nullptr;
+}
+
+void ThreadPool::run_tasks(std::unique_lock<std::mutex>& lock) {
+  while (job_ && next_ < count_) {
+    int index = next_++;
+    const std::function<void(int)>& fn = *job_;
+    lock.unlock();
+    fn(index);
+    lock.lock();
+    if (--pending_ == 0) done_cv_.notify_all();
+  }
+}
+
+void ThreadPool::worker_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_cv_.wait(lock, [this] { return stop_ || (job_ && next_ < count_); });
+    if (stop_) return;
+    run_tasks(lock);
+  }
+}
+
+}  // namespace util
+}  // namespace telehealth
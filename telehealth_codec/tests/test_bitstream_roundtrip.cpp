@@ -1,14 +1,822 @@
 #include <codec/Encoder.h>
+#include <codec/Decoder.h>
 #include <codec/EncoderConfig.h>
+#include <codec/DeadlineController.h>
+#include <codec/SceneChange.h>
 #include <codec/Frame.h>
 #include <codec/Bitstream.h>
+#include <codec/EntropyCoder.h>
+#include <codec/Transform.h>
 #include <codec/YuvConverter.h>
 #include <io/VideoSource.h>
 #include <io/FileBitstreamSink.h>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Writer output must keep the LSB-first layout and read back through BitstreamReader.
+static bool check_bit_packing() {
+  telehealth::codec::BitstreamWriter w;
+  w.write_bits(0x5, 3);
+  w.write_bits(0x1F, 5);
+  w.write_bits(0xABCD, 16);
+  w.write_bits(0x1, 2);
+  w.write_byte(0x5A);
+  const uint8_t tail[3] = {1, 2, 3};
+  w.write_bytes(tail, 3);
+  const std::vector<uint8_t> expected = {0xFD, 0xCD, 0xAB, 0x01, 0x5A, 1, 2, 3};
+  if (w.buffer() != expected) {
+    std::cerr << "Bit packing layout mismatch\n";
+    return false;
+  }
+
+  std::vector<uint32_t> values;
+  std::vector<int> widths;
+  w.reset();
+  for (int i = 0; i < 5000; ++i) {
+    int n = 1 + rand() % 32;
+    uint32_t v = static_cast<uint32_t>(rand()) * 2654435761u;
+    if (n < 32) v &= (1u << n) - 1;
+    widths.push_back(n);
+    values.push_back(v);
+    w.write_bits(v, n);
+  }
+  size_t bits = w.bit_position();
+  w.flush_byte_align();
+  if (w.buffer().size() != (bits + 7) / 8) {
+    std::cerr << "Writer size mismatch\n";
+    return false;
+  }
+  telehealth::codec::BitstreamReader r;
+  r.set_data(w.buffer());
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (r.read_bits(widths[i]) != values[i]) {
+      std::cerr << "Bit roundtrip mismatch at symbol " << i << "\n";
+      return false;
+    }
+  }
+
+  // peek/skip and the zero-run helper, then zero padding past the end of the buffer.
+  w.reset();
+  w.write_bits(0, 9);
+  w.write_bits(1, 1);
+  w.write_bits(0x2A, 6);
+  w.flush_byte_align();
+  r.set_data(w.buffer());
+  if (r.count_leading_zeros() != 9 || r.peek_bits(10) != 0x200) {
+    std::cerr << "Reader peek mismatch\n";
+    return false;
+  }
+  r.skip_bits(10);
+  if (r.read_bits(6) != 0x2A || !r.eof() || r.read_bits(32) != 0 || r.count_leading_zeros() != 32) {
+    std::cerr << "Reader tail mismatch\n";
+    return false;
+  }
+  return true;
+}
+
+// Each slice of a multi-slice I-frame must decode on its own from its offset-table entry,
+// ending exactly where the next slice starts.
+static bool check_slices() {
+  using namespace telehealth::codec;
+  EncoderConfig cfg;
+  cfg.width = 48;
+  cfg.height = 64;
+  cfg.num_slices = 3;
+  cfg.slice_threads = 2;
+  Encoder encoder(cfg);
+  FrameYUV yuv;
+  yuv.allocate(cfg.width, cfg.height);
+  for (int y = 0; y < cfg.height; ++y)
+    for (int x = 0; x < cfg.width; ++x) yuv.y_row(y)[x] = static_cast<uint8_t>((x * 7 + y * y) & 0xFF);
+  FrameMeta meta;
+  EncodedFrame ef = encoder.encode(yuv, meta);
+  if (ef.type != FrameType::I || ef.num_slices != 3 || ef.slice_offsets.size() != 4) return false;
+
+  const int mb_cols = 3, mb_rows = 4;
+  size_t starts[4] = {0, ef.slice_offsets[2], ef.slice_offsets[3], ef.coeff_bytes.size()};
+  for (int s = 0; s < 3; ++s) {
+    if (starts[s] >= starts[s + 1]) return false;
+    EntropyCoder decoder(cfg.entropy_mode);
+    BitstreamReader r;
+    r.set_data(ef.coeff_bytes.data() + starts[s], starts[s + 1] - starts[s]);
+    decoder.begin_slice(r);
+    int rows = (s + 1) * mb_rows / 3 - s * mb_rows / 3;
+    for (int m = 0; m < rows * mb_cols; ++m) {
+      uint32_t cbp = decoder.decode_cbp(r);
+      decoder.decode_intra_modes(r);
+      for (int b = 0; b < kCbpBlocks; ++b) {
+        int32_t coeff[64];
+        if (cbp & (1u << b)) decoder.decode_block_8x8(r, ef.qp, coeff);
+      }
+    }
+    r.align_to_byte();
+    if (r.bit_position() != (starts[s + 1] - starts[s]) * 8) {
+      std::cerr << "Slice " << s << " did not end at the next slice offset\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+static double psnr_y(const telehealth::codec::FrameYUV& a, const telehealth::codec::FrameYUV& b) {
+  double err = 0;
+  for (int y = 0; y < a.height; ++y)
+    for (int x = 0; x < a.width; ++x) {
+      double d = a.y_row(y)[x] - b.y_row(y)[x];
+      err += d * d;
+    }
+  err /= a.width * a.height;
+  return err == 0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / err);
+}
+
+static bool same_picture(const telehealth::codec::FrameYUV& a, const telehealth::codec::FrameYUV& b) {
+  return a.width == b.width && a.height == b.height && a.y_plane == b.y_plane && a.u_plane == b.u_plane &&
+         a.v_plane == b.v_plane;
+}
+
+// Frame f of the shared test content: a luma ramp, an 8x8 checker and fine texture panning
+// right by speed pixels a frame, over smooth chroma.
+static void fill_test_frame(telehealth::codec::FrameYUV& yuv, int f, int speed = 1) {
+  for (int y = 0; y < yuv.height; ++y)
+    for (int x = 0; x < yuv.width; ++x) {
+      const int px = x + speed * f;
+      yuv.y_row(y)[x] = static_cast<uint8_t>((px * y) / 8 + ((px / 8 + y / 8) & 1) * 40 + (px * 7 + y * 3) % 23);
+    }
+  for (int y = 0; y < yuv.height / 2; ++y)
+    for (int x = 0; x < yuv.width / 2; ++x) {
+      yuv.u_row(y)[x] = static_cast<uint8_t>(128 + x - y);
+      yuv.v_row(y)[x] = static_cast<uint8_t>(100 + 2 * y);
+    }
+}
+
+// Encode yuv as frame f, decode its serialized record and require the decoder's picture to
+// be the encoder's reconstruction. out, if given, receives the encoded frame; lookahead and
+// count go to Encoder::encode.
+static bool encode_and_match(telehealth::codec::Encoder& encoder, telehealth::codec::Decoder& decoder,
+                             const telehealth::codec::FrameYUV& yuv, int f,
+                             telehealth::codec::EncodedFrame* out = nullptr,
+                             const telehealth::codec::FrameComplexity* lookahead = nullptr, int count = 0) {
+  using namespace telehealth::codec;
+  FrameMeta meta;
+  meta.frame_id = f;
+  EncodedFrame ef = encoder.encode(yuv, meta, lookahead, count);
+  EncodedFrame parsed;
+  const size_t size = ef.raw_bytes.size();
+  const bool ok = parse_frame(ef.raw_bytes.data(), size, encoder.config().height, &parsed) == size &&
+                  decoder.decode(parsed) && decoder.intact() &&
+                  same_picture(decoder.frame(), *encoder.reconstructed_frame());
+  if (out) *out = std::move(ef);
+  return ok;
+}
+
+// The encoder's reference must be what a decoder rebuilds: Decoder output matches it exactly
+// in every entropy mode, with and without slices and deblocking (two GOPs, so Huffman mode
+// also sends and drops tables), and P-frames predicted from it stay close to the source.
+// 40x40 exercises partial MBs.
+static bool check_reconstruction() {
+  using namespace telehealth::codec;
+  Transform transform;
+  srand(5);
+  for (int it = 0; it < 1000; ++it) {
+    int16_t r[64];
+    int32_t c[64], back[64];
+    for (auto& v : r) v = static_cast<int16_t>(rand() % 511 - 255);
+    transform.forward_8x8(r, 8, c);
+    transform.inverse_8x8(c, back, 8);
+    for (int i = 0; i < 64; ++i)
+      if (std::abs(back[i] - r[i]) > 3) {
+        std::cerr << "Inverse transform is not an inverse\n";
+        return false;
+      }
+  }
+
+  const EntropyMode modes[] = {EntropyMode::Fixed, EntropyMode::ExpGolomb, EntropyMode::Arithmetic,
+                               EntropyMode::Huffman, EntropyMode::Rans};
+  for (EntropyMode mode : modes)
+    for (int slices : {1, 3})
+      for (int variant = 0; variant < 4; ++variant) {
+        const bool deblock = variant & 1, wavefront = variant & 2;
+        EncoderConfig cfg;
+        cfg.width = 40;
+        cfg.height = 40;
+        cfg.gop_size = 6;
+        cfg.entropy_mode = mode;
+        cfg.num_slices = slices;
+        cfg.deblock = deblock;
+        cfg.wavefront = wavefront;
+        cfg.slice_threads = 3;
+        Encoder encoder(cfg);
+        Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+        FrameYUV yuv(cfg.width, cfg.height);
+        for (int f = 0; f < 10; ++f) {
+          fill_test_frame(yuv, f, 2);
+          EncodedFrame ef;
+          if (!encode_and_match(encoder, decoder, yuv, f, &ef)) {
+            std::cerr << "Decoded frame " << f << " differs from the encoder reconstruction ("
+                      << entropy_mode_name(mode) << ", " << slices << " slices, deblock " << deblock
+                      << ", wavefront " << wavefront << ")\n";
+            return false;
+          }
+          if (psnr_y(yuv, *encoder.reconstructed_frame()) < 30.0) {
+            std::cerr << "Reconstruction of frame " << f << " is too far from the source\n";
+            return false;
+          }
+          if (((ef.flags & kFrameFlagDeblock) != 0) != deblock) {
+            std::cerr << "Deblock flag does not follow the config\n";
+            return false;
+          }
+        }
+      }
+  return true;
+}
+
+// P-frame blocks whose residual SAD is under the quantizer's zero-block bound skip the
+// transform and leave the CBP. The bound grows with QP and the matrix's smallest step, so
+// streams at a fine and a coarse constant QP, flat and perceptual, must still decode exactly.
+static bool check_zero_block_skip() {
+  using namespace telehealth::codec;
+  for (QuantMatrixPreset preset : {QuantMatrixPreset::Flat, QuantMatrixPreset::Perceptual})
+    for (int qp : {8, 44}) {
+      EncoderConfig cfg;
+      cfg.width = 96;
+      cfg.height = 64;
+      cfg.gop_size = 0;
+      cfg.constant_qp = true;
+      cfg.qp_default = qp;
+      cfg.quant_matrix = preset;
+      Encoder encoder(cfg);
+      Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+      FrameYUV yuv(cfg.width, cfg.height);
+      for (int f = 0; f < 6; ++f) {
+        fill_test_frame(yuv, f);
+        if (!encode_and_match(encoder, decoder, yuv, f)) {
+          std::cerr << "Frame " << f << " at QP " << qp << " does not decode to the reconstruction\n";
+          return false;
+        }
+      }
+    }
+  return true;
+}
+
+// Every quant matrix preset round-trips exactly through the Decoder: the file header names
+// the preset, and Custom weights (finer and coarser than flat, different per matrix kind)
+// reach the decoder through Encoder::quant_matrices(), without which it decodes differently.
+static bool check_quant_matrices() {
+  using namespace telehealth::codec;
+  QuantMatrices custom;
+  for (int k = 0; k < kNumQuantMatrices; ++k)
+    for (int i = 0; i < 64; ++i) custom.weights[k][i] = static_cast<uint8_t>(8 + (i * 5 + k * 11) % 40);
+  for (QuantMatrixPreset preset : {QuantMatrixPreset::Flat, QuantMatrixPreset::Perceptual, QuantMatrixPreset::Custom})
+    for (EntropyMode mode : {EntropyMode::ExpGolomb, EntropyMode::Arithmetic}) {
+      EncoderConfig cfg;
+      cfg.width = 96;
+      cfg.height = 64;
+      cfg.gop_size = 4;
+      cfg.entropy_mode = mode;
+      cfg.deblock = true;
+      cfg.quant_matrix = preset;
+      cfg.custom_quant_matrices = custom;
+      Encoder encoder(cfg);
+      const BitstreamFileHeader header = encoder.file_header();
+      Decoder decoder(header, encoder.quant_matrices());
+      Decoder without_weights(header);
+      if (header.quant_matrix != static_cast<uint8_t>(preset)) {
+        std::cerr << "File header names quant matrix " << int(header.quant_matrix) << "\n";
+        return false;
+      }
+      FrameYUV yuv(cfg.width, cfg.height);
+      bool without_weights_differs = false;
+      for (int f = 0; f < 6; ++f) {
+        fill_test_frame(yuv, f, 2);
+        EncodedFrame ef;
+        if (!encode_and_match(encoder, decoder, yuv, f, &ef)) {
+          std::cerr << "Frame " << f << " with quant matrix " << int(header.quant_matrix) << " ("
+                    << entropy_mode_name(mode) << ") does not decode to the reconstruction\n";
+          return false;
+        }
+        without_weights.decode(ef);
+        without_weights_differs = without_weights_differs || !same_picture(without_weights.frame(), decoder.frame());
+      }
+      if (without_weights_differs != (preset == QuantMatrixPreset::Custom)) {
+        std::cerr << "Decoder without the custom weights " << (without_weights_differs ? "differs" : "matches")
+                  << " (quant matrix " << int(header.quant_matrix) << ")\n";
+        return false;
+      }
+    }
+  return true;
+}
+
+// Wavefront rows run on however many threads there are, but every MB waits for the same
+// neighbours, so the bitstream must not depend on the thread count.
+static bool check_wavefront_determinism() {
+  using namespace telehealth::codec;
+  for (EntropyMode mode : {EntropyMode::Arithmetic, EntropyMode::Rans}) {
+    std::vector<std::vector<uint8_t>> streams[2];
+    for (int run = 0; run < 2; ++run) {
+      EncoderConfig cfg;
+      cfg.width = 160;
+      cfg.height = 96;
+      cfg.gop_size = 4;
+      cfg.entropy_mode = mode;
+      cfg.wavefront = true;
+      cfg.slice_threads = run == 0 ? 1 : 4;
+      Encoder encoder(cfg);
+      FrameYUV yuv(cfg.width, cfg.height);
+      for (int f = 0; f < 6; ++f) {
+        fill_test_frame(yuv, f, 3);
+        FrameMeta meta;
+        meta.frame_id = f;
+        EncodedFrame ef = encoder.encode(yuv, meta);
+        if (!(ef.flags & kFrameFlagWavefront) || ef.slice_offsets.size() != 2u * (cfg.height / MB_SIZE - 1))
+          return false;
+        streams[run].push_back(ef.raw_bytes);
+      }
+    }
+    if (streams[0] != streams[1]) {
+      std::cerr << "Wavefront bitstream depends on the thread count (" << entropy_mode_name(mode) << ")\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// With intra refresh there is no keyframe after frame 0, yet a decoder that lost a frame must
+// be back in step once a sweep that started after the loss has finished: frames 1..N carry
+// bands 0..N-1, so losing frame 2 is healed by the sweep of frames N+1..2N. Moving texture
+// and deblocking make sure drift would show if a refreshed MB read unrefreshed samples.
+static bool check_intra_refresh() {
+  using namespace telehealth::codec;
+  const int sweep = 3;
+  EncoderConfig cfg;
+  cfg.width = 96;
+  cfg.height = 64;
+  cfg.gop_size = 4;  // ignored while intra refresh is on
+  cfg.intra_refresh_frames = sweep;
+  cfg.deblock = true;
+  cfg.scene_change_threshold = 0;  // the wrapping pattern changes wholesale between frames
+  Encoder encoder(cfg);
+  Decoder all(encoder.file_header(), encoder.quant_matrices());
+  Decoder lossy(encoder.file_header(), encoder.quant_matrices());
+  FrameYUV yuv(cfg.width, cfg.height);
+  bool drifted = false;
+  for (int f = 0; f < 3 * sweep + 1; ++f) {
+    fill_test_frame(yuv, f, 3);
+    EncodedFrame ef;
+    if (!encode_and_match(encoder, all, yuv, f, &ef)) return false;
+    if ((ef.type == FrameType::I) != (f == 0)) {
+      std::cerr << "Intra refresh frame " << f << " has the wrong type\n";
+      return false;
+    }
+    if (f == 2) continue;  // lost
+    if (!lossy.decode(ef)) return false;
+    const bool same = same_picture(lossy.frame(), all.frame());
+    if (f > 2 && f < 2 * sweep) drifted = drifted || !same;
+    if (f >= 2 * sweep && !same) {
+      std::cerr << "Decoder has not recovered by frame " << f << " after a lost frame\n";
+      return false;
+    }
+  }
+  if (!drifted) {
+    std::cerr << "Lost frame did not disturb the decoder; recovery is untested\n";
+    return false;
+  }
+  return true;
+}
+
+// Receiver feedback: the decoder acknowledges intact frames and reports the first one that
+// is not. After a lost frame the next P-frame predicts from the newest acknowledged long-term
+// reference, is intact again and costs far less than the I-frame it replaces; without
+// long-term references the encoder falls back to an I-frame. Huffman mode also covers
+// recovery from the loss of the frame that carried the tables.
+static bool check_long_term_recovery() {
+  using namespace telehealth::codec;
+  for (EntropyMode mode : {EntropyMode::ExpGolomb, EntropyMode::Huffman})
+    for (int long_term : {2, 0}) {
+      EncoderConfig cfg;
+      cfg.width = 96;
+      cfg.height = 64;
+      cfg.gop_size = 0;
+      cfg.entropy_mode = mode;
+      cfg.huffman_training_frames = 2;
+      cfg.long_term_refs = long_term;
+      cfg.long_term_interval = 4;
+      cfg.constant_qp = true;  // sizes are compared at one QP
+      Encoder encoder(cfg);
+      Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+      FrameYUV yuv(cfg.width, cfg.height);
+      size_t i_frame_bytes = 0;
+      bool reported = false, recovered = false;
+      for (int f = 0; f < 12; ++f) {
+        fill_test_frame(yuv, f);
+        FrameMeta meta;
+        meta.frame_id = f;
+        EncodedFrame ef = encoder.encode(yuv, meta);
+        if (f == 0) i_frame_bytes = ef.total_bytes();
+        if (reported && !recovered) {
+          recovered = true;
+          if ((ef.type == FrameType::I) != (long_term == 0) ||
+              (long_term > 0 && ef.total_bytes() * 2 > i_frame_bytes)) {
+            std::cerr << "Recovery frame " << f << " is " << (ef.type == FrameType::I ? "an I-frame" : "a P-frame")
+                      << " of " << ef.total_bytes() << " bytes (I-frame " << i_frame_bytes << ")\n";
+            return false;
+          }
+        }
+        if (f == 3) continue;  // lost: frame 3 carries the Huffman tables
+        if (!decoder.decode(ef)) return false;
+        if (decoder.intact()) {
+          if (!same_picture(decoder.frame(), *encoder.reconstructed_frame())) {
+            std::cerr << "Intact frame " << f << " differs from the encoder reconstruction\n";
+            return false;
+          }
+          encoder.acknowledge(ef.frame_id);
+        } else if (!reported) {
+          reported = true;
+          encoder.report_loss();
+        } else if (recovered) {
+          std::cerr << "Decoder is not intact at frame " << f << " after recovery\n";
+          return false;
+        }
+      }
+      if (!recovered || !decoder.intact()) {
+        std::cerr << "Loss was not recovered (" << entropy_mode_name(mode) << ", " << long_term
+                  << " long-term references)\n";
+        return false;
+      }
+    }
+  return true;
+}
+
+// Every temporal operating point (frames up to layer L) must decode to the encoder's reconstructions.
+static bool check_temporal_layers() {
+  using namespace telehealth::codec;
+  for (EntropyMode mode : {EntropyMode::ExpGolomb, EntropyMode::Huffman}) {
+    EncoderConfig cfg;
+    cfg.width = 96;
+    cfg.height = 64;
+    cfg.gop_size = 0;
+    cfg.entropy_mode = mode;
+    cfg.huffman_training_frames = 2;
+    cfg.temporal_layers = 3;
+    cfg.long_term_refs = 1;
+    cfg.long_term_interval = 4;
+    Encoder encoder(cfg);
+    FrameYUV yuv(cfg.width, cfg.height);
+    std::vector<EncodedFrame> frames;
+    std::vector<FrameYUV> recons;
+    for (int f = 0; f < 13; ++f) {
+      fill_test_frame(yuv, f);
+      FrameMeta meta;
+      meta.frame_id = f;
+      frames.push_back(encoder.encode(yuv, meta));
+      recons.push_back(*encoder.reconstructed_frame());
+      const int expected = f == 0 ? 0 : (f % 4 == 0 ? 0 : (f % 2 == 0 ? 1 : 2));
+      if (frames.back().temporal_layer() != expected) {
+        std::cerr << "Frame " << f << " is in temporal layer " << frames.back().temporal_layer() << ", expected "
+                  << expected << "\n";
+        return false;
+      }
+    }
+    for (int max_layer = 0; max_layer < cfg.temporal_layers; ++max_layer) {
+      Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+      for (size_t f = 0; f < frames.size(); ++f) {
+        if (frames[f].temporal_layer() > max_layer) continue;
+        if (!decoder.decode(frames[f]) || !decoder.intact() || !same_picture(decoder.frame(), recons[f])) {
+          std::cerr << "Frame " << f << " does not decode at operating point T" << max_layer << " ("
+                    << entropy_mode_name(mode) << ")\n";
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Rate control halves the coded size when the budget collapses and restores it when the
+// budget returns; each switch is an I-frame, and the serialized stream decodes exactly.
+static bool check_dynamic_resolution() {
+  using namespace telehealth::codec;
+  EncoderConfig cfg;
+  cfg.width = 128;
+  cfg.height = 96;
+  cfg.fps = 10;
+  cfg.gop_size = 0;
+  cfg.wavefront = true;  // substream count follows the signalled height
+  cfg.slice_threads = 1;
+  cfg.max_downscale = 2;
+  cfg.target_bitrate_kbps = 5;
+  Encoder encoder(cfg);
+  Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+  FrameYUV yuv(cfg.width, cfg.height);
+  int down = -1, up = -1;
+  for (int f = 0; f < 60 && up < 0; ++f) {
+    fill_test_frame(yuv, f, 2);
+    EncodedFrame ef;
+    if (!encode_and_match(encoder, decoder, yuv, f, &ef)) {
+      std::cerr << "Frame " << f << " does not decode to the encoder reconstruction\n";
+      return false;
+    }
+    const bool small = (ef.flags & kFrameFlagResolution) != 0;
+    if (small && (ef.width != cfg.width / 2 || ef.height != cfg.height / 2)) {
+      std::cerr << "Frame " << f << " coded at " << ef.width << "x" << ef.height << "\n";
+      return false;
+    }
+    if ((small && down < 0) || (!small && down >= 0)) {
+      if (ef.type != FrameType::I) {
+        std::cerr << "Resolution changed on a P-frame (" << f << ")\n";
+        return false;
+      }
+      (small ? down : up) = f;
+      if (small) encoder.set_target_bitrate_kbps(1000);  // bandwidth is back
+    }
+  }
+  if (down < 0 || up < 0) {
+    std::cerr << "Resolution did not switch down and back up (" << down << ", " << up << ")\n";
+    return false;
+  }
+  return true;
+}
+
+// Every speed preset decodes to the encoder's reconstruction, and the deadline controller
+// (fed simulated per-preset encode times) steps down to a preset inside the budget and stays
+// there, and steps up from an idle preset while there is headroom.
+static bool check_speed_presets() {
+  using namespace telehealth::codec;
+  for (int p = 0; p < kSpeedPresets; ++p) {
+    EncoderConfig cfg;
+    cfg.width = 96;
+    cfg.height = 64;
+    cfg.gop_size = 0;
+    apply_speed_preset(static_cast<SpeedPreset>(p), &cfg);
+    Encoder encoder(cfg);
+    Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+    FrameYUV yuv(cfg.width, cfg.height);
+    for (int f = 0; f < 6; ++f) {
+      fill_test_frame(yuv, f, 3);
+      if (!encode_and_match(encoder, decoder, yuv, f) ||
+          encoder.last_frame_stats().preset != static_cast<SpeedPreset>(p)) {
+        std::cerr << "Frame " << f << " does not decode with preset " << speed_preset_name(cfg.speed_preset) << "\n";
+        return false;
+      }
+    }
+  }
+
+  const double times_ms[kSpeedPresets] = {2, 4, 6, 8, 20};
+  DeadlineController slow_start(10, SpeedPreset::Slow);
+  SpeedPreset preset = SpeedPreset::Slow;
+  for (int f = 0; f < 300; ++f) {
+    preset = slow_start.update(times_ms[static_cast<int>(preset)]);
+    if (f >= 10 && preset != SpeedPreset::Medium) {
+      std::cerr << "Frame " << f << " left the preset that fits the budget (" << speed_preset_name(preset) << ")\n";
+      return false;
+    }
+  }
+  const double light_ms[kSpeedPresets] = {1, 2, 3, 4, 20};
+  DeadlineController idle(10, SpeedPreset::Ultrafast);
+  for (int f = 0; f < 200 && idle.preset() != SpeedPreset::Medium; ++f)
+    idle.update(light_ms[static_cast<int>(idle.preset())]);
+  if (idle.preset() != SpeedPreset::Medium) {
+    std::cerr << "Controller did not step up to the budget (" << speed_preset_name(idle.preset()) << ")\n";
+    return false;
+  }
+  return true;
+}
+
+// A camera switch mid-sequence is coded as an I-frame (with gop_size 0, the only one after
+// frame 0), while panning content stays P-frames with motion cost reported in sad_sum.
+// Frame f of a moving checker that cuts to diagonal stripes at frame cut.
+static void fill_scene_cut_frame(int f, int cut, telehealth::codec::FrameYUV* yuv) {
+  for (int y = 0; y < yuv->height; ++y)
+    for (int x = 0; x < yuv->width; ++x)
+      yuv->y_row(y)[x] = f < cut ? static_cast<uint8_t>((((x + 2 * f) / 8 + y / 8) & 1) * 80 + (x + 2 * f) / 2 + y)
+                                 : static_cast<uint8_t>((((x * 3 + y * 5 + f) / 24) & 1) * 120 + 60 + y / 2);
+  for (int y = 0; y < yuv->height / 2; ++y)
+    for (int x = 0; x < yuv->width / 2; ++x) {
+      yuv->u_row(y)[x] = static_cast<uint8_t>(f < cut ? 128 + x - y : 90 + y);
+      yuv->v_row(y)[x] = static_cast<uint8_t>(f < cut ? 100 + 2 * y : 160 - x);
+    }
+}
+
+static bool check_scene_change() {
+  using namespace telehealth::codec;
+  EncoderConfig cfg;
+  cfg.width = 128;
+  cfg.height = 96;
+  cfg.gop_size = 0;
+  Encoder encoder(cfg);
+  Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+  FrameYUV yuv(cfg.width, cfg.height);
+  const int cut = 12;
+  for (int f = 0; f < 2 * cut; ++f) {
+    fill_scene_cut_frame(f, cut, &yuv);
+    EncodedFrame ef;
+    if (!encode_and_match(encoder, decoder, yuv, f, &ef)) {
+      std::cerr << "Scene change frame " << f << " does not decode\n";
+      return false;
+    }
+    const FrameStats& stats = encoder.last_frame_stats();
+    if ((ef.type == FrameType::I) != (f == 0 || f == cut) || stats.scene_change != (f == cut)) {
+      std::cerr << "Scene change frame " << f << " coded as " << (ef.type == FrameType::I ? "I" : "P") << "\n";
+      return false;
+    }
+    if (ef.type == FrameType::P && stats.sad_sum <= 0) {
+      std::cerr << "P-frame " << f << " reports no motion cost\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Rate control steers QP before coding: the header carries the QP the frame was coded with,
+// a lower target means a higher QP, the buffer never overflows once the model has seen a
+// frame, and after the first second the bitrate tracks the target.
+static bool check_rate_control() {
+  using namespace telehealth::codec;
+  const int fps = 15, frames = 45;
+  double mean_qp[2] = {};
+  for (int run = 0; run < 2; ++run) {
+    EncoderConfig cfg;
+    cfg.width = 128;
+    cfg.height = 96;
+    cfg.fps = fps;
+    cfg.gop_size = 15;
+    cfg.target_bitrate_kbps = run == 0 ? 120 : 200;
+    Encoder encoder(cfg);
+    Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+    FrameYUV yuv(cfg.width, cfg.height);
+    size_t bytes = 0;
+    for (int f = 0; f < frames; ++f) {
+      fill_test_frame(yuv, f, 3);
+      EncodedFrame ef;
+      const bool decoded = encode_and_match(encoder, decoder, yuv, f, &ef);
+      const FrameStats& stats = encoder.last_frame_stats();
+      if (!decoded || ef.qp != stats.qp || (f > 0 && stats.vbv_fullness >= 1.0)) {
+        std::cerr << "Rate-controlled frame " << f << " (QP " << int(ef.qp) << ", buffer " << stats.vbv_fullness
+                  << ") is inconsistent\n";
+        return false;
+      }
+      if (f >= fps) {
+        bytes += ef.total_bytes();
+        mean_qp[run] += ef.qp / double(frames - fps);
+      }
+    }
+    const double kbps = bytes * 8.0 * fps / (frames - fps) / 1000.0;
+    if (kbps < cfg.target_bitrate_kbps * 0.7 || kbps > cfg.target_bitrate_kbps * 1.3) {
+      std::cerr << "Rate control missed " << cfg.target_bitrate_kbps << " kbps: " << kbps << "\n";
+      return false;
+    }
+  }
+  if (mean_qp[0] <= mean_qp[1]) {
+    std::cerr << "Lower target did not raise QP (" << mean_qp[0] << " vs " << mean_qp[1] << ")\n";
+    return false;
+  }
+  return true;
+}
+
+// Lookahead: with the analyses of the frames behind it, the encoder still codes the cut as an
+// I-frame, and rate control, seeing it coming, meets it with an emptier buffer than without
+// (and so can afford a lower QP for it).
+static bool check_lookahead() {
+  using namespace telehealth::codec;
+  const int cut = 18, lookahead = 2;
+  double fullness_before_cut[2] = {};
+  int cut_qp[2] = {};
+  for (int run = 0; run < 2; ++run) {
+    EncoderConfig cfg;
+    cfg.width = 128;
+    cfg.height = 96;
+    cfg.fps = 15;
+    cfg.gop_size = 0;
+    cfg.target_bitrate_kbps = 30;
+    cfg.lookahead_frames = run == 0 ? 0 : lookahead;
+    Encoder encoder(cfg);
+    Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+    SceneChangeDetector analyzer(cfg.scene_change_threshold);
+    std::vector<FrameYUV> frames(2 * cut, FrameYUV(cfg.width, cfg.height));
+    std::vector<FrameComplexity> analyses;
+    for (int f = 0; f < 2 * cut; ++f) {
+      fill_scene_cut_frame(f, cut, &frames[f]);
+      analyzer.analyze(frames[f].y_plane.data(), frames[f].stride_y, cfg.width, cfg.height);
+      analyses.push_back(analyzer.complexity());
+    }
+    for (int f = 0; f < 2 * cut; ++f) {
+      const int count = cfg.lookahead_frames > 0 ? std::min(cfg.lookahead_frames + 1, 2 * cut - f) : 0;
+      EncodedFrame ef;
+      if (!encode_and_match(encoder, decoder, frames[f], f, &ef, count > 0 ? &analyses[f] : nullptr, count) ||
+          (ef.type == FrameType::I) != (f == 0 || f == cut)) {
+        std::cerr << "Lookahead frame " << f << " wrong (" << (ef.type == FrameType::I ? "I" : "P") << ")\n";
+        return false;
+      }
+      if (f == cut - 1) fullness_before_cut[run] = encoder.last_frame_stats().vbv_fullness;
+      if (f == cut) cut_qp[run] = encoder.last_frame_stats().qp;
+    }
+  }
+  if (fullness_before_cut[1] >= fullness_before_cut[0] || cut_qp[1] > cut_qp[0]) {
+    std::cerr << "Lookahead did not make room for the cut (buffer " << fullness_before_cut[1] << " vs "
+              << fullness_before_cut[0] << ", QP " << cut_qp[1] << " vs " << cut_qp[0] << ")\n";
+    return false;
+  }
+  return true;
+}
+
+// Byte cap: a guaranteed cap well under the frames' natural size holds for every serialized
+// frame, in every entropy mode and across slices, by raising MB rows above the frame QP
+// (sent as row deltas the decoder follows) and dropping residual an MB cannot afford.
+// Asking for wavefront as well codes whole slices, which have rows to raise. The normal
+// cap raises rows too, but leaves wavefront rows, substreams of their own, at the frame QP.
+static bool check_byte_cap() {
+  using namespace telehealth::codec;
+  const EntropyMode modes[] = {EntropyMode::Fixed, EntropyMode::ExpGolomb, EntropyMode::Arithmetic,
+                               EntropyMode::Huffman, EntropyMode::Rans};
+  // One slice, then larger frames in four slices, where each slice's share of the cap is small.
+  // Fixed mode's MVs alone take about 40 bits an MB, more than the larger frames' caps leave.
+  struct CapCase {
+    int width, height, slices;
+    uint32_t cap;
+    bool fixed_mode;
+  };
+  const CapCase cases[] = {{128, 96, 1, 700, true}, {176, 144, 4, 400, false}, {320, 240, 4, 600, false}};
+  for (const CapCase& c : cases)
+    for (int run = 0; run < 2 * 5 + 2; ++run) {
+      const bool wavefront = run % 2 == 1;
+      if (run < 2 && !c.fixed_mode) continue;
+      EncoderConfig cfg;
+      cfg.width = c.width;
+      cfg.height = c.height;
+      cfg.fps = 15;
+      cfg.gop_size = 4;
+      cfg.use_diamond_search = true;
+      cfg.target_bitrate_kbps = 1000;
+      cfg.entropy_mode = run < 10 ? modes[run / 2] : EntropyMode::ExpGolomb;
+      cfg.num_slices = std::max(c.slices, wavefront ? 2 : 1);
+      cfg.wavefront = wavefront;
+      cfg.slice_threads = 2;
+      cfg.frame_byte_cap = c.cap;
+      cfg.guaranteed_byte_cap = run < 10;
+      Encoder encoder(cfg);
+      // rANS mode only estimates its bits, so it keeps the normal cap.
+      const bool guaranteed = encoder.config().guaranteed_byte_cap;
+      if (guaranteed != (run < 10 && cfg.entropy_mode != EntropyMode::Rans)) {
+        std::cerr << "Guaranteed byte cap is " << (guaranteed ? "on" : "off") << " in "
+                  << entropy_mode_name(cfg.entropy_mode) << " mode\n";
+        return false;
+      }
+      Decoder decoder(encoder.file_header(), encoder.quant_matrices());
+      FrameYUV yuv(cfg.width, cfg.height);
+      int raised = 0;
+      for (int f = 0; f < 8; ++f) {
+        fill_test_frame(yuv, f, 3);
+        for (int y = cfg.height / 2; y < cfg.height; ++y)  // noisy lower half: the rows the cap squeezes
+          for (int x = 0; x < cfg.width; ++x) yuv.y_row(y)[x] += static_cast<uint8_t>((x * x * 13 + y * f * 7) % 61);
+        EncodedFrame ef;
+        if (!encode_and_match(encoder, decoder, yuv, f, &ef) || !ef.row_qp ||
+            ((ef.flags & kFrameFlagWavefront) != 0) != (wavefront && !guaranteed)) {
+          std::cerr << "Byte-capped frame " << f << " (run " << run << ") does not decode to the reconstruction\n";
+          return false;
+        }
+        if (guaranteed && ef.raw_bytes.size() > c.cap) {
+          std::cerr << "Frame " << f << " (" << cfg.width << "x" << cfg.height << ", "
+                    << entropy_mode_name(cfg.entropy_mode) << ", wavefront " << wavefront << ") is "
+                    << ef.raw_bytes.size() << " bytes, over the " << c.cap << " byte cap\n";
+          return false;
+        }
+        const FrameStats& stats = encoder.last_frame_stats();
+        raised += stats.max_row_qp > stats.qp;
+      }
+      if ((raised > 0) == (wavefront && !guaranteed)) {
+        std::cerr << "Byte cap raised " << raised << " frames' rows (run " << run << ")\n";
+        return false;
+      }
+    }
+  return true;
+}
 
 int main() {
+  if (!check_bit_packing()) return 1;
+  if (!check_slices()) {
+    std::cerr << "Slice check failed\n";
+    return 1;
+  }
+  if (!check_reconstruction()) return 1;
+  if (!check_zero_block_skip()) return 1;
+  if (!check_quant_matrices()) return 1;
+  if (!check_wavefront_determinism()) {
+    std::cerr << "Wavefront check failed\n";
+    return 1;
+  }
+  if (!check_intra_refresh()) return 1;
+  if (!check_long_term_recovery()) return 1;
+  if (!check_temporal_layers()) return 1;
+  if (!check_dynamic_resolution()) return 1;
+  if (!check_speed_presets()) return 1;
+  if (!check_scene_change()) return 1;
+  if (!check_rate_control()) return 1;
+  if (!check_lookahead()) return 1;
+  if (!check_byte_cap()) return 1;
+
   telehealth::io::VideoSourceConfig src_cfg;
   src_cfg.path = "synthetic";
   src_cfg.width = 64;
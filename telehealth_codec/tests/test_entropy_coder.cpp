@@ -0,0 +1,227 @@
+#include <codec/EntropyCoder.h>
+#include <codec/Bitstream.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+using telehealth::codec::BitstreamReader;
+using telehealth::codec::BitstreamWriter;
+using telehealth::codec::EntropyCoder;
+using telehealth::codec::EntropyMode;
+using telehealth::codec::HuffmanTables;
+using telehealth::codec::IntraMbModes;
+using telehealth::codec::IntraMode;
+using telehealth::codec::MotionVector;
+
+// P-frame MBs (CBP with the intra flag, then the MV or the intra modes, then the coded
+// blocks) must decode back exactly in every entropy mode, and the cost API must match the
+// bits written (exactly for VLC modes, closely for arithmetic). Huffman mode trains its
+// tables on a first pass over the same MBs and sends them up front.
+static bool roundtrip(EntropyMode mode, size_t* bytes_out) {
+  using telehealth::codec::kCbpBlocks;
+  using telehealth::codec::kCbpIntraMb;
+  const int mbs = 40;
+  static int32_t coeff[mbs][kCbpBlocks][64];
+  static uint32_t cbps[mbs];
+  MotionVector mvs[mbs];
+  IntraMbModes modes[mbs];
+  auto is_intra = [](int m) { return m % 6 == 5; };
+  srand(7);
+  for (int m = 0; m < mbs; ++m) {
+    uint32_t cbp = 0;
+    for (int b = 0; b < kCbpBlocks; ++b) {
+      std::memset(coeff[m][b], 0, sizeof(coeff[m][b]));
+      int nonzero = (m * kCbpBlocks + b) % 5 == 0 || m % 7 == 3 ? 0 : 1 + rand() % 12;
+      for (int n = 0; n < nonzero; ++n) {
+        int level = rand() % 4 == 0 ? (rand() % 300) - 150 : (rand() % 2 ? 1 : -1);
+        coeff[m][b][rand() % 64] = level;
+      }
+      if (m == 1 && b == 1) coeff[m][b][63] = 2047;  // longest run, largest fixed-mode level
+      if (EntropyCoder::is_coded(coeff[m][b])) cbp |= 1u << b;
+    }
+    cbps[m] = cbp;
+    if (is_intra(m)) {  // intra MBs send modes instead of an MV (which predicts as zero)
+      modes[m].split = m % 4 == 1;
+      for (int b = 0; b < 4; ++b) modes[m].luma[b] = static_cast<IntraMode>((m + b) % 4);
+      modes[m].chroma = static_cast<IntraMode>(m % 3);
+      continue;
+    }
+    mvs[m].dx = static_cast<int16_t>((rand() % 65) - 32);
+    mvs[m].dy = static_cast<int16_t>((rand() % 65) - 32);
+  }
+  auto flagged = [&](int m) { return cbps[m] | (is_intra(m) ? kCbpIntraMb : 0u); };
+
+  EntropyCoder coder(mode);
+  BitstreamWriter w;
+  HuffmanTables tables;
+  if (mode == EntropyMode::Huffman) {
+    BitstreamWriter training;
+    for (int m = 0; m < mbs; ++m) {
+      coder.encode_cbp(flagged(m), training, true);
+      if (is_intra(m))
+        coder.encode_intra_modes(modes[m], training);
+      else
+        coder.encode_mv(mvs[m], m > 0 ? mvs[m - 1] : MotionVector(), training);
+      for (int b = 0; b < kCbpBlocks; ++b)
+        if (cbps[m] & (1u << b)) coder.encode_block_8x8(coeff[m][b], 28, training);
+    }
+    coder.huffman_stats().build(&tables);
+    tables.write(w);
+    coder.set_huffman_tables(&tables);
+  }
+  const size_t table_bits = w.bit_position();
+  uint64_t estimated = 0;  // 1/16 bit
+  coder.begin_slice(w);
+  for (int m = 0; m < mbs; ++m) {
+    uint32_t cbp = cbps[m];
+    MotionVector pred = m > 0 ? mvs[m - 1] : MotionVector();
+    coder.refresh_costs();
+    estimated += coder.cbp_cost(flagged(m), true);
+    coder.encode_cbp(flagged(m), w, true);
+    if (is_intra(m)) {
+      estimated += coder.intra_modes_cost(modes[m]);
+      coder.encode_intra_modes(modes[m], w);
+    } else {
+      if (mode != EntropyMode::Huffman)  // Huffman mode prices MVDs as Exp-Golomb
+        estimated += coder.mvd_cost(mvs[m].dx - pred.dx, mvs[m].dy - pred.dy);
+      size_t mv_start = w.bit_position();
+      coder.encode_mv(mvs[m], pred, w);
+      const size_t mv_bits = w.bit_position() - mv_start;
+      if (mode == EntropyMode::Huffman) estimated += mv_bits << telehealth::codec::kBitCostShift;
+      // MVDs here are within +-64; the bound prices what is written, Huffman tables included.
+      if (mode != EntropyMode::Arithmetic && mode != EntropyMode::Rans &&
+          (mv_bits << telehealth::codec::kBitCostShift) > coder.mvd_cost_bound(64)) {
+        std::cerr << entropy_mode_name(mode) << " MVD of " << mv_bits << " bits exceeds mvd_cost_bound\n";
+        return false;
+      }
+    }
+    for (int b = 0; b < kCbpBlocks; ++b) {
+      if (!(cbp & (1u << b))) continue;
+      estimated += coder.block_cost(coeff[m][b]);
+      coder.encode_block_8x8(coeff[m][b], 28, w);
+    }
+  }
+  size_t written_bits = w.bit_position() - table_bits;
+  coder.end_slice(w);
+  w.flush_byte_align();
+  *bytes_out = w.buffer().size();
+
+  double estimated_bits = static_cast<double>(estimated) / (1 << telehealth::codec::kBitCostShift);
+  if (mode == EntropyMode::Arithmetic || mode == EntropyMode::Rans) {
+    // rANS prices as Exp-Golomb, so it only has to be in the right range.
+    double tolerance = mode == EntropyMode::Rans ? 0.3 : 0.1;
+    double actual = static_cast<double>(w.buffer().size()) * 8;
+    if (estimated_bits < actual * (1 - tolerance) || estimated_bits > actual * (1 + tolerance)) {
+      std::cerr << entropy_mode_name(mode) << " cost estimate " << estimated_bits << " bits vs " << actual
+                << " written\n";
+      return false;
+    }
+  } else if (estimated_bits != static_cast<double>(written_bits)) {
+    std::cerr << "VLC cost estimate " << estimated_bits << " bits vs " << written_bits << " written\n";
+    return false;
+  }
+
+  EntropyCoder decoder(mode);
+  BitstreamReader r;
+  r.set_data(w.buffer());
+  HuffmanTables decoded_tables;
+  if (mode == EntropyMode::Huffman) {
+    if (!decoded_tables.read(r)) {
+      std::cerr << "Huffman tables did not parse\n";
+      return false;
+    }
+    decoder.set_huffman_tables(&decoded_tables);
+  }
+  decoder.begin_slice(r);
+  for (int m = 0; m < mbs; ++m) {
+    uint32_t cbp = decoder.decode_cbp(r, true);
+    if (cbp != flagged(m)) {
+      std::cerr << "CBP mismatch at MB " << m << "\n";
+      return false;
+    }
+    if (is_intra(m)) {
+      IntraMbModes got = decoder.decode_intra_modes(r);
+      bool same = got.split == modes[m].split && got.chroma == modes[m].chroma;
+      for (int b = 0; b < (got.split ? 4 : 1); ++b) same = same && got.luma[b] == modes[m].luma[b];
+      if (!same) {
+        std::cerr << "Intra modes mismatch at MB " << m << "\n";
+        return false;
+      }
+    } else {
+      MotionVector mv = decoder.decode_mv(r, m > 0 ? mvs[m - 1] : MotionVector());
+      if (mv.dx != mvs[m].dx || mv.dy != mvs[m].dy) {
+        std::cerr << "MV mismatch at MB " << m << "\n";
+        return false;
+      }
+    }
+    for (int b = 0; b < kCbpBlocks; ++b) {
+      int32_t decoded[64] = {};
+      if (cbp & (1u << b)) decoder.decode_block_8x8(r, 28, decoded);
+      if (std::memcmp(decoded, coeff[m][b], sizeof(decoded)) != 0) {
+        std::cerr << "Coefficient mismatch at MB " << m << " block " << b << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool check_exp_golomb_codes() {
+  BitstreamWriter w;
+  for (uint32_t v = 0; v < 70000; v += 7) w.write_ue(v);
+  w.write_ue(0xFFFFFFFEu);
+  for (int32_t v = -3000; v <= 3000; ++v) w.write_se(v);
+  w.flush_byte_align();
+  BitstreamReader r;
+  r.set_data(w.buffer());
+  for (uint32_t v = 0; v < 70000; v += 7)
+    if (r.read_ue() != v) return false;
+  if (r.read_ue() != 0xFFFFFFFEu) return false;
+  for (int32_t v = -3000; v <= 3000; ++v)
+    if (r.read_se() != v) return false;
+  return true;
+}
+
+// Lengths from the stream must form a complete prefix code, or the lookup table has holes.
+static bool check_huffman_lengths() {
+  telehealth::codec::HuffmanCode code;
+  const uint8_t complete[4] = {1, 2, 3, 3};
+  const uint8_t incomplete[4] = {2, 2, 3, 3};
+  const uint8_t too_long[2] = {1, 13};
+  if (!code.set_lengths(complete, 4) || code.set_lengths(incomplete, 4) || code.set_lengths(too_long, 2))
+    return false;
+  BitstreamWriter w;
+  for (int s : {3, 0, 2, 1, 0}) code.write(w, s);
+  w.flush_byte_align();
+  BitstreamReader r;
+  r.set_data(w.buffer());
+  for (int s : {3, 0, 2, 1, 0})
+    if (code.read(r) != s) return false;
+  return true;
+}
+
+int main() {
+  if (!check_exp_golomb_codes()) {
+    std::cerr << "Exp-Golomb code roundtrip failed\n";
+    return 1;
+  }
+  if (!check_huffman_lengths()) {
+    std::cerr << "Huffman code construction failed\n";
+    return 1;
+  }
+  size_t fixed_bytes = 0, eg_bytes = 0, arith_bytes = 0, huffman_bytes = 0, rans_bytes = 0;
+  if (!roundtrip(EntropyMode::Fixed, &fixed_bytes)) return 1;
+  if (!roundtrip(EntropyMode::ExpGolomb, &eg_bytes)) return 1;
+  if (!roundtrip(EntropyMode::Arithmetic, &arith_bytes)) return 1;
+  if (!roundtrip(EntropyMode::Huffman, &huffman_bytes)) return 1;
+  if (!roundtrip(EntropyMode::Rans, &rans_bytes)) return 1;
+  if (eg_bytes >= fixed_bytes || arith_bytes >= eg_bytes) {
+    std::cerr << "Entropy modes not ordered by size: " << fixed_bytes << " / " << eg_bytes << " / "
+              << arith_bytes << "\n";
+    return 1;
+  }
+  std::cout << "Entropy coder OK (fixed " << fixed_bytes << " bytes, exp-golomb " << eg_bytes
+            << " bytes, arithmetic " << arith_bytes << " bytes, huffman " << huffman_bytes
+            << " bytes, rans " << rans_bytes << " bytes)\n";
+  return 0;
+}
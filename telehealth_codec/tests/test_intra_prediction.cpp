@@ -0,0 +1,138 @@
+#include <codec/IntraPrediction.h>
+#include <codec/Encoder.h>
+#include <codec/Frame.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace telehealth::codec;
+
+static void random_neighbors(IntraNeighbors& nb) {
+  for (int i = 0; i < 16; ++i) {
+    nb.top[i] = static_cast<uint8_t>(rand() % 256);
+    nb.left[i] = static_cast<uint8_t>(rand() % 256);
+  }
+  nb.top_left = static_cast<uint8_t>(rand() % 256);
+  nb.has_top = rand() % 4 != 0;
+  nb.has_left = rand() % 4 != 0;
+}
+
+// Simple patterns each mode must reproduce exactly.
+static bool check_modes() {
+  IntraPredictor predictor(SimdLevel::Scalar);
+  IntraNeighbors nb;
+  for (int i = 0; i < 16; ++i) {
+    nb.top[i] = static_cast<uint8_t>(10 * i);
+    nb.left[i] = static_cast<uint8_t>(200 - 5 * i);
+  }
+  nb.top_left = 100;
+  nb.has_top = nb.has_left = true;
+  uint8_t pred[256];
+  predictor.predict(IntraMode::Vertical, nb, 16, pred, 16);
+  for (int y = 0; y < 16; ++y)
+    if (std::memcmp(pred + y * 16, nb.top, 16) != 0) return false;
+  predictor.predict(IntraMode::Horizontal, nb, 16, pred, 16);
+  for (int y = 0; y < 16; ++y)
+    for (int x = 0; x < 16; ++x)
+      if (pred[y * 16 + x] != nb.left[y]) return false;
+  nb.has_left = false;  // DC of the top row alone: mean of 0..150 step 10 = 75
+  predictor.predict(IntraMode::DC, nb, 16, pred, 16);
+  for (int i = 0; i < 256; ++i)
+    if (pred[i] != 75) return false;
+  nb.has_top = false;
+  predictor.predict(IntraMode::DC, nb, 8, pred, 8);
+  for (int i = 0; i < 64; ++i)
+    if (pred[i] != 128) return false;
+
+  // A linear ramp continues into the block under plane prediction.
+  for (int i = 0; i < 16; ++i) {
+    nb.top[i] = static_cast<uint8_t>(20 + 3 * i + 3);
+    nb.left[i] = static_cast<uint8_t>(20 + 2 * i + 2);
+  }
+  nb.top_left = 20;
+  nb.has_top = nb.has_left = true;
+  predictor.predict(IntraMode::Plane, nb, 16, pred, 16);
+  for (int y = 0; y < 16; ++y)
+    for (int x = 0; x < 16; ++x)
+      if (std::abs(pred[y * 16 + x] - (20 + 3 * (x + 1) + 2 * (y + 1))) > 1) return false;
+  return true;
+}
+
+// SIMD predictors and SATD must match scalar bit for bit.
+static bool check_simd(int* compared) {
+  if (!simd_level_available(SimdLevel::Sse2)) return true;
+  IntraPredictor scalar(SimdLevel::Scalar), simd(SimdLevel::Sse2);
+  srand(11);
+  for (int trial = 0; trial < 500; ++trial) {
+    IntraNeighbors nb;
+    random_neighbors(nb);
+    for (int size : {8, 16}) {
+      for (int m = 0; m < kIntraModes; ++m) {
+        uint8_t a[256], b[256];
+        scalar.predict(static_cast<IntraMode>(m), nb, size, a, size);
+        simd.predict(static_cast<IntraMode>(m), nb, size, b, size);
+        if (std::memcmp(a, b, static_cast<size_t>(size * size)) != 0) {
+          std::cerr << "SSE2 prediction differs: mode " << m << " size " << size << "\n";
+          return false;
+        }
+        (*compared)++;
+      }
+    }
+    uint8_t src[8 * 24], pred[8 * 12];
+    const int level = rand() % 3;  // random, extreme and flat differences
+    for (int i = 0; i < 8 * 24; ++i) src[i] = static_cast<uint8_t>(level == 1 ? (i % 2) * 255 : rand() % 256);
+    for (int i = 0; i < 8 * 12; ++i) pred[i] = static_cast<uint8_t>(level == 1 ? (i % 3 == 0) * 255 : rand() % 256);
+    if (level == 2) std::memset(pred, 7, sizeof(pred));
+    if (scalar.satd_8x8(src, 24, pred, 12) != simd.satd_8x8(src, 24, pred, 12)) {
+      std::cerr << "SSE2 SATD differs in trial " << trial << "\n";
+      return false;
+    }
+    (*compared)++;
+  }
+  uint8_t flat_src[64], flat_pred[64];
+  std::memset(flat_src, 90, 64);
+  std::memset(flat_pred, 80, 64);
+  return scalar.satd_8x8(flat_src, 8, flat_pred, 8) == 640;
+}
+
+// Smooth content codes far smaller as intra-predicted I-frames than as plain DCT blocks, and
+// the decoder-side reconstruction stays close to the source.
+static bool check_i_frame() {
+  EncoderConfig cfg;
+  cfg.width = 64;
+  cfg.height = 48;
+  cfg.gop_size = 1;
+  Encoder encoder(cfg);
+  FrameYUV yuv(cfg.width, cfg.height);
+  for (int y = 0; y < cfg.height; ++y)
+    for (int x = 0; x < cfg.width; ++x) yuv.y_row(y)[x] = static_cast<uint8_t>(30 + 2 * x + y);
+  std::memset(yuv.u_plane.data(), 100, yuv.u_plane.size());
+  std::memset(yuv.v_plane.data(), 150, yuv.v_plane.size());
+  EncodedFrame ef = encoder.encode(yuv, FrameMeta());
+  const FrameYUV* rec = encoder.reconstructed_frame();
+  long err = 0;
+  for (int y = 0; y < cfg.height; ++y)
+    for (int x = 0; x < cfg.width; ++x) err += std::abs(rec->y_row(y)[x] - yuv.y_row(y)[x]);
+  if (err > cfg.width * cfg.height * 2) {
+    std::cerr << "I-frame reconstruction error too large (" << err << ")\n";
+    return false;
+  }
+  // 12 MBs of a ramp: a handful of bytes each once plane prediction removes the gradient.
+  if (ef.coeff_bytes.size() > 12 * 8) {
+    std::cerr << "Ramp I-frame took " << ef.coeff_bytes.size() << " bytes\n";
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  if (!check_modes()) {
+    std::cerr << "Intra mode predictions wrong\n";
+    return 1;
+  }
+  int compared = 0;
+  if (!check_simd(&compared)) return 1;
+  if (!check_i_frame()) return 1;
+  std::cout << "Intra prediction test OK (" << compared << " SIMD comparisons)\n";
+  return 0;
+}
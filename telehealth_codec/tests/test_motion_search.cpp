@@ -3,6 +3,7 @@
 #include <codec/MotionEstimation.h>
 #include <codec/EncoderConfig.h>
 #include <iostream>
+#include <algorithm>
 #include <cstring>
 
 int main() {
@@ -26,6 +27,57 @@ int main() {
     std::cerr << "Motion search returned invalid cost\n";
     return 1;
   }
+
+  // Median prediction: left (2,0), top (4,-2), top-right (3,6) -> (3,0); top-left stands in
+  // for top-right at the right edge; the first row uses the left neighbour only.
+  using telehealth::codec::MotionVector;
+  MotionVector field[2 * 3];
+  field[0] = MotionVector(9, 9);
+  field[1] = MotionVector(4, -2);
+  field[2] = MotionVector(3, 6);
+  field[3] = MotionVector(2, 0);
+  field[4] = MotionVector(5, 1);
+  MotionVector p = telehealth::codec::predict_mv(field, 3, 1, 1);
+  MotionVector edge = telehealth::codec::predict_mv(field, 3, 2, 1);
+  MotionVector first_row = telehealth::codec::predict_mv(field, 3, 2, 0);
+  if (p.dx != 3 || p.dy != 0 || edge.dx != 4 || edge.dy != 1 || first_row.dx != 4 || first_row.dy != -2) {
+    std::cerr << "MV predictor mismatch\n";
+    return 1;
+  }
+
+  // On a flat block every MV has the same SAD, so the rate term must pick the predictor.
+  telehealth::codec::FrameYUV flat(64, 64);
+  for (auto& px : flat.y_plane) px = 128;
+  telehealth::codec::BlockViewConst bflat(flat.y_plane.data() + 16 * flat.stride_y + 16, flat.stride_y, 16, 16);
+  MotionVector pred(3, -2);
+  int lambda = telehealth::codec::MotionEstimation::lambda_for_qp(28);
+  auto full = me.estimate(bflat, flat, pos, pred, lambda);
+  auto diamond = me.estimate_diamond(bflat, flat, pos, pred, lambda);
+  if (full.mv.dx != pred.dx || full.mv.dy != pred.dy || diamond.mv.dx != pred.dx || diamond.mv.dy != pred.dy) {
+    std::cerr << "Rate-constrained search did not choose the predictor\n";
+    return 1;
+  }
+
+  // Early termination: a zero MV costing at most the threshold ends the search even though
+  // a shifted match is exact; without a threshold the exact match wins.
+  telehealth::codec::FrameYUV ramp(64, 64), shifted(64, 64);
+  for (int y = 0; y < 64; ++y)
+    for (int x = 0; x < 64; ++x) {
+      ramp.y_row(y)[x] = static_cast<uint8_t>(2 * x + y);
+      shifted.y_row(y)[x] = static_cast<uint8_t>(std::max(2 * (x - 5), 0) + y);
+    }
+  telehealth::codec::BlockViewConst bramp(ramp.y_plane.data() + 16 * ramp.stride_y + 16, ramp.stride_y, 16, 16);
+  auto exact = me.estimate(bramp, shifted, pos);
+  config.early_termination_threshold = 16 * 16 * 10;  // zero-MV SAD
+  telehealth::codec::MotionEstimation early(config);
+  auto early_full = early.estimate(bramp, shifted, pos);
+  auto early_diamond = early.estimate_diamond(bramp, shifted, pos);
+  if (exact.cost != 0 || (exact.mv.dx == 0 && exact.mv.dy == 0) || early_full.mv.dx != 0 || early_full.mv.dy != 0 ||
+      early_full.cost != 2560 || early_diamond.mv.dx != 0 || early_diamond.mv.dy != 0) {
+    std::cerr << "Early termination mismatch\n";
+    return 1;
+  }
+
   std::cout << "Motion search test OK (mv=(" << result.mv.dx << "," << result.mv.dy << ") cost=" << result.cost << ")\n";
   return 0;
 }
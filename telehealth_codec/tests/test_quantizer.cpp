@@ -0,0 +1,72 @@
+#include <codec/Quantizer.h>
+#include <codec/Transform.h>
+#include <codec/Residual.h>
+#include <codec/EntropyCoder.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using namespace telehealth::codec;
+
+// True when the residual survives the transform and quantization with a nonzero level.
+static bool codes_block(Quantizer& quantizer, int qp, QuantMatrixKind kind, const int16_t* residual) {
+  Transform transform;
+  int32_t coeff[64];
+  transform.forward_8x8(residual, 8, coeff);
+  quantizer.quantize_8x8(coeff, qp, kind);
+  return EntropyCoder::is_coded(coeff);
+}
+
+// Spread sad over the block with one sign, which puts all of it into the DC coefficient.
+static void fill_flat(int16_t* residual, uint32_t sad) {
+  for (int i = 0; i < 64; ++i) residual[i] = static_cast<int16_t>(sad / 64 + (static_cast<uint32_t>(i) < sad % 64));
+}
+
+// zero_block_sad_threshold is a bound the encoder may skip on: every residual whose SAD is
+// at or under it quantizes to an all-zero block, however the SAD is laid out. It is also
+// tight enough to matter: one coefficient step of DC above it codes a block.
+static bool check_zero_block_threshold(int* checked) {
+  srand(11);
+  for (QuantMatrixPreset preset : {QuantMatrixPreset::Flat, QuantMatrixPreset::Perceptual}) {
+    Quantizer quantizer(QuantMatrices::from_preset(preset));
+    for (QuantMatrixKind kind : {QuantMatrixKind::InterLuma, QuantMatrixKind::InterChroma})
+      for (int qp = 0; qp <= Quantizer::kMaxQp; ++qp) {
+        const uint32_t threshold = quantizer.zero_block_sad_threshold(qp, kind);
+        int16_t residual[64];
+        fill_flat(residual, threshold);
+        bool coded = codes_block(quantizer, qp, kind, residual);
+        for (int i = 0; i < 64; ++i) residual[i] = 0;
+        residual[27] = static_cast<int16_t>(-static_cast<int32_t>(threshold));
+        coded = coded || codes_block(quantizer, qp, kind, residual);
+        for (int it = 0; it < 20 && !coded; ++it) {
+          for (int i = 0; i < 64; ++i) residual[i] = 0;
+          for (uint32_t left = threshold; left > 0;) {
+            const uint32_t v = std::min<uint32_t>(left, 1 + rand() % 16);
+            residual[rand() % 64] += static_cast<int16_t>(rand() % 2 ? v : -static_cast<int32_t>(v));
+            left -= v;
+          }
+          coded = residual_sad_8x8(residual, 8) <= threshold && codes_block(quantizer, qp, kind, residual);
+        }
+        if (coded) {
+          std::cerr << "Residual with SAD <= " << threshold << " coded a block (preset " << static_cast<int>(preset)
+                    << ", QP " << qp << ")\n";
+          return false;
+        }
+        fill_flat(residual, threshold + 8);
+        if (residual_sad_8x8(residual, 8) <= threshold || !codes_block(quantizer, qp, kind, residual)) {
+          std::cerr << "Residual with SAD " << threshold + 8 << " coded no block (preset " << static_cast<int>(preset)
+                    << ", QP " << qp << ")\n";
+          return false;
+        }
+        (*checked)++;
+      }
+  }
+  return true;
+}
+
+int main() {
+  int checked = 0;
+  if (!check_zero_block_threshold(&checked)) return 1;
+  std::cout << "Quantizer test OK (" << checked << " thresholds)\n";
+  return 0;
+}